@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/Effects.h"
+#include "../src/PackedAudio.h"
+#include "../src/SimdKernels.h"
+#include "../src/Stats.h"
+#include "../src/WavFile.h"
+#include "../src/generator.h"
+
+using namespace std;
+using namespace effects;
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr uint32_t kSampleRate = 44100;
+
+	struct Options
+	{
+		// Longest generated signal, in seconds
+		float max_length = 3600.f;
+		// Minimal measuring time of every case, in seconds
+		double min_time = 0.5;
+		// Run only cases, whose name contains this string
+		string filter;
+		string json_path;
+		string label;
+	};
+
+	struct Result
+	{
+		string group;
+		string name;
+		size_t frames;
+		size_t channels;
+		int bit_depth;
+		size_t iterations;
+		double best_seconds;
+		size_t bytes;
+		// Heap bytes allocated by the measured part, the least of all iterations
+		size_t allocated = 0;
+
+		[[nodiscard]] double GetSamples() const
+		{
+			return static_cast<double>(frames * channels);
+		}
+
+		[[nodiscard]] double GetNsPerSample() const
+		{
+			return best_seconds * 1e9 / GetSamples();
+		}
+
+		[[nodiscard]] double GetSamplesPerSecond() const
+		{
+			return GetSamples() / best_seconds;
+		}
+
+		[[nodiscard]] double GetBytesPerSecond() const
+		{
+			return static_cast<double>(bytes) / best_seconds;
+		}
+	};
+
+	/**
+	 * \brief Generate multichannel test signal, every channel has its own frequency
+	 */
+	WavFile<float> MakeSignal(size_t channels, float length, int bit_depth)
+	{
+		WavFile<float>::AudioData samples(channels, vector<float>(static_cast<size_t>(length * kSampleRate)));
+		for (size_t channel = 0; channel < channels; channel++)
+		{
+			Oscillator(kWaveSine, 220. * static_cast<double>(channel + 1), kSampleRate).Render(samples[channel].data(), samples[channel].size());
+			for (auto& sample : samples[channel])
+				sample *= 0.5f;
+		}
+
+		return WavFile<float>(kSampleRate, bit_depth, std::move(samples));
+	}
+
+	/**
+	 * \brief Run the case at least 3 times and until min_time elapsed, keep the best time
+	 * \param prepare called before every iteration, not measured
+	 * \param run measured part
+	 */
+	Result Measure(const Options& options, Result result, const function<void()>& prepare, const function<void()>& run)
+	{
+		using clock = chrono::steady_clock;
+
+		double total = 0;
+		result.iterations = 0;
+		result.best_seconds = numeric_limits<double>::max();
+		result.allocated = numeric_limits<size_t>::max();
+
+		while (result.iterations < 3 || total < options.min_time)
+		{
+			prepare();
+
+			const size_t start_allocated = Stats::GetThreadAllocatedBytes();
+			const auto start = clock::now();
+			run();
+			const double elapsed = chrono::duration<double>(clock::now() - start).count();
+
+			result.best_seconds = std::min(result.best_seconds, elapsed);
+			result.allocated = std::min(result.allocated, Stats::GetThreadAllocatedBytes() - start_allocated);
+			total += elapsed;
+			result.iterations++;
+		}
+
+		return result;
+	}
+
+	void PrintResult(const Result& result)
+	{
+		cout << left << setw(10) << result.group << setw(40) << result.name
+			<< right << fixed << setprecision(2)
+			<< setw(10) << result.GetNsPerSample() << " ns/sample"
+			<< setw(10) << result.GetSamplesPerSecond() / 1e6 << " Msamples/s"
+			<< setw(10) << result.GetBytesPerSecond() / (1 << 20) << " MB/s"
+			<< setw(12) << result.allocated << " B alloc"
+			<< endl;
+	}
+
+	void WriteJson(const Options& options, const vector<Result>& results)
+	{
+		ofstream file(options.json_path);
+		file << "{\n  \"label\": \"" << options.label << "\",\n"
+			<< "  \"simd\": \"" << GetSimdLevelName(SimdKernels::Get().level) << "\",\n  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const auto& r = results[i];
+			file << "    {"
+				<< "\"group\": \"" << r.group << "\", "
+				<< "\"name\": \"" << r.name << "\", "
+				<< "\"frames\": " << r.frames << ", "
+				<< "\"channels\": " << r.channels << ", "
+				<< "\"bit_depth\": " << r.bit_depth << ", "
+				<< "\"iterations\": " << r.iterations << ", "
+				<< "\"best_seconds\": " << r.best_seconds << ", "
+				<< "\"ns_per_sample\": " << r.GetNsPerSample() << ", "
+				<< "\"samples_per_sec\": " << r.GetSamplesPerSecond() << ", "
+				<< "\"bytes_per_sec\": " << r.GetBytesPerSecond() << ", "
+				<< "\"allocated_bytes\": " << r.allocated
+				<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		file << "  ]\n}\n";
+	}
+
+	string FormatName(const string& prefix, size_t channels, int bit_depth, float length)
+	{
+		stringstream ss;
+		ss << prefix << "/" << channels << "ch/" << bit_depth << "bit/" << length << "s";
+		return ss.str();
+	}
+
+	/**
+	 * \brief Load and Save at every bit depth and channel layout
+	 */
+	void BenchmarkIO(const Options& options, vector<Result>& results)
+	{
+		const auto path = (fs::temp_directory_path() / "wav_effects_bench.wav").string();
+		const float lengths[] = { 1.f, 10.f, 60.f, 600.f, 3600.f };
+		static constexpr const char* kIoCases[] = { "save", "save_nodither", "save_shaped", "load", "load_packed", "save_flac", "load_flac" };
+
+		for (int bit_depth : { 8, 16, 24, 32 })
+		{
+			for (size_t channels : { 1, 2, 6 })
+			{
+				for (float length : lengths)
+				{
+					// Full length sweep only for the most common format
+					if (length > options.max_length || (length > 10.f && (bit_depth != 16 || channels != 2)))
+						continue;
+
+					const auto save_name = FormatName("save", channels, bit_depth, length);
+					const auto load_name = FormatName("load", channels, bit_depth, length);
+					const auto suffix = save_name.substr(save_name.find('/'));
+					const bool matched = std::any_of(std::begin(kIoCases), std::end(kIoCases),
+						[&](const char* name) { return (name + suffix).find(options.filter) != string::npos; });
+					if (!matched)
+						continue;
+
+					const auto wav = MakeSignal(channels, length, bit_depth);
+					const Result base{ "io", "", wav.GetNumSamplesPerChannel(), channels, bit_depth, 0, 0,
+						wav.GetNumSamplesPerChannel() * channels * (bit_depth / 8) };
+
+					auto result = base;
+					result.name = save_name;
+					if (save_name.find(options.filter) != string::npos)
+					{
+						results.push_back(Measure(options, result, [] {}, [&] { wav.Save(path); }));
+						PrintResult(results.back());
+					}
+
+					// Cost of dither and noise shaping against plain quantization
+					if (bit_depth == 16)
+					{
+						for (const auto& [name, dither] : { make_pair("save_nodither", DitherOptions{ kDitherNone }),
+							make_pair("save_shaped", DitherOptions{ kDitherTpdf, kShapingLipshitz }) })
+						{
+							result.name = FormatName(name, channels, bit_depth, length);
+							if (result.name.find(options.filter) == string::npos)
+								continue;
+
+							results.push_back(Measure(options, result, [] {}, [&] { wav.Save(path, dither); }));
+							PrintResult(results.back());
+						}
+					}
+
+					// Loads read the file saved above
+					wav.Save(path);
+
+					result.name = load_name;
+					if (load_name.find(options.filter) != string::npos)
+					{
+						WavFile<float> loaded;
+						results.push_back(Measure(options, result, [&] { loaded = WavFile<float>(); }, [&] { loaded.Load(path); }));
+						PrintResult(results.back());
+					}
+
+					// Load without conversion to floats, compact storage
+					result.name = FormatName("load_packed", channels, bit_depth, length);
+					if (result.name.find(options.filter) != string::npos)
+					{
+						PackedAudio packed;
+						results.push_back(Measure(options, result, [&] { packed = PackedAudio(); }, [&] { packed.Load(path); }));
+						PrintResult(results.back());
+					}
+
+					// Lossless compression, frames are encoded and decoded in parallel
+					if (bit_depth != 32)
+					{
+						const auto flac_path = (fs::temp_directory_path() / "wav_effects_bench.flac").string();
+						const auto packed = PackedAudio::FromWav(wav);
+
+						result.name = FormatName("save_flac", channels, bit_depth, length);
+						if (result.name.find(options.filter) != string::npos)
+						{
+							results.push_back(Measure(options, result, [] {}, [&] { packed.Save(flac_path); }));
+							PrintResult(results.back());
+						}
+
+						result.name = FormatName("load_flac", channels, bit_depth, length);
+						if (result.name.find(options.filter) != string::npos)
+						{
+							packed.Save(flac_path);
+							PackedAudio loaded_flac;
+							results.push_back(Measure(options, result, [&] { loaded_flac = PackedAudio(); }, [&] { loaded_flac.Load(flac_path); }));
+							PrintResult(results.back());
+						}
+
+						fs::remove(flac_path);
+					}
+				}
+			}
+		}
+
+		fs::remove(path);
+	}
+
+	/**
+	 * \brief Every effect on stereo signal of different lengths
+	 */
+	void BenchmarkEffects(const Options& options, vector<Result>& results)
+	{
+		typedef function<void(WavFile<float>&)> Effect;
+		const vector<pair<string, Effect>> effects_list = {
+			{ "mono_to_stereo", [](auto& wav) { MonoToStereo(wav); } },
+			{ "rotating", [](auto& wav) { ApplyRotatingStereo(wav, 2.f); } },
+			{ "volume", [](auto& wav) { ApplyVolume(wav, -3.f); } },
+			{ "reverse", [](auto& wav) { ApplyReverse(wav); } },
+			{ "delay", [](auto& wav) { ApplyDelay(wav, 100, 0.5f); } },
+			{ "reverb", [](auto& wav) { ApplyReverberation(wav); } },
+			{ "compressor", [](auto& wav) { ApplyCompressor(wav, -12.f, 4.f); } },
+			{ "distortion", [](auto& wav) { ApplyDistortion(wav, 0.5f, 0.5f); } },
+			{ "fade_in", [](auto& wav) { ApplyFadeIn(wav, 1.f, kLogarithmic); } },
+			{ "fade_out", [](auto& wav) { ApplyFadeOut(wav, 1.f, kSine); } },
+			{ "tremolo", [](auto& wav) { ApplyTremolo(wav, 5.f); } },
+			{ "chorus_3voices", [](auto& wav) { ApplyChorus(wav, 0.8f, 3.f, 3); } },
+			{ "flanger", [](auto& wav) { ApplyFlanger(wav, 0.25f, 2.f); } },
+			{ "vibrato_allpass", [](auto& wav) { ApplyVibrato(wav, 5.f, 1.f, kInterpolateAllpass); } },
+			{ "lowpass", [](auto& wav) { ApplyFilter(wav, kLowPass, 1000.f); } },
+			{ "eq_4band", [](auto& wav) { ApplyFilterBank(wav, {
+				{ kLowShelf, 100.f, 0.7f, 3.f }, { kPeak, 500.f, 1.f, -2.f },
+				{ kPeak, 3000.f, 2.f, 4.f }, { kHighShelf, 8000.f, 0.7f, -3.f } }); } },
+			{ "time_stretch", [](auto& wav) { ApplyTimeStretch(wav, 1.25f); } },
+			{ "pitch_shift", [](auto& wav) { ApplyPitchShift(wav, 3.f); } },
+		};
+
+		for (float length : { 1.f, 60.f, 600.f })
+		{
+			if (length > options.max_length)
+				continue;
+
+			const auto stereo = MakeSignal(2, length, 16);
+			const auto mono = MakeSignal(1, length, 16);
+
+			for (const auto& [name, effect] : effects_list)
+			{
+				const auto& source = name == "mono_to_stereo" ? mono : stereo;
+				const auto full_name = FormatName(name, source.GetNumChannels(), 32, length);
+				if (full_name.find(options.filter) == string::npos)
+					continue;
+
+				WavFile<float> wav;
+				const Result result{ "effect", full_name, source.GetNumSamplesPerChannel(), source.GetNumChannels(), 32, 0, 0,
+					source.GetNumSamplesPerChannel() * source.GetNumChannels() * sizeof(float) };
+
+				results.push_back(Measure(options, result, [&] { wav = source; }, [&] { effect(wav); }));
+				PrintResult(results.back());
+			}
+		}
+	}
+
+	/**
+	 * \brief Every generator into the preallocated buffer
+	 */
+	void BenchmarkGenerators(const Options& options, vector<Result>& results)
+	{
+		typedef function<void(float*, size_t)> Generator;
+		const vector<pair<string, Generator>> generators = {
+			{ "sine", [](float* out, size_t count) { Oscillator(kWaveSine, 1000., kSampleRate).Render(out, count); } },
+			{ "saw", [](float* out, size_t count) { Oscillator(kWaveSaw, 1000., kSampleRate).Render(out, count); } },
+			{ "square", [](float* out, size_t count) { Oscillator(kWaveSquare, 1000., kSampleRate).Render(out, count); } },
+			{ "triangle", [](float* out, size_t count) { Oscillator(kWaveTriangle, 1000., kSampleRate).Render(out, count); } },
+			{ "white", [](float* out, size_t count) { NoiseGenerator(kWhiteNoise).Render(out, count); } },
+			{ "pink", [](float* out, size_t count) { NoiseGenerator(kPinkNoise).Render(out, count); } },
+			{ "log_sweep", [](float* out, size_t count) { GenerateSweep(out, count, 20., 20000., kSampleRate); } },
+		};
+
+		for (float length : { 1.f, 60.f })
+		{
+			if (length > options.max_length)
+				continue;
+
+			vector<float> buffer(static_cast<size_t>(length * kSampleRate));
+			for (const auto& [name, generator] : generators)
+			{
+				const auto full_name = FormatName(name, 1, 32, length);
+				if (full_name.find(options.filter) == string::npos)
+					continue;
+
+				const Result result{ "generate", full_name, buffer.size(), 1, 32, 0, 0, buffer.size() * sizeof(float) };
+				results.push_back(Measure(options, result, [] {}, [&] { generator(buffer.data(), buffer.size()); }));
+				PrintResult(results.back());
+			}
+		}
+	}
+
+	/**
+	 * \brief Whole pipeline: Load -> effects -> Save
+	 */
+	void BenchmarkPipeline(const Options& options, vector<Result>& results)
+	{
+		const auto in_path = (fs::temp_directory_path() / "wav_effects_bench_in.wav").string();
+		const auto out_path = (fs::temp_directory_path() / "wav_effects_bench_out.wav").string();
+
+		for (float length : { 10.f, 600.f, 3600.f })
+		{
+			const auto name = FormatName("pipeline", 2, 16, length);
+			if (length > options.max_length || name.find(options.filter) == string::npos)
+				continue;
+
+			MakeSignal(2, length, 16).Save(in_path);
+
+			const Result result{ "macro", name, static_cast<size_t>(length * kSampleRate), 2, 16, 0, 0,
+				static_cast<size_t>(length * kSampleRate) * 2 * 2 };
+
+			results.push_back(Measure(options, result, [] {}, [&] {
+				WavFile<float> wav;
+				wav.Load(in_path);
+				ApplyVolume(wav, -3.f);
+				ApplyCompressor(wav, -12.f, 4.f);
+				ApplyDelay(wav, 250, 0.3f);
+				ApplyFadeIn(wav, 1.f);
+				ApplyFadeOut(wav, 1.f);
+				wav.Save(out_path);
+			}));
+			PrintResult(results.back());
+		}
+
+		fs::remove(in_path);
+		fs::remove(out_path);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--json" && i + 1 < argc)
+			options.json_path = argv[++i];
+		else if (arg == "--label" && i + 1 < argc)
+			options.label = argv[++i];
+		else if (arg == "--filter" && i + 1 < argc)
+			options.filter = argv[++i];
+		else if (arg == "--max-length" && i + 1 < argc)
+			options.max_length = stof(argv[++i]);
+		else if (arg == "--min-time" && i + 1 < argc)
+			options.min_time = stod(argv[++i]);
+		else
+		{
+			cout << "Usage: " << fs::path(argv[0]).stem().u8string()
+				<< " [--json results.json] [--label version] [--filter name] [--max-length seconds] [--min-time seconds]" << endl;
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	// Level is set by WAV_EFFECTS_SIMD, so runs of the levels can be compared
+	cout << "SIMD kernels: " << GetSimdLevelName(SimdKernels::Get().level) << endl;
+
+	vector<Result> results;
+	BenchmarkIO(options, results);
+	BenchmarkEffects(options, results);
+	BenchmarkGenerators(options, results);
+	BenchmarkPipeline(options, results);
+
+	if (!options.json_path.empty())
+		WriteJson(options, results);
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include <fstream>
+#include <iostream>
+#include "AudioInfo.h"
+#include "Flac.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	uint32_t ReadUInt32(const uint8_t* data)
+	{
+		return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+	}
+
+	uint16_t ReadUInt16(const uint8_t* data)
+	{
+		return static_cast<uint16_t>(data[0] | (data[1] << 8));
+	}
+
+	string GetFlacBlockName(int type)
+	{
+		static const char* kNames[] = { "STREAMINFO", "PADDING", "APPLICATION", "SEEKTABLE", "VORBIS_COMMENT", "CUESHEET", "PICTURE" };
+		return type < static_cast<int>(std::size(kNames)) ? kNames[type] : "block " + to_string(type);
+	}
+
+	bool ProbeWav(ifstream& file, uint64_t file_size, AudioInfo& info)
+	{
+		uint8_t format[16] = {};
+		bool has_format = false;
+		bool has_data = false;
+		uint64_t data_size = 0;
+
+		// Chunk headers are read one by one, chunk bodies are skipped
+		for (uint64_t pos = 12; pos + 8 <= file_size; )
+		{
+			uint8_t header[8];
+			file.seekg(static_cast<streamoff>(pos));
+			if (!file.read(reinterpret_cast<char*>(header), 8))
+				break;
+
+			const uint64_t size = ReadUInt32(header + 4);
+			info.chunks.push_back({ string(header, header + 4), pos, size });
+
+			if (info.chunks.back().id == "fmt " && size >= 16)
+				has_format = static_cast<bool>(file.read(reinterpret_cast<char*>(format), 16));
+			else if (info.chunks.back().id == "data")
+			{
+				// Truncated file has less samples, than its header tells
+				data_size = std::min(size, file_size - pos - 8);
+				has_data = true;
+			}
+
+			pos += 8 + size + (size & 1);
+		}
+
+		const uint16_t num_channels = ReadUInt16(format + 2);
+		const uint16_t block_align = ReadUInt16(format + 12);
+		info.sample_rate = ReadUInt32(format + 4);
+		info.bit_depth = ReadUInt16(format + 14);
+		info.num_channels = num_channels;
+
+		if (!has_format || !has_data || ReadUInt16(format) != 1 || num_channels < 1 ||
+			(info.bit_depth != 8 && info.bit_depth != 16 && info.bit_depth != 24 && info.bit_depth != 32) ||
+			block_align != num_channels * info.bit_depth / 8)
+			return false;
+
+		info.num_frames = data_size / block_align;
+		return true;
+	}
+
+	bool ProbeFlac(ifstream& file, uint64_t file_size, AudioInfo& info)
+	{
+		info.is_flac = true;
+
+		// Metadata block headers are read one by one, STREAMINFO is the first block
+		bool has_info = false;
+		for (uint64_t pos = 4; pos + 4 <= file_size; )
+		{
+			vector<uint8_t> block(4);
+			file.seekg(static_cast<streamoff>(pos));
+			if (!file.read(reinterpret_cast<char*>(block.data()), 4))
+				return false;
+
+			const bool last = (block[0] & 0x80) != 0;
+			const int type = block[0] & 0x7F;
+			const uint64_t size = block[1] << 16 | block[2] << 8 | block[3];
+			info.chunks.push_back({ GetFlacBlockName(type), pos, size });
+
+			if (type == 0)
+			{
+				block.resize(4 + size);
+				if (!file.read(reinterpret_cast<char*>(block.data() + 4), static_cast<streamsize>(size)))
+					return false;
+
+				// Stream info is parsed by the codec from the stream marker on
+				block.insert(block.begin(), { 'f', 'L', 'a', 'C' });
+				block[4] |= 0x80;
+
+				FlacStreamInfo stream_info;
+				if (!FlacCodec::ReadStreamInfo(block, stream_info))
+					return false;
+
+				info.sample_rate = stream_info.sample_rate;
+				info.bit_depth = stream_info.bit_depth;
+				info.num_channels = stream_info.num_channels;
+				info.num_frames = stream_info.num_frames;
+				has_info = true;
+			}
+
+			pos += 4 + size;
+			if (last)
+			{
+				info.chunks.push_back({ "frames", pos, file_size - std::min(pos, file_size) });
+				return has_info;
+			}
+		}
+
+		return false;
+	}
+}
+
+bool AudioInfo::Probe(const std::filesystem::path& path)
+{
+	*this = AudioInfo();
+
+	error_code ec;
+	const uint64_t file_size = fs::file_size(path, ec);
+	if (ec)
+		return false;
+
+	ifstream file(path, ios::binary);
+	uint8_t header[12];
+	if (!file.read(reinterpret_cast<char*>(header), 4))
+		return false;
+
+	if (FlacCodec::IsFlac(header, 4))
+		return ProbeFlac(file, file_size, *this);
+
+	if (!file.read(reinterpret_cast<char*>(header + 4), 8) || string(header, header + 4) != "RIFF" ||
+		string(header + 8, header + 12) != "WAVE")
+		return false;
+
+	return ProbeWav(file, file_size, *this);
+}
+
+double AudioInfo::GetLengthInSeconds() const
+{
+	return sample_rate != 0 ? static_cast<double>(num_frames) / sample_rate : 0.;
+}
+
+uint64_t AudioInfo::GetPackedBytes() const
+{
+	return num_frames * num_channels * (bit_depth / 8);
+}
+
+void AudioInfo::PrintSummary() const
+{
+	cout << "|======================================|" << endl
+		 << "| Format: " << (is_flac ? "FLAC" : "WAVE") << endl
+		 << "| Num Channels: " << num_channels << endl
+		 << "| Num Samples Per Channel: " << num_frames << endl
+		 << "| Sample Rate: " << sample_rate << endl
+		 << "| Bit Depth: " << bit_depth << endl
+		 << "| Length in Seconds: " << GetLengthInSeconds() << endl
+		 << "| Chunks:" << endl;
+
+	for (const auto& chunk : chunks)
+		cout << "|   " << chunk.id << " at " << chunk.offset << ", " << chunk.size << " bytes" << endl;
+
+	cout << "|======================================|" << endl;
+}
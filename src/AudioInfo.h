@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Chunk of the RIFF file, or metadata block of the FLAC stream
+ */
+struct AudioChunk
+{
+	std::string id;
+	// Offset of the chunk header from the beginning of the file
+	uint64_t offset = 0;
+	// Size of the chunk without its header
+	uint64_t size = 0;
+};
+
+/**
+ * \brief Format of the audio file, read from its headers without reading the samples
+ */
+struct AudioInfo
+{
+	bool is_flac = false;
+	uint32_t sample_rate = 0;
+	int bit_depth = 0;
+	size_t num_channels = 0;
+	uint64_t num_frames = 0;
+	std::vector<AudioChunk> chunks;
+
+	/**
+	 * \brief Read headers of the wave or FLAC file, typically the first few kilobytes.
+	 * Chunks are walked by seeking, so sample data is never read. Errors aren't printed,
+	 * so probing many files stays quiet.
+	 * \return true, if file is a PCM wave file or FLAC file, otherwise false
+	 */
+	bool Probe(const std::filesystem::path& path);
+
+	[[nodiscard]] double GetLengthInSeconds() const;
+
+	/**
+	 * \brief Bytes of the samples, when they are loaded packed
+	 */
+	[[nodiscard]] uint64_t GetPackedBytes() const;
+
+	/**
+	 * \brief Prints format and chunk list to standart output
+	 */
+	void PrintSummary() const;
+};
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <iostream>
+#include "AudioStream.h"
+#include "Flac.h"
+#include "SimdKernels.h"
+
+using namespace std;
+
+namespace
+{
+	// Bytes of the data chunk read or written at once
+	constexpr size_t kIoBlockBytes = 64 * 1024;
+
+	void WriteUInt32(vector<uint8_t>& data, uint32_t value)
+	{
+		for (int byte = 0; byte < 4; byte++)
+			data.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+	}
+
+	void WriteUInt16(vector<uint8_t>& data, uint16_t value)
+	{
+		data.push_back(static_cast<uint8_t>(value));
+		data.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	void WriteString(vector<uint8_t>& data, const char* str)
+	{
+		data.insert(data.end(), str, str + 4);
+	}
+}
+
+bool AudioReader::Open(const std::string& filename)
+{
+	file_.close();
+	decoded_ = PackedAudio();
+	position_ = 0;
+
+	if (!info_.Probe(filename))
+	{
+		cerr << "Error: couldn't Open " << filename << " as a wave or FLAC file" << endl;
+		return false;
+	}
+
+	if (info_.is_flac)
+		return decoded_.Load(filename);
+
+	const auto data = std::find_if(info_.chunks.begin(), info_.chunks.end(), [](const AudioChunk& chunk) { return chunk.id == "data"; });
+	file_.open(filename, ios::binary);
+	if (!file_.good() || !file_.seekg(static_cast<streamoff>(data->offset + 8)))
+	{
+		cerr << "Error: couldn't Open " << filename << endl;
+		return false;
+	}
+
+	return true;
+}
+
+size_t AudioReader::Read(float* const* channels, size_t count)
+{
+	count = std::min<size_t>(count, info_.num_frames - position_);
+	if (info_.is_flac)
+	{
+		for (size_t channel = 0; channel < info_.num_channels; channel++)
+			decoded_.Read(channel, position_, count, channels[channel]);
+
+		position_ += count;
+		return count;
+	}
+
+	const size_t bytes_per_sample = info_.bit_depth / 8;
+	const size_t block_align = info_.num_channels * bytes_per_sample;
+	const size_t frames_per_block = std::max<size_t>(1, kIoBlockBytes / block_align);
+	buffer_.resize(std::min(count, frames_per_block) * block_align);
+
+	// Deinterleave by blocks
+	size_t done = 0;
+	while (done < count)
+	{
+		const size_t block = std::min(frames_per_block, count - done);
+		if (!file_.read(reinterpret_cast<char*>(buffer_.data()), static_cast<streamsize>(block * block_align)))
+		{
+			cerr << "Error: couldn't read samples of the file" << endl;
+			break;
+		}
+
+		if (info_.bit_depth == 16 && info_.num_channels == 1)
+			SimdKernels::Get().decode16(buffer_.data(), block, channels[0] + done);
+		else if (info_.bit_depth == 16 && info_.num_channels == 2)
+			SimdKernels::Get().decode16_stereo(buffer_.data(), block, channels[0] + done, channels[1] + done);
+		else
+		{
+			for (size_t channel = 0; channel < info_.num_channels; channel++)
+				DecodePcm(info_.bit_depth, buffer_.data() + channel * bytes_per_sample, block, block_align, channels[channel] + done);
+		}
+
+		done += block;
+	}
+
+	position_ += done;
+	return done;
+}
+
+uint32_t AudioReader::GetSampleRate() const
+{
+	return info_.sample_rate;
+}
+
+int AudioReader::GetBitDepth() const
+{
+	return info_.bit_depth;
+}
+
+size_t AudioReader::GetNumChannels() const
+{
+	return info_.num_channels;
+}
+
+size_t AudioReader::GetNumFrames() const
+{
+	return info_.num_frames;
+}
+
+bool AudioWriter::Open(const std::string& filename, uint32_t sample_rate, int bit_depth, size_t num_channels, size_t num_frames,
+	const DitherOptions& dither)
+{
+	filename_ = filename;
+	is_flac_ = FlacCodec::HasFlacExtension(filename);
+	bit_depth_ = bit_depth;
+	num_channels_ = num_channels;
+	num_frames_ = num_frames;
+	position_ = 0;
+
+	quantizers_.clear();
+	for (size_t channel = 0; channel < num_channels; channel++)
+		quantizers_.emplace_back(bit_depth, dither, channel);
+
+	if (is_flac_)
+	{
+		packed_ = PackedAudio(sample_rate, bit_depth, num_channels, num_frames);
+		return true;
+	}
+
+	const size_t block_align = num_channels * (bit_depth / 8);
+	const size_t data_chunk_size = num_frames * block_align;
+
+	vector<uint8_t> header;
+	WriteString(header, "RIFF");
+	WriteUInt32(header, static_cast<uint32_t>(4 + 24 + 8 + data_chunk_size));
+	WriteString(header, "WAVE");
+	WriteString(header, "fmt ");
+	WriteUInt32(header, 16);
+	WriteUInt16(header, 1);
+	WriteUInt16(header, static_cast<uint16_t>(num_channels));
+	WriteUInt32(header, sample_rate);
+	WriteUInt32(header, static_cast<uint32_t>(sample_rate * block_align));
+	WriteUInt16(header, static_cast<uint16_t>(block_align));
+	WriteUInt16(header, static_cast<uint16_t>(bit_depth));
+	WriteString(header, "data");
+	WriteUInt32(header, static_cast<uint32_t>(data_chunk_size));
+
+	file_.open(filename, ios::binary);
+	if (!file_.good() || !file_.write(reinterpret_cast<const char*>(header.data()), static_cast<streamsize>(header.size())))
+	{
+		cerr << "Error: couldn't Save file to " << filename << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool AudioWriter::Write(const float* const* channels, size_t count)
+{
+	if (count > num_frames_ - position_)
+	{
+		cerr << "Error: more frames are written, than " << filename_ << " was opened for" << endl;
+		return false;
+	}
+
+	if (is_flac_)
+	{
+		for (size_t channel = 0; channel < num_channels_; channel++)
+			packed_.Write(channel, position_, count, channels[channel], quantizers_[channel]);
+
+		position_ += count;
+		return true;
+	}
+
+	const size_t bytes_per_sample = bit_depth_ / 8;
+	const size_t block_align = num_channels_ * bytes_per_sample;
+	const size_t frames_per_block = std::max<size_t>(1, kIoBlockBytes / block_align);
+	buffer_.resize(std::min(count, frames_per_block) * block_align);
+
+	// Interleave by blocks
+	for (size_t done = 0; done < count; )
+	{
+		const size_t block = std::min(frames_per_block, count - done);
+		for (size_t channel = 0; channel < num_channels_; channel++)
+			quantizers_[channel].Encode(bit_depth_, channels[channel] + done, block, buffer_.data() + channel * bytes_per_sample, block_align);
+
+		if (!file_.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<streamsize>(block * block_align)))
+		{
+			cerr << "Error: couldn't Save file to " << filename_ << endl;
+			return false;
+		}
+
+		done += block;
+	}
+
+	position_ += count;
+	return true;
+}
+
+bool AudioWriter::Close()
+{
+	if (position_ != num_frames_)
+	{
+		cerr << "Error: " << num_frames_ - position_ << " frames of " << filename_ << " weren't written" << endl;
+		return false;
+	}
+
+	if (is_flac_)
+	{
+		const bool saved = packed_.Save(filename_);
+		packed_ = PackedAudio();
+		return saved;
+	}
+
+	file_.close();
+	if (file_.fail())
+	{
+		cerr << "Error: couldn't Save file to " << filename_ << endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "AudioInfo.h"
+#include "PackedAudio.h"
+#include "Quantizer.h"
+
+/**
+ * \brief Reads samples of the wave or FLAC file by blocks
+ *
+ * Wave file is read from its data chunk as samples are requested, so only a block
+ * of it is in memory. FLAC file is decoded whole on opening, its frames are decoded in parallel.
+ */
+class AudioReader
+{
+public:
+	/**
+	 * \brief Open file and read its headers
+	 * \return true, if file is a wave or FLAC file, otherwise false
+	 */
+	bool Open(const std::string& filename);
+
+	/**
+	 * \brief Read next frames, every channel into its own buffer
+	 * \param channels pointers to GetNumChannels() buffers of count floats
+	 * \param count number of frames to read
+	 * \return number of frames read, less than count at the end of the file
+	 */
+	size_t Read(float* const* channels, size_t count);
+
+	[[nodiscard]] uint32_t GetSampleRate() const;
+	[[nodiscard]] int GetBitDepth() const;
+	[[nodiscard]] size_t GetNumChannels() const;
+	[[nodiscard]] size_t GetNumFrames() const;
+
+private:
+	std::ifstream file_;
+	AudioInfo info_;
+	// Samples of FLAC file
+	PackedAudio decoded_;
+	size_t position_ = 0;
+	std::vector<uint8_t> buffer_;
+};
+
+/**
+ * \brief Writes samples of the wave file by blocks, number of frames is known beforehand
+ *
+ * FLAC file (.flac extension) is packed as it's written and encoded on closing,
+ * its frames are encoded in parallel.
+ */
+class AudioWriter
+{
+public:
+	/**
+	 * \brief Create file and write its header
+	 * \param dither dither and noise shaping of 8, 16 and 24 bit formats
+	 * \return true, if file was created, otherwise false
+	 */
+	bool Open(const std::string& filename, uint32_t sample_rate, int bit_depth, size_t num_channels, size_t num_frames,
+		const DitherOptions& dither = DitherOptions());
+
+	/**
+	 * \brief Write next frames, every channel from its own buffer
+	 * \param channels pointers to num_channels buffers of count floats
+	 * \param count number of frames, all of them must fit into num_frames
+	 * \return true, if writing was successful, otherwise false
+	 */
+	bool Write(const float* const* channels, size_t count);
+
+	/**
+	 * \brief Finish the file
+	 * \return true, if all frames were written and file was saved, otherwise false
+	 */
+	bool Close();
+
+private:
+	std::string filename_;
+	std::ofstream file_;
+	// Samples of FLAC file
+	PackedAudio packed_;
+	bool is_flac_ = false;
+	int bit_depth_ = 16;
+	size_t num_channels_ = 0;
+	size_t num_frames_ = 0;
+	size_t position_ = 0;
+	std::vector<Quantizer> quantizers_;
+	std::vector<uint8_t> buffer_;
+};
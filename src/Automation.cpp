@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "Automation.h"
+
+namespace
+{
+	// Difference from the target, that is considered reached
+	constexpr float kSettledDistance = 1e-6f;
+}
+
+Envelope::Envelope(std::vector<Breakpoint> points) : points_(std::move(points))
+{
+	for (size_t i = 1; i < points_.size(); i++)
+		if (points_[i].time < points_[i - 1].time)
+			throw std::invalid_argument("Envelope points must be sorted by time");
+}
+
+Envelope Envelope::Parse(const std::string& text)
+{
+	std::vector<Breakpoint> points;
+
+	std::stringstream ss(text);
+	std::string point_text;
+	while (getline(ss, point_text, '/'))
+	{
+		const auto at_idx = point_text.find('@');
+		if (at_idx == std::string::npos)
+			throw std::invalid_argument("Envelope point must be value@time: " + point_text);
+
+		try
+		{
+			points.push_back({ std::stod(point_text.substr(at_idx + 1)), std::stof(point_text.substr(0, at_idx)) });
+		}
+		catch (std::exception&)
+		{
+			throw std::invalid_argument("Invalid envelope point: " + point_text);
+		}
+	}
+
+	if (points.empty())
+		throw std::invalid_argument("Envelope has no points");
+
+	return Envelope(std::move(points));
+}
+
+std::string Envelope::ToString() const
+{
+	std::stringstream ss;
+	for (size_t i = 0; i < points_.size(); i++)
+		ss << (i == 0 ? "" : "/") << points_[i].value << '@' << points_[i].time;
+	return ss.str();
+}
+
+std::string Envelope::ToExactString() const
+{
+	std::stringstream ss;
+	ss << std::hexfloat;
+	for (size_t i = 0; i < points_.size(); i++)
+		ss << (i == 0 ? "" : "/") << points_[i].value << '@' << points_[i].time;
+	return ss.str();
+}
+
+bool Envelope::IsEmpty() const
+{
+	return points_.empty();
+}
+
+const std::vector<Breakpoint>& Envelope::GetPoints() const
+{
+	return points_;
+}
+
+float Envelope::GetValue(double time) const
+{
+	if (points_.empty())
+		return 0.f;
+
+	const auto next = std::upper_bound(points_.begin(), points_.end(), time, [](double t, const Breakpoint& point) {
+		return t < point.time;
+	});
+
+	if (next == points_.begin())
+		return points_.front().value;
+	if (next == points_.end())
+		return points_.back().value;
+
+	const auto& from = *(next - 1);
+	return static_cast<float>(from.value + (time - from.time) * (next->value - from.value) / (next->time - from.time));
+}
+
+void Envelope::Render(float* out, size_t start_frame, size_t count, double sample_rate) const
+{
+	if (points_.empty())
+	{
+		std::fill_n(out, count, 0.f);
+		return;
+	}
+
+	// First point after the start
+	const double start_time = static_cast<double>(start_frame) / sample_rate;
+	auto next = std::upper_bound(points_.begin(), points_.end(), start_time, [](double time, const Breakpoint& point) {
+		return time < point.time;
+	});
+
+	size_t i = 0;
+	while (i < count)
+	{
+		if (next == points_.begin() || next == points_.end())
+		{
+			// Hold the first value before the first point, the last one after the last point
+			const float value = next == points_.end() ? points_.back().value : points_.front().value;
+			const size_t end = next == points_.end()
+				? count
+				: std::min(count, static_cast<size_t>(std::ceil(next->time * sample_rate)) - start_frame);
+
+			std::fill(out + i, out + end, value);
+			i = end;
+		}
+		else
+		{
+			const auto& from = *(next - 1);
+			const auto& to = *next;
+			const double slope = (to.value - from.value) / (to.time - from.time);
+			const size_t end = std::min(count, static_cast<size_t>(std::ceil(to.time * sample_rate)) - start_frame);
+
+			for (; i < end; i++)
+			{
+				const double time = static_cast<double>(start_frame + i) / sample_rate;
+				out[i] = static_cast<float>(from.value + (time - from.time) * slope);
+			}
+		}
+
+		++next;
+	}
+}
+
+SmoothedParameter::SmoothedParameter(float value) : target_(value), current_(value)
+{
+}
+
+SmoothedParameter::SmoothedParameter(const SmoothedParameter& other)
+	: target_(other.GetTarget()), current_(other.current_), coefficient_(other.coefficient_)
+{
+}
+
+SmoothedParameter& SmoothedParameter::operator=(const SmoothedParameter& other)
+{
+	target_.store(other.GetTarget(), std::memory_order_relaxed);
+	current_ = other.current_;
+	coefficient_ = other.coefficient_;
+	return *this;
+}
+
+void SmoothedParameter::SetTarget(float value)
+{
+	target_.store(value, std::memory_order_relaxed);
+}
+
+float SmoothedParameter::GetTarget() const
+{
+	return target_.load(std::memory_order_relaxed);
+}
+
+void SmoothedParameter::SetSmoothing(double sample_rate, double smoothing_time)
+{
+	coefficient_ = smoothing_time > 0 ? static_cast<float>(1. - std::exp(-1. / (smoothing_time * sample_rate))) : 1.f;
+}
+
+void SmoothedParameter::Reset(float value)
+{
+	target_.store(value, std::memory_order_relaxed);
+	current_ = value;
+}
+
+void SmoothedParameter::Render(float* out, size_t count)
+{
+	// Target is read once per block, so the block is a clean ramp
+	const float target = GetTarget();
+	if (std::abs(target - current_) <= kSettledDistance * std::max(1.f, std::abs(target)))
+	{
+		current_ = target;
+		std::fill_n(out, count, target);
+		return;
+	}
+
+	float current = current_;
+	for (size_t i = 0; i < count; i++)
+	{
+		current += (target - current) * coefficient_;
+		out[i] = current;
+	}
+	current_ = current;
+}
+
+float SmoothedParameter::GetValue() const
+{
+	return current_;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Point of the automation envelope
+ */
+struct Breakpoint
+{
+	// Time from the beginning of the file, seconds
+	double time = 0;
+	float value = 0;
+};
+
+/**
+ * \brief Parameter value as a function of time: breakpoints joined by straight lines
+ *
+ * Value is held before the first and after the last point. Values are computed for every
+ * frame from its absolute position, so any block of frames renders the same way.
+ * Text form is `value@time` points, separated by `/`, e.g. `-20@0/0@2.5`.
+ */
+class Envelope
+{
+public:
+	Envelope() = default;
+
+	/**
+	 * \throw invalid_argument points are not sorted by time
+	 */
+	explicit Envelope(std::vector<Breakpoint> points);
+
+	/**
+	 * \brief Parse envelope from its text form
+	 * \throw invalid_argument invalid text or points not sorted by time
+	 */
+	static Envelope Parse(const std::string& text);
+
+	/**
+	 * \brief Text form, that can be parsed back
+	 */
+	[[nodiscard]] std::string ToString() const;
+
+	/**
+	 * \brief Text form with exact values in hexfloat, for hashing
+	 */
+	[[nodiscard]] std::string ToExactString() const;
+
+	[[nodiscard]] bool IsEmpty() const;
+	[[nodiscard]] const std::vector<Breakpoint>& GetPoints() const;
+
+	[[nodiscard]] float GetValue(double time) const;
+
+	/**
+	 * \brief Values of frames [start_frame, start_frame + count)
+	 */
+	void Render(float* out, size_t start_frame, size_t count, double sample_rate) const;
+
+private:
+	std::vector<Breakpoint> points_;
+};
+
+/**
+ * \brief Parameter, that is set from any thread and read smoothly by the processing thread
+ *
+ * Target is an atomic, so setting it doesn't lock. Processing thread follows the target
+ * with a one-pole low-pass filter, so steps of the value don't make zipper noise.
+ */
+class SmoothedParameter
+{
+public:
+	explicit SmoothedParameter(float value = 0.f);
+
+	SmoothedParameter(const SmoothedParameter& other);
+	SmoothedParameter& operator=(const SmoothedParameter& other);
+
+	/**
+	 * \brief Set value to glide to, any thread
+	 */
+	void SetTarget(float value);
+	[[nodiscard]] float GetTarget() const;
+
+	/**
+	 * \brief Set smoothing, processing thread only
+	 * \param sample_rate sample rate
+	 * \param smoothing_time time constant, seconds, 0 disables smoothing
+	 */
+	void SetSmoothing(double sample_rate, double smoothing_time = 0.02);
+
+	/**
+	 * \brief Jump to the value without smoothing, processing thread only
+	 */
+	void Reset(float value);
+
+	/**
+	 * \brief Next count values, processing thread only
+	 */
+	void Render(float* out, size_t count);
+
+	/**
+	 * \brief Current smoothed value
+	 */
+	[[nodiscard]] float GetValue() const;
+
+private:
+	std::atomic<float> target_;
+	float current_;
+	// Part of the distance to the target, that is passed every sample
+	float coefficient_ = 1.f;
+};
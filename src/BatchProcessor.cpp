@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include "BatchProcessor.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	mutex log_mutex;
+}
+
+BatchProcessor::BatchProcessor(BatchOptions options) : options_(std::move(options))
+{
+	if (!options_.cache_dir.empty())
+		cache_ = make_unique<RenderCache>(options_.cache_dir, options_.cache_link);
+}
+
+bool BatchProcessor::Run()
+{
+	const auto jobs = CollectJobs();
+	if (jobs.empty())
+	{
+		cerr << "Error: No files matched " << options_.input << endl;
+		return false;
+	}
+
+	// Pending jobs ordered by estimated memory, so the largest job that fits can be found fast
+	multimap<size_t, const Job*> pending;
+	for (const auto& job : jobs)
+		pending.emplace(job.estimated_memory, &job);
+
+	ThreadPool pool(options_.num_threads);
+	atomic<size_t> num_failed = 0;
+	atomic<size_t> num_done = 0;
+
+	segment_threads_ = std::max<size_t>(1, pool.GetNumThreads() / jobs.size());
+	cout << "Processing " << jobs.size() << " files on " << pool.GetNumThreads() << " threads" << endl;
+
+	while (!pending.empty())
+	{
+		unique_lock<mutex> lock(budget_mutex_);
+
+		auto it = pending.end();
+		budget_cv_.wait(lock, [&] {
+			// Job larger than the whole budget is admitted only when nothing else is running
+			if (running_jobs_ == 0)
+			{
+				it = prev(pending.end());
+				return true;
+			}
+
+			if (memory_in_use_ >= options_.memory_budget)
+				return false;
+
+			it = pending.upper_bound(options_.memory_budget - memory_in_use_);
+			if (it == pending.begin())
+				return false;
+
+			it = prev(it);
+			return true;
+		});
+
+		const Job* job = it->second;
+		pending.erase(it);
+		memory_in_use_ += job->estimated_memory;
+		++running_jobs_;
+		lock.unlock();
+
+		pool.Submit([this, job, &num_failed, &num_done, total = jobs.size()] {
+			// Exception of the job (e.g. bad_alloc while loading, failed cache copy) fails only this job,
+			// the budget is released below either way
+			bool ok = false;
+			try
+			{
+				ok = ProcessJob(*job);
+			}
+			catch (exception& ex)
+			{
+				lock_guard<mutex> log_lock(log_mutex);
+				cerr << "Error: " << job->input.string() << ": " << ex.what() << endl;
+			}
+
+			if (!ok)
+				++num_failed;
+
+			{
+				lock_guard<mutex> log_lock(log_mutex);
+				cout << "[" << ++num_done << "/" << total << "] " << (ok ? "" : "FAILED ") << job->input.string() << endl;
+			}
+
+			{
+				lock_guard<mutex> budget_lock(budget_mutex_);
+				memory_in_use_ -= job->estimated_memory;
+				--running_jobs_;
+			}
+			budget_cv_.notify_all();
+		});
+	}
+
+	pool.Wait();
+
+	cout << "Done: " << jobs.size() - num_failed << " succeeded, " << num_failed << " failed" << endl;
+	if (cache_)
+		cout << "Cache: " << cache_->GetHits() << " hits, " << cache_->GetMisses() << " misses" << endl;
+	return num_failed == 0;
+}
+
+std::vector<BatchProcessor::Job> BatchProcessor::CollectJobs() const
+{
+	vector<Job> jobs;
+	const bool streamable = options_.chain.IsStreamable();
+
+	if (fs::is_directory(options_.input))
+	{
+		// Headers are probed in parallel, with saved index only new and changed files are probed
+		MediaIndex index(options_.input);
+		if (!options_.index_path.empty())
+			index.Load(options_.index_path);
+
+		index.Update(options_.num_threads);
+
+		if (!options_.index_path.empty() && !index.Save(options_.index_path))
+			cerr << "Error: couldn't save index to " << options_.index_path.string() << endl;
+
+		for (const auto& entry : index.GetEntries())
+			jobs.push_back({ options_.input / entry.path, options_.output_dir / entry.path, EstimateMemory(entry, streamable) });
+	}
+	else
+	{
+		auto dir = options_.input.parent_path();
+		if (dir.empty())
+			dir = fs::current_path();
+
+		const auto pattern = options_.input.filename().string();
+		if (!fs::is_directory(dir))
+			return jobs;
+
+		for (const auto& entry : fs::directory_iterator(dir))
+		{
+			if (!entry.is_regular_file() || !MatchGlob(pattern, entry.path().filename().string()))
+				continue;
+
+			MediaIndex::Entry probed;
+			probed.file_size = entry.file_size();
+			probed.valid = probed.info.Probe(entry.path());
+			jobs.push_back({ entry.path(), options_.output_dir / entry.path().filename(), EstimateMemory(probed, streamable) });
+		}
+	}
+
+	return jobs;
+}
+
+bool BatchProcessor::ProcessJob(const Job& job) const
+{
+	error_code ec;
+	fs::create_directories(job.output.parent_path(), ec);
+
+	// Samples stay packed, streamable chains never expand them to floats.
+	// Key of the cache is hashed while the input is decoded, so the input is read once
+	PackedAudio audio;
+	Meter meter;
+	XxHash64 source_hash;
+	if (!audio.Load(job.input.string(), &meter, cache_ ? &source_hash : nullptr))
+		return false;
+
+	string key;
+	if (cache_)
+	{
+		key = cache_->GetKey(source_hash.Digest(), options_.chain, options_.dither, job.output);
+		if (cache_->Fetch(key, job.output))
+			return true;
+	}
+
+	try
+	{
+		const auto levels = meter.GetLevels();
+		options_.chain.Apply(audio, &levels, options_.dither, segment_threads_);
+	}
+	catch (exception& ex)
+	{
+		lock_guard<mutex> log_lock(log_mutex);
+		cerr << "Error: " << job.input.string() << ": " << ex.what() << endl;
+		return false;
+	}
+
+	// Output may be a hard link to the cache entry, don't overwrite it in place
+	if (cache_)
+		fs::remove(job.output, ec);
+
+	if (!audio.Save(job.output.string()))
+		return false;
+
+	if (!key.empty())
+		cache_->Store(key, job.output);
+
+	return true;
+}
+
+size_t BatchProcessor::EstimateMemory(const MediaIndex::Entry& entry, bool streamable)
+{
+	if (!entry.valid)
+		return static_cast<size_t>(entry.file_size);
+
+	// FLAC stream is read whole before it's decoded
+	const auto& info = entry.info;
+	uint64_t memory = info.GetPackedBytes() + (info.is_flac ? entry.file_size : 0);
+	if (!streamable)
+		memory += info.num_frames * info.num_channels * sizeof(float);
+	return static_cast<size_t>(memory);
+}
+
+bool BatchProcessor::MatchGlob(std::string_view pattern, std::string_view str)
+{
+	// Iterative matching with backtracking to the last `*`
+	size_t p = 0, s = 0;
+	size_t star_p = string_view::npos, star_s = 0;
+
+	while (s < str.size())
+	{
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s]))
+		{
+			p++;
+			s++;
+		}
+		else if (p < pattern.size() && pattern[p] == '*')
+		{
+			star_p = p++;
+			star_s = s;
+		}
+		else if (star_p != string_view::npos)
+		{
+			p = star_p + 1;
+			s = ++star_s;
+		}
+		else
+			return false;
+	}
+
+	while (p < pattern.size() && pattern[p] == '*')
+		p++;
+
+	return p == pattern.size();
+}
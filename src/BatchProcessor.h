@@ -0,0 +1,95 @@
+#pragma once
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EffectChain.h"
+#include "MediaIndex.h"
+#include "RenderCache.h"
+
+/**
+ * \brief Options of batch processing
+ */
+struct BatchOptions
+{
+	// Input directory (processed recursively), or glob pattern like `dir/*.wav`
+	std::filesystem::path input;
+	std::filesystem::path output_dir;
+	EffectChain chain;
+	DitherOptions dither;
+
+	// Maximum estimated memory of all running jobs, in bytes
+	size_t memory_budget = size_t(1) << 30;
+
+	// Number of worker threads, 0 means hardware concurrency
+	size_t num_threads = 0;
+
+	// Render cache directory, empty means no cache
+	std::filesystem::path cache_dir;
+	// Produce cached outputs by hard links instead of copies
+	bool cache_link = false;
+
+	// Metadata index of the input directory, so only new and changed files are probed. Empty means no index
+	std::filesystem::path index_path;
+};
+
+/**
+ * \brief Batch processor: Load -> effects -> Save for every matched file
+ *
+ * Jobs run on the work-stealing thread pool, largest file first.
+ * A job is admitted only when its estimated memory fits into the budget,
+ * a job larger than the whole budget runs alone. When there are fewer files than threads,
+ * every file splits its chain processing into segments on its share of the threads.
+ * With render cache, outputs of already rendered (file, chain) pairs are taken from the cache.
+ */
+class BatchProcessor
+{
+public:
+	explicit BatchProcessor(BatchOptions options);
+
+	/**
+	 * \brief Process all matched files
+	 * \return true, if all files were processed successfully, otherwise false
+	 */
+	bool Run();
+
+private:
+	struct Job
+	{
+		std::filesystem::path input;
+		std::filesystem::path output;
+		size_t estimated_memory;
+	};
+
+	[[nodiscard]] std::vector<Job> CollectJobs() const;
+	bool ProcessJob(const Job& job) const;
+
+	/**
+	 * \brief Estimate peak memory of processing the file from its probed header
+	 *
+	 * Samples are kept packed, streamable chain processes them in place, other chains
+	 * hold decoded samples and then repack them, so estimation is packed size,
+	 * or decoded size + packed size. FLAC file is read whole, so its size is added.
+	 * \param entry probed file, file size is the estimation of a file that can't be probed
+	 * \param streamable chain processes packed samples by blocks
+	 */
+	[[nodiscard]] static size_t EstimateMemory(const MediaIndex::Entry& entry, bool streamable);
+
+	/**
+	 * \brief Simple wildcard matching, supports `*` and `?`
+	 */
+	[[nodiscard]] static bool MatchGlob(std::string_view pattern, std::string_view str);
+
+	BatchOptions options_;
+	std::unique_ptr<RenderCache> cache_;
+
+	std::mutex budget_mutex_;
+	std::condition_variable budget_cv_;
+	size_t memory_in_use_ = 0;
+	size_t running_jobs_ = 0;
+
+	// Threads of segment-parallel processing of every file
+	size_t segment_threads_ = 1;
+};
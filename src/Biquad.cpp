@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "Biquad.h"
+#include "DenormalGuard.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BIQUAD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+
+	// Frames processed at once, interleaved buffer of kBlockSize * 4 floats fits into L1 cache
+	constexpr size_t kBlockSize = 256;
+
+	bool IsClose(float a, float b, float tolerance)
+	{
+		return std::abs(a - b) <= tolerance;
+	}
+
+#ifdef BIQUAD_SSE
+	struct PackedCoefficients
+	{
+		__m128d b0, b1, b2, a1, a2;
+	};
+
+	/**
+	 * \brief Filter a sample of 2 lanes, s1 and s2 are the states of the lanes
+	 */
+	__m128d Tick(const PackedCoefficients& c, __m128d x, __m128d& s1, __m128d& s2)
+	{
+		const __m128d y = _mm_add_pd(_mm_mul_pd(c.b0, x), s1);
+		s1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(c.b1, x), _mm_mul_pd(c.a1, y)), s2);
+		s2 = _mm_sub_pd(_mm_mul_pd(c.b2, x), _mm_mul_pd(c.a2, y));
+		return y;
+	}
+#endif
+}
+
+BiquadCoefficients BiquadCoefficients::Design(const BiquadParams& params, double sample_rate)
+{
+	if (params.freq <= 0 || params.freq >= sample_rate / 2)
+		throw std::invalid_argument("Filter frequency must be between 0 and half of sample rate");
+
+	if (params.q <= 0)
+		throw std::invalid_argument("Filter Q must be greater than 0");
+
+	const double w0 = 2. * kPi * params.freq / sample_rate;
+	const double cos_w0 = std::cos(w0);
+	const double alpha = std::sin(w0) / (2. * params.q);
+	const double a = std::pow(10., params.gain_db / 40.);
+	const double sqrt_a_alpha = 2. * std::sqrt(a) * alpha;
+
+	double b0, b1, b2, a0, a1, a2;
+	switch (params.type)
+	{
+		case kLowPass:
+			b0 = (1. - cos_w0) / 2.;
+			b1 = 1. - cos_w0;
+			b2 = (1. - cos_w0) / 2.;
+			a0 = 1. + alpha;
+			a1 = -2. * cos_w0;
+			a2 = 1. - alpha;
+			break;
+
+		case kHighPass:
+			b0 = (1. + cos_w0) / 2.;
+			b1 = -(1. + cos_w0);
+			b2 = (1. + cos_w0) / 2.;
+			a0 = 1. + alpha;
+			a1 = -2. * cos_w0;
+			a2 = 1. - alpha;
+			break;
+
+		case kBandPass:
+			// Constant 0 dB peak gain
+			b0 = alpha;
+			b1 = 0.;
+			b2 = -alpha;
+			a0 = 1. + alpha;
+			a1 = -2. * cos_w0;
+			a2 = 1. - alpha;
+			break;
+
+		case kNotch:
+			b0 = 1.;
+			b1 = -2. * cos_w0;
+			b2 = 1.;
+			a0 = 1. + alpha;
+			a1 = -2. * cos_w0;
+			a2 = 1. - alpha;
+			break;
+
+		case kPeak:
+			b0 = 1. + alpha * a;
+			b1 = -2. * cos_w0;
+			b2 = 1. - alpha * a;
+			a0 = 1. + alpha / a;
+			a1 = -2. * cos_w0;
+			a2 = 1. - alpha / a;
+			break;
+
+		case kLowShelf:
+			b0 = a * ((a + 1.) - (a - 1.) * cos_w0 + sqrt_a_alpha);
+			b1 = 2. * a * ((a - 1.) - (a + 1.) * cos_w0);
+			b2 = a * ((a + 1.) - (a - 1.) * cos_w0 - sqrt_a_alpha);
+			a0 = (a + 1.) + (a - 1.) * cos_w0 + sqrt_a_alpha;
+			a1 = -2. * ((a - 1.) + (a + 1.) * cos_w0);
+			a2 = (a + 1.) + (a - 1.) * cos_w0 - sqrt_a_alpha;
+			break;
+
+		case kHighShelf:
+			b0 = a * ((a + 1.) + (a - 1.) * cos_w0 + sqrt_a_alpha);
+			b1 = -2. * a * ((a - 1.) + (a + 1.) * cos_w0);
+			b2 = a * ((a + 1.) + (a - 1.) * cos_w0 - sqrt_a_alpha);
+			a0 = (a + 1.) - (a - 1.) * cos_w0 + sqrt_a_alpha;
+			a1 = 2. * ((a - 1.) - (a + 1.) * cos_w0);
+			a2 = (a + 1.) - (a - 1.) * cos_w0 - sqrt_a_alpha;
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown filter type");
+	}
+
+	return { b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0 };
+}
+
+BiquadCascade::BiquadCascade(size_t num_channels, double sample_rate, const std::vector<BiquadParams>& sections)
+	: num_channels_(num_channels), num_groups_((num_channels + kLanes - 1) / kLanes), sample_rate_(sample_rate)
+{
+	for (const auto& params : sections)
+		AddSection(params);
+}
+
+void BiquadCascade::AddSection(const BiquadParams& params)
+{
+	Section section;
+	section.current = params;
+	section.target = params;
+	section.coefficients = BiquadCoefficients::Design(params, sample_rate_);
+	section.z1.assign(num_groups_ * kLanes, 0.);
+	section.z2.assign(num_groups_ * kLanes, 0.);
+	sections_.push_back(std::move(section));
+}
+
+void BiquadCascade::SetParams(size_t section, const BiquadParams& params)
+{
+	if (section >= sections_.size())
+		throw std::out_of_range("Filter section");
+
+	if (params.type != sections_[section].current.type)
+		throw std::invalid_argument("Filter type can't be changed");
+
+	// Validate before accepting
+	(void)BiquadCoefficients::Design(params, sample_rate_);
+
+	sections_[section].target = params;
+	sections_[section].smoothing = true;
+}
+
+void BiquadCascade::SetSmoothingTime(double seconds)
+{
+	smoothing_time_ = seconds;
+}
+
+void BiquadCascade::Reset()
+{
+	for (auto& section : sections_)
+	{
+		std::fill(section.z1.begin(), section.z1.end(), 0.);
+		std::fill(section.z2.begin(), section.z2.end(), 0.);
+	}
+}
+
+void BiquadCascade::Process(float* const* channels, size_t count)
+{
+	Process(channels, count, nullptr);
+}
+
+void BiquadCascade::Process(float* const* channels, size_t count, const float* const* ramps)
+{
+	DenormalGuard guard;
+
+	alignas(16) float buffer[kBlockSize * kLanes];
+	size_t num_frames = 0;
+	for (size_t offset = 0; offset < count; offset += num_frames)
+	{
+		if (ramps != nullptr)
+			FollowRamps(ramps, offset);
+
+		const bool smoothing = std::any_of(sections_.begin(), sections_.end(), [](const auto& section) {
+			return section.smoothing;
+		});
+
+		// Ramps may change at any frame, so they are followed every kSmoothingBlock frames
+		num_frames = std::min(count - offset, smoothing || ramps != nullptr ? kSmoothingBlock : kBlockSize);
+		if (smoothing)
+			UpdateSmoothing(num_frames);
+
+		for (size_t group = 0; group < num_groups_; group++)
+		{
+			// Interleave channels of the group, missing channels are silent lanes
+			for (size_t lane = 0; lane < kLanes; lane++)
+			{
+				const size_t channel = group * kLanes + lane;
+				for (size_t i = 0; i < num_frames; i++)
+					buffer[i * kLanes + lane] = channel < num_channels_ ? channels[channel][offset + i] : 0.f;
+			}
+
+			for (auto& section : sections_)
+				ProcessGroup(section, group, buffer, num_frames);
+
+			for (size_t lane = 0; lane < kLanes && group * kLanes + lane < num_channels_; lane++)
+			{
+				float* out = channels[group * kLanes + lane] + offset;
+				for (size_t i = 0; i < num_frames; i++)
+					out[i] = buffer[i * kLanes + lane];
+			}
+		}
+	}
+}
+
+size_t BiquadCascade::GetNumSections() const
+{
+	return sections_.size();
+}
+
+void BiquadCascade::FollowRamps(const float* const* ramps, size_t offset)
+{
+	for (size_t i = 0; i < sections_.size(); i++)
+	{
+		const float* const* section_ramps = ramps + i * kParamsPerSection;
+		auto params = sections_[i].target;
+		if (section_ramps[1] != nullptr)
+			params.freq = section_ramps[1][offset];
+		if (section_ramps[2] != nullptr)
+			params.q = section_ramps[2][offset];
+		if (section_ramps[3] != nullptr)
+			params.gain_db = section_ramps[3][offset];
+
+		const auto& target = sections_[i].target;
+		if (params.freq != target.freq || params.q != target.q || params.gain_db != target.gain_db)
+			SetParams(i, params);
+	}
+}
+
+void BiquadCascade::UpdateSmoothing(size_t num_frames)
+{
+	const double k = smoothing_time_ > 0
+		? 1. - std::exp(-static_cast<double>(num_frames) / (smoothing_time_ * sample_rate_))
+		: 1.;
+
+	for (auto& section : sections_)
+	{
+		if (!section.smoothing)
+			continue;
+
+		auto& current = section.current;
+		const auto& target = section.target;
+
+		// Frequency and Q glide exponentially, so the glide is uniform in octaves
+		current.freq = static_cast<float>(current.freq * std::pow(target.freq / current.freq, k));
+		current.q = static_cast<float>(current.q * std::pow(target.q / current.q, k));
+		current.gain_db = static_cast<float>(current.gain_db + (target.gain_db - current.gain_db) * k);
+
+		if (IsClose(current.freq, target.freq, target.freq * 1e-4f) && IsClose(current.q, target.q, target.q * 1e-4f) &&
+			IsClose(current.gain_db, target.gain_db, 1e-3f))
+		{
+			current = target;
+			section.smoothing = false;
+		}
+
+		section.coefficients = BiquadCoefficients::Design(current, sample_rate_);
+	}
+}
+
+void BiquadCascade::ProcessGroup(Section& section, size_t group, float* buffer, size_t count) const
+{
+	const auto& c = section.coefficients;
+	double* z1 = &section.z1[group * kLanes];
+	double* z2 = &section.z2[group * kLanes];
+
+#ifdef BIQUAD_SSE
+	// Lanes 0, 1 and lanes 2, 3 of the group are filtered in two double registers
+	const PackedCoefficients packed = {
+		_mm_set1_pd(c.b0), _mm_set1_pd(c.b1), _mm_set1_pd(c.b2), _mm_set1_pd(c.a1), _mm_set1_pd(c.a2)
+	};
+
+	__m128d s1_low = _mm_loadu_pd(z1), s1_high = _mm_loadu_pd(z1 + 2);
+	__m128d s2_low = _mm_loadu_pd(z2), s2_high = _mm_loadu_pd(z2 + 2);
+	for (size_t i = 0; i < count; i++)
+	{
+		const __m128 x = _mm_load_ps(buffer + i * kLanes);
+		const __m128d y_low = Tick(packed, _mm_cvtps_pd(x), s1_low, s2_low);
+		const __m128d y_high = Tick(packed, _mm_cvtps_pd(_mm_movehl_ps(x, x)), s1_high, s2_high);
+		_mm_store_ps(buffer + i * kLanes, _mm_movelh_ps(_mm_cvtpd_ps(y_low), _mm_cvtpd_ps(y_high)));
+	}
+
+	_mm_storeu_pd(z1, s1_low);
+	_mm_storeu_pd(z1 + 2, s1_high);
+	_mm_storeu_pd(z2, s2_low);
+	_mm_storeu_pd(z2 + 2, s2_high);
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t lane = 0; lane < kLanes; lane++)
+		{
+			const double x = buffer[i * kLanes + lane];
+			const double y = c.b0 * x + z1[lane];
+			z1[lane] = c.b1 * x - c.a1 * y + z2[lane];
+			z2[lane] = c.b2 * x - c.a2 * y;
+			buffer[i * kLanes + lane] = static_cast<float>(y);
+		}
+	}
+#endif
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <vector>
+
+enum FilterType
+{
+	kLowPass = 1,
+	kHighPass,
+	kBandPass,
+	kNotch,
+	kPeak,
+	kLowShelf,
+	kHighShelf
+};
+
+/**
+ * \brief Parameters of the single filter section
+ */
+struct BiquadParams
+{
+	FilterType type = kLowPass;
+	// Cutoff or center frequency, Hz
+	float freq = 1000.f;
+	float q = 0.70710678f;
+	// Gain of peak and shelf filters, dB
+	float gain_db = 0.f;
+};
+
+/**
+ * \brief Normalized biquad coefficients (a0 = 1)
+ */
+struct BiquadCoefficients
+{
+	double b0 = 1., b1 = 0., b2 = 0.;
+	double a1 = 0., a2 = 0.;
+
+	/**
+	 * \brief Coefficients by RBJ Audio EQ Cookbook formulas
+	 * \throw invalid_argument frequency not in (0, sample_rate / 2), q <= 0 or unknown type
+	 */
+	static BiquadCoefficients Design(const BiquadParams& params, double sample_rate);
+};
+
+/**
+ * \brief Cascade of biquad sections, transposed direct form II
+ *
+ * Channels are processed in groups of 4, every channel in its own SIMD lane,
+ * so the recursion of every channel runs in parallel. Recursion runs in double:
+ * float state of a low cutoff section amplifies its rounding noise up to about -100 dBFS.
+ * Parameter changes are smoothed: frequency, Q and gain glide to the new values,
+ * coefficients are recalculated every kSmoothingBlock frames.
+ */
+class BiquadCascade
+{
+public:
+	static constexpr size_t kSmoothingBlock = 32;
+	// Ramps of every section: its type (not automated), freq, q and gain_db, like eq parameters
+	static constexpr size_t kParamsPerSection = 4;
+
+	/**
+	 * \param num_channels number of channels
+	 * \param sample_rate sample rate
+	 * \param sections filter sections, applied in order
+	 * \throw invalid_argument invalid parameters of any section
+	 */
+	BiquadCascade(size_t num_channels, double sample_rate, const std::vector<BiquadParams>& sections = {});
+
+	/**
+	 * \brief Append section to the end of the cascade
+	 * \throw invalid_argument invalid parameters
+	 */
+	void AddSection(const BiquadParams& params);
+
+	/**
+	 * \brief Set new parameters, that section glides to
+	 * \throw invalid_argument invalid parameters or type differs from the current one
+	 * \throw out_of_range section out of range
+	 */
+	void SetParams(size_t section, const BiquadParams& params);
+
+	/**
+	 * \brief Time, parameters change during, by 1/e of the difference
+	 */
+	void SetSmoothingTime(double seconds);
+
+	/**
+	 * \brief Clear filter state
+	 */
+	void Reset();
+
+	/**
+	 * \brief Filter samples in place
+	 * \param channels pointers to num_channels buffers
+	 * \param count number of frames in every buffer
+	 */
+	void Process(float* const* channels, size_t count);
+
+	/**
+	 * \brief Filter samples in place, while parameters of the sections follow ramps.
+	 * Sections glide to the values of the ramps at the start of every kSmoothingBlock frames
+	 * \param channels pointers to num_channels buffers
+	 * \param count number of frames in every buffer
+	 * \param ramps values of every frame, indexed `kParamsPerSection * section + param`,
+	 *  nullptr entry keeps the parameter
+	 * \throw invalid_argument ramp value is an invalid parameter
+	 */
+	void Process(float* const* channels, size_t count, const float* const* ramps);
+
+	[[nodiscard]] size_t GetNumSections() const;
+
+private:
+	static constexpr size_t kLanes = 4;
+
+	struct Section
+	{
+		BiquadParams current;
+		BiquadParams target;
+		BiquadCoefficients coefficients;
+		bool smoothing = false;
+
+		// States of every group of kLanes channels
+		std::vector<double> z1;
+		std::vector<double> z2;
+	};
+
+	/**
+	 * \brief Set targets of the sections to the values of the ramps at frame offset
+	 */
+	void FollowRamps(const float* const* ramps, size_t offset);
+	void UpdateSmoothing(size_t num_frames);
+	void ProcessGroup(Section& section, size_t group, float* buffer, size_t count) const;
+
+	size_t num_channels_;
+	size_t num_groups_;
+	double sample_rate_;
+	double smoothing_time_ = 0.02;
+	std::vector<Section> sections_;
+};
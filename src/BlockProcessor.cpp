@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <stdexcept>
+#include "BlockProcessor.h"
+
+FilterProcessor::FilterProcessor(size_t num_channels, double sample_rate, const std::vector<BiquadParams>& sections)
+	: cascade_(num_channels, sample_rate, sections), channels_(num_channels)
+{
+	// Ramps are smooth already, envelopes are lines and set parameters are smoothed,
+	// so sections follow them without a glide of their own
+	cascade_.SetSmoothingTime(0.);
+}
+
+void FilterProcessor::Process(WavFile<float>& wav, const FrameRange& range, size_t, const float* const* ramps)
+{
+	for (size_t i = 0; i < channels_.size(); i++)
+		channels_[i] = wav.samples[i].data() + range.begin;
+
+	cascade_.Process(channels_.data(), range.GetLength(), ramps);
+}
+
+DelayProcessor::DelayProcessor(size_t num_channels, uint32_t sample_rate, size_t num_frames, const std::vector<Delay>& delays,
+	size_t channel)
+	: channel_(channel)
+{
+	if (channel != kAllChannels && channel >= num_channels)
+		throw std::out_of_range("Channel");
+
+	for (const auto& delay : delays)
+	{
+		if (delay.millis <= 0 || delay.millis * 0.001 > static_cast<double>(num_frames) / sample_rate)
+			throw std::out_of_range("Delay time");
+
+		if (delay.decay <= 0)
+			throw std::invalid_argument("Decay must be greater than 0");
+
+		// Same rounding as ApplyDelay
+		const size_t delay_frames = static_cast<size_t>(static_cast<float>(delay.millis) * (sample_rate / 1000.f));
+		lines_.push_back({ delay.decay, std::vector<std::vector<float>>(num_channels, std::vector<float>(delay_frames, 0.f)) });
+	}
+}
+
+void DelayProcessor::Process(WavFile<float>& wav, const FrameRange& range, size_t, const float* const*)
+{
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	for (auto& line : lines_)
+	{
+		const size_t length = line.history[0].size();
+		for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+		{
+			if (channel_ != kAllChannels && channel != channel_)
+				continue;
+
+			// History starts silent, so the frames before the first echo get nothing added
+			float* samples = wav.samples[channel].data();
+			float* history = line.history[channel].data();
+			size_t position = line.position;
+			for (size_t i = frames.begin; i < frames.end; )
+			{
+				const size_t count = std::min(frames.end - i, length - position);
+				for (size_t j = 0; j < count; j++)
+				{
+					samples[i + j] += history[position + j] * line.decay;
+					history[position + j] = samples[i + j];
+				}
+
+				i += count;
+				position = (position + count) % length;
+			}
+		}
+
+		line.position = (line.position + frames.GetLength()) % length;
+	}
+}
+
+ModulatedDelayProcessor::ModulatedDelayProcessor(size_t num_channels, double sample_rate, const ModulatedDelayParams& params)
+	: delay_(num_channels, sample_rate, params), channels_(num_channels)
+{
+}
+
+void ModulatedDelayProcessor::Process(WavFile<float>& wav, const FrameRange& range, size_t, const float* const*)
+{
+	for (size_t i = 0; i < channels_.size(); i++)
+		channels_[i] = wav.samples[i].data() + range.begin;
+
+	delay_.Process(channels_.data(), range.GetLength());
+}
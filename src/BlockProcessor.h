@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Biquad.h"
+#include "FrameRange.h"
+#include "ModulatedDelay.h"
+#include "WavFile.h"
+
+/**
+ * \brief Effect, that processes the file part by part in order and keeps its state between the parts
+ */
+class BlockProcessor
+{
+public:
+	virtual ~BlockProcessor() = default;
+
+	/**
+	 * \brief Process frames in range, that follow the frames of the previous call in the file
+	 * \param wav buffer, whose frame i is frame offset + i of the file
+	 * \param range frames of the buffer to process
+	 * \param offset frame of the file, that the buffer starts at
+	 * \param ramps values of every frame in range for the parameters, indexed like params of the effect
+	 *  up to its most parameters, nullptr entry keeps the parameter
+	 */
+	virtual void Process(WavFile<float>& wav, const FrameRange& range, size_t offset, const float* const* ramps) = 0;
+};
+
+/**
+ * \brief Cascade of biquad filters, parameters are indexed like eq parameters: type, freq, q and gain of every section
+ */
+class FilterProcessor final : public BlockProcessor
+{
+public:
+	/**
+	 * \throw invalid_argument invalid parameters of any section
+	 */
+	FilterProcessor(size_t num_channels, double sample_rate, const std::vector<BiquadParams>& sections);
+
+	void Process(WavFile<float>& wav, const FrameRange& range, size_t offset, const float* const* ramps) override;
+
+private:
+	BiquadCascade cascade_;
+	std::vector<float*> channels_;
+};
+
+/**
+ * \brief Delays with feedback, applied one after another, like ApplyDelay and ApplyReverberation
+ *
+ * Every delay keeps the last output frames of its length, so a part needs nothing of the file before it.
+ */
+class DelayProcessor final : public BlockProcessor
+{
+public:
+	static constexpr size_t kAllChannels = static_cast<size_t>(-1);
+
+	struct Delay
+	{
+		int millis = 0;
+		float decay = 0.f;
+	};
+
+	/**
+	 * \param num_channels number of channels
+	 * \param sample_rate sample rate
+	 * \param num_frames length of the file
+	 * \param delays delays, applied in order
+	 * \param channel channel, that delays are applied to, or kAllChannels
+	 * \throw out_of_range channel or delay time out of range
+	 * \throw invalid_argument decay <= 0
+	 */
+	DelayProcessor(size_t num_channels, uint32_t sample_rate, size_t num_frames, const std::vector<Delay>& delays,
+		size_t channel = kAllChannels);
+
+	void Process(WavFile<float>& wav, const FrameRange& range, size_t offset, const float* const* ramps) override;
+
+private:
+	struct Line
+	{
+		float decay;
+		// Last output frames of every channel, written circularly
+		std::vector<std::vector<float>> history;
+		size_t position = 0;
+	};
+
+	std::vector<Line> lines_;
+	size_t channel_;
+};
+
+/**
+ * \brief Modulated delay of chorus, flanger or vibrato, its LFO continues from the previous part
+ */
+class ModulatedDelayProcessor final : public BlockProcessor
+{
+public:
+	/**
+	 * \throw invalid_argument invalid parameters
+	 */
+	ModulatedDelayProcessor(size_t num_channels, double sample_rate, const ModulatedDelayParams& params);
+
+	void Process(WavFile<float>& wav, const FrameRange& range, size_t offset, const float* const* ramps) override;
+
+private:
+	ModulatedDelay delay_;
+	std::vector<float*> channels_;
+};
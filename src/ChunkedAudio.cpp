@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+#include "ChunkedAudio.h"
+
+ChunkedAudio::ChunkedAudio(const WavFile<float>& wav)
+	: sample_rate_(wav.sampleRate), bit_depth_(wav.bitDepth), num_frames_(wav.GetNumSamplesPerChannel()),
+	channels_(wav.GetNumChannels())
+{
+	const size_t num_chunks = (num_frames_ + kChunkFrames - 1) / kChunkFrames;
+	for (size_t channel = 0; channel < channels_.size(); channel++)
+	{
+		const auto& samples = wav.samples[channel];
+		channels_[channel].reserve(num_chunks);
+		for (size_t begin = 0; begin < num_frames_; begin += kChunkFrames)
+		{
+			const size_t end = std::min(num_frames_, begin + kChunkFrames);
+			channels_[channel].push_back(std::make_shared<std::vector<float>>(samples.begin() + begin, samples.begin() + end));
+		}
+	}
+}
+
+uint32_t ChunkedAudio::GetSampleRate() const
+{
+	return sample_rate_;
+}
+
+int ChunkedAudio::GetBitDepth() const
+{
+	return bit_depth_;
+}
+
+size_t ChunkedAudio::GetNumChannels() const
+{
+	return channels_.size();
+}
+
+size_t ChunkedAudio::GetNumFrames() const
+{
+	return num_frames_;
+}
+
+void ChunkedAudio::Write(const WavFile<float>& wav, const FrameRange& range)
+{
+	if (!HasLayout(wav))
+		throw std::invalid_argument("Wave file has another layout than the chunked samples");
+
+	const auto frames = range.Clamp(num_frames_);
+	const auto [first, last] = GetChunks(frames);
+	for (size_t channel = 0; channel < channels_.size(); channel++)
+	{
+		for (size_t idx = first; idx < last; idx++)
+		{
+			// Copy on write: chunk of another storage stays as it was
+			auto& chunk = channels_[channel][idx];
+			if (chunk.use_count() > 1)
+				chunk = std::make_shared<std::vector<float>>(*chunk);
+
+			const size_t chunk_begin = idx * kChunkFrames;
+			const size_t begin = std::max(frames.begin, chunk_begin);
+			const size_t end = std::min(frames.end, chunk_begin + chunk->size());
+			std::copy(wav.samples[channel].begin() + begin, wav.samples[channel].begin() + end, chunk->begin() + (begin - chunk_begin));
+		}
+	}
+}
+
+void ChunkedAudio::Read(WavFile<float>& wav, const FrameRange& range) const
+{
+	if (!HasLayout(wav))
+		throw std::invalid_argument("Wave file has another layout than the chunked samples");
+
+	const auto frames = range.Clamp(num_frames_);
+	const auto [first, last] = GetChunks(frames);
+	for (size_t channel = 0; channel < channels_.size(); channel++)
+	{
+		for (size_t idx = first; idx < last; idx++)
+		{
+			const auto& chunk = *channels_[channel][idx];
+			const size_t chunk_begin = idx * kChunkFrames;
+			const size_t begin = std::max(frames.begin, chunk_begin);
+			const size_t end = std::min(frames.end, chunk_begin + chunk.size());
+			std::copy(chunk.begin() + (begin - chunk_begin), chunk.begin() + (end - chunk_begin), wav.samples[channel].begin() + begin);
+		}
+	}
+}
+
+size_t ChunkedAudio::GetMemoryUsage(const std::vector<const ChunkedAudio*>& storages)
+{
+	std::unordered_set<const std::vector<float>*> counted;
+	size_t bytes = 0;
+
+	for (const auto* storage : storages)
+		for (const auto& channel : storage->channels_)
+			for (const auto& chunk : channel)
+				if (counted.insert(chunk.get()).second)
+					bytes += chunk->size() * sizeof(float);
+
+	return bytes;
+}
+
+std::pair<size_t, size_t> ChunkedAudio::GetChunks(const FrameRange& range) const
+{
+	const auto frames = range.Clamp(num_frames_);
+	if (frames.IsEmpty())
+		return { 0, 0 };
+
+	return { frames.begin / kChunkFrames, (frames.end + kChunkFrames - 1) / kChunkFrames };
+}
+
+bool ChunkedAudio::HasLayout(const WavFile<float>& wav) const
+{
+	return wav.GetNumChannels() == channels_.size() && wav.GetNumSamplesPerChannel() == num_frames_;
+}
+
+void AudioMirror::Sync(const ChunkedAudio& audio, const FrameRange& range)
+{
+	buffer_.sampleRate = audio.sample_rate_;
+	buffer_.bitDepth = audio.bit_depth_;
+	if (!audio.HasLayout(buffer_))
+	{
+		buffer_.samples.assign(audio.GetNumChannels(), std::vector<float>(audio.GetNumFrames()));
+		held_.clear();
+	}
+	ResizeHeld(audio);
+
+	const auto [first, last] = audio.GetChunks(range);
+	for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+	{
+		for (size_t idx = first; idx < last; idx++)
+		{
+			// Weak pointer of the held chunk keeps its memory block, so a new chunk can't take its address
+			const auto& chunk = audio.channels_[channel][idx];
+			auto& held = held_[channel][idx];
+			if (held.lock() == chunk)
+				continue;
+
+			std::copy(chunk->begin(), chunk->end(), buffer_.samples[channel].begin() + idx * ChunkedAudio::kChunkFrames);
+			held = chunk;
+		}
+	}
+}
+
+void AudioMirror::Hold(const ChunkedAudio& audio, const FrameRange& range)
+{
+	if (!audio.HasLayout(buffer_))
+		throw std::invalid_argument("Wave file has another layout than the chunked samples");
+
+	ResizeHeld(audio);
+
+	const auto [first, last] = audio.GetChunks(range);
+	for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+		for (size_t idx = first; idx < last; idx++)
+			held_[channel][idx] = audio.channels_[channel][idx];
+}
+
+void AudioMirror::Invalidate(const FrameRange& range)
+{
+	const size_t num_frames = buffer_.GetNumSamplesPerChannel();
+	const auto frames = range.Clamp(num_frames);
+	if (frames.IsEmpty())
+		return;
+
+	const size_t first = frames.begin / ChunkedAudio::kChunkFrames;
+	const size_t last = (frames.end + ChunkedAudio::kChunkFrames - 1) / ChunkedAudio::kChunkFrames;
+	for (auto& channel : held_)
+		for (size_t idx = first; idx < std::min(last, channel.size()); idx++)
+			channel[idx].reset();
+}
+
+WavFile<float>& AudioMirror::GetBuffer()
+{
+	return buffer_;
+}
+
+void AudioMirror::ResizeHeld(const ChunkedAudio& audio)
+{
+	const size_t num_chunks = audio.GetChunks(FrameRange()).second;
+	const bool same = held_.size() == audio.GetNumChannels() && std::all_of(held_.begin(), held_.end(), [num_chunks](const auto& channel) {
+		return channel.size() == num_chunks;
+	});
+	if (!same)
+		held_.assign(audio.GetNumChannels(), std::vector<std::weak_ptr<std::vector<float>>>(num_chunks));
+}
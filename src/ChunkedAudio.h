@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "FrameRange.h"
+#include "WavFile.h"
+
+/**
+ * \brief Samples split into reference-counted chunks with copy-on-write
+ *
+ * Copy of the storage shares every chunk, writing frames copies only the shared chunks,
+ * that they touch. So a copy kept for undo or as a cache costs only the chunks edited after it,
+ * and a chunk, that isn't the same object in two storages, is the one edited.
+ */
+class ChunkedAudio
+{
+public:
+	// Frames per chunk
+	static constexpr size_t kChunkFrames = 64 * 1024;
+
+	ChunkedAudio() = default;
+
+	/**
+	 * \brief Split samples of the wave file into new chunks
+	 */
+	explicit ChunkedAudio(const WavFile<float>& wav);
+
+	[[nodiscard]] uint32_t GetSampleRate() const;
+	[[nodiscard]] int GetBitDepth() const;
+	[[nodiscard]] size_t GetNumChannels() const;
+	[[nodiscard]] size_t GetNumFrames() const;
+
+	/**
+	 * \brief Copy frames of the range from the wave file. Chunks of the range are copied first,
+	 * if they are shared, other chunks stay shared
+	 * \throw invalid_argument wave file has another number of channels or frames
+	 */
+	void Write(const WavFile<float>& wav, const FrameRange& range);
+
+	/**
+	 * \brief Copy frames of the range into the wave file
+	 * \throw invalid_argument wave file has another number of channels or frames
+	 */
+	void Read(WavFile<float>& wav, const FrameRange& range) const;
+
+	/**
+	 * \brief Memory of the chunks of all storages, shared chunks are counted once, bytes
+	 */
+	[[nodiscard]] static size_t GetMemoryUsage(const std::vector<const ChunkedAudio*>& storages);
+
+private:
+	friend class AudioMirror;
+
+	typedef std::shared_ptr<std::vector<float>> Chunk;
+
+	/**
+	 * \brief Chunks, that hold frames of the range, [first, last)
+	 */
+	[[nodiscard]] std::pair<size_t, size_t> GetChunks(const FrameRange& range) const;
+
+	[[nodiscard]] bool HasLayout(const WavFile<float>& wav) const;
+
+	uint32_t sample_rate_ = 0;
+	int bit_depth_ = 0;
+	size_t num_frames_ = 0;
+
+	// Outer container is channels, inner is chunks
+	std::vector<std::vector<Chunk>> channels_;
+};
+
+/**
+ * \brief Flat wave file, that holds samples of chunked storages
+ *
+ * Effects process flat buffers. Mirror remembers the chunk, that every part of its buffer holds,
+ * without keeping it alive or shared, so switching to a storage, that shares most chunks
+ * with the held one, copies only the chunks, that differ.
+ */
+class AudioMirror
+{
+public:
+	/**
+	 * \brief Make the chunks of the buffer, that hold frames of the range, hold the storage.
+	 * Buffer takes format of the storage, if its layout changes, no chunk is held anymore,
+	 * so empty range only sets the format
+	 */
+	void Sync(const ChunkedAudio& audio, const FrameRange& range = FrameRange());
+
+	/**
+	 * \brief Remember, that chunks of the range hold the storage, after the buffer was written into it
+	 */
+	void Hold(const ChunkedAudio& audio, const FrameRange& range = FrameRange());
+
+	/**
+	 * \brief Forget chunks of the range, the buffer is going to be changed there
+	 */
+	void Invalidate(const FrameRange& range = FrameRange());
+
+	/**
+	 * \brief Buffer, changes must be announced by Invalidate or Hold
+	 */
+	[[nodiscard]] WavFile<float>& GetBuffer();
+
+private:
+	/**
+	 * \brief Forget every chunk, if the storage has another number of channels or chunks
+	 */
+	void ResizeHeld(const ChunkedAudio& audio);
+
+	WavFile<float> buffer_;
+	std::vector<std::vector<std::weak_ptr<std::vector<float>>>> held_;
+};
@@ -0,0 +1,125 @@
+#include <cstdint>
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef CPU_X86
+	struct CpuidRegisters
+	{
+		uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+	};
+
+	CpuidRegisters Cpuid(uint32_t leaf, uint32_t subleaf = 0)
+	{
+		CpuidRegisters regs;
+#ifdef _MSC_VER
+		int values[4];
+		__cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+		regs = { static_cast<uint32_t>(values[0]), static_cast<uint32_t>(values[1]), static_cast<uint32_t>(values[2]), static_cast<uint32_t>(values[3]) };
+#else
+		__cpuid_count(leaf, subleaf, regs.eax, regs.ebx, regs.ecx, regs.edx);
+#endif
+		return regs;
+	}
+
+	/**
+	 * \brief Register states, that the OS saves on context switch (XCR0)
+	 */
+	uint64_t GetEnabledStates()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return static_cast<uint64_t>(edx) << 32 | eax;
+#endif
+	}
+
+	bool HasBit(uint32_t value, int bit)
+	{
+		return (value >> bit & 1) != 0;
+	}
+
+	CpuFeatures Detect()
+	{
+		CpuFeatures features;
+		const uint32_t max_leaf = Cpuid(0).eax;
+		if (max_leaf < 1)
+			return features;
+
+		const auto leaf1 = Cpuid(1);
+		features.sse2 = HasBit(leaf1.edx, 26);
+		features.sse41 = HasBit(leaf1.ecx, 19);
+		features.sse42 = HasBit(leaf1.ecx, 20);
+
+		// AVX registers are usable, only if the OS saves them: SSE and AVX states, and 3 AVX-512 states
+		const bool os_saves_avx = HasBit(leaf1.ecx, 27) && (GetEnabledStates() & 0x6) == 0x6;
+		const bool os_saves_avx512 = os_saves_avx && (GetEnabledStates() & 0xE6) == 0xE6;
+		features.avx = os_saves_avx && HasBit(leaf1.ecx, 28);
+		features.fma = features.avx && HasBit(leaf1.ecx, 12);
+
+		if (max_leaf >= 7)
+		{
+			const auto leaf7 = Cpuid(7);
+			features.avx2 = features.avx && HasBit(leaf7.ebx, 5);
+			features.avx512f = os_saves_avx512 && HasBit(leaf7.ebx, 16);
+			features.avx512cd = features.avx512f && HasBit(leaf7.ebx, 28);
+			features.avx512bw = features.avx512f && HasBit(leaf7.ebx, 30);
+			features.avx512dq = features.avx512f && HasBit(leaf7.ebx, 17);
+			features.avx512vl = features.avx512f && HasBit(leaf7.ebx, 31);
+		}
+
+		return features;
+	}
+#else
+	CpuFeatures Detect()
+	{
+		return CpuFeatures();
+	}
+#endif
+}
+
+const CpuFeatures& CpuFeatures::Get()
+{
+	static const CpuFeatures features = Detect();
+	return features;
+}
+
+SimdLevel CpuFeatures::GetSimdLevel() const
+{
+	const bool has_avx2 = avx2 && fma;
+	if (has_avx2 && avx512f && avx512cd && avx512bw && avx512dq && avx512vl)
+		return kSimdAvx512;
+	if (has_avx2)
+		return kSimdAvx2;
+	if (sse2)
+		return kSimdSse2;
+	return kSimdScalar;
+}
+
+bool CpuFeatures::Supports(SimdLevel level) const
+{
+	return level <= GetSimdLevel();
+}
+
+const char* GetSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+		case kSimdSse2: return "sse2";
+		case kSimdAvx2: return "avx2";
+		case kSimdAvx512: return "avx512";
+		default: return "scalar";
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * \brief Instruction set of the SIMD kernels, every level includes the previous ones
+ */
+enum SimdLevel
+{
+	kSimdScalar = 1,
+	kSimdSse2,
+	kSimdAvx2,
+	kSimdAvx512
+};
+
+/**
+ * \brief Instruction set extensions of the CPU, that the OS saves the registers of
+ */
+struct CpuFeatures
+{
+	bool sse2 = false;
+	bool sse41 = false;
+	bool sse42 = false;
+	bool avx = false;
+	bool avx2 = false;
+	bool fma = false;
+	bool avx512f = false;
+	bool avx512cd = false;
+	bool avx512bw = false;
+	bool avx512dq = false;
+	bool avx512vl = false;
+
+	/**
+	 * \brief Features of the CPU, detected by cpuid on the first call
+	 */
+	[[nodiscard]] static const CpuFeatures& Get();
+
+	/**
+	 * \brief Highest SIMD level, that the CPU runs. Levels require every extension, that their
+	 * translation units may be compiled to: AVX2 with FMA, AVX-512 with CD, BW, DQ and VL like /arch:AVX512
+	 */
+	[[nodiscard]] SimdLevel GetSimdLevel() const;
+
+	[[nodiscard]] bool Supports(SimdLevel level) const;
+};
+
+/**
+ * \brief Name of the level, as it's given in WAV_EFFECTS_SIMD: scalar, sse2, avx2 or avx512
+ */
+[[nodiscard]] const char* GetSimdLevelName(SimdLevel level);
@@ -0,0 +1,32 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DENORMAL_GUARD_SSE
+#include <xmmintrin.h>
+#endif
+
+/**
+ * \brief Flush denormals to zero while alive, decaying recursion produces them and they are very slow on x86
+ */
+class DenormalGuard
+{
+public:
+#ifdef DENORMAL_GUARD_SSE
+	DenormalGuard() : csr_(_mm_getcsr())
+	{
+		// Flush-to-zero and denormals-are-zero
+		_mm_setcsr(csr_ | 0x8040);
+	}
+
+	~DenormalGuard()
+	{
+		_mm_setcsr(csr_);
+	}
+
+	DenormalGuard(const DenormalGuard&) = delete;
+	DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+private:
+	unsigned int csr_;
+#endif
+};
@@ -0,0 +1,1037 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include "EffectChain.h"
+#include "AudioInfo.h"
+#include "BlockProcessor.h"
+#include "Effects.h"
+#include "ScratchArena.h"
+#include "Silence.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace effects;
+
+namespace
+{
+	typedef vector<float> Params;
+
+	struct EffectInfo
+	{
+		const char* name;
+		const char* usage;
+		size_t min_params;
+		size_t max_params;
+		EffectLocality locality;
+
+		// Apply effect to the frames in range, global effects process whole file
+		void (*apply)(WavFile<float>& wav, const FrameRange& range, const Params& p);
+
+		// Frames that effect may modify, nullptr if it's whole file
+		FrameRange (*affected)(const WavFile<float>& wav, const Params& p);
+
+		// Bit mask of parameters, that may change in time
+		unsigned automatable = 0;
+
+		// Apply effect to the frames in range with automatable parameters taken from ramps,
+		// that hold value of every frame in range
+		void (*apply_automated)(WavFile<float>& wav, const FrameRange& range, const Params& p, const float* const* ramps) = nullptr;
+
+		// Output frame depends only on the same input frame and not on its position,
+		// so blocks of frames may be processed apart from the file
+		bool time_invariant = false;
+
+		// Frames of input, after which the state of the time invariant effect settles below kSettleLevel,
+		// so a segment may be processed apart from the file with such pre-roll. nullptr if effect can't be split
+		size_t (*settle)(const WavFile<float>& wav, const Params& p) = nullptr;
+
+		// Whether the time invariant effect keeps every block at or below the silence threshold (dB) under it,
+		// so silent blocks may skip it without the output depending on the threshold. nullptr if it doesn't
+		bool (*keeps_silence)(const Params& p, float silence_db) = nullptr;
+
+		// Processor of consecutive parts of the file, that keeps state of the effect between them,
+		// so automated parameters may change while it runs. nullptr if the effect has no state
+		std::unique_ptr<BlockProcessor> (*make_processor)(const AudioInfo& format, const Params& p) = nullptr;
+
+		// Apply pointwise effect, that depends on the frame position, to the frames in range of the part of the file,
+		// that starts at frame offset of the file num_frames long. nullptr if the effect is time invariant
+		void (*apply_part)(WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, const Params& p) = nullptr;
+
+		// Effect makes mono file stereo
+		bool makes_stereo = false;
+	};
+
+	// Frames of automated parameters rendered at once
+	constexpr size_t kAutomationBlock = 256;
+	constexpr size_t kMaxAutomatedParams = 4;
+
+	// Level of the input before the pre-roll, that is left in the segment, -120 dB
+	constexpr double kSettleLevel = 1e-6;
+	// Segments per thread of the segment-parallel processing, so threads finish close to each other
+	constexpr size_t kSegmentsPerThread = 2;
+	// Segment is at least this long and 4 times longer than its pre-roll
+	constexpr size_t kMinSegmentFrames = 64 * 1024;
+	constexpr size_t kMinSegmentsPerPreRoll = 4;
+
+	float ParamOr(const Params& p, size_t idx, float default_value)
+	{
+		return idx < p.size() ? p[idx] : default_value;
+	}
+
+	size_t SecondsToFrames(const WavFile<float>& wav, float seconds)
+	{
+		return static_cast<size_t>(std::max(0.f, seconds) * wav.sampleRate);
+	}
+
+	void Normalize(WavFile<float>& wav, const Params& p, const Levels* levels)
+	{
+		const auto type = static_cast<NormalizeType>(ParamOr(p, 1, kNormalizeLoudness));
+		const auto ceiling = ParamOr(p, 2, -1.f);
+
+		if (levels != nullptr)
+			ApplyNormalize(wav, *levels, p[0], type, ceiling);
+		else
+			ApplyNormalize(wav, p[0], type, ceiling);
+	}
+
+	/**
+	 * \brief Frames, until the echoes of the delay decay below kSettleLevel, kEnd if it's longer than the file
+	 */
+	size_t GetDelaySettleFrames(const WavFile<float>& wav, int delay_millis, float decay)
+	{
+		if (delay_millis <= 0 || !(decay > 0.f && decay < 1.f))
+			return FrameRange::kEnd;
+
+		const auto delay_frames = static_cast<size_t>(static_cast<float>(delay_millis) * (wav.sampleRate / 1000.f));
+		const double frames = delay_frames * std::ceil(std::log(kSettleLevel) / std::log(decay));
+		return frames < static_cast<double>(wav.GetNumSamplesPerChannel()) ? static_cast<size_t>(frames) : FrameRange::kEnd;
+	}
+
+	/**
+	 * \brief Frames, until the impulse response of the filter sections decays below kSettleLevel,
+	 * kEnd if it's longer than the file
+	 */
+	size_t GetFilterSettleFrames(const WavFile<float>& wav, const vector<BiquadParams>& sections)
+	{
+		double frames = 0.;
+		for (const auto& section : sections)
+		{
+			BiquadCoefficients coefficients;
+			try
+			{
+				coefficients = BiquadCoefficients::Design(section, wav.sampleRate);
+			}
+			catch (invalid_argument&)
+			{
+				return FrameRange::kEnd;
+			}
+
+			// Radius of the larger pole of z^2 + a1 z + a2
+			const double a1 = coefficients.a1;
+			const double a2 = coefficients.a2;
+			const double discriminant = a1 * a1 - 4. * a2;
+			const double radius = discriminant < 0. ? std::sqrt(a2) : (std::abs(a1) + std::sqrt(discriminant)) / 2.;
+			if (radius >= 1.)
+				return FrameRange::kEnd;
+
+			// Slowly decaying response has high gain, about 1 / (1 - radius)
+			if (radius > 0.)
+				frames += std::ceil(std::log(kSettleLevel * (1. - radius)) / std::log(radius));
+		}
+
+		return frames < static_cast<double>(wav.GetNumSamplesPerChannel()) ? static_cast<size_t>(frames) : FrameRange::kEnd;
+	}
+
+	/**
+	 * \brief Filter sections from parameters, grouped by `type,freq,q,gain`
+	 */
+	vector<BiquadParams> ToFilterSections(const Params& p)
+	{
+		if (p.size() % 4 != 0)
+			throw invalid_argument("Every eq band needs type, freq, q and gain");
+
+		vector<BiquadParams> sections;
+		for (size_t i = 0; i < p.size(); i += 4)
+			sections.push_back({ static_cast<FilterType>(p[i]), p[i + 1], p[i + 2], p[i + 3] });
+		return sections;
+	}
+
+	const EffectInfo kEffects[] = {
+		{ "mono_to_stereo", "", 0, 0, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params&) {
+			if (wav.IsMono())
+				MonoToStereo(wav);
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, nullptr, nullptr, true },
+		{ "reverse", "", 0, 0, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params&) {
+			ApplyReverse(wav);
+		}, nullptr },
+		{ "volume", "db", 1, 1, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			ApplyVolume(wav, range, p[0]);
+		}, nullptr, 0b1, [](WavFile<float>& wav, const FrameRange& range, const Params&, const float* const* r) {
+			ApplyVolume(wav, range, r[0]);
+		}, true, nullptr, [](const Params& p, float silence_db) {
+			// Gain would lift quiet samples above the threshold, digital silence stays zero at any gain
+			return p[0] <= 0.f || silence_db == kDigitalSilence;
+		} },
+		{ "reverb", "", 0, 0, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params&) {
+			ApplyReverberation(wav);
+		}, nullptr, 0, nullptr, false, [](const WavFile<float>& wav, const Params&) {
+			// Delays of ApplyReverberation
+			const size_t frames[] = { GetDelaySettleFrames(wav, 100, 0.75f), GetDelaySettleFrames(wav, 250, 0.35f), GetDelaySettleFrames(wav, 500, 0.15f) };
+			return frames[0] + frames[1] + frames[2];
+		}, nullptr, [](const AudioInfo& format, const Params&) -> unique_ptr<BlockProcessor> {
+			return make_unique<DelayProcessor>(format.num_channels, format.sample_rate, format.num_frames,
+				vector<DelayProcessor::Delay>{ { 100, 0.75f }, { 250, 0.35f }, { 500, 0.15f } });
+		} },
+		{ "rotating", "rate", 1, 1, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			if (wav.IsMono())
+				MonoToStereo(wav);
+			ApplyRotatingStereo(wav, range, p[0]);
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, nullptr, [](WavFile<float>& wav, const FrameRange& range, size_t offset, size_t, const Params& p) {
+			ApplyRotatingStereo(wav, range, offset, p[0]);
+		}, true },
+		{ "fade_in", "seconds[,curve]", 1, 2, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			ApplyFadeIn(wav, range, p[0], static_cast<CurveType>(ParamOr(p, 1, kLinear)));
+		}, [](const WavFile<float>& wav, const Params& p) {
+			return FrameRange{ 0, SecondsToFrames(wav, p[0]) + 1 };
+		}, 0, nullptr, false, nullptr, nullptr, nullptr, [](WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, const Params& p) {
+			ApplyFadeIn(wav, range, offset, num_frames, p[0], static_cast<CurveType>(ParamOr(p, 1, kLinear)));
+		} },
+		{ "fade_out", "seconds[,curve]", 1, 2, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			ApplyFadeOut(wav, range, p[0], static_cast<CurveType>(ParamOr(p, 1, kLinear)));
+		}, [](const WavFile<float>& wav, const Params& p) {
+			const auto num_frames = wav.GetNumSamplesPerChannel();
+			return FrameRange{ num_frames - std::min(num_frames, SecondsToFrames(wav, p[0]) + 1), num_frames };
+		}, 0, nullptr, false, nullptr, nullptr, nullptr, [](WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, const Params& p) {
+			ApplyFadeOut(wav, range, offset, num_frames, p[0], static_cast<CurveType>(ParamOr(p, 1, kLinear)));
+		} },
+		{ "tremolo", "freq[,dry]", 1, 2, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			const auto dry = ParamOr(p, 1, 0.5f);
+			ApplyTremolo(wav, range, p[0], dry, 1.f - dry);
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, nullptr, [](WavFile<float>& wav, const FrameRange& range, size_t offset, size_t, const Params& p) {
+			const auto dry = ParamOr(p, 1, 0.5f);
+			ApplyTremolo(wav, range, offset, p[0], dry, 1.f - dry);
+		} },
+		{ "delay", "millis,decay[,channel]", 2, 3, kCausal, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			if (p.size() == 3)
+				ApplyDelay(wav, static_cast<size_t>(p[2]), range, static_cast<int>(p[0]), p[1]);
+			else
+				ApplyDelay(wav, range, static_cast<int>(p[0]), p[1]);
+		}, [](const WavFile<float>& wav, const Params& p) {
+			return FrameRange{ SecondsToFrames(wav, p[0] / 1000.f), FrameRange::kEnd };
+		}, 0, nullptr, false, [](const WavFile<float>& wav, const Params& p) {
+			return GetDelaySettleFrames(wav, static_cast<int>(p[0]), p[1]);
+		}, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<DelayProcessor>(format.num_channels, format.sample_rate, format.num_frames,
+				vector<DelayProcessor::Delay>{ { static_cast<int>(p[0]), p[1] } },
+				p.size() == 3 ? static_cast<size_t>(p[2]) : DelayProcessor::kAllChannels);
+		} },
+		{ "compressor", "threshold,ratio[,downward]", 2, 3, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			ApplyCompressor(wav, range, p[0], p[1], ParamOr(p, 2, 1.f) != 0.f);
+		}, nullptr, 0b11, [](WavFile<float>& wav, const FrameRange& range, const Params& p, const float* const* r) {
+			ApplyCompressor(wav, range, r[0], r[1], ParamOr(p, 2, 1.f) != 0.f);
+		}, true, nullptr, [](const Params& p, float silence_db) {
+			// Upward compressor raises quiet samples, and even zero as lin_to_db never goes below -80 dB.
+			// Downward one leaves the samples below its threshold as they are
+			return ParamOr(p, 2, 1.f) != 0.f && p[0] >= lin_to_db(db_to_lin(silence_db));
+		} },
+		{ "distortion", "drive,blend[,volume]", 2, 3, kPointwise, [](WavFile<float>& wav, const FrameRange& range, const Params& p) {
+			ApplyDistortion(wav, range, p[0], p[1], ParamOr(p, 2, 1.f));
+		}, nullptr, 0b11, [](WavFile<float>& wav, const FrameRange& range, const Params& p, const float* const* r) {
+			ApplyDistortion(wav, range, r[0], r[1], ParamOr(p, 2, 1.f));
+		}, true, nullptr, [](const Params&, float silence_db) {
+			// Drive lifts quiet samples by up to 60 dB, only zero stays where it was
+			return silence_db == kDigitalSilence;
+		} },
+		{ "normalize", "target[,type[,ceiling]]", 1, 3, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			Normalize(wav, p, nullptr);
+		}, nullptr },
+		// Filter state depends on the input before the range, which is not kept, so filters are global.
+		// Automated filters run by their processor, that keeps the state between the ramps
+		{ "filter", "type,freq[,q[,gain]]", 2, 4, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyFilter(wav, static_cast<FilterType>(p[0]), p[1], ParamOr(p, 2, 0.70710678f), ParamOr(p, 3, 0.f));
+		}, nullptr, 0b1110, nullptr, false, [](const WavFile<float>& wav, const Params& p) {
+			return GetFilterSettleFrames(wav, { { static_cast<FilterType>(p[0]), p[1], ParamOr(p, 2, 0.70710678f), ParamOr(p, 3, 0.f) } });
+		}, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<FilterProcessor>(format.num_channels, format.sample_rate,
+				vector<BiquadParams>{ { static_cast<FilterType>(p[0]), p[1], ParamOr(p, 2, 0.70710678f), ParamOr(p, 3, 0.f) } });
+		} },
+		{ "eq", "type,freq,q,gain[,type,freq,q,gain...]", 4, 32, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyFilterBank(wav, ToFilterSections(p));
+		}, nullptr, 0xEEEEEEEE, nullptr, false, [](const WavFile<float>& wav, const Params& p) {
+			return p.size() % 4 == 0 ? GetFilterSettleFrames(wav, ToFilterSections(p)) : FrameRange::kEnd;
+		}, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<FilterProcessor>(format.num_channels, format.sample_rate, ToFilterSections(p));
+		} },
+		{ "time_stretch", "factor", 1, 1, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyTimeStretch(wav, p[0]);
+		}, nullptr },
+		{ "pitch_shift", "semitones", 1, 1, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyPitchShift(wav, p[0]);
+		}, nullptr },
+		{ "trim", "threshold[,padding]", 1, 2, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyTrim(wav, p[0], ParamOr(p, 1, 0.f));
+		}, nullptr },
+		// Delay line holds the fed back signal, not the output, so modulated delays process whole file,
+		// or run part by part from the beginning by their processors
+		{ "chorus", "rate,depth[,voices[,mix[,interpolation]]]", 2, 5, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyChorus(wav, p[0], p[1], static_cast<size_t>(ParamOr(p, 2, 3.f)), ParamOr(p, 3, 0.5f),
+				static_cast<InterpolationType>(ParamOr(p, 4, kInterpolateCubic)));
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<ModulatedDelayProcessor>(format.num_channels, format.sample_rate,
+				GetChorusParams(p[0], p[1], static_cast<size_t>(ParamOr(p, 2, 3.f)), ParamOr(p, 3, 0.5f),
+					static_cast<InterpolationType>(ParamOr(p, 4, kInterpolateCubic))));
+		} },
+		{ "flanger", "rate,depth[,feedback[,mix[,interpolation]]]", 2, 5, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyFlanger(wav, p[0], p[1], ParamOr(p, 2, 0.5f), ParamOr(p, 3, 0.5f),
+				static_cast<InterpolationType>(ParamOr(p, 4, kInterpolateCubic)));
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<ModulatedDelayProcessor>(format.num_channels, format.sample_rate,
+				GetFlangerParams(p[0], p[1], ParamOr(p, 2, 0.5f), ParamOr(p, 3, 0.5f),
+					static_cast<InterpolationType>(ParamOr(p, 4, kInterpolateCubic))));
+		} },
+		{ "vibrato", "rate,depth[,interpolation]", 2, 3, kGlobal, [](WavFile<float>& wav, const FrameRange&, const Params& p) {
+			ApplyVibrato(wav, p[0], p[1], static_cast<InterpolationType>(ParamOr(p, 2, kInterpolateCubic)));
+		}, nullptr, 0, nullptr, false, nullptr, nullptr, [](const AudioInfo& format, const Params& p) -> unique_ptr<BlockProcessor> {
+			return make_unique<ModulatedDelayProcessor>(format.num_channels, format.sample_rate,
+				GetVibratoParams(p[0], p[1], static_cast<InterpolationType>(ParamOr(p, 2, kInterpolateCubic))));
+		} },
+	};
+
+	const EffectInfo& FindEffect(const string& name)
+	{
+		for (const auto& info : kEffects)
+			if (name == info.name)
+				return info;
+
+		throw invalid_argument("Unknown effect: " + name);
+	}
+
+	bool HasEnvelopes(const EffectStep& step)
+	{
+		return std::any_of(step.envelopes.begin(), step.envelopes.end(), [](const Envelope& envelope) {
+			return !envelope.IsEmpty();
+		});
+	}
+
+	/**
+	 * \brief Whether the step has no tail and keeps silence below silence_db silent (volume, distortion,
+	 * downward compressor without envelopes), so it may skip silent blocks
+	 */
+	bool SkipsSilence(const EffectStep& step, float silence_db)
+	{
+		const auto& info = FindEffect(step.name);
+		return info.keeps_silence != nullptr && info.keeps_silence(step.params, silence_db) && !HasEnvelopes(step) && !step.HasRegion();
+	}
+
+	/**
+	 * \brief Apply step to the blocks of the range, that aren't silent
+	 */
+	void ApplyToSound(const EffectStep& step, WavFile<float>& wav, const SilenceMap& silence, const FrameRange& range = FrameRange())
+	{
+		const auto& info = FindEffect(step.name);
+		for (const auto& sound : silence.GetSoundRanges(range))
+			info.apply(wav, sound, step.params);
+	}
+
+	/**
+	 * \brief Apply step block by block, rendering ramps of automatable parameters into the scratch arena
+	 */
+	void ApplyAutomated(const EffectInfo& info, const EffectStep& step, WavFile<float>& wav, const FrameRange& range)
+	{
+		const float* block_ramps[kMaxAutomatedParams] = {};
+		const size_t num_params = std::min(step.params.size(), kMaxAutomatedParams);
+
+		ScratchScope scratch;
+		float* buffers[kMaxAutomatedParams] = {};
+		for (size_t i = 0; i < num_params; i++)
+			buffers[i] = scratch.Allocate<float>(kAutomationBlock);
+
+		const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+		for (size_t begin = frames.begin; begin < frames.end; begin += kAutomationBlock)
+		{
+			const size_t count = std::min(kAutomationBlock, frames.end - begin);
+			for (size_t i = 0; i < num_params; i++)
+			{
+				if ((info.automatable & (1u << i)) == 0)
+					continue;
+
+				if (i < step.envelopes.size() && !step.envelopes[i].IsEmpty())
+					step.envelopes[i].Render(buffers[i], begin, count, wav.sampleRate);
+				else
+					std::fill_n(buffers[i], count, step.params[i]);
+				block_ramps[i] = buffers[i];
+			}
+
+			info.apply_automated(wav, { begin, begin + count }, step.params, block_ramps);
+		}
+	}
+
+	/**
+	 * \brief Step processed part by part. Ramps of the automatable parameters are rendered into the scratch arena
+	 * for every part from their envelopes or values, state of the effect is kept by its processor,
+	 * pointwise effects compute frame positions from the offset of the part
+	 */
+	class StepProcessor final : public BlockProcessor
+	{
+	public:
+		StepProcessor(const EffectInfo& info, const EffectStep& step, const AudioInfo& format)
+			: info_(info), step_(step), sample_rate_(format.sample_rate), num_frames_(format.num_frames),
+			  ramps_(info.max_params, nullptr)
+		{
+			if (info.make_processor != nullptr)
+				effect_ = info.make_processor(format, step.params);
+
+			// Parameters are validated before the first part
+			WavFile<float> empty(format.sample_rate, format.bit_depth, WavFile<float>::AudioData(format.num_channels));
+			Process(empty, FrameRange::Empty(), 0, nullptr);
+		}
+
+		void Process(WavFile<float>& wav, const FrameRange& range, size_t offset, const float* const* ramps) override
+		{
+			ScratchScope scratch;
+			const bool automated = ramps != nullptr || HasEnvelopes(step_);
+			const size_t count = range.GetLength();
+			for (size_t i = 0; i < step_.params.size() && automated; i++)
+			{
+				if (!EffectChain::IsAutomatable(step_, i))
+					continue;
+
+				if (ramps != nullptr && ramps[i] != nullptr)
+				{
+					ramps_[i] = ramps[i];
+					continue;
+				}
+
+				float* buffer = scratch.Allocate<float>(count);
+				if (i < step_.envelopes.size() && !step_.envelopes[i].IsEmpty())
+					step_.envelopes[i].Render(buffer, offset + range.begin, count, sample_rate_);
+				else
+					std::fill_n(buffer, count, step_.params[i]);
+				ramps_[i] = buffer;
+			}
+
+			// Channels added by mono_to_stereo are copied by the caller, so it has nothing to do
+			if (effect_ != nullptr)
+				effect_->Process(wav, range, offset, automated ? ramps_.data() : nullptr);
+			else if (info_.apply_part != nullptr)
+				info_.apply_part(wav, range, offset, num_frames_, step_.params);
+			else if (info_.locality == kPointwise && automated)
+				info_.apply_automated(wav, range, step_.params, ramps_.data());
+			else if (info_.locality == kPointwise)
+				info_.apply(wav, range, step_.params);
+		}
+
+	private:
+		const EffectInfo& info_;
+		EffectStep step_;
+		uint32_t sample_rate_;
+		size_t num_frames_;
+		unique_ptr<BlockProcessor> effect_;
+		vector<const float*> ramps_;
+	};
+
+	AudioInfo GetFormat(const WavFile<float>& wav)
+	{
+		AudioInfo format;
+		format.sample_rate = wav.sampleRate;
+		format.bit_depth = wav.bitDepth;
+		format.num_channels = wav.GetNumChannels();
+		format.num_frames = wav.GetNumSamplesPerChannel();
+		return format;
+	}
+
+	/**
+	 * \brief Apply automated step, that has a block processor, to the whole file in blocks of kAutomationBlock,
+	 * so rendered ramps stay small
+	 */
+	void ApplyByProcessor(const EffectInfo& info, const EffectStep& step, WavFile<float>& wav)
+	{
+		StepProcessor processor(info, step, GetFormat(wav));
+		const size_t num_frames = wav.GetNumSamplesPerChannel();
+		for (size_t begin = 0; begin < num_frames; begin += kAutomationBlock)
+			processor.Process(wav, { begin, std::min(num_frames, begin + kAutomationBlock) }, 0, nullptr);
+	}
+
+	/**
+	 * \brief Apply step to the copy of its region as a whole file and put the result back
+	 */
+	void ApplyRegion(const EffectInfo& info, const EffectStep& step, WavFile<float>& wav, const FrameRange& region)
+	{
+		WavFile<float>::AudioData samples(wav.GetNumChannels());
+		for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+		{
+			const auto& in = wav.samples[channel];
+			samples[channel].assign(in.begin() + region.begin, in.begin() + region.end);
+		}
+
+		WavFile<float> part(wav.sampleRate, wav.bitDepth, std::move(samples));
+		if (HasEnvelopes(step) && info.make_processor != nullptr)
+			ApplyByProcessor(info, step, part);
+		else if (HasEnvelopes(step))
+			ApplyAutomated(info, step, part, FrameRange());
+		else
+			info.apply(part, FrameRange(), step.params);
+
+		// Rotating makes mono region stereo
+		if (wav.IsMono() && part.IsStereo())
+			MonoToStereo(wav);
+
+		for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+		{
+			auto& out = wav.samples[channel];
+			const auto& in = part.samples[channel];
+			if (in.size() == region.GetLength())
+			{
+				std::copy(in.begin(), in.end(), out.begin() + region.begin);
+				continue;
+			}
+
+			// Time stretch changes length of the region
+			out.erase(out.begin() + region.begin, out.begin() + region.end);
+			out.insert(out.begin() + region.begin, in.begin(), in.end());
+		}
+	}
+
+	/**
+	 * \brief Run task for every segment on the pool and wait for them, not for other tasks of the pool
+	 * \throw exception the first exception thrown by a task
+	 */
+	void RunSegments(ThreadPool& pool, size_t num_segments, const function<void(size_t)>& task)
+	{
+		mutex done_mutex;
+		condition_variable done_cv;
+		size_t remaining = num_segments;
+		exception_ptr error;
+
+		for (size_t segment = 0; segment < num_segments; segment++)
+		{
+			pool.Submit([&, segment] {
+				try
+				{
+					task(segment);
+				}
+				catch (...)
+				{
+					lock_guard<mutex> lock(done_mutex);
+					if (!error)
+						error = current_exception();
+				}
+
+				// Notified under the lock, so the waiting caller can't return before it
+				lock_guard<mutex> lock(done_mutex);
+				if (--remaining == 0)
+					done_cv.notify_all();
+			});
+		}
+
+		unique_lock<mutex> lock(done_mutex);
+		done_cv.wait(lock, [&] { return remaining == 0; });
+
+		if (error)
+			rethrow_exception(error);
+	}
+
+	/**
+	 * \brief Apply steps to the segments of the file in parallel
+	 * \param in_place steps are pointwise and process segments in place, otherwise they process their copies
+	 * \param pre_roll frames of input before a segment, that its steps need
+	 * \param silence_db threshold of silent blocks, that steps without a tail skip in place
+	 */
+	void ApplyToSegments(ThreadPool& pool, const vector<EffectStep>& steps, WavFile<float>& wav, bool in_place, size_t pre_roll,
+		float silence_db)
+	{
+		const size_t num_frames = wav.GetNumSamplesPerChannel();
+		const size_t min_segment = std::max(kMinSegmentFrames, pre_roll * kMinSegmentsPerPreRoll);
+		const size_t num_segments = std::min(pool.GetNumThreads() * kSegmentsPerThread, num_frames / min_segment);
+		if (num_segments < 2)
+		{
+			for (const auto& step : steps)
+				EffectChain::ApplyStep(step, wav);
+			return;
+		}
+
+		StageTimer timer("segments", num_frames * wav.GetNumChannels());
+		auto get_segment = [&](size_t segment) {
+			return FrameRange{ num_frames * segment / num_segments, num_frames * (segment + 1) / num_segments };
+		};
+
+		if (in_place)
+		{
+			// Steps change layout (e.g. mono to stereo) here, not in the segments
+			for (const auto& step : steps)
+				EffectChain::ApplyStepInRange(step, wav, FrameRange::Empty());
+
+			// Silent blocks are found once, steps skip them, so they stay silent for the next steps
+			const bool skip_silence = std::all_of(steps.begin(), steps.end(), [silence_db](const EffectStep& step) {
+				return SkipsSilence(step, silence_db);
+			});
+			const auto silence = skip_silence ? SilenceMap(wav, silence_db) : SilenceMap();
+
+			RunSegments(pool, num_segments, [&](size_t segment) {
+				for (const auto& step : steps)
+				{
+					if (skip_silence)
+						ApplyToSound(step, wav, silence, get_segment(segment));
+					else
+						EffectChain::ApplyStepInRange(step, wav, get_segment(segment));
+				}
+			});
+			return;
+		}
+
+		// Input before every segment is kept, before the previous segment is overwritten
+		vector<WavFile<float>::AudioData> pre_rolls(num_segments, WavFile<float>::AudioData(wav.GetNumChannels()));
+		RunSegments(pool, num_segments, [&](size_t segment) {
+			const auto frames = get_segment(segment);
+			for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+			{
+				const auto& in = wav.samples[channel];
+				pre_rolls[segment][channel].assign(in.begin() + (frames.begin - std::min(frames.begin, pre_roll)), in.begin() + frames.begin);
+			}
+		});
+
+		RunSegments(pool, num_segments, [&](size_t segment) {
+			const auto frames = get_segment(segment);
+			auto samples = std::move(pre_rolls[segment]);
+			const size_t pre_roll_frames = samples[0].size();
+			for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+			{
+				const auto& in = wav.samples[channel];
+				samples[channel].insert(samples[channel].end(), in.begin() + frames.begin, in.begin() + frames.end);
+			}
+
+			WavFile<float> part(wav.sampleRate, wav.bitDepth, std::move(samples));
+			for (const auto& step : steps)
+				FindEffect(step.name).apply(part, FrameRange(), step.params);
+
+			for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+			{
+				const auto& out = part.samples[channel];
+				std::copy(out.begin() + pre_roll_frames, out.end(), wav.samples[channel].begin() + frames.begin);
+			}
+		});
+	}
+}
+
+EffectChain EffectChain::Parse(const std::string& text)
+{
+	EffectChain chain;
+
+	stringstream ss(text);
+	string step_text;
+	while (getline(ss, step_text, ';'))
+	{
+		if (step_text.empty())
+			continue;
+
+		EffectStep step;
+
+		// Region suffix, e.g. `[30-45]` or `[30-]`
+		const auto region_idx = step_text.find('[');
+		if (region_idx != string::npos)
+		{
+			const auto dash_idx = step_text.find('-', region_idx);
+			if (step_text.back() != ']' || dash_idx == string::npos)
+				throw invalid_argument("Invalid region '" + step_text.substr(region_idx) + "', expected [begin-end]");
+
+			try
+			{
+				step.region_begin = stof(step_text.substr(region_idx + 1, dash_idx - region_idx - 1));
+				if (dash_idx + 2 < step_text.size())
+					step.region_end = stof(step_text.substr(dash_idx + 1, step_text.size() - dash_idx - 2));
+			}
+			catch (exception&)
+			{
+				throw invalid_argument("Invalid region '" + step_text.substr(region_idx) + "', expected [begin-end]");
+			}
+
+			step_text.erase(region_idx);
+		}
+
+		const auto colon_idx = step_text.find(':');
+		step.name = step_text.substr(0, colon_idx);
+
+		if (colon_idx != string::npos)
+		{
+			stringstream params_ss(step_text.substr(colon_idx + 1));
+			string param;
+			while (getline(params_ss, param, ','))
+			{
+				if (param.find('@') != string::npos)
+				{
+					// Automated parameter keeps the first value of its envelope as the value
+					step.envelopes.resize(step.params.size() + 1);
+					step.envelopes.back() = Envelope::Parse(param);
+					step.params.push_back(step.envelopes.back().GetPoints().front().value);
+					continue;
+				}
+
+				try
+				{
+					step.params.push_back(stof(param));
+				}
+				catch (exception&)
+				{
+					throw invalid_argument("Invalid parameter '" + param + "' of effect " + step.name);
+				}
+			}
+		}
+
+		chain.Add(std::move(step));
+	}
+
+	return chain;
+}
+
+void EffectChain::Add(EffectStep step)
+{
+	Validate(step);
+	steps_.push_back(std::move(step));
+}
+
+void EffectChain::Apply(WavFile<float>& wav, const Levels* levels) const
+{
+	// Silent blocks are found once for a run of steps without a tail, they skip them, so they stay silent
+	SilenceMap silence;
+	bool has_silence = false;
+
+	// Known levels describe only the input of the first step
+	for (size_t i = 0; i < steps_.size(); i++)
+	{
+		const auto& step = steps_[i];
+		if (!SkipsSilence(step, silence_threshold_db_))
+		{
+			ApplyStep(step, wav, FrameRange(), i == 0 ? levels : nullptr);
+			has_silence = false;
+			continue;
+		}
+
+		if (!has_silence)
+		{
+			silence = SilenceMap(wav, silence_threshold_db_);
+			has_silence = true;
+		}
+
+		StageTimer timer("effect " + step.name, wav.GetNumSamplesPerChannel() * wav.GetNumChannels());
+		ApplyToSound(step, wav, silence);
+	}
+}
+
+void EffectChain::ApplySegmented(WavFile<float>& wav, size_t num_threads, const Levels* levels) const
+{
+	ThreadPool pool(num_threads);
+	ApplySegmented(wav, pool, levels);
+}
+
+void EffectChain::ApplySegmented(WavFile<float>& wav, ThreadPool& pool, const Levels* levels) const
+{
+	for (size_t i = 0; i < steps_.size(); )
+	{
+		// Longest run of steps, that can process segments apart from the file. Position dependent
+		// steps (fades, LFOs, envelopes) run only in place, stateful steps only with pre-roll
+		size_t end = i;
+		size_t pre_roll = 0;
+		bool in_place = false;
+		bool stateful = false;
+		for (; end < steps_.size(); end++)
+		{
+			const auto& step = steps_[end];
+			const auto& info = FindEffect(step.name);
+			const size_t step_pre_roll = GetPreRoll(step, wav);
+			if (step_pre_roll == FrameRange::kEnd || pre_roll + step_pre_roll > wav.GetNumSamplesPerChannel())
+				break;
+
+			const bool position_dependent = info.locality == kPointwise && (!info.time_invariant || HasEnvelopes(step));
+			if ((position_dependent && stateful) || (info.locality != kPointwise && in_place))
+				break;
+
+			in_place = in_place || position_dependent;
+			stateful = stateful || info.locality != kPointwise;
+			pre_roll += step_pre_roll;
+		}
+
+		if (end == i)
+		{
+			ApplyStep(steps_[i], wav, FrameRange(), i == 0 ? levels : nullptr);
+			i++;
+			continue;
+		}
+
+		const vector<EffectStep> run(steps_.begin() + i, steps_.begin() + end);
+		ApplyToSegments(pool, run, wav, !stateful, pre_roll, silence_threshold_db_);
+		i = end;
+	}
+}
+
+void EffectChain::Apply(PackedAudio& audio, const Levels* levels, const DitherOptions& dither, ThreadPool& pool) const
+{
+	// Streamable chain runs by blocks on the calling thread
+	if (IsStreamable())
+	{
+		Apply(audio, levels, dither, 1);
+		return;
+	}
+
+	auto wav = audio.ToWav();
+	audio = PackedAudio();
+	ApplySegmented(wav, pool, levels);
+	audio = PackedAudio::FromWav(wav, dither);
+}
+
+void EffectChain::Apply(PackedAudio& audio, const Levels* levels, const DitherOptions& dither, size_t num_threads) const
+{
+	if (!IsStreamable())
+	{
+		// Packed samples are released while the floats are processed
+		auto wav = audio.ToWav();
+		audio = PackedAudio();
+		if (num_threads > 1)
+			ApplySegmented(wav, num_threads, levels);
+		else
+			Apply(wav, levels);
+		audio = PackedAudio::FromWav(wav, dither);
+		return;
+	}
+
+	StageTimer timer("packed chain", audio.GetNumFrames() * audio.GetNumChannels());
+
+	// Effects take wave file, a block sized one is reused for every block
+	const size_t block_frames = PackedBlockIterator::GetBlockFrames(audio.GetNumChannels(), audio.GetBitDepth());
+	WavFile<float> block(audio.GetSampleRate(), audio.GetBitDepth(),
+		WavFile<float>::AudioData(audio.GetNumChannels(), vector<float>(block_frames)));
+
+	// Steps of streamable chain have no tail, silent block is left as it is, if every step keeps it silent
+	const float silence = db_to_lin(silence_threshold_db_);
+	const bool skip_silence = std::all_of(steps_.begin(), steps_.end(), [this](const EffectStep& step) {
+		return SkipsSilence(step, silence_threshold_db_);
+	});
+	PackedBlockIterator it(audio, dither);
+	while (it.Next())
+	{
+		const size_t count = it.GetNumFrames();
+		bool silent = skip_silence;
+		for (size_t channel = 0; channel < audio.GetNumChannels() && silent; channel++)
+			silent = SilenceMap::IsSilent(it.GetChannel(channel), count, silence);
+		if (silent)
+			continue;
+
+		for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+			std::copy_n(it.GetChannel(channel), count, block.samples[channel].begin());
+
+		for (const auto& step : steps_)
+			FindEffect(step.name).apply(block, { 0, count }, step.params);
+
+		for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+			std::copy_n(block.samples[channel].begin(), count, it.GetChannel(channel));
+	}
+}
+
+void EffectChain::SetSilenceThreshold(float threshold_db)
+{
+	silence_threshold_db_ = threshold_db;
+}
+
+float EffectChain::GetSilenceThreshold() const
+{
+	return silence_threshold_db_;
+}
+
+bool EffectChain::IsStreamable() const
+{
+	return std::all_of(steps_.begin(), steps_.end(), [](const EffectStep& step) {
+		return FindEffect(step.name).time_invariant && !HasEnvelopes(step) && !step.HasRegion();
+	});
+}
+
+std::string EffectChain::ToString() const
+{
+	stringstream ss;
+	for (size_t i = 0; i < steps_.size(); i++)
+	{
+		if (i != 0)
+			ss << ';';
+
+		const auto& step = steps_[i];
+		ss << step.name;
+		for (size_t j = 0; j < step.params.size(); j++)
+		{
+			ss << (j == 0 ? ':' : ',');
+			if (j < step.envelopes.size() && !step.envelopes[j].IsEmpty())
+				ss << step.envelopes[j].ToString();
+			else
+				ss << step.params[j];
+		}
+
+		if (step.HasRegion())
+		{
+			ss << '[' << step.region_begin << '-';
+			if (step.region_end != numeric_limits<float>::infinity())
+				ss << step.region_end;
+			ss << ']';
+		}
+	}
+
+	return ss.str();
+}
+
+const std::vector<EffectStep>& EffectChain::GetSteps() const
+{
+	return steps_;
+}
+
+bool EffectChain::IsEmpty() const
+{
+	return steps_.empty();
+}
+
+void EffectChain::PrintUsage()
+{
+	cout << "Effects (separate with ';'):" << endl;
+	for (const auto& info : kEffects)
+	{
+		cout << "  " << info.name;
+		if (info.max_params > 0)
+			cout << ':' << info.usage;
+		cout << endl;
+	}
+
+	cout << "Any effect, except mono_to_stereo, may be restricted to a region in seconds, e.g. delay:300,0.5[30-45]" << endl;
+}
+
+void EffectChain::Validate(const EffectStep& step)
+{
+	const auto& info = FindEffect(step.name);
+	if (step.params.size() < info.min_params || step.params.size() > info.max_params)
+		throw invalid_argument("Wrong number of parameters for effect " + step.name);
+
+	if (step.envelopes.size() > step.params.size())
+		throw invalid_argument("More envelopes than parameters for effect " + step.name);
+
+	for (size_t i = 0; i < step.envelopes.size(); i++)
+		if (!step.envelopes[i].IsEmpty() && !IsAutomatable(step, i))
+			throw invalid_argument("Parameter " + to_string(i + 1) + " of effect " + step.name + " can't be automated");
+
+	if (step.HasRegion())
+	{
+		if (!(step.region_begin >= 0.f && step.region_end > step.region_begin))
+			throw invalid_argument("Region of effect " + step.name + " must have 0 <= begin < end");
+
+		if (step.name == "mono_to_stereo")
+			throw invalid_argument("Effect mono_to_stereo can't be restricted to a region");
+	}
+}
+
+bool EffectChain::IsAutomatable(const EffectStep& step, size_t param_idx)
+{
+	const auto& info = FindEffect(step.name);
+	return param_idx < static_cast<size_t>(numeric_limits<unsigned>::digits) && (info.automatable & (1u << param_idx)) != 0;
+}
+
+void EffectChain::ApplyStep(const EffectStep& step, WavFile<float>& wav, const FrameRange& range, const Levels* levels)
+{
+	const auto& info = FindEffect(step.name);
+
+	if (step.HasRegion())
+	{
+		// Region is rendered whole, once any frame of it is in range
+		const auto region = GetRegion(step, wav);
+		if (region.IsEmpty() || (info.locality != kGlobal && !region.Intersects(range)))
+			return;
+
+		StageTimer timer("effect " + step.name, region.GetLength() * wav.GetNumChannels());
+		ApplyRegion(info, step, wav, region);
+		return;
+	}
+
+	const auto frames = info.locality == kGlobal ? wav.GetNumSamplesPerChannel() : range.Clamp(wav.GetNumSamplesPerChannel()).GetLength();
+	StageTimer timer("effect " + step.name, frames * wav.GetNumChannels());
+
+	if (levels != nullptr && step.name == "normalize")
+		Normalize(wav, step.params, levels);
+	else if (HasEnvelopes(step) && info.make_processor != nullptr)
+		ApplyByProcessor(info, step, wav);
+	else if (HasEnvelopes(step))
+		ApplyAutomated(info, step, wav, range);
+	else
+		info.apply(wav, range, step.params);
+}
+
+void EffectChain::ApplyStepInRange(const EffectStep& step, WavFile<float>& wav, const FrameRange& range)
+{
+	const auto& info = FindEffect(step.name);
+	if (info.locality == kGlobal)
+		throw invalid_argument("Effect " + step.name + " processes whole file");
+
+	if (step.HasRegion())
+		throw invalid_argument("Effect " + step.name + " with a region processes whole region");
+
+	if (HasEnvelopes(step))
+		ApplyAutomated(info, step, wav, range);
+	else
+		info.apply(wav, range, step.params);
+}
+
+std::unique_ptr<BlockProcessor> EffectChain::MakeProcessor(const EffectStep& step, AudioInfo& format)
+{
+	const auto& info = FindEffect(step.name);
+	if (info.locality == kGlobal && info.make_processor == nullptr && !info.makes_stereo)
+		throw invalid_argument("Effect " + step.name + " processes whole file");
+
+	if (step.HasRegion())
+		throw invalid_argument("Effect " + step.name + " with a region processes whole region");
+
+	if (info.makes_stereo && format.num_channels == 1)
+		format.num_channels = 2;
+
+	return make_unique<StepProcessor>(info, step, format);
+}
+
+EffectLocality EffectChain::GetLocality(const EffectStep& step)
+{
+	return FindEffect(step.name).locality;
+}
+
+FrameRange EffectChain::GetAffectedRange(const EffectStep& step, const WavFile<float>& wav)
+{
+	if (step.HasRegion())
+		return GetRegion(step, wav);
+
+	const auto& info = FindEffect(step.name);
+	const auto range = info.affected != nullptr ? info.affected(wav, step.params) : FrameRange();
+	return range.Clamp(wav.GetNumSamplesPerChannel());
+}
+
+size_t EffectChain::GetPreRoll(const EffectStep& step, const WavFile<float>& wav)
+{
+	const auto& info = FindEffect(step.name);
+	if (step.HasRegion())
+		return FrameRange::kEnd;
+
+	if (info.locality == kPointwise)
+		return 0;
+
+	return info.settle != nullptr && !HasEnvelopes(step) ? info.settle(wav, step.params) : FrameRange::kEnd;
+}
+
+FrameRange EffectChain::GetRegion(const EffectStep& step, const WavFile<float>& wav)
+{
+	FrameRange region;
+	region.begin = static_cast<size_t>(static_cast<double>(step.region_begin) * wav.sampleRate);
+	if (step.region_end != numeric_limits<float>::infinity())
+		region.end = static_cast<size_t>(static_cast<double>(step.region_end) * wav.sampleRate);
+
+	return region.Clamp(wav.GetNumSamplesPerChannel());
+}
+
+const char* EffectChain::GetUsage(const std::string& name)
+{
+	return FindEffect(name).usage;
+}
@@ -1,12 +1,76 @@
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 #include "Effects.h"
+#include "ScratchArena.h"
+#include "Silence.h"
+#include "SimdKernels.h"
 #include "utility.h"
-#include "generator.h"
 
 using std::clamp;
 
+namespace
+{
+	constexpr float kMinStretch = 0.25f;
+	constexpr float kMaxStretch = 4.f;
+
+	// Frames, whose fade gains are computed at once and applied to every channel
+	constexpr size_t kFadeBlockSize = 4096;
+
+	/**
+	 * \brief Cubic Hermite (Catmull-Rom) interpolation of samples at fractional position
+	 */
+	float InterpolateCubic(const std::vector<float>& samples, double position)
+	{
+		const auto i = static_cast<ptrdiff_t>(std::floor(position));
+		const auto t = static_cast<float>(position - static_cast<double>(i));
+		const auto at = [&samples](ptrdiff_t idx) {
+			return idx >= 0 && idx < static_cast<ptrdiff_t>(samples.size()) ? samples[idx] : 0.f;
+		};
+
+		const float y0 = at(i - 1), y1 = at(i), y2 = at(i + 1), y3 = at(i + 2);
+		const float c1 = 0.5f * (y2 - y0);
+		const float c2 = y0 - 2.5f * y1 + 2.f * y2 - 0.5f * y3;
+		const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+		return ((c3 * t + c2) * t + c1) * t + y1;
+	}
+
+	/**
+	 * \brief Process every channel of the file by the modulated delay, LFO starts at the beginning of the file
+	 */
+	void ApplyModulatedDelay(WavFile<float>& wav, const ModulatedDelayParams& params)
+	{
+		ModulatedDelay delay(wav.GetNumChannels(), wav.sampleRate, params);
+
+		ScratchScope scratch;
+		auto** channels = scratch.Allocate<float*>(wav.GetNumChannels());
+		for (size_t i = 0; i < wav.GetNumChannels(); i++)
+			channels[i] = wav.samples[i].data();
+
+		delay.Process(channels, wav.GetNumSamplesPerChannel());
+	}
+
+	/**
+	 * \brief Multiply frames [begin, end) of the file in every channel by gain(frame), computed once per frame
+	 * \param offset frame of the file, that the wave file starts at
+	 */
+	template <typename GainFunction>
+	void ApplyGainCurve(WavFile<float>& wav, size_t offset, size_t begin, size_t end, GainFunction gain)
+	{
+		ScratchScope scratch;
+		float* gains = scratch.Allocate<float>(kFadeBlockSize);
+		for (size_t block_start = begin; block_start < end; block_start += kFadeBlockSize)
+		{
+			const size_t count = std::min(kFadeBlockSize, end - block_start);
+			for (size_t i = 0; i < count; i++)
+				gains[i] = gain(block_start + i);
+			for (auto& channel : wav.samples)
+				SimdKernels::Get().multiply(channel.data() + (block_start - offset), gains, count);
+		}
+	}
+}
+
 void effects::MonoToStereo(WavFile<float>& wav)
 {
 	if (!wav.IsMono())
@@ -17,6 +81,16 @@ void effects::MonoToStereo(WavFile<float>& wav)
 }
 
 void effects::ApplyRotatingStereo(WavFile<float>& wav, float rate)
+{
+	ApplyRotatingStereo(wav, FrameRange(), rate);
+}
+
+void effects::ApplyRotatingStereo(WavFile<float>& wav, const FrameRange& range, float rate)
+{
+	ApplyRotatingStereo(wav, range, 0, rate);
+}
+
+void effects::ApplyRotatingStereo(WavFile<float>& wav, const FrameRange& range, size_t offset, float rate)
 {
 	if (!wav.IsStereo())
 		throw std::invalid_argument("Wave file must be a stereo");
@@ -24,19 +98,37 @@ void effects::ApplyRotatingStereo(WavFile<float>& wav, float rate)
 	if (rate <= 0)
 		throw std::invalid_argument("Rate must be greater than 0");
 
-	for (size_t i = 0; i < wav.GetNumSamplesPerChannel(); i++)
+	// Rate is the angular speed, radians per second, phase is counted in periods from the beginning of the file
+	const double step = rate / (2. * kPi * wav.sampleRate);
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	for (size_t i = frames.begin; i < frames.end; i++)
 	{
-		const float x = static_cast<float>(i) / static_cast<float>(wav.sampleRate) * rate;
-		wav.samples[0][i] *= sin(x);
-		wav.samples[1][i] *= cos(x);
+		const double phase = static_cast<double>(offset + i) * step;
+		wav.samples[0][i] *= sin_of_phase(phase);
+		wav.samples[1][i] *= sin_of_phase(phase + 0.25);
 	}
 }
 
 void effects::ApplyVolume(WavFile<float>& wav, float volume_db)
 {
+	ApplyVolume(wav, FrameRange(), volume_db);
+}
+
+void effects::ApplyVolume(WavFile<float>& wav, const FrameRange& range, float volume_db)
+{
+	// Plain gain keeps the sign and leaves zero at zero
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	const float gain = db_to_lin(volume_db);
 	for (auto& channel : wav.samples)
-		for (auto& sample : channel)
-			sample = db_to_lin(lin_to_db(sample) + volume_db);
+		SimdKernels::Get().scale(channel.data() + frames.begin, frames.GetLength(), gain);
+}
+
+void effects::ApplyVolume(WavFile<float>& wav, const FrameRange& range, const float* volume_db)
+{
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	for (auto& channel : wav.samples)
+		for (size_t i = frames.begin; i < frames.end; i++)
+			channel[i] *= db_to_lin(volume_db[i - range.begin]);
 }
 
 void effects::ApplyReverse(WavFile<float>& wav)
@@ -47,11 +139,21 @@ void effects::ApplyReverse(WavFile<float>& wav)
 
 void effects::ApplyDelay(WavFile<float>& wav, int delay_millis, float decay)
 {
-	for (int i = 0; i < static_cast<int>(wav.samples.size()); i++)
-		ApplyDelay(wav, i, delay_millis, decay);
+	ApplyDelay(wav, FrameRange(), delay_millis, decay);
 }
 
 void effects::ApplyDelay(WavFile<float>& wav, size_t channel_idx, int delay_millis, float decay)
+{
+	ApplyDelay(wav, channel_idx, FrameRange(), delay_millis, decay);
+}
+
+void effects::ApplyDelay(WavFile<float>& wav, const FrameRange& range, int delay_millis, float decay)
+{
+	for (size_t i = 0; i < wav.GetNumChannels(); i++)
+		ApplyDelay(wav, i, range, delay_millis, decay);
+}
+
+void effects::ApplyDelay(WavFile<float>& wav, size_t channel_idx, const FrameRange& range, int delay_millis, float decay)
 {
 	if (channel_idx >= wav.GetNumChannels())
 		throw std::out_of_range("Channel");
@@ -62,9 +164,68 @@ void effects::ApplyDelay(WavFile<float>& wav, size_t channel_idx, int delay_mill
 	if (decay <= 0)
 		throw std::invalid_argument("Decay must be greater than 0");
 
-	const int delaySamples = static_cast<int>(static_cast<float>(delay_millis) * (wav.sampleRate / 1000.f));
-	for (size_t i = 0; i < wav.samples[channel_idx].size() - delaySamples; i++)
-		wav.samples[channel_idx][i + delaySamples] += wav.samples[channel_idx][i] * decay;
+	const size_t delaySamples = static_cast<size_t>(static_cast<float>(delay_millis) * (wav.sampleRate / 1000.f));
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	auto& channel = wav.samples[channel_idx];
+
+	// Samples are processed in order, so every source sample already contains its own echoes
+	for (size_t i = std::max(frames.begin, delaySamples); i < frames.end; i++)
+		channel[i] += channel[i - delaySamples] * decay;
+}
+
+ModulatedDelayParams effects::GetChorusParams(float rate, float depth_ms, size_t num_voices, float mix, InterpolationType interpolation)
+{
+	ModulatedDelayParams params;
+	params.delay_ms = 15.f;
+	params.depth_ms = depth_ms;
+	params.rate = rate;
+	params.num_voices = num_voices;
+	params.stereo_phase = 0.25f;
+	params.mix = mix;
+	params.interpolation = interpolation;
+	return params;
+}
+
+ModulatedDelayParams effects::GetFlangerParams(float rate, float depth_ms, float feedback, float mix, InterpolationType interpolation)
+{
+	ModulatedDelayParams params;
+	params.delay_ms = 1.f;
+	params.depth_ms = depth_ms;
+	params.rate = rate;
+	params.stereo_phase = 0.25f;
+	params.feedback = feedback;
+	params.mix = mix;
+	params.interpolation = interpolation;
+	return params;
+}
+
+ModulatedDelayParams effects::GetVibratoParams(float rate, float depth_ms, InterpolationType interpolation)
+{
+	// Shortest delay is the minimum of the delay line, a couple of frames
+	ModulatedDelayParams params;
+	params.delay_ms = 0.f;
+	params.depth_ms = depth_ms;
+	params.rate = rate;
+	params.mix = 1.f;
+	params.interpolation = interpolation;
+	return params;
+}
+
+void effects::ApplyChorus(WavFile<float>& wav, float rate, float depth_ms, size_t num_voices, float mix,
+	InterpolationType interpolation)
+{
+	ApplyModulatedDelay(wav, GetChorusParams(rate, depth_ms, num_voices, mix, interpolation));
+}
+
+void effects::ApplyFlanger(WavFile<float>& wav, float rate, float depth_ms, float feedback, float mix,
+	InterpolationType interpolation)
+{
+	ApplyModulatedDelay(wav, GetFlangerParams(rate, depth_ms, feedback, mix, interpolation));
+}
+
+void effects::ApplyVibrato(WavFile<float>& wav, float rate, float depth_ms, InterpolationType interpolation)
+{
+	ApplyModulatedDelay(wav, GetVibratoParams(rate, depth_ms, interpolation));
 }
 
 void effects::ApplyReverberation(WavFile<float>& wav)
@@ -77,10 +238,17 @@ void effects::ApplyReverberation(WavFile<float>& wav)
 
 void effects::ApplyCompressor(WavFile<float>& wav, float threshold, float ratio, bool downward)
 {
+	ApplyCompressor(wav, FrameRange(), threshold, ratio, downward);
+}
+
+void effects::ApplyCompressor(WavFile<float>& wav, const FrameRange& range, float threshold, float ratio, bool downward)
+{
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
 	for (auto& channel : wav.samples)
 	{
-		for (auto& sample : channel)
+		for (size_t i = frames.begin; i < frames.end; i++)
 		{
+			auto& sample = channel[i];
 			const auto sample_db = lin_to_db(sample);
 
 			if (downward)
@@ -97,61 +265,264 @@ void effects::ApplyCompressor(WavFile<float>& wav, float threshold, float ratio,
 	}
 }
 
+void effects::ApplyCompressor(WavFile<float>& wav, const FrameRange& range, const float* threshold, const float* ratio, bool downward)
+{
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	for (auto& channel : wav.samples)
+	{
+		for (size_t i = frames.begin; i < frames.end; i++)
+		{
+			auto& sample = channel[i];
+			const auto sample_db = lin_to_db(sample);
+			const auto t = threshold[i - range.begin];
+			const auto r = ratio[i - range.begin];
+
+			if (downward)
+			{
+				if (sample_db > t)
+					sample = sign(sample) * db_to_lin((sample_db - t) / r + t);
+			}
+			else
+			{
+				if (sample_db < t)
+					sample = sign(sample) * db_to_lin(t - ((t - sample_db) / r));
+			}
+		}
+	}
+}
+
 void effects::ApplyDistortion(WavFile<float>& wav, float drive, float blend, float volume)
 {
-	const float range = 1000.f;
+	ApplyDistortion(wav, FrameRange(), drive, blend, volume);
+}
+
+void effects::ApplyDistortion(WavFile<float>& wav, const FrameRange& range, float drive, float blend, float volume)
+{
+	const float drive_range = 1000.f;
 
 	drive = clamp<float>(drive, 0.f, 1.f);
 	blend = clamp<float>(blend, 0.f, 1.f);
 	volume = clamp<float>(volume, 0.f, 1.f);
 
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
 	for (auto& channel : wav.samples)
+		SimdKernels::Get().distort(channel.data() + frames.begin, frames.end - frames.begin, drive * drive_range, blend, volume);
+}
+
+void effects::ApplyDistortion(WavFile<float>& wav, const FrameRange& range, const float* drive, const float* blend, float volume)
+{
+	const float drive_range = 1000.f;
+
+	volume = clamp<float>(volume, 0.f, 1.f);
+
+	// Clamped automation of a block is shared by the channels
+	ScratchScope scratch;
+	float* drives = scratch.Allocate<float>(kFadeBlockSize);
+	float* blends = scratch.Allocate<float>(kFadeBlockSize);
+
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	for (size_t block_start = frames.begin; block_start < frames.end; block_start += kFadeBlockSize)
 	{
-		for (auto& sample : channel)
+		const size_t count = std::min(kFadeBlockSize, frames.end - block_start);
+		for (size_t i = 0; i < count; i++)
 		{
-			const auto clean_sample = sample;
-
-			sample *= drive * range;
-			sample = (2.f / kPi * static_cast<float>(atan(sample)) * blend + clean_sample * (1.f - blend)) / 2.f * volume;
+			drives[i] = clamp<float>(drive[block_start + i - range.begin], 0.f, 1.f) * drive_range;
+			blends[i] = clamp<float>(blend[block_start + i - range.begin], 0.f, 1.f);
 		}
+
+		for (auto& channel : wav.samples)
+			SimdKernels::Get().distort_ramps(channel.data() + block_start, drives, blends, count, volume);
 	}
 }
 
 void effects::ApplyFadeIn(WavFile<float>& wav, float time, CurveType curve_type)
 {
-	if (time <= 0 || time > wav.GetLengthInSeconds())
+	ApplyFadeIn(wav, FrameRange(), time, curve_type);
+}
+
+void effects::ApplyFadeIn(WavFile<float>& wav, const FrameRange& range, float time, CurveType curve_type)
+{
+	ApplyFadeIn(wav, range, 0, wav.GetNumSamplesPerChannel(), time, curve_type);
+}
+
+void effects::ApplyFadeIn(WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, float time, CurveType curve_type)
+{
+	if (time <= 0 || time > static_cast<double>(num_frames) / wav.sampleRate)
 		throw std::invalid_argument("Invalid fade time");
 
 	const float fade_samples = time * wav.sampleRate;
-	for(auto& channel : wav.samples)
-		for(size_t i = 0; i < fade_samples && i < wav.GetNumSamplesPerChannel(); i++)
-			channel[i] *= ApplyCurve(static_cast<float>(i) / fade_samples, curve_type);
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+	const size_t end = std::min(offset + frames.end, static_cast<size_t>(std::ceil(fade_samples)));
+	ApplyGainCurve(wav, offset, offset + frames.begin, end, [&](size_t i) {
+		return ApplyCurve(static_cast<float>(i) / fade_samples, curve_type);
+	});
 }
 
 void effects::ApplyFadeOut(WavFile<float>& wav, float time, CurveType curve_type)
 {
-	if (time <= 0 || time > wav.GetLengthInSeconds())
+	ApplyFadeOut(wav, FrameRange(), time, curve_type);
+}
+
+void effects::ApplyFadeOut(WavFile<float>& wav, const FrameRange& range, float time, CurveType curve_type)
+{
+	ApplyFadeOut(wav, range, 0, wav.GetNumSamplesPerChannel(), time, curve_type);
+}
+
+void effects::ApplyFadeOut(WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, float time, CurveType curve_type)
+{
+	if (time <= 0 || time > static_cast<double>(num_frames) / wav.sampleRate)
 		throw std::invalid_argument("Invalid fade time");
 
-	const size_t samples_count = wav.GetNumSamplesPerChannel();
 	const size_t fade_samples = time * wav.sampleRate; // fade time in samples
-	const size_t start_pos = samples_count - fade_samples; // sample that starts
+	const size_t start_pos = num_frames - fade_samples; // sample that starts
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
 
-	for (auto& channel : wav.samples)
-		for (size_t i = start_pos; i < samples_count; i++)
-			channel[i] *= 1.f - ApplyCurve(static_cast<float>(i - start_pos) / fade_samples, curve_type);
+	ApplyGainCurve(wav, offset, std::max(start_pos, offset + frames.begin), offset + frames.end, [&](size_t i) {
+		return 1.f - ApplyCurve(static_cast<float>(i - start_pos) / fade_samples, curve_type);
+	});
 }
 
 void effects::ApplyTremolo(WavFile<float>& wav, float freq, float dry, float wet)
+{
+	ApplyTremolo(wav, FrameRange(), freq, dry, wet);
+}
+
+void effects::ApplyTremolo(WavFile<float>& wav, const FrameRange& range, float freq, float dry, float wet)
+{
+	ApplyTremolo(wav, range, 0, freq, dry, wet);
+}
+
+void effects::ApplyTremolo(WavFile<float>& wav, const FrameRange& range, size_t offset, float freq, float dry, float wet)
 {
 	dry = clamp(dry, 0.f, 1.f);
 	wet = clamp(wet, 0.f, 1.f);
 
-	const auto sine_wave = GenerateSineWave(freq, 
-		static_cast<float>(wav.GetNumSamplesPerChannel()) / wav.sampleRate, 
-		wav.sampleRate);
-	
+	// LFO phase is counted in periods from the beginning of the file
+	const double step = static_cast<double>(freq) / wav.sampleRate;
+	const auto frames = range.Clamp(wav.GetNumSamplesPerChannel());
+
+	for (size_t i = frames.begin; i < frames.end; i++)
+	{
+		const float lfo = sin_of_phase(static_cast<double>(offset + i) * step) / 2.f + 0.5f;
+		for (auto& channel : wav.samples)
+			channel[i] = (channel[i] * dry) + ((channel[i] * lfo) * wet);
+	}
+}
+
+void effects::ApplyNormalize(WavFile<float>& wav, float target, NormalizeType type, float ceiling)
+{
+	ApplyNormalize(wav, Meter::Analyze(wav), target, type, ceiling);
+}
+
+void effects::ApplyNormalize(WavFile<float>& wav, const Levels& levels, float target, NormalizeType type, float ceiling)
+{
+	if (levels.channels.size() != wav.GetNumChannels())
+		throw std::invalid_argument("Levels don't match the wave file");
+
+	const auto to_db = [](float value) {
+		return 20.f * std::log10(value);
+	};
+
+	// Silent file can't be normalized, leave it as is
+	float gain_db;
+	switch (type)
+	{
+		case kNormalizeLoudness:
+			if (!std::isfinite(levels.loudness))
+				return;
+
+			gain_db = target - static_cast<float>(levels.loudness);
+			if (levels.GetTruePeak() > 0)
+				gain_db = std::min(gain_db, ceiling - to_db(levels.GetTruePeak()));
+			break;
+
+		case kNormalizePeak:
+			if (levels.GetPeak() <= 0)
+				return;
+
+			gain_db = target - to_db(levels.GetPeak());
+			break;
+
+		case kNormalizeTruePeak:
+			if (levels.GetTruePeak() <= 0)
+				return;
+
+			gain_db = target - to_db(levels.GetTruePeak());
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown normalize type");
+	}
+
+	const float gain = db_to_lin(gain_db);
 	for (auto& channel : wav.samples)
-		for (size_t i = 0; i < channel.size(); i++)
-			channel[i] = (channel[i] * dry) + ((channel[i] * (sine_wave[i] / 2.f + 0.5f)) * wet);
+		SimdKernels::Get().scale(channel.data(), channel.size(), gain);
+}
+
+void effects::ApplyFilter(WavFile<float>& wav, FilterType type, float freq, float q, float gain_db)
+{
+	ApplyFilterBank(wav, { { type, freq, q, gain_db } });
+}
+
+void effects::ApplyFilterBank(WavFile<float>& wav, const std::vector<BiquadParams>& sections)
+{
+	BiquadCascade cascade(wav.GetNumChannels(), wav.sampleRate, sections);
+
+	ScratchScope scratch;
+	auto** channels = scratch.Allocate<float*>(wav.GetNumChannels());
+	for (size_t i = 0; i < wav.GetNumChannels(); i++)
+		channels[i] = wav.samples[i].data();
+
+	cascade.Process(channels, wav.GetNumSamplesPerChannel());
+}
+
+void effects::ApplyTimeStretch(WavFile<float>& wav, float factor)
+{
+	if (!(factor >= kMinStretch && factor <= kMaxStretch))
+		throw std::invalid_argument("Stretch factor must be between 0.25 and 4");
+
+	const Stft stft;
+	stft.Process(wav, [](size_t) { return Stft::FrameCallback(PhaseVocoder()); }, factor);
+}
+
+void effects::ApplyPitchShift(WavFile<float>& wav, float semitones)
+{
+	if (!(std::abs(semitones) <= 24.f))
+		throw std::invalid_argument("Pitch shift must be between -24 and 24 semitones");
+
+	const size_t num_frames = wav.GetNumSamplesPerChannel();
+	const double ratio = std::pow(2., semitones / 12.);
+	ApplyTimeStretch(wav, static_cast<float>(ratio));
+
+	// Resampling by ratio > 1 drops samples, band-limit before it (4th order Butterworth)
+	if (ratio > 1.)
+	{
+		const auto cutoff = static_cast<float>(0.45 * wav.sampleRate / ratio);
+		ApplyFilterBank(wav, { { kLowPass, cutoff, 0.54119610f }, { kLowPass, cutoff, 1.30656296f } });
+	}
+
+	std::vector<float> resampled(num_frames);
+	for (auto& channel : wav.samples)
+	{
+		for (size_t i = 0; i < num_frames; i++)
+			resampled[i] = InterpolateCubic(channel, static_cast<double>(i) * ratio);
+		channel.swap(resampled);
+		resampled.resize(num_frames);
+	}
+}
+
+void effects::ApplyTrim(WavFile<float>& wav, float threshold_db, float padding)
+{
+	const auto content = SilenceMap::FindContent(wav, threshold_db);
+	if (content.IsEmpty())
+		return;
+
+	const auto padding_frames = static_cast<size_t>(std::max(padding, 0.f) * static_cast<float>(wav.sampleRate));
+	const FrameRange kept{ content.begin - std::min(content.begin, padding_frames), content.end + padding_frames };
+	const auto frames = kept.Clamp(wav.GetNumSamplesPerChannel());
+	for (auto& channel : wav.samples)
+	{
+		channel.erase(channel.begin() + static_cast<ptrdiff_t>(frames.end), channel.end());
+		channel.erase(channel.begin(), channel.begin() + static_cast<ptrdiff_t>(frames.begin));
+	}
 }
@@ -1,7 +1,27 @@
 #pragma once
 #include "WavFile.h"
+#include "Biquad.h"
+#include "FrameRange.h"
+#include "Meter.h"
+#include "ModulatedDelay.h"
+#include "Stft.h"
 #include "curve.h"
 
+enum NormalizeType
+{
+	// Integrated loudness, LUFS
+	kNormalizeLoudness = 1,
+	// Sample peak, dBFS
+	kNormalizePeak,
+	// True peak, dBTP
+	kNormalizeTruePeak
+};
+
+/*
+ * Overloads with `range` process only frames inside the range, computing them
+ * the same way as whole file processing does (e.g. LFO phase and fade position
+ * are counted from the beginning of the file).
+ */
 namespace effects
 {
 	/**
@@ -18,12 +38,47 @@ namespace effects
 	 */
 	void ApplyRotatingStereo(WavFile<float>& wav, float rate);
 
+	/**
+	 * \brief Apply rotation effect on stereo wave file
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param rate rotating rate, in seconds
+	 * \throw invalid_argument file not in stereo, or rate <= 0
+	 */
+	void ApplyRotatingStereo(WavFile<float>& wav, const FrameRange& range, float rate);
+
+	/**
+	 * \brief Apply rotation effect on the stereo part of the file
+	 * \param wav part of the file, its frame i is frame offset + i of the file
+	 * \param range frames of the part to process
+	 * \param offset frame of the file, that the part starts at
+	 * \param rate rotating rate, in seconds
+	 * \throw invalid_argument file not in stereo, or rate <= 0
+	 */
+	void ApplyRotatingStereo(WavFile<float>& wav, const FrameRange& range, size_t offset, float rate);
+
 	/**
 	 * \brief Increase volume by volume_db
 	 * \param wav wave file
 	 * \param volume_db How much dB increase
 	 */
 	void ApplyVolume(WavFile<float>& wav, float volume_db);
+
+	/**
+	 * \brief Increase volume by volume_db
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param volume_db How much dB increase
+	 */
+	void ApplyVolume(WavFile<float>& wav, const FrameRange& range, float volume_db);
+
+	/**
+	 * \brief Increase volume by automated volume_db
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param volume_db dB of every frame in range, indexed from range.begin
+	 */
+	void ApplyVolume(WavFile<float>& wav, const FrameRange& range, const float* volume_db);
 	
 	/**
 	 * \brief Apply effect of reversing the sound
@@ -52,6 +107,82 @@ namespace effects
 	 */
 	void ApplyDelay(WavFile<float>& wav, size_t channel_idx, int delay_millis, float decay);
 
+	/**
+	 * \brief Apply delay effect
+	 * \param wav wave file
+	 * \param range frames, that receive delayed signal
+	 * \param delay_millis Delay milliseconds
+	 * \param decay Decay
+	 * \throw out_of_range delay time out of range
+	 * \throw invalid_argument decay <= 0
+	 */
+	void ApplyDelay(WavFile<float>& wav, const FrameRange& range, int delay_millis, float decay);
+
+	/**
+	 * \brief Apply delay effect
+	 * \param wav wave file
+	 * \param channel_idx Channel number for applying effect
+	 * \param range frames, that receive delayed signal
+	 * \param delay_millis Delay milliseconds
+	 * \param decay Decay
+	 * \throw out_of_range channel or delay time out of range
+	 * \throw invalid_argument decay <= 0
+	 */
+	void ApplyDelay(WavFile<float>& wav, size_t channel_idx, const FrameRange& range, int delay_millis, float decay);
+
+	/**
+	 * \brief Apply chorus effect, voices delayed by 15 ms and more, LFO phases of the channels differ by a quarter
+	 * \param wav wave file
+	 * \param rate LFO frequency, Hz
+	 * \param depth_ms how much longer the delay gets, ms
+	 * \param num_voices delayed copies of every channel (1..8)
+	 * \param mix part of the delayed signal (0..1)
+	 * \param interpolation interpolation of the delay line
+	 * \throw invalid_argument parameters out of range
+	 */
+	void ApplyChorus(WavFile<float>& wav, float rate, float depth_ms, size_t num_voices = 3, float mix = 0.5f,
+		InterpolationType interpolation = kInterpolateCubic);
+
+	/**
+	 * \brief Apply flanger effect, delay of 1 ms and more with feedback
+	 * \param wav wave file
+	 * \param rate LFO frequency, Hz
+	 * \param depth_ms how much longer the delay gets, ms
+	 * \param feedback part of the delayed signal fed back (-1..1 exclusive)
+	 * \param mix part of the delayed signal (0..1)
+	 * \param interpolation interpolation of the delay line
+	 * \throw invalid_argument parameters out of range
+	 */
+	void ApplyFlanger(WavFile<float>& wav, float rate, float depth_ms, float feedback = 0.5f, float mix = 0.5f,
+		InterpolationType interpolation = kInterpolateCubic);
+
+	/**
+	 * \brief Apply vibrato effect, pitch modulation by the delay without dry signal
+	 * \param wav wave file
+	 * \param rate LFO frequency, Hz
+	 * \param depth_ms how much longer the delay gets, ms
+	 * \param interpolation interpolation of the delay line
+	 * \throw invalid_argument parameters out of range
+	 */
+	void ApplyVibrato(WavFile<float>& wav, float rate, float depth_ms, InterpolationType interpolation = kInterpolateCubic);
+
+	/**
+	 * \brief Parameters of the modulated delay of ApplyChorus
+	 */
+	ModulatedDelayParams GetChorusParams(float rate, float depth_ms, size_t num_voices = 3, float mix = 0.5f,
+		InterpolationType interpolation = kInterpolateCubic);
+
+	/**
+	 * \brief Parameters of the modulated delay of ApplyFlanger
+	 */
+	ModulatedDelayParams GetFlangerParams(float rate, float depth_ms, float feedback = 0.5f, float mix = 0.5f,
+		InterpolationType interpolation = kInterpolateCubic);
+
+	/**
+	 * \brief Parameters of the modulated delay of ApplyVibrato
+	 */
+	ModulatedDelayParams GetVibratoParams(float rate, float depth_ms, InterpolationType interpolation = kInterpolateCubic);
+
 	/**
 	 * \brief Apply reverberation effect
 	 * \param wav wave file
@@ -66,6 +197,24 @@ namespace effects
 	 */
 	void ApplyCompressor(WavFile<float>& wav, float threshold, float ratio, bool downward = true);
 
+	/**
+	 * \brief Apple compressor effect
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param threshold Threshold, dB
+	 * \param ratio Compressing ratio
+	 */
+	void ApplyCompressor(WavFile<float>& wav, const FrameRange& range, float threshold, float ratio, bool downward = true);
+
+	/**
+	 * \brief Apple compressor effect with automated parameters
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param threshold threshold of every frame in range, dB, indexed from range.begin
+	 * \param ratio compressing ratio of every frame in range, indexed from range.begin
+	 */
+	void ApplyCompressor(WavFile<float>& wav, const FrameRange& range, const float* threshold, const float* ratio, bool downward = true);
+
 	/**
 	 * \brief Apply distortion effect
 	 * \param wav wave file
@@ -74,6 +223,26 @@ namespace effects
 	 * \param volume volume level (0..1). Default is 1.
 	 */
 	void ApplyDistortion(WavFile<float>& wav, float drive, float blend, float volume = 1.f);
+
+	/**
+	 * \brief Apply distortion effect
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param drive drive level (0..1)
+	 * \param blend blending level of clean and distorted sound (0..1)
+	 * \param volume volume level (0..1). Default is 1.
+	 */
+	void ApplyDistortion(WavFile<float>& wav, const FrameRange& range, float drive, float blend, float volume = 1.f);
+
+	/**
+	 * \brief Apply distortion effect with automated drive and blend
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param drive drive level of every frame in range (0..1), indexed from range.begin
+	 * \param blend blending level of every frame in range (0..1), indexed from range.begin
+	 * \param volume volume level (0..1). Default is 1.
+	 */
+	void ApplyDistortion(WavFile<float>& wav, const FrameRange& range, const float* drive, const float* blend, float volume = 1.f);
 	
 	/**
 	 * \brief Apply fade in
@@ -84,6 +253,28 @@ namespace effects
 	 */
 	void ApplyFadeIn(WavFile<float>& wav, float time, CurveType curve_type = kLinear);
 
+	/**
+	 * \brief Apply fade in
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param time fade time in seconds
+	 * \param curve_type fade curve type
+	 * \throw invalid_argument time <= 0
+	 */
+	void ApplyFadeIn(WavFile<float>& wav, const FrameRange& range, float time, CurveType curve_type = kLinear);
+
+	/**
+	 * \brief Apply fade in to the part of the file
+	 * \param wav part of the file, its frame i is frame offset + i of the file
+	 * \param range frames of the part to process
+	 * \param offset frame of the file, that the part starts at
+	 * \param num_frames length of the file
+	 * \param time fade time in seconds
+	 * \param curve_type fade curve type
+	 * \throw invalid_argument time <= 0
+	 */
+	void ApplyFadeIn(WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, float time, CurveType curve_type);
+
 	/**
 	 * \brief Apply fade out
 	 * \param wav wave file
@@ -93,6 +284,28 @@ namespace effects
 	 */
 	void ApplyFadeOut(WavFile<float>& wav, float time, CurveType curve_type = kLinear);
 
+	/**
+	 * \brief Apply fade out
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param time fade time in seconds
+	 * \param curve_type fade curve type
+	 * \throw invalid_argument time <= 0
+	 */
+	void ApplyFadeOut(WavFile<float>& wav, const FrameRange& range, float time, CurveType curve_type = kLinear);
+
+	/**
+	 * \brief Apply fade out to the part of the file
+	 * \param wav part of the file, its frame i is frame offset + i of the file
+	 * \param range frames of the part to process
+	 * \param offset frame of the file, that the part starts at
+	 * \param num_frames length of the file
+	 * \param time fade time in seconds
+	 * \param curve_type fade curve type
+	 * \throw invalid_argument time <= 0
+	 */
+	void ApplyFadeOut(WavFile<float>& wav, const FrameRange& range, size_t offset, size_t num_frames, float time, CurveType curve_type);
+
 	/**
 	 * \brief Apply tremolo effect
 	 * \param wav wave file
@@ -101,4 +314,88 @@ namespace effects
 	 * \param wet
 	 */
 	void ApplyTremolo(WavFile<float>& wav, float freq, float dry = 0.5f, float wet = 0.5f);
-}
\ No newline at end of file
+
+	/**
+	 * \brief Apply tremolo effect
+	 * \param wav wave file
+	 * \param range frames to process
+	 * \param freq frequency of tremolo in Herz
+	 * \param dry 
+	 * \param wet
+	 */
+	void ApplyTremolo(WavFile<float>& wav, const FrameRange& range, float freq, float dry = 0.5f, float wet = 0.5f);
+
+	/**
+	 * \brief Apply tremolo effect to the part of the file
+	 * \param wav part of the file, its frame i is frame offset + i of the file
+	 * \param range frames of the part to process
+	 * \param offset frame of the file, that the part starts at
+	 * \param freq frequency of tremolo in Herz
+	 * \param dry
+	 * \param wet
+	 */
+	void ApplyTremolo(WavFile<float>& wav, const FrameRange& range, size_t offset, float freq, float dry, float wet);
+
+	/**
+	 * \brief Change volume, so the file reaches target level
+	 * \param wav wave file
+	 * \param target target level, its unit depends on type
+	 * \param type what level to normalize
+	 * \param ceiling maximal true peak after loudness normalization, dBTP
+	 */
+	void ApplyNormalize(WavFile<float>& wav, float target, NormalizeType type = kNormalizeLoudness, float ceiling = -1.f);
+
+	/**
+	 * \brief Change volume, so the file reaches target level
+	 * \param wav wave file
+	 * \param levels levels of the file, e.g. measured while loading it
+	 * \param target target level, its unit depends on type
+	 * \param type what level to normalize
+	 * \param ceiling maximal true peak after loudness normalization, dBTP
+	 * \throw invalid_argument levels don't match the file layout
+	 */
+	void ApplyNormalize(WavFile<float>& wav, const Levels& levels, float target, NormalizeType type = kNormalizeLoudness, float ceiling = -1.f);
+
+	/**
+	 * \brief Apply biquad filter
+	 * \param wav wave file
+	 * \param type filter type
+	 * \param freq cutoff or center frequency, Hz
+	 * \param q quality factor
+	 * \param gain_db gain of peak and shelf filters, dB
+	 * \throw invalid_argument frequency not in (0, sample_rate / 2), q <= 0 or unknown type
+	 */
+	void ApplyFilter(WavFile<float>& wav, FilterType type, float freq, float q = 0.70710678f, float gain_db = 0.f);
+
+	/**
+	 * \brief Apply cascade of biquad filters in one pass
+	 * \param wav wave file
+	 * \param sections filter sections, applied in order
+	 * \throw invalid_argument invalid parameters of any section
+	 */
+	void ApplyFilterBank(WavFile<float>& wav, const std::vector<BiquadParams>& sections);
+
+	/**
+	 * \brief Change duration without changing pitch, by phase vocoder
+	 * \param wav wave file
+	 * \param factor ratio of new duration to the current one (0.25..4)
+	 * \throw invalid_argument factor out of range
+	 */
+	void ApplyTimeStretch(WavFile<float>& wav, float factor);
+
+	/**
+	 * \brief Change pitch without changing duration, time stretch followed by resampling
+	 * \param wav wave file
+	 * \param semitones pitch change (-24..24)
+	 * \throw invalid_argument semitones out of range
+	 */
+	void ApplyPitchShift(WavFile<float>& wav, float semitones);
+
+	/**
+	 * \brief Remove leading and trailing silence, silent file is kept as it is
+	 * \param wav wave file
+	 * \param threshold_db level in dBFS, at and below which samples are silent
+	 * \param padding seconds of silence kept before and after the sound
+	 */
+	void ApplyTrim(WavFile<float>& wav, float threshold_db, float padding = 0.f);
+}
@@ -0,0 +1,142 @@
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "Fft.h"
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+
+	std::complex<float> Twiddle(size_t k, size_t n)
+	{
+		const double angle = -2. * kPi * static_cast<double>(k) / static_cast<double>(n);
+		return { static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)) };
+	}
+}
+
+std::shared_ptr<const FftPlan> FftPlan::Get(size_t size)
+{
+	if (size < 4 || (size & (size - 1)) != 0)
+		throw std::invalid_argument("FFT size must be a power of two, at least 4");
+
+	static std::mutex mutex;
+	static std::map<size_t, std::shared_ptr<const FftPlan>> plans;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& plan = plans[size];
+	if (!plan)
+		plan.reset(new FftPlan(size));
+
+	return plan;
+}
+
+FftPlan::FftPlan(size_t size) : size_(size)
+{
+	const size_t n = size / 2;
+
+	size_t bits = 0;
+	while ((size_t(1) << bits) < n)
+		bits++;
+
+	bit_reverse_.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t reversed = 0;
+		for (size_t bit = 0; bit < bits; bit++)
+			reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+		bit_reverse_[i] = reversed;
+	}
+
+	twiddles_.resize(n / 2);
+	for (size_t k = 0; k < twiddles_.size(); k++)
+		twiddles_[k] = Twiddle(k, n);
+
+	real_twiddles_.resize(n);
+	for (size_t k = 0; k < n; k++)
+		real_twiddles_[k] = Twiddle(k, size);
+}
+
+void FftPlan::Forward(const float* input, std::complex<float>* output) const
+{
+	const size_t n = size_ / 2;
+
+	// Even samples to real part, odd ones to imaginary part
+	for (size_t i = 0; i < n; i++)
+		output[bit_reverse_[i]] = { input[2 * i], input[2 * i + 1] };
+
+	Transform(output, false);
+
+	// Split spectra of even and odd samples, combine them into spectrum of the real signal
+	const auto z0 = output[0];
+	output[0] = { z0.real() + z0.imag(), 0.f };
+	output[n] = { z0.real() - z0.imag(), 0.f };
+
+	for (size_t k = 1; k <= n / 2; k++)
+	{
+		const auto a = output[k];
+		const auto b = std::conj(output[n - k]);
+		const auto even = 0.5f * (a + b);
+		const auto odd = std::complex<float>(0.f, -0.5f) * (a - b);
+
+		output[k] = even + real_twiddles_[k] * odd;
+		// Same for bin n - k, twiddle of it is -conj(twiddle of k)
+		output[n - k] = std::conj(even - real_twiddles_[k] * odd);
+	}
+}
+
+void FftPlan::Inverse(const std::complex<float>* input, float* output) const
+{
+	const size_t n = size_ / 2;
+	// Output is used as complex buffer, array of complex is layout compatible with array of float pairs
+	auto* buffer = reinterpret_cast<std::complex<float>*>(output);
+
+	buffer[bit_reverse_[0]] = { 0.5f * (input[0].real() + input[n].real()), 0.5f * (input[0].real() - input[n].real()) };
+
+	for (size_t k = 1; k < n; k++)
+	{
+		const auto a = input[k];
+		const auto b = std::conj(input[n - k]);
+		const auto even = 0.5f * (a + b);
+		const auto odd = 0.5f * (a - b) * std::conj(real_twiddles_[k]);
+
+		buffer[bit_reverse_[k]] = even + std::complex<float>(0.f, 1.f) * odd;
+	}
+
+	Transform(buffer, true);
+
+	const float scale = 1.f / static_cast<float>(n);
+	for (size_t i = 0; i < size_; i++)
+		output[i] *= scale;
+}
+
+size_t FftPlan::GetSize() const
+{
+	return size_;
+}
+
+size_t FftPlan::GetNumBins() const
+{
+	return size_ / 2 + 1;
+}
+
+void FftPlan::Transform(std::complex<float>* data, bool inverse) const
+{
+	// Input is already in bit reversed order
+	const size_t n = size_ / 2;
+	for (size_t length = 2; length <= n; length <<= 1)
+	{
+		const size_t half = length / 2;
+		const size_t step = n / length;
+		for (size_t start = 0; start < n; start += length)
+		{
+			for (size_t j = 0; j < half; j++)
+			{
+				const auto w = inverse ? std::conj(twiddles_[j * step]) : twiddles_[j * step];
+				const auto t = w * data[start + j + half];
+				data[start + j + half] = data[start + j] - t;
+				data[start + j] += t;
+			}
+		}
+	}
+}
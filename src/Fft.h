@@ -0,0 +1,55 @@
+#pragma once
+#include <complex>
+#include <memory>
+#include <vector>
+
+/**
+ * \brief Plan of the real FFT of fixed power of two size
+ *
+ * Real signal of size N is packed into complex signal of size N / 2, transformed by iterative
+ * radix-2 FFT and unpacked into N / 2 + 1 bins. Twiddles and bit reversal table are computed once
+ * per size, plans are cached and shared between threads.
+ */
+class FftPlan
+{
+public:
+	/**
+	 * \brief Get cached plan, create if it doesn't exist
+	 * \param size number of real samples, power of two >= 4
+	 * \throw invalid_argument size is not a power of two or less than 4
+	 */
+	static std::shared_ptr<const FftPlan> Get(size_t size);
+
+	/**
+	 * \brief Forward transform
+	 * \param input size real samples
+	 * \param output size / 2 + 1 bins, not normalized
+	 */
+	void Forward(const float* input, std::complex<float>* output) const;
+
+	/**
+	 * \brief Inverse transform, scaled by 1 / size, so Inverse(Forward(x)) = x
+	 * \param input size / 2 + 1 bins
+	 * \param output size real samples
+	 */
+	void Inverse(const std::complex<float>* input, float* output) const;
+
+	[[nodiscard]] size_t GetSize() const;
+	[[nodiscard]] size_t GetNumBins() const;
+
+private:
+	explicit FftPlan(size_t size);
+
+	/**
+	 * \brief In place complex FFT of size / 2 points, not normalized
+	 */
+	void Transform(std::complex<float>* data, bool inverse) const;
+
+	size_t size_;
+	// Bit reversed indices of complex FFT
+	std::vector<size_t> bit_reverse_;
+	// exp(-2 pi i k / (size / 2)), k < size / 4
+	std::vector<std::complex<float>> twiddles_;
+	// exp(-2 pi i k / size), k < size / 2, for packing and unpacking
+	std::vector<std::complex<float>> real_twiddles_;
+};
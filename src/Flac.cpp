@@ -0,0 +1,1631 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "Flac.h"
+#include "ScratchArena.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+	constexpr size_t kStreamInfoSize = 34;
+	constexpr size_t kMaxChannels = 8;
+	constexpr size_t kMaxFixedOrder = 4;
+	constexpr size_t kMaxLpcOrder = 32;
+	// Format allows 15, partition parameters are kept in fixed arrays
+	constexpr size_t kMaxPartitionOrder = 8;
+	constexpr int kMaxRiceParameter = 30;
+	// Residuals must stay in 32 bits after zigzag coding
+	constexpr int64_t kMaxResidual = int64_t(1) << 30;
+	// Smallest part of the stream decoded by one task
+	constexpr size_t kMinDecodeChunkBytes = 256 * 1024;
+	// Seeking stops, when the frame before the sample is known within this many bytes
+	constexpr size_t kSeekPrecision = 64 * 1024;
+
+	// Channel assignments of stereo frames
+	constexpr uint32_t kLeftSide = 8;
+	constexpr uint32_t kRightSide = 9;
+	constexpr uint32_t kMidSide = 10;
+
+	enum
+	{
+		kSubframeConstant = 1,
+		kSubframeVerbatim,
+		kSubframeFixed,
+		kSubframeLpc
+	};
+
+	int CountLeadingZeros(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		// _BitScanReverse64 is missing on 32 bit targets
+		unsigned long index;
+		if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+			return 31 - static_cast<int>(index);
+		_BitScanReverse(&index, static_cast<unsigned long>(value));
+		return 63 - static_cast<int>(index);
+#else
+		return __builtin_clzll(value);
+#endif
+	}
+
+	/**
+	 * \brief Big-endian value of the little-endian load
+	 */
+	uint64_t ByteSwap64(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		return _byteswap_uint64(value);
+#else
+		return __builtin_bswap64(value);
+#endif
+	}
+
+	int Log2(uint64_t value)
+	{
+		return value == 0 ? 0 : 63 - CountLeadingZeros(value);
+	}
+
+	uint32_t ZigZag(int32_t value)
+	{
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+
+	struct CrcTables
+	{
+		CrcTables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t crc8 = i;
+				uint32_t crc16 = i << 8;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					crc8 = (crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : crc8 << 1;
+					crc16 = (crc16 & 0x8000) ? (crc16 << 1) ^ 0x8005 : crc16 << 1;
+				}
+
+				crc8_table[i] = static_cast<uint8_t>(crc8);
+				crc16_table[0][i] = static_cast<uint16_t>(crc16);
+			}
+
+			for (size_t slice = 1; slice < 8; slice++)
+				for (size_t i = 0; i < 256; i++)
+				{
+					const uint16_t crc = crc16_table[slice - 1][i];
+					crc16_table[slice][i] = static_cast<uint16_t>((crc << 8) ^ crc16_table[0][crc >> 8]);
+				}
+		}
+
+		uint8_t crc8_table[256];
+		// Tables of CRC-16 of the byte followed by 0 to 7 zero bytes, for slicing by 8
+		uint16_t crc16_table[8][256];
+	};
+
+	const CrcTables& GetCrcTables()
+	{
+		static const CrcTables tables;
+		return tables;
+	}
+
+	uint8_t Crc8(const uint8_t* data, size_t size)
+	{
+		const auto& tables = GetCrcTables();
+		uint8_t crc = 0;
+		for (size_t i = 0; i < size; i++)
+			crc = tables.crc8_table[crc ^ data[i]];
+		return crc;
+	}
+
+	uint16_t Crc16(const uint8_t* data, size_t size)
+	{
+		const auto& table = GetCrcTables().crc16_table;
+		uint32_t crc = 0;
+		for (; size >= 8; size -= 8, data += 8)
+		{
+			crc ^= data[0] << 8 | data[1];
+			crc = table[7][crc >> 8] ^ table[6][crc & 0xFF] ^ table[5][data[2]] ^ table[4][data[3]] ^
+				table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+		}
+
+		for (; size != 0; size--, data++)
+			crc = ((crc << 8) & 0xFFFF) ^ table[0][(crc >> 8) ^ *data];
+		return static_cast<uint16_t>(crc);
+	}
+
+	/**
+	 * \brief Appends big-endian bit fields to the byte vector
+	 */
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(vector<uint8_t>& data) : data_(data)
+		{
+		}
+
+		void Write(uint32_t value, int bits)
+		{
+			if (bits == 0)
+				return;
+
+			accumulator_ = (accumulator_ << bits) | (value & ((uint64_t(1) << bits) - 1));
+			count_ += bits;
+			while (count_ >= 8)
+			{
+				count_ -= 8;
+				data_.push_back(static_cast<uint8_t>(accumulator_ >> count_));
+			}
+		}
+
+		void WriteSigned(int32_t value, int bits)
+		{
+			Write(static_cast<uint32_t>(value), bits);
+		}
+
+		void WriteUnary(uint32_t zeros)
+		{
+			for (; zeros >= 32; zeros -= 32)
+				Write(0, 32);
+			Write(1, static_cast<int>(zeros) + 1);
+		}
+
+		void WriteRice(int32_t value, int parameter)
+		{
+			const uint32_t zigzag = ZigZag(value);
+			const uint32_t quotient = zigzag >> parameter;
+			const uint32_t low = zigzag & ((uint32_t(1) << parameter) - 1);
+
+			// Unary quotient, stop bit and low bits in one field
+			if (quotient + 1 + parameter <= 32)
+			{
+				Write((uint32_t(1) << parameter) | low, static_cast<int>(quotient) + 1 + parameter);
+			}
+			else
+			{
+				WriteUnary(quotient);
+				Write(low, parameter);
+			}
+		}
+
+		void AlignToByte()
+		{
+			if (count_ != 0)
+				Write(0, 8 - count_);
+		}
+
+	private:
+		vector<uint8_t>& data_;
+		uint64_t accumulator_ = 0;
+		int count_ = 0;
+	};
+
+	/**
+	 * \brief Reads big-endian bit fields through a 64 bit cache, refilled by one unaligned load
+	 * \throw runtime_error read past the end of the data
+	 */
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* data, size_t size, size_t position) : data_(data), size_(size), byte_(position)
+		{
+		}
+
+		uint32_t Read(int bits)
+		{
+			if (bits == 0)
+				return 0;
+
+			if (cached_ < bits)
+			{
+				Refill();
+				if (cached_ < bits)
+					throw runtime_error("unexpected end of stream");
+			}
+
+			const auto value = static_cast<uint32_t>(cache_ >> (64 - bits));
+			Consume(bits);
+			return value;
+		}
+
+		int32_t ReadSigned(int bits)
+		{
+			if (bits == 0)
+				return 0;
+
+			return static_cast<int32_t>(Read(bits) << (32 - bits)) >> (32 - bits);
+		}
+
+		uint32_t ReadUnary()
+		{
+			uint32_t zeros = 0;
+			for (;;)
+			{
+				Refill();
+				const int count = cache_ != 0 ? CountLeadingZeros(cache_) : 64;
+				if (count < cached_)
+				{
+					Consume(count + 1);
+					return zeros + count;
+				}
+
+				zeros += cached_;
+				cache_ = 0;
+				cached_ = 0;
+			}
+		}
+
+		int32_t ReadRice(int parameter)
+		{
+			Refill();
+
+			uint32_t zigzag;
+			const int zeros = cache_ != 0 ? CountLeadingZeros(cache_) : 64;
+			if (zeros + 1 + parameter <= cached_)
+			{
+				// Quotient and low bits are in the cache
+				const auto low = parameter != 0 ? static_cast<uint32_t>((cache_ << (zeros + 1)) >> (64 - parameter)) : 0;
+				zigzag = (static_cast<uint32_t>(zeros) << parameter) | low;
+				Consume(zeros + 1 + parameter);
+			}
+			else
+			{
+				const uint32_t quotient = ReadUnary();
+				zigzag = (quotient << parameter) | Read(parameter);
+			}
+
+			return static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+		}
+
+		void AlignToByte()
+		{
+			Consume(cached_ & 7);
+		}
+
+		[[nodiscard]] size_t GetBytePosition() const
+		{
+			return byte_ - static_cast<size_t>(cached_) / 8;
+		}
+
+	private:
+		/**
+		 * \brief Top up the cache to at least 56 bits, unless the data ends.
+		 * Bits below the cached ones are zeros or the following bits of the data.
+		 */
+		void Refill()
+		{
+			if (byte_ + 8 <= size_)
+			{
+				uint64_t value;
+				std::memcpy(&value, data_ + byte_, 8);
+				cache_ |= ByteSwap64(value) >> cached_;
+				byte_ += static_cast<size_t>(63 - cached_) >> 3;
+				cached_ |= 56;
+				return;
+			}
+
+			for (; cached_ <= 56 && byte_ < size_; byte_++, cached_ += 8)
+				cache_ |= uint64_t(data_[byte_]) << (56 - cached_);
+
+			if (cached_ == 0)
+				throw runtime_error("unexpected end of stream");
+		}
+
+		void Consume(int bits)
+		{
+			cache_ <<= bits;
+			cached_ -= bits;
+		}
+
+		const uint8_t* data_;
+		size_t size_;
+		// Next byte to load into the cache
+		size_t byte_;
+		uint64_t cache_ = 0;
+		int cached_ = 0;
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+	// Headers /////////////////////////////////////////////////////////////////
+
+	struct FrameHeader
+	{
+		size_t block_size = 0;
+		uint32_t channel_assignment = 0;
+		uint64_t first_sample = 0;
+		// Bytes of the header with its CRC-8
+		size_t size = 0;
+	};
+
+	bool ParseMetadata(const vector<uint8_t>& data, FlacStreamInfo& info, size_t& frames_start)
+	{
+		if (!FlacCodec::IsFlac(data.data(), data.size()))
+			return false;
+
+		bool has_info = false;
+		for (size_t pos = 4; pos + 4 <= data.size(); )
+		{
+			const bool last = (data[pos] & 0x80) != 0;
+			const int type = data[pos] & 0x7F;
+			const size_t length = data[pos + 1] << 16 | data[pos + 2] << 8 | data[pos + 3];
+			pos += 4;
+
+			if (type == 0 && length >= kStreamInfoSize && pos + kStreamInfoSize <= data.size())
+			{
+				BitReader reader(data.data(), data.size(), pos);
+				info.min_block_size = reader.Read(16);
+				info.max_block_size = reader.Read(16);
+				reader.Read(24);
+				reader.Read(24);
+				info.sample_rate = reader.Read(20);
+				info.num_channels = reader.Read(3) + 1;
+				info.bit_depth = static_cast<int>(reader.Read(5)) + 1;
+				const uint64_t high = reader.Read(4);
+				info.num_frames = high << 32 | reader.Read(32);
+				has_info = true;
+			}
+
+			pos += length;
+			if (last)
+			{
+				frames_start = pos;
+				return has_info && pos <= data.size();
+			}
+		}
+
+		return false;
+	}
+
+	uint32_t GetBlockSizeCode(size_t block_size)
+	{
+		if (block_size == 192)
+			return 1;
+
+		for (uint32_t code = 2; code <= 5; code++)
+			if (block_size == size_t(576) << (code - 2))
+				return code;
+
+		for (uint32_t code = 8; code <= 15; code++)
+			if (block_size == size_t(256) << (code - 8))
+				return code;
+
+		return block_size <= 256 ? 6 : 7;
+	}
+
+	uint32_t GetSampleRateCode(uint32_t sample_rate)
+	{
+		static constexpr uint32_t kRates[] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+		for (uint32_t code = 1; code < std::size(kRates); code++)
+			if (sample_rate == kRates[code])
+				return code;
+
+		if (sample_rate % 1000 == 0 && sample_rate / 1000 < 256)
+			return 12;
+		if (sample_rate < 65536)
+			return 13;
+		if (sample_rate % 10 == 0 && sample_rate / 10 < 65536)
+			return 14;
+		return 0;
+	}
+
+	uint32_t GetSampleSizeCode(int bit_depth)
+	{
+		switch (bit_depth)
+		{
+			case 8:
+				return 1;
+
+			case 16:
+				return 4;
+
+			default:
+				return 6;
+		}
+	}
+
+	void WriteUtf8(BitWriter& writer, uint64_t value)
+	{
+		if (value < 0x80)
+		{
+			writer.Write(static_cast<uint32_t>(value), 8);
+			return;
+		}
+
+		// Leading byte holds 7 - bytes bits, every continuation byte 6 bits
+		int bytes = 2;
+		while (bytes < 7 && value >= uint64_t(1) << (5 * bytes + 1))
+			bytes++;
+
+		const uint32_t prefix = (0xFF00u >> bytes) & 0xFF;
+		writer.Write(prefix | static_cast<uint32_t>(value >> (6 * (bytes - 1))), 8);
+		for (int byte = bytes - 2; byte >= 0; byte--)
+			writer.Write(0x80 | static_cast<uint32_t>((value >> (6 * byte)) & 0x3F), 8);
+	}
+
+	uint64_t ReadUtf8(BitReader& reader)
+	{
+		const uint32_t first = reader.Read(8);
+		if ((first & 0x80) == 0)
+			return first;
+
+		int bytes = 0;
+		while (bytes < 8 && (first & (0x80u >> bytes)))
+			bytes++;
+
+		if (bytes < 2 || bytes > 7)
+			throw runtime_error("invalid frame number");
+
+		uint64_t value = first & (0x7Fu >> bytes);
+		for (int byte = 1; byte < bytes; byte++)
+		{
+			const uint32_t next = reader.Read(8);
+			if ((next & 0xC0) != 0x80)
+				throw runtime_error("invalid frame number");
+			value = value << 6 | (next & 0x3F);
+		}
+
+		return value;
+	}
+
+	size_t GetNumFrameChannels(uint32_t channel_assignment)
+	{
+		return channel_assignment < kLeftSide ? channel_assignment + 1 : 2;
+	}
+
+	bool IsSideChannel(uint32_t channel_assignment, size_t channel)
+	{
+		return (channel_assignment == kLeftSide && channel == 1) || (channel_assignment == kRightSide && channel == 0) ||
+			(channel_assignment == kMidSide && channel == 1);
+	}
+
+	/**
+	 * \brief Parse frame header at the position and check it against the stream info
+	 * \return false, if there is no valid frame header
+	 */
+	bool ReadFrameHeader(const vector<uint8_t>& data, size_t pos, const FlacStreamInfo& info, FrameHeader& header)
+	{
+		if (pos + 2 > data.size() || data[pos] != 0xFF || (data[pos + 1] & 0xFE) != 0xF8)
+			return false;
+
+		try
+		{
+			BitReader reader(data.data(), data.size(), pos + 2);
+			const bool variable_blocking = (data[pos + 1] & 1) != 0;
+			const uint32_t block_size_code = reader.Read(4);
+			const uint32_t sample_rate_code = reader.Read(4);
+			header.channel_assignment = reader.Read(4);
+			const uint32_t sample_size_code = reader.Read(3);
+			if (reader.Read(1) != 0 || block_size_code == 0 || sample_rate_code == 15 || header.channel_assignment > kMidSide ||
+				sample_size_code == 3)
+				return false;
+
+			const uint64_t number = ReadUtf8(reader);
+
+			if (block_size_code == 1)
+				header.block_size = 192;
+			else if (block_size_code <= 5)
+				header.block_size = size_t(576) << (block_size_code - 2);
+			else if (block_size_code == 6)
+				header.block_size = reader.Read(8) + 1;
+			else if (block_size_code == 7)
+				header.block_size = reader.Read(16) + 1;
+			else
+				header.block_size = size_t(256) << (block_size_code - 8);
+
+			if (sample_rate_code == 12)
+				reader.Read(8);
+			else if (sample_rate_code == 13 || sample_rate_code == 14)
+				reader.Read(16);
+
+			const size_t crc_pos = reader.GetBytePosition();
+			if (reader.Read(8) != Crc8(data.data() + pos, crc_pos - pos))
+				return false;
+
+			static constexpr int kSampleSizes[] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+			const int bit_depth = sample_size_code == 0 ? info.bit_depth : kSampleSizes[sample_size_code];
+			if (bit_depth != info.bit_depth || GetNumFrameChannels(header.channel_assignment) != info.num_channels ||
+				(info.max_block_size != 0 && header.block_size > info.max_block_size))
+				return false;
+
+			header.first_sample = variable_blocking ? number : number * info.min_block_size;
+			header.size = reader.GetBytePosition() - pos;
+			return true;
+		}
+		catch (const runtime_error&)
+		{
+			return false;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+	// Encoder /////////////////////////////////////////////////////////////////
+
+	/**
+	 * \brief Partitioned Rice coding of a residual
+	 */
+	struct RicePlan
+	{
+		size_t partition_order = 0;
+		bool extended = false;
+		uint8_t parameters[size_t(1) << kMaxPartitionOrder] = {};
+		uint64_t bits = 0;
+	};
+
+	/**
+	 * \brief Rice parameter with the least estimated bits of count values with the zigzag sum
+	 */
+	int ChooseRiceParameter(uint64_t sum, size_t count, uint64_t& bits)
+	{
+		if (count == 0)
+		{
+			bits = 0;
+			return 0;
+		}
+
+		const int guess = Log2(sum / count);
+		int best = 0;
+		bits = numeric_limits<uint64_t>::max();
+		for (int parameter = std::max(guess - 1, 0); parameter <= std::min(guess + 1, kMaxRiceParameter); parameter++)
+		{
+			const uint64_t estimate = count * (parameter + 1) + (sum >> parameter);
+			if (estimate < bits)
+			{
+				bits = estimate;
+				best = parameter;
+			}
+		}
+
+		return best;
+	}
+
+	/**
+	 * \brief Choose partition order and Rice parameters of the residual after the warm-up samples
+	 * \param sums scratch of 2^max_partition_order values
+	 */
+	void PlanResidual(const int32_t* residual, size_t num_frames, size_t order, size_t max_partition_order, uint64_t* sums, RicePlan& plan)
+	{
+		// Partitions must split the block evenly and the first one must hold the warm-up samples
+		size_t max_order = 0;
+		while (max_order < max_partition_order && num_frames % (size_t(2) << max_order) == 0 && (num_frames >> (max_order + 1)) > order)
+			max_order++;
+
+		// Sums of the finest partitions, coarser ones are merged from them
+		const size_t partition_size = num_frames >> max_order;
+		for (size_t partition = 0, idx = 0; partition < (size_t(1) << max_order); partition++)
+		{
+			const size_t end = (partition + 1) * partition_size - order;
+			uint64_t sum = 0;
+			for (; idx < end; idx++)
+				sum += ZigZag(residual[idx]);
+			sums[partition] = sum;
+		}
+
+		plan.bits = numeric_limits<uint64_t>::max();
+		RicePlan candidate;
+		for (size_t partition_order = max_order + 1; partition_order-- > 0; )
+		{
+			const size_t num_partitions = size_t(1) << partition_order;
+			const size_t size = num_frames >> partition_order;
+
+			candidate.partition_order = partition_order;
+			candidate.extended = false;
+			candidate.bits = 2 + 4;
+			for (size_t partition = 0; partition < num_partitions; partition++)
+			{
+				uint64_t bits;
+				const int parameter = ChooseRiceParameter(sums[partition], size - (partition == 0 ? order : 0), bits);
+				candidate.parameters[partition] = static_cast<uint8_t>(parameter);
+				candidate.extended |= parameter > 14;
+				candidate.bits += bits;
+			}
+			candidate.bits += num_partitions * (candidate.extended ? 5 : 4);
+
+			if (candidate.bits < plan.bits)
+				plan = candidate;
+
+			for (size_t partition = 0; partition < num_partitions / 2; partition++)
+				sums[partition] = sums[2 * partition] + sums[2 * partition + 1];
+		}
+	}
+
+	struct Subframe
+	{
+		int type = kSubframeVerbatim;
+		// Bits per sample without the wasted bits
+		int bps = 0;
+		int wasted_bits = 0;
+		const int32_t* samples = nullptr;
+
+		size_t order = 0;
+		int precision = 0;
+		int shift = 0;
+		int32_t coefficients[kMaxLpcOrder] = {};
+
+		const int32_t* residual = nullptr;
+		RicePlan rice;
+		uint64_t bits = 0;
+	};
+
+	/**
+	 * \brief Fixed polynomial residual of the order
+	 * \return false, if the residual doesn't fit the Rice coder
+	 */
+	bool ComputeFixedResidual(const int32_t* x, size_t num_frames, size_t order, int32_t* residual)
+	{
+		for (size_t i = order; i < num_frames; i++)
+		{
+			int64_t value;
+			switch (order)
+			{
+				case 0:
+					value = x[i];
+					break;
+
+				case 1:
+					value = int64_t(x[i]) - x[i - 1];
+					break;
+
+				case 2:
+					value = int64_t(x[i]) - 2 * int64_t(x[i - 1]) + x[i - 2];
+					break;
+
+				case 3:
+					value = int64_t(x[i]) - 3 * int64_t(x[i - 1]) + 3 * int64_t(x[i - 2]) - x[i - 3];
+					break;
+
+				default:
+					value = int64_t(x[i]) - 4 * int64_t(x[i - 1]) + 6 * int64_t(x[i - 2]) - 4 * int64_t(x[i - 3]) + x[i - 4];
+					break;
+			}
+
+			if (value >= kMaxResidual || value <= -kMaxResidual)
+				return false;
+			residual[i - order] = static_cast<int32_t>(value);
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Quantized linear prediction residual
+	 * \return false, if the residual doesn't fit the Rice coder
+	 */
+	bool ComputeLpcResidual(const int32_t* x, size_t num_frames, const int32_t* lpc_coefficients, size_t order, int shift, int32_t* residual)
+	{
+		// Local copy, stores to the residual can't alias it
+		int32_t coefficients[kMaxLpcOrder];
+		std::copy_n(lpc_coefficients, order, coefficients);
+
+		for (size_t i = order; i < num_frames; i++)
+		{
+			int64_t prediction = 0;
+			for (size_t j = 0; j < order; j++)
+				prediction += int64_t(coefficients[j]) * x[i - 1 - j];
+
+			const int64_t value = x[i] - (prediction >> shift);
+			if (value >= kMaxResidual || value <= -kMaxResidual)
+				return false;
+			residual[i - order] = static_cast<int32_t>(value);
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Tukey(0.5) window of the block length, kept per thread as blocks have the same length
+	 */
+	const vector<double>& GetWindow(size_t num_frames)
+	{
+		thread_local vector<double> window;
+		if (window.size() != num_frames)
+		{
+			window.assign(num_frames, 1.);
+			const size_t taper = num_frames / 4;
+			for (size_t i = 0; i < taper; i++)
+			{
+				const double value = 0.5 - 0.5 * std::cos(kPi * static_cast<double>(i) / static_cast<double>(taper));
+				window[i] = value;
+				window[num_frames - 1 - i] = value;
+			}
+		}
+
+		return window;
+	}
+
+	/**
+	 * \brief Precision of quantized LPC coefficients, as libFLAC chooses it
+	 */
+	int GetLpcPrecision(int bps, size_t num_frames, size_t order)
+	{
+		int precision;
+		if (bps <= 16)
+		{
+			precision = num_frames <= 192 ? 7 : num_frames <= 384 ? 8 : num_frames <= 576 ? 9 : num_frames <= 1152 ? 10 :
+				num_frames <= 2304 ? 11 : num_frames <= 4608 ? 12 : 13;
+		}
+		else
+		{
+			precision = num_frames <= 384 ? 13 : num_frames <= 1152 ? 14 : 15;
+		}
+
+		// Keeps the prediction in 32 bits for decoders with 32 bit accumulators
+		if (bps <= 17)
+			precision = std::min(precision, 32 - bps - Log2(order));
+		return precision;
+	}
+
+	/**
+	 * \brief Quantize prediction coefficients with error feedback
+	 * \return false, if the coefficients can't be quantized
+	 */
+	bool QuantizeCoefficients(const double* lp, size_t order, int precision, int32_t* coefficients, int& shift)
+	{
+		double max_abs = 0.;
+		for (size_t j = 0; j < order; j++)
+			max_abs = std::max(max_abs, std::fabs(lp[j]));
+		if (max_abs <= 0.)
+			return false;
+
+		// One bit of the precision is the sign
+		int exponent;
+		std::frexp(max_abs, &exponent);
+		shift = std::min(precision - 1 - exponent, 15);
+		if (shift < 0)
+			return false;
+
+		const int32_t max_value = (1 << (precision - 1)) - 1;
+		const int32_t min_value = -(1 << (precision - 1));
+		double error = 0.;
+		for (size_t j = 0; j < order; j++)
+		{
+			error += lp[j] * (1 << shift);
+			const auto value = static_cast<int32_t>(std::clamp<double>(std::lround(error), min_value, max_value));
+			coefficients[j] = value;
+			error -= value;
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Choose the smallest subframe coding of the samples
+	 */
+	void AnalyzeSubframe(const int32_t* x, size_t num_frames, int bps, const FlacOptions& options, ScratchScope& scratch, Subframe& subframe)
+	{
+		subframe = Subframe();
+		subframe.samples = x;
+		subframe.bps = bps;
+
+		if (std::all_of(x, x + num_frames, [&](int32_t value) { return value == x[0]; }))
+		{
+			subframe.type = kSubframeConstant;
+			subframe.bits = 8 + bps;
+			return;
+		}
+
+		// Low bits, that are zero in every sample, are shifted out
+		uint32_t bits_used = 0;
+		for (size_t i = 0; i < num_frames; i++)
+			bits_used |= static_cast<uint32_t>(x[i]);
+
+		while ((bits_used & 1) == 0)
+		{
+			bits_used >>= 1;
+			subframe.wasted_bits++;
+		}
+
+		if (subframe.wasted_bits != 0)
+		{
+			auto* shifted = scratch.Allocate<int32_t>(num_frames);
+			for (size_t i = 0; i < num_frames; i++)
+				shifted[i] = x[i] >> subframe.wasted_bits;
+			x = shifted;
+			subframe.samples = x;
+			subframe.bps = bps -= subframe.wasted_bits;
+		}
+
+		const uint64_t header_bits = 8 + subframe.wasted_bits;
+		subframe.bits = header_bits + uint64_t(num_frames) * bps;
+
+		const size_t max_partition_order = std::min(options.max_partition_order, kMaxPartitionOrder);
+		auto* sums = scratch.Allocate<uint64_t>(size_t(1) << kMaxPartitionOrder);
+		auto* residual = scratch.Allocate<int32_t>(num_frames);
+		auto* best_residual = scratch.Allocate<int32_t>(num_frames);
+		RicePlan plan;
+
+		auto try_candidate = [&](int type, size_t order, uint64_t parameter_bits)
+		{
+			PlanResidual(residual, num_frames, order, max_partition_order, sums, plan);
+			const uint64_t bits = header_bits + order * bps + parameter_bits + plan.bits;
+			if (bits >= subframe.bits)
+				return false;
+
+			subframe.type = type;
+			subframe.order = order;
+			subframe.rice = plan;
+			subframe.bits = bits;
+			std::swap(residual, best_residual);
+			subframe.residual = best_residual;
+			return true;
+		};
+
+
+		// Fixed predictor with the least absolute residual, sums start after the longest warm-up
+		const size_t max_fixed_order = std::min(kMaxFixedOrder, num_frames - 1);
+		uint64_t abs_sums[kMaxFixedOrder + 1] = {};
+		int64_t last[kMaxFixedOrder + 1] = {};
+		for (size_t i = 0; i < num_frames; i++)
+		{
+			// Difference of each order is taken from the lower order at this and the previous sample
+			int64_t difference = x[i];
+			for (size_t order = 0; order <= max_fixed_order; order++)
+			{
+				const int64_t lower = difference;
+				if (i >= max_fixed_order)
+					abs_sums[order] += static_cast<uint64_t>(lower < 0 ? -lower : lower);
+				difference = lower - last[order];
+				last[order] = lower;
+			}
+		}
+
+		const size_t fixed_order = std::min_element(abs_sums, abs_sums + max_fixed_order + 1) - abs_sums;
+		if (ComputeFixedResidual(x, num_frames, fixed_order, residual))
+			try_candidate(kSubframeFixed, fixed_order, 0);
+
+		const size_t max_lpc_order = std::min({ options.max_lpc_order, kMaxLpcOrder, num_frames - 1 });
+		if (max_lpc_order == 0)
+			return;
+
+		// Autocorrelation of the windowed block
+		const auto& window = GetWindow(num_frames);
+		auto* windowed = scratch.Allocate<double>(num_frames);
+		for (size_t i = 0; i < num_frames; i++)
+			windowed[i] = x[i] * window[i];
+
+		double autocorrelation[kMaxLpcOrder + 1];
+		for (size_t lag = 0; lag <= max_lpc_order; lag++)
+		{
+			double sum = 0.;
+			for (size_t i = lag; i < num_frames; i++)
+				sum += windowed[i] * windowed[i - lag];
+			autocorrelation[lag] = sum;
+		}
+
+		if (autocorrelation[0] <= 0.)
+			return;
+
+		// Levinson-Durbin recursion, coefficients and prediction error of every order
+		double lp[kMaxLpcOrder][kMaxLpcOrder];
+		double errors[kMaxLpcOrder];
+		double a[kMaxLpcOrder] = {};
+		double error = autocorrelation[0];
+		size_t num_orders = 0;
+		for (size_t i = 0; i < max_lpc_order; i++)
+		{
+			double acc = autocorrelation[i + 1];
+			for (size_t j = 0; j < i; j++)
+				acc -= a[j] * autocorrelation[i - j];
+
+			const double reflection = acc / error;
+			double next[kMaxLpcOrder];
+			for (size_t j = 0; j < i; j++)
+				next[j] = a[j] - reflection * a[i - 1 - j];
+			next[i] = reflection;
+			std::copy(next, next + i + 1, a);
+
+			error *= 1. - reflection * reflection;
+			std::copy(a, a + i + 1, lp[i]);
+			errors[i] = error;
+			num_orders = i + 1;
+			if (error <= 0.)
+				break;
+		}
+
+		// Order with the least expected bits of residual and coefficients
+		size_t lpc_order = 0;
+		double best_bits = numeric_limits<double>::max();
+		for (size_t order = 1; order <= num_orders; order++)
+		{
+			const double bits_per_sample = errors[order - 1] > 0. ? std::max(0.5 * std::log2(errors[order - 1] * 0.5 / num_frames), 0.) : 0.;
+			const double bits = bits_per_sample * static_cast<double>(num_frames - order) +
+				static_cast<double>(order * (bps + GetLpcPrecision(bps, num_frames, order)));
+			if (bits < best_bits)
+			{
+				best_bits = bits;
+				lpc_order = order;
+			}
+		}
+
+		const int precision = GetLpcPrecision(bps, num_frames, lpc_order);
+		int32_t coefficients[kMaxLpcOrder];
+		int shift;
+		if (precision < 5 || !QuantizeCoefficients(lp[lpc_order - 1], lpc_order, precision, coefficients, shift))
+			return;
+
+		if (ComputeLpcResidual(x, num_frames, coefficients, lpc_order, shift, residual) &&
+			try_candidate(kSubframeLpc, lpc_order, 4 + 5 + lpc_order * precision))
+		{
+			subframe.precision = precision;
+			subframe.shift = shift;
+			std::copy(coefficients, coefficients + lpc_order, subframe.coefficients);
+		}
+	}
+
+	void WriteResidual(BitWriter& writer, const Subframe& subframe, size_t num_frames)
+	{
+		const auto& rice = subframe.rice;
+		writer.Write(rice.extended ? 1 : 0, 2);
+		writer.Write(static_cast<uint32_t>(rice.partition_order), 4);
+
+		const int parameter_bits = rice.extended ? 5 : 4;
+		const size_t size = num_frames >> rice.partition_order;
+		const int32_t* residual = subframe.residual;
+		for (size_t partition = 0; partition < (size_t(1) << rice.partition_order); partition++)
+		{
+			const int parameter = rice.parameters[partition];
+			writer.Write(parameter, parameter_bits);
+
+			const size_t count = size - (partition == 0 ? subframe.order : 0);
+			for (size_t i = 0; i < count; i++)
+				writer.WriteRice(residual[i], parameter);
+			residual += count;
+		}
+	}
+
+	void WriteSubframe(BitWriter& writer, const Subframe& subframe, size_t num_frames)
+	{
+		writer.Write(0, 1);
+		switch (subframe.type)
+		{
+			case kSubframeConstant:
+				writer.Write(0, 6);
+				writer.Write(0, 1);
+				writer.WriteSigned(subframe.samples[0], subframe.bps);
+				return;
+
+			case kSubframeVerbatim:
+				writer.Write(1, 6);
+				break;
+
+			case kSubframeFixed:
+				writer.Write(8 + static_cast<uint32_t>(subframe.order), 6);
+				break;
+
+			default:
+				writer.Write(31 + static_cast<uint32_t>(subframe.order), 6);
+				break;
+		}
+
+		if (subframe.wasted_bits != 0)
+		{
+			writer.Write(1, 1);
+			writer.WriteUnary(subframe.wasted_bits - 1);
+		}
+		else
+		{
+			writer.Write(0, 1);
+		}
+
+		const size_t num_samples = subframe.type == kSubframeVerbatim ? num_frames : subframe.order;
+		for (size_t i = 0; i < num_samples; i++)
+			writer.WriteSigned(subframe.samples[i], subframe.bps);
+
+		if (subframe.type == kSubframeVerbatim)
+			return;
+
+		if (subframe.type == kSubframeLpc)
+		{
+			writer.Write(subframe.precision - 1, 4);
+			writer.WriteSigned(subframe.shift, 5);
+			for (size_t j = 0; j < subframe.order; j++)
+				writer.WriteSigned(subframe.coefficients[j], subframe.precision);
+		}
+
+		WriteResidual(writer, subframe, num_frames);
+	}
+
+	/**
+	 * \brief Encode one frame of the audio
+	 */
+	void EncodeFrame(const PackedAudio& audio, size_t start, size_t num_frames, uint64_t frame_number, const FlacOptions& options,
+		vector<uint8_t>& out)
+	{
+		ScratchScope scratch;
+		const size_t num_channels = audio.GetNumChannels();
+		const int bit_depth = audio.GetBitDepth();
+
+		int32_t* samples[kMaxChannels];
+		for (size_t channel = 0; channel < num_channels; channel++)
+		{
+			samples[channel] = scratch.Allocate<int32_t>(num_frames);
+			audio.ReadInt(channel, start, num_frames, samples[channel]);
+		}
+
+		Subframe subframes[4];
+		uint32_t channel_assignment = static_cast<uint32_t>(num_channels - 1);
+		const Subframe* chosen[2] = {};
+		if (num_channels == 2)
+		{
+			// Left, right, side and mid, side takes one more bit
+			auto* side = scratch.Allocate<int32_t>(num_frames);
+			auto* mid = scratch.Allocate<int32_t>(num_frames);
+			for (size_t i = 0; i < num_frames; i++)
+			{
+				side[i] = samples[0][i] - samples[1][i];
+				mid[i] = (samples[0][i] + samples[1][i]) >> 1;
+			}
+
+			AnalyzeSubframe(samples[0], num_frames, bit_depth, options, scratch, subframes[0]);
+			AnalyzeSubframe(samples[1], num_frames, bit_depth, options, scratch, subframes[1]);
+			AnalyzeSubframe(side, num_frames, bit_depth + 1, options, scratch, subframes[2]);
+			AnalyzeSubframe(mid, num_frames, bit_depth, options, scratch, subframes[3]);
+
+			const uint64_t bits[] = {
+				subframes[0].bits + subframes[1].bits,
+				subframes[0].bits + subframes[2].bits,
+				subframes[2].bits + subframes[1].bits,
+				subframes[3].bits + subframes[2].bits
+			};
+			const Subframe* pairs[][2] = {
+				{ &subframes[0], &subframes[1] },
+				{ &subframes[0], &subframes[2] },
+				{ &subframes[2], &subframes[1] },
+				{ &subframes[3], &subframes[2] }
+			};
+			static constexpr uint32_t kAssignments[] = { 1, kLeftSide, kRightSide, kMidSide };
+
+			const size_t best = std::min_element(std::begin(bits), std::end(bits)) - std::begin(bits);
+			channel_assignment = kAssignments[best];
+			chosen[0] = pairs[best][0];
+			chosen[1] = pairs[best][1];
+		}
+
+		out.reserve(num_frames * num_channels * bit_depth / 8 + 64);
+		BitWriter writer(out);
+
+		// Frame header with fixed blocking
+		const uint32_t block_size_code = GetBlockSizeCode(num_frames);
+		const uint32_t sample_rate_code = GetSampleRateCode(audio.GetSampleRate());
+		writer.Write(0xFFF8, 16);
+		writer.Write(block_size_code, 4);
+		writer.Write(sample_rate_code, 4);
+		writer.Write(channel_assignment, 4);
+		writer.Write(GetSampleSizeCode(bit_depth), 3);
+		writer.Write(0, 1);
+		WriteUtf8(writer, frame_number);
+
+		if (block_size_code == 6)
+			writer.Write(static_cast<uint32_t>(num_frames - 1), 8);
+		else if (block_size_code == 7)
+			writer.Write(static_cast<uint32_t>(num_frames - 1), 16);
+
+		if (sample_rate_code == 12)
+			writer.Write(audio.GetSampleRate() / 1000, 8);
+		else if (sample_rate_code == 13)
+			writer.Write(audio.GetSampleRate(), 16);
+		else if (sample_rate_code == 14)
+			writer.Write(audio.GetSampleRate() / 10, 16);
+
+		writer.Write(Crc8(out.data(), out.size()), 8);
+
+		if (num_channels == 2)
+		{
+			WriteSubframe(writer, *chosen[0], num_frames);
+			WriteSubframe(writer, *chosen[1], num_frames);
+		}
+		else
+		{
+			// Other channels are coded independently, each one is written as soon as it's analyzed
+			for (size_t channel = 0; channel < num_channels; channel++)
+			{
+				ScratchScope channel_scratch;
+				AnalyzeSubframe(samples[channel], num_frames, bit_depth, options, channel_scratch, subframes[0]);
+				WriteSubframe(writer, subframes[0], num_frames);
+			}
+		}
+
+		writer.AlignToByte();
+		writer.Write(Crc16(out.data(), out.size()), 16);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+	// Decoder /////////////////////////////////////////////////////////////////
+
+	void DecodeResidual(BitReader& reader, size_t num_frames, size_t order, int32_t* residual)
+	{
+		const uint32_t method = reader.Read(2);
+		if (method > 1)
+			throw runtime_error("reserved residual coding method");
+
+		const int parameter_bits = method == 0 ? 4 : 5;
+		const uint32_t escape = (1u << parameter_bits) - 1;
+		const size_t partition_order = reader.Read(4);
+		const size_t size = num_frames >> partition_order;
+		if ((size << partition_order) != num_frames || size < order)
+			throw runtime_error("invalid partition order");
+
+		for (size_t partition = 0; partition < (size_t(1) << partition_order); partition++)
+		{
+			const uint32_t parameter = reader.Read(parameter_bits);
+			const size_t count = size - (partition == 0 ? order : 0);
+			if (parameter == escape)
+			{
+				const int bits = static_cast<int>(reader.Read(5));
+				for (size_t i = 0; i < count; i++)
+					residual[i] = reader.ReadSigned(bits);
+			}
+			else
+			{
+				for (size_t i = 0; i < count; i++)
+					residual[i] = reader.ReadRice(static_cast<int>(parameter));
+			}
+			residual += count;
+		}
+	}
+
+	/**
+	 * \brief Turn residual after the warm-up samples back into samples
+	 */
+	void RestoreFixed(int32_t* x, size_t num_frames, size_t order)
+	{
+		for (size_t i = order; i < num_frames; i++)
+		{
+			int64_t prediction;
+			switch (order)
+			{
+				case 0:
+					prediction = 0;
+					break;
+
+				case 1:
+					prediction = x[i - 1];
+					break;
+
+				case 2:
+					prediction = 2 * int64_t(x[i - 1]) - x[i - 2];
+					break;
+
+				case 3:
+					prediction = 3 * int64_t(x[i - 1]) - 3 * int64_t(x[i - 2]) + x[i - 3];
+					break;
+
+				default:
+					prediction = 4 * int64_t(x[i - 1]) - 6 * int64_t(x[i - 2]) + 4 * int64_t(x[i - 3]) - x[i - 4];
+					break;
+			}
+
+			x[i] = static_cast<int32_t>(x[i] + prediction);
+		}
+	}
+
+	void RestoreLpc(int32_t* x, size_t num_frames, const int32_t* lpc_coefficients, size_t order, int shift)
+	{
+		// Local copy, stores to the samples can't alias it
+		int32_t coefficients[kMaxLpcOrder];
+		std::copy_n(lpc_coefficients, order, coefficients);
+
+		for (size_t i = order; i < num_frames; i++)
+		{
+			int64_t prediction = 0;
+			for (size_t j = 0; j < order; j++)
+				prediction += int64_t(coefficients[j]) * x[i - 1 - j];
+			x[i] = static_cast<int32_t>(x[i] + (prediction >> shift));
+		}
+	}
+
+	void DecodeSubframe(BitReader& reader, size_t num_frames, int bps, int32_t* out)
+	{
+		if (reader.Read(1) != 0)
+			throw runtime_error("invalid subframe header");
+
+		const uint32_t type = reader.Read(6);
+		int wasted_bits = 0;
+		if (reader.Read(1) != 0)
+			wasted_bits = static_cast<int>(reader.ReadUnary()) + 1;
+		if (wasted_bits > bps)
+			throw runtime_error("invalid wasted bits");
+		bps -= wasted_bits;
+
+		if (type == 0)
+		{
+			std::fill(out, out + num_frames, reader.ReadSigned(bps));
+		}
+		else if (type == 1)
+		{
+			for (size_t i = 0; i < num_frames; i++)
+				out[i] = reader.ReadSigned(bps);
+		}
+		else if (type >= 8 && type <= 12)
+		{
+			const size_t order = type - 8;
+			if (order > num_frames)
+				throw runtime_error("predictor order exceeds block size");
+
+			for (size_t i = 0; i < order; i++)
+				out[i] = reader.ReadSigned(bps);
+			DecodeResidual(reader, num_frames, order, out + order);
+			RestoreFixed(out, num_frames, order);
+		}
+		else if (type >= 32)
+		{
+			const size_t order = type - 31;
+			if (order > num_frames)
+				throw runtime_error("predictor order exceeds block size");
+
+			for (size_t i = 0; i < order; i++)
+				out[i] = reader.ReadSigned(bps);
+
+			const int precision = static_cast<int>(reader.Read(4)) + 1;
+			const int shift = reader.ReadSigned(5);
+			if (precision == 16 || shift < 0)
+				throw runtime_error("invalid LPC coefficients");
+
+			int32_t coefficients[kMaxLpcOrder];
+			for (size_t j = 0; j < order; j++)
+				coefficients[j] = reader.ReadSigned(precision);
+
+			DecodeResidual(reader, num_frames, order, out + order);
+			RestoreLpc(out, num_frames, coefficients, order, shift);
+		}
+		else
+		{
+			throw runtime_error("reserved subframe type");
+		}
+
+		if (wasted_bits != 0)
+			for (size_t i = 0; i < num_frames; i++)
+				out[i] = static_cast<int32_t>(static_cast<uint32_t>(out[i]) << wasted_bits);
+	}
+
+	/**
+	 * \brief Decode the frame and store its samples in range, once its CRC-16 is verified
+	 * \param range frames of the stream, that audio holds from its beginning
+	 * \return position after the frame
+	 * \throw runtime_error frame is invalid
+	 */
+	size_t DecodeFrame(const vector<uint8_t>& data, size_t pos, const FrameHeader& header, const FlacStreamInfo& info,
+		const FrameRange& range, PackedAudio& audio)
+	{
+		const size_t num_frames = header.block_size;
+		if (header.first_sample + num_frames > info.num_frames)
+			throw runtime_error("frame is past the end of the stream");
+
+		ScratchScope scratch;
+		BitReader reader(data.data(), data.size(), pos + header.size);
+		int32_t* channels[kMaxChannels];
+		for (size_t channel = 0; channel < info.num_channels; channel++)
+		{
+			channels[channel] = scratch.Allocate<int32_t>(num_frames);
+			const int bps = info.bit_depth + (IsSideChannel(header.channel_assignment, channel) ? 1 : 0);
+			DecodeSubframe(reader, num_frames, bps, channels[channel]);
+		}
+
+		reader.AlignToByte();
+		const size_t crc_pos = reader.GetBytePosition();
+		if (reader.Read(16) != Crc16(data.data() + pos, crc_pos - pos))
+			throw runtime_error("frame CRC mismatch");
+
+		int32_t* left = channels[0];
+		int32_t* right = channels[1];
+		switch (header.channel_assignment)
+		{
+			case kLeftSide:
+				for (size_t i = 0; i < num_frames; i++)
+					right[i] = left[i] - right[i];
+				break;
+
+			case kRightSide:
+				for (size_t i = 0; i < num_frames; i++)
+					left[i] += right[i];
+				break;
+
+			case kMidSide:
+				for (size_t i = 0; i < num_frames; i++)
+				{
+					const int32_t side = right[i];
+					const int32_t mid = static_cast<int32_t>(static_cast<uint32_t>(left[i]) << 1) | (side & 1);
+					left[i] = (mid + side) >> 1;
+					right[i] = (mid - side) >> 1;
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		const auto frames = range.Intersect({ header.first_sample, header.first_sample + num_frames });
+		if (!frames.IsEmpty())
+		{
+			for (size_t channel = 0; channel < info.num_channels; channel++)
+				audio.WriteInt(channel, frames.begin - range.begin, frames.GetLength(), channels[channel] + (frames.begin - header.first_sample));
+		}
+
+		return reader.GetBytePosition();
+	}
+
+	/**
+	 * \brief Find the first frame at or after the position, that passes both CRC checks, and decode it
+	 * \param pos position to search from, becomes position of the found frame or end
+	 * \return position after the frame
+	 */
+	size_t SyncFrame(const vector<uint8_t>& data, size_t& pos, size_t end, const FlacStreamInfo& info, const FrameRange& range,
+		PackedAudio& audio, FrameHeader& header)
+	{
+		for (; pos < end; pos++)
+		{
+			if (!ReadFrameHeader(data, pos, info, header))
+				continue;
+
+			try
+			{
+				return DecodeFrame(data, pos, header, info, range, audio);
+			}
+			catch (const runtime_error&)
+			{
+				// Sync code inside of a frame
+			}
+		}
+
+		return end;
+	}
+
+	/**
+	 * \brief Bisect the stream for a frame, that starts at or before the sample
+	 * \return position of the frame, at most kSeekPrecision bytes before the last such frame
+	 */
+	size_t SeekFrame(const vector<uint8_t>& data, size_t frames_start, const FlacStreamInfo& info, const FrameRange& range,
+		PackedAudio& audio, uint64_t sample)
+	{
+		// Frame at low starts at or before the sample, no frame from high on does
+		size_t low = frames_start;
+		size_t high = data.size();
+		while (high - low > kSeekPrecision)
+		{
+			const size_t middle = low + (high - low) / 2;
+			size_t pos = middle;
+			FrameHeader header;
+			SyncFrame(data, pos, high, info, range, audio, header);
+
+			if (pos < high && header.first_sample <= sample)
+				low = pos;
+			else
+				high = middle;
+		}
+
+		return low;
+	}
+}
+
+bool FlacCodec::IsFlac(const uint8_t* data, size_t size)
+{
+	return size >= 4 && data[0] == 'f' && data[1] == 'L' && data[2] == 'a' && data[3] == 'C';
+}
+
+bool FlacCodec::HasFlacExtension(const std::string& filename)
+{
+	const auto dot = filename.find_last_of('.');
+	if (dot == string::npos)
+		return false;
+
+	auto ext = filename.substr(dot);
+	transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+	return ext == ".flac";
+}
+
+bool FlacCodec::ReadStreamInfo(const std::vector<uint8_t>& data, FlacStreamInfo& info)
+{
+	size_t frames_start;
+	return ParseMetadata(data, info, frames_start);
+}
+
+bool FlacCodec::Decode(const std::vector<uint8_t>& data, PackedAudio& audio, size_t num_threads)
+{
+	return Decode(data, audio, FrameRange(), num_threads);
+}
+
+bool FlacCodec::Decode(const std::vector<uint8_t>& data, PackedAudio& audio, const FrameRange& range, size_t num_threads)
+{
+	StageTimer timer("flac decode");
+
+	FlacStreamInfo info;
+	size_t frames_start = 0;
+	if (!ParseMetadata(data, info, frames_start))
+	{
+		cerr << "Error: Invalid .flac file." << endl;
+		return false;
+	}
+
+	if (info.bit_depth != 8 && info.bit_depth != 16 && info.bit_depth != 24)
+	{
+		cerr << "Error: this FLAC file has a bit depth that is not 8, 16 or 24 bits" << endl;
+		return false;
+	}
+
+	if (info.num_frames == 0 && frames_start < data.size())
+	{
+		cerr << "Error: FLAC files without the total number of samples aren`t supported." << endl;
+		return false;
+	}
+
+	const auto frames = range.Clamp(static_cast<size_t>(info.num_frames));
+	audio = PackedAudio(info.sample_rate, info.bit_depth, info.num_channels, frames.GetLength());
+	if (frames.IsEmpty())
+		return true;
+
+	// Frames of the range are found by bisecting the stream on the sample numbers of the frame headers,
+	// so only frames from the one before the range begin are decoded
+	const size_t span_begin = frames.begin > 0 ? SeekFrame(data, frames_start, info, frames, audio, frames.begin) : frames_start;
+	const size_t span_end = frames.end < info.num_frames ? SeekFrame(data, span_begin, info, frames, audio, frames.end) : data.size();
+
+	// Span is split into byte ranges, every range decodes the frames, that start in it.
+	// Range, except the first one, starts at its first frame, that passes both CRC checks.
+	// The last range goes on to the frame, that starts at or after the range end.
+	if (num_threads == 0)
+		num_threads = std::max(1u, thread::hardware_concurrency());
+	const size_t span_size = span_end - span_begin;
+	const size_t num_chunks = std::clamp<size_t>(span_size / kMinDecodeChunkBytes, 1, num_threads * 4);
+
+	atomic<uint64_t> decoded_frames = 0;
+	mutex error_mutex;
+	string error;
+
+	auto decode_chunk = [&](size_t chunk)
+	{
+		const size_t end = chunk + 1 == num_chunks ? data.size() : span_begin + span_size * (chunk + 1) / num_chunks;
+		size_t pos = span_begin + span_size * chunk / num_chunks;
+		bool synced = chunk == 0;
+		uint64_t decoded = 0;
+
+		try
+		{
+			FrameHeader header;
+			while (pos < end)
+			{
+				size_t next;
+				if (synced)
+				{
+					if (!ReadFrameHeader(data, pos, info, header))
+						throw runtime_error("lost frame sync");
+					if (header.first_sample >= frames.end)
+						break;
+					next = DecodeFrame(data, pos, header, info, frames, audio);
+				}
+				else
+				{
+					next = SyncFrame(data, pos, end, info, frames, audio, header);
+					if (pos == end || header.first_sample >= frames.end)
+						break;
+					synced = true;
+				}
+
+				decoded += frames.Intersect({ header.first_sample, header.first_sample + header.block_size }).GetLength();
+				pos = next;
+			}
+		}
+		catch (const runtime_error& e)
+		{
+			lock_guard<mutex> lock(error_mutex);
+			if (error.empty())
+				error = e.what();
+		}
+
+		decoded_frames += decoded;
+	};
+
+	if (num_chunks == 1)
+	{
+		decode_chunk(0);
+	}
+	else
+	{
+		ThreadPool pool(num_threads);
+		for (size_t chunk = 0; chunk < num_chunks; chunk++)
+			pool.Submit([&decode_chunk, chunk] { decode_chunk(chunk); });
+		pool.Wait();
+	}
+
+	if (error.empty() && decoded_frames != frames.GetLength())
+		error = "stream is incomplete";
+
+	if (!error.empty())
+	{
+		cerr << "Error: Invalid .flac file, " << error << "." << endl;
+		return false;
+	}
+
+	timer.SetSamples(audio.GetNumFrames() * audio.GetNumChannels());
+	timer.SetBytes(data.size());
+	return true;
+}
+
+bool FlacCodec::Encode(const PackedAudio& audio, std::vector<uint8_t>& data, const FlacOptions& options)
+{
+	const int bit_depth = audio.GetBitDepth();
+	if (bit_depth != 8 && bit_depth != 16 && bit_depth != 24)
+	{
+		cerr << "Error: FLAC files of " << bit_depth << " bits aren`t supported, only 8, 16 or 24 bits" << endl;
+		return false;
+	}
+
+	if (audio.GetNumChannels() < 1 || audio.GetNumChannels() > kMaxChannels)
+	{
+		cerr << "Error: FLAC files have 1 to 8 channels." << endl;
+		return false;
+	}
+
+	StageTimer timer("flac encode", audio.GetNumFrames() * audio.GetNumChannels());
+
+	const size_t block_size = std::clamp<size_t>(options.block_size, 16, 65535);
+	const size_t num_frames = audio.GetNumFrames();
+	const size_t num_blocks = (num_frames + block_size - 1) / block_size;
+
+	// Frames are independent, every one is encoded into its own buffer
+	vector<vector<uint8_t>> frames(num_blocks);
+	auto encode_frame = [&](size_t block)
+	{
+		const size_t start = block * block_size;
+		EncodeFrame(audio, start, std::min(block_size, num_frames - start), block, options, frames[block]);
+	};
+
+	if (num_blocks <= 1 || options.num_threads == 1)
+	{
+		for (size_t block = 0; block < num_blocks; block++)
+			encode_frame(block);
+	}
+	else
+	{
+		ThreadPool pool(options.num_threads);
+		for (size_t block = 0; block < num_blocks; block++)
+			pool.Submit([&encode_frame, block] { encode_frame(block); });
+		pool.Wait();
+	}
+
+	size_t min_frame_size = num_blocks != 0 ? numeric_limits<size_t>::max() : 0;
+	size_t max_frame_size = 0;
+	size_t total_size = 4 + 4 + kStreamInfoSize;
+	for (const auto& frame : frames)
+	{
+		min_frame_size = std::min(min_frame_size, frame.size());
+		max_frame_size = std::max(max_frame_size, frame.size());
+		total_size += frame.size();
+	}
+
+	data.clear();
+	data.reserve(total_size);
+	data.insert(data.end(), { 'f', 'L', 'a', 'C' });
+
+	// The only metadata block, so it's the last one
+	BitWriter writer(data);
+	writer.Write(0x80, 8);
+	writer.Write(static_cast<uint32_t>(kStreamInfoSize), 24);
+	writer.Write(static_cast<uint32_t>(block_size), 16);
+	writer.Write(static_cast<uint32_t>(block_size), 16);
+	writer.Write(static_cast<uint32_t>(std::min<size_t>(min_frame_size, 0xFFFFFF)), 24);
+	writer.Write(static_cast<uint32_t>(std::min<size_t>(max_frame_size, 0xFFFFFF)), 24);
+	writer.Write(audio.GetSampleRate(), 20);
+	writer.Write(static_cast<uint32_t>(audio.GetNumChannels() - 1), 3);
+	writer.Write(bit_depth - 1, 5);
+	writer.Write(static_cast<uint32_t>(uint64_t(num_frames) >> 32), 4);
+	writer.Write(static_cast<uint32_t>(num_frames), 32);
+	// MD5 signature isn't computed, zero means unset
+	for (int i = 0; i < 4; i++)
+		writer.Write(0, 32);
+
+	for (const auto& frame : frames)
+		data.insert(data.end(), frame.begin(), frame.end());
+
+	timer.SetBytes(data.size());
+	return true;
+}
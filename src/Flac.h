@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PackedAudio.h"
+
+/**
+ * \brief FLAC encoder settings
+ */
+struct FlacOptions
+{
+	// Frames per FLAC frame
+	size_t block_size = 4096;
+	// Highest order of linear prediction, 0 leaves only fixed predictors
+	size_t max_lpc_order = 8;
+	// Highest partition order of the Rice coded residual
+	size_t max_partition_order = 8;
+	// Number of worker threads, 0 means hardware concurrency
+	size_t num_threads = 0;
+};
+
+/**
+ * \brief Audio format of the FLAC stream, from its STREAMINFO block
+ */
+struct FlacStreamInfo
+{
+	uint32_t sample_rate = 0;
+	size_t num_channels = 0;
+	int bit_depth = 0;
+	// 0 means unknown
+	uint64_t num_frames = 0;
+	size_t min_block_size = 0;
+	size_t max_block_size = 0;
+};
+
+/**
+ * \brief Lossless FLAC codec of 8, 16 and 24 bit audio
+ *
+ * Encoder chooses per frame the best of independent, left/side, right/side and mid/side stereo,
+ * and per subframe the smallest of constant, verbatim, fixed and LPC prediction with
+ * partitioned Rice coded residual. Frames are independent, so both encoder and decoder
+ * process them in parallel: decoder finds frame starts by their sync codes and header CRC,
+ * and verifies every decoded frame by its CRC-16. MD5 signature of the stream is left unset.
+ */
+class FlacCodec
+{
+public:
+	/**
+	 * \brief Whether the data starts with the FLAC stream marker
+	 */
+	[[nodiscard]] static bool IsFlac(const uint8_t* data, size_t size);
+
+	/**
+	 * \brief Whether file name has .flac extension
+	 */
+	[[nodiscard]] static bool HasFlacExtension(const std::string& filename);
+
+	/**
+	 * \brief Read the STREAMINFO block
+	 * \param data beginning of the stream, the first kilobytes are enough
+	 * \return true, if the stream info was read, otherwise false
+	 */
+	static bool ReadStreamInfo(const std::vector<uint8_t>& data, FlacStreamInfo& info);
+
+	/**
+	 * \brief Decode whole stream
+	 * \param data FLAC stream
+	 * \param audio decoded samples
+	 * \param num_threads number of worker threads, 0 means hardware concurrency
+	 * \return true, if decoding was successful, otherwise false
+	 */
+	static bool Decode(const std::vector<uint8_t>& data, PackedAudio& audio, size_t num_threads = 0);
+
+	/**
+	 * \brief Decode frames of the range, the frame before it is found by bisecting the stream
+	 * \param data FLAC stream
+	 * \param audio decoded samples of the range, clamped to the stream length
+	 * \param range frames to decode
+	 * \param num_threads number of worker threads, 0 means hardware concurrency
+	 * \return true, if decoding was successful, otherwise false
+	 */
+	static bool Decode(const std::vector<uint8_t>& data, PackedAudio& audio, const FrameRange& range, size_t num_threads = 0);
+
+	/**
+	 * \brief Encode samples into FLAC stream
+	 * \param audio samples of 8, 16 or 24 bits
+	 * \param data FLAC stream
+	 * \param options encoder settings
+	 * \return true, if encoding was successful, otherwise false
+	 */
+	static bool Encode(const PackedAudio& audio, std::vector<uint8_t>& data, const FlacOptions& options = FlacOptions());
+};
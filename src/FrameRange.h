@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+
+/**
+ * \brief Half-open range of frames [begin, end)
+ *
+ * Default range covers whole file.
+ */
+struct FrameRange
+{
+	static constexpr size_t kEnd = std::numeric_limits<size_t>::max();
+
+	size_t begin = 0;
+	size_t end = kEnd;
+
+	static FrameRange Empty()
+	{
+		return { 0, 0 };
+	}
+
+	[[nodiscard]] bool IsEmpty() const
+	{
+		return begin >= end;
+	}
+
+	[[nodiscard]] size_t GetLength() const
+	{
+		return IsEmpty() ? 0 : end - begin;
+	}
+
+	/**
+	 * \brief Limit range to the file length
+	 */
+	[[nodiscard]] FrameRange Clamp(size_t num_frames) const
+	{
+		return { std::min(begin, num_frames), std::min(end, num_frames) };
+	}
+
+	[[nodiscard]] bool Intersects(const FrameRange& other) const
+	{
+		return !IsEmpty() && !other.IsEmpty() && begin < other.end && other.begin < end;
+	}
+
+	/**
+	 * \brief Frames, that are in both ranges
+	 */
+	[[nodiscard]] FrameRange Intersect(const FrameRange& other) const
+	{
+		const FrameRange range{ std::max(begin, other.begin), std::min(end, other.end) };
+		return range.IsEmpty() ? Empty() : range;
+	}
+
+	/**
+	 * \brief Smallest range, that contains both ranges
+	 */
+	[[nodiscard]] FrameRange Union(const FrameRange& other) const
+	{
+		if (IsEmpty())
+			return other;
+		if (other.IsEmpty())
+			return *this;
+
+		return { std::min(begin, other.begin), std::max(end, other.end) };
+	}
+};
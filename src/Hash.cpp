@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstring>
+#include "Hash.h"
+
+namespace
+{
+	constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+	constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+	constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+	constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+	constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+	uint64_t RotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	// Input is little-endian, as the wave files are
+	uint64_t Read64(const uint8_t* ptr)
+	{
+		uint64_t value;
+		memcpy(&value, ptr, sizeof(value));
+		return value;
+	}
+
+	uint32_t Read32(const uint8_t* ptr)
+	{
+		uint32_t value;
+		memcpy(&value, ptr, sizeof(value));
+		return value;
+	}
+
+	uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * kPrime2;
+		acc = RotateLeft(acc, 31);
+		return acc * kPrime1;
+	}
+
+	uint64_t MergeRound(uint64_t acc, uint64_t value)
+	{
+		acc ^= Round(0, value);
+		return acc * kPrime1 + kPrime4;
+	}
+}
+
+XxHash64::XxHash64(uint64_t seed)
+	: seed_(seed), acc_{ seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1 }, buffer_{}
+{
+}
+
+void XxHash64::Update(const void* data, size_t size)
+{
+	auto ptr = static_cast<const uint8_t*>(data);
+	const auto end = ptr + size;
+	total_size_ += size;
+
+	// Fill the buffered stripe first
+	if (buffer_size_ > 0)
+	{
+		const auto n = std::min(sizeof(buffer_) - buffer_size_, size);
+		memcpy(buffer_ + buffer_size_, ptr, n);
+		buffer_size_ += n;
+		ptr += n;
+
+		if (buffer_size_ < sizeof(buffer_))
+			return;
+
+		for (size_t lane = 0; lane < 4; lane++)
+			acc_[lane] = Round(acc_[lane], Read64(buffer_ + lane * 8));
+		buffer_size_ = 0;
+	}
+
+	// Whole 32 byte stripes, 4 independent lanes
+	for (; ptr + 32 <= end; ptr += 32)
+	{
+		acc_[0] = Round(acc_[0], Read64(ptr));
+		acc_[1] = Round(acc_[1], Read64(ptr + 8));
+		acc_[2] = Round(acc_[2], Read64(ptr + 16));
+		acc_[3] = Round(acc_[3], Read64(ptr + 24));
+	}
+
+	buffer_size_ = static_cast<size_t>(end - ptr);
+	memcpy(buffer_, ptr, buffer_size_);
+}
+
+void XxHash64::Update(std::string_view str)
+{
+	Update(str.data(), str.size());
+}
+
+uint64_t XxHash64::Digest() const
+{
+	uint64_t hash;
+	if (total_size_ >= 32)
+	{
+		hash = RotateLeft(acc_[0], 1) + RotateLeft(acc_[1], 7) + RotateLeft(acc_[2], 12) + RotateLeft(acc_[3], 18);
+		for (auto acc : acc_)
+			hash = MergeRound(hash, acc);
+	}
+	else
+		hash = seed_ + kPrime5;
+
+	hash += total_size_;
+
+	const uint8_t* ptr = buffer_;
+	const uint8_t* end = buffer_ + buffer_size_;
+	for (; ptr + 8 <= end; ptr += 8)
+	{
+		hash ^= Round(0, Read64(ptr));
+		hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+	}
+
+	if (ptr + 4 <= end)
+	{
+		hash ^= static_cast<uint64_t>(Read32(ptr)) * kPrime1;
+		hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+		ptr += 4;
+	}
+
+	for (; ptr < end; ptr++)
+	{
+		hash ^= *ptr * kPrime5;
+		hash = RotateLeft(hash, 11) * kPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t XxHash64::Hash(const void* data, size_t size, uint64_t seed)
+{
+	XxHash64 hash(seed);
+	hash.Update(data, size);
+	return hash.Digest();
+}
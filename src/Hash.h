@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+/**
+ * \brief Streaming 64-bit xxHash (XXH64)
+ */
+class XxHash64
+{
+public:
+	explicit XxHash64(uint64_t seed = 0);
+
+	/**
+	 * \brief Feed next part of the data
+	 */
+	void Update(const void* data, size_t size);
+	void Update(std::string_view str);
+
+	/**
+	 * \brief Hash of all data fed so far, hashing can be continued after it
+	 */
+	[[nodiscard]] uint64_t Digest() const;
+
+	/**
+	 * \brief Hash of the single buffer
+	 */
+	[[nodiscard]] static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+
+private:
+	uint64_t seed_;
+	uint64_t acc_[4];
+	uint8_t buffer_[32];
+	size_t buffer_size_ = 0;
+	uint64_t total_size_ = 0;
+};
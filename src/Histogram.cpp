@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include "Histogram.h"
+
+Histogram::Histogram(std::string name, std::string unit, double min_value, size_t num_octaves, size_t buckets_per_octave)
+	: name_(std::move(name)), unit_(std::move(unit)), min_value_(min_value),
+	  buckets_per_octave_(static_cast<double>(buckets_per_octave)), buckets_(num_octaves * buckets_per_octave + 2)
+{
+	Reset();
+}
+
+void Histogram::Record(double value)
+{
+	// Single writer, so read-modify-write of the summary doesn't need to be atomic as a whole
+	const size_t count = count_.load(std::memory_order_relaxed);
+	sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	if (count == 0 || value < min_.load(std::memory_order_relaxed))
+		min_.store(value, std::memory_order_relaxed);
+	if (count == 0 || value > max_.load(std::memory_order_relaxed))
+		max_.store(value, std::memory_order_relaxed);
+
+	size_t bucket = 0;
+	if (value >= min_value_)
+	{
+		const double position = std::log2(value / min_value_) * buckets_per_octave_;
+		bucket = std::min(buckets_.size() - 1, 1 + static_cast<size_t>(position));
+	}
+
+	buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+	count_.store(count + 1, std::memory_order_release);
+}
+
+void Histogram::Reset()
+{
+	for (auto& bucket : buckets_)
+		bucket.store(0, std::memory_order_relaxed);
+
+	sum_.store(0., std::memory_order_relaxed);
+	min_.store(0., std::memory_order_relaxed);
+	max_.store(0., std::memory_order_relaxed);
+	count_.store(0, std::memory_order_release);
+}
+
+size_t Histogram::GetCount() const
+{
+	return count_.load(std::memory_order_acquire);
+}
+
+double Histogram::GetMin() const
+{
+	return min_.load(std::memory_order_relaxed);
+}
+
+double Histogram::GetMax() const
+{
+	return max_.load(std::memory_order_relaxed);
+}
+
+double Histogram::GetMean() const
+{
+	const size_t count = GetCount();
+	return count != 0 ? sum_.load(std::memory_order_relaxed) / static_cast<double>(count) : 0.;
+}
+
+double Histogram::GetPercentile(double percentile) const
+{
+	size_t total = 0;
+	for (const auto& bucket : buckets_)
+		total += bucket.load(std::memory_order_relaxed);
+
+	if (total == 0)
+		return 0.;
+
+	const auto rank = static_cast<size_t>(std::ceil(percentile / 100. * static_cast<double>(total)));
+	size_t seen = 0;
+	for (size_t i = 0; i < buckets_.size(); i++)
+	{
+		seen += buckets_[i].load(std::memory_order_relaxed);
+		if (seen >= std::max<size_t>(rank, 1))
+			return std::min(GetBucketUpperBound(i), GetMax());
+	}
+
+	return GetMax();
+}
+
+void Histogram::Print(std::ostream& out) const
+{
+	const auto flags = out.flags();
+	const auto precision = out.precision();
+
+	out << name_ << ": count " << GetCount() << std::fixed << std::setprecision(3)
+		<< ", min " << GetMin() << ", mean " << GetMean() << ", p50 " << GetPercentile(50)
+		<< ", p99 " << GetPercentile(99) << ", max " << GetMax() << ' ' << unit_ << std::endl;
+
+	size_t max_bucket = 0;
+	for (const auto& bucket : buckets_)
+		max_bucket = std::max(max_bucket, bucket.load(std::memory_order_relaxed));
+
+	constexpr size_t kBarWidth = 40;
+	for (size_t i = 0; i < buckets_.size(); i++)
+	{
+		const size_t value = buckets_[i].load(std::memory_order_relaxed);
+		if (value == 0)
+			continue;
+
+		out << "  < " << std::setw(10) << GetBucketUpperBound(i) << ' ' << unit_ << ' '
+			<< std::setw(10) << value << ' ' << std::string((value * kBarWidth + max_bucket - 1) / max_bucket, '#') << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void Histogram::PrintJson(std::ostream& out) const
+{
+	out << "{\"name\": \"" << name_ << "\", \"unit\": \"" << unit_ << "\", \"count\": " << GetCount()
+		<< ", \"min\": " << GetMin() << ", \"mean\": " << GetMean() << ", \"p50\": " << GetPercentile(50)
+		<< ", \"p99\": " << GetPercentile(99) << ", \"max\": " << GetMax() << "}";
+}
+
+double Histogram::GetBucketUpperBound(size_t bucket) const
+{
+	if (bucket + 1 == buckets_.size())
+		return GetMax();
+
+	return min_value_ * std::exp2(static_cast<double>(bucket) / buckets_per_octave_);
+}
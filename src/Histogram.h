@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Histogram with logarithmic buckets, that can be recorded from the real-time thread
+ *
+ * Bucket k holds values in [min * 2^(k / buckets_per_octave), min * 2^((k + 1) / buckets_per_octave)),
+ * smaller values go to the first bucket, larger ones to the last. Recording is wait-free and
+ * doesn't allocate; single writer is assumed, readers may read concurrently.
+ */
+class Histogram
+{
+public:
+	/**
+	 * \param name name, that is printed
+	 * \param unit unit of values, e.g. `ms`
+	 * \param min_value lower bound of the second bucket
+	 * \param num_octaves range of values, in octaves above min_value
+	 * \param buckets_per_octave resolution
+	 */
+	Histogram(std::string name, std::string unit, double min_value, size_t num_octaves, size_t buckets_per_octave = 4);
+
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	void Record(double value);
+	void Reset();
+
+	[[nodiscard]] size_t GetCount() const;
+	[[nodiscard]] double GetMin() const;
+	[[nodiscard]] double GetMax() const;
+	[[nodiscard]] double GetMean() const;
+
+	/**
+	 * \brief Upper bound of the bucket, that contains the percentile
+	 * \param percentile 0..100
+	 */
+	[[nodiscard]] double GetPercentile(double percentile) const;
+
+	/**
+	 * \brief Print summary and non-empty buckets as bars
+	 */
+	void Print(std::ostream& out) const;
+
+	/**
+	 * \brief Print summary as JSON object
+	 */
+	void PrintJson(std::ostream& out) const;
+
+private:
+	[[nodiscard]] double GetBucketUpperBound(size_t bucket) const;
+
+	std::string name_;
+	std::string unit_;
+	double min_value_;
+	double buckets_per_octave_;
+
+	std::vector<std::atomic<size_t>> buckets_;
+	std::atomic<size_t> count_ = 0;
+	std::atomic<double> sum_ = 0.;
+	std::atomic<double> min_ = 0.;
+	std::atomic<double> max_ = 0.;
+};
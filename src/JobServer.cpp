@@ -0,0 +1,362 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "JobServer.h"
+#include "Hash.h"
+#include "Meter.h"
+#include "Stats.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Separator of request fields, paths and chains have no tabs
+	constexpr char kFieldSeparator = '\t';
+
+	// Parsed chains kept for next jobs, the map is emptied when it grows over it
+	constexpr size_t kMaxCachedChains = 256;
+
+	mutex log_mutex;
+
+	vector<string> SplitFields(const string& line)
+	{
+		vector<string> fields;
+		size_t start = 0;
+		while (true)
+		{
+			const size_t end = line.find(kFieldSeparator, start);
+			fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+			if (end == string::npos)
+				return fields;
+
+			start = end + 1;
+		}
+	}
+
+	string QuoteJson(const string& text)
+	{
+		string quoted = "\"";
+		for (const char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				quoted += '\\';
+				quoted += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				constexpr char kHex[] = "0123456789abcdef";
+				quoted += "\\u00";
+				quoted += kHex[c >> 4];
+				quoted += kHex[c & 0xF];
+			}
+			else
+				quoted += c;
+		}
+		return quoted + "\"";
+	}
+
+	string ErrorResponse(const string& error)
+	{
+		return "{\"ok\": false, \"error\": " + QuoteJson(error) + "}";
+	}
+
+	double SecondsSince(chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	bool HasLineBreak(const string& text)
+	{
+		return text.find_first_of("\r\n") != string::npos;
+	}
+}
+
+struct JobServer::Connection
+{
+	LocalSocket socket;
+	thread worker;
+
+	// Job is running, connection is shut down only after it's answered
+	mutex busy_mutex;
+	bool busy = false;
+	atomic<bool> finished = false;
+};
+
+JobServer::JobServer(JobServerOptions options) : options_(std::move(options)), pool_(options_.num_threads)
+{
+	if (!options_.cache_dir.empty())
+		cache_ = make_unique<RenderCache>(options_.cache_dir, options_.cache_link);
+}
+
+JobServer::~JobServer() = default;
+
+bool JobServer::Run()
+{
+	const auto listener = LocalSocket::Listen(options_.socket_path);
+	if (!listener.IsValid())
+		return false;
+
+	cout << "Serving jobs on " << options_.socket_path.string() << " with " << pool_.GetNumThreads() << " threads" << endl;
+
+	while (!stopping_)
+	{
+		auto socket = listener.Accept();
+		if (stopping_)
+			break;
+
+		if (!socket.IsValid())
+		{
+			cerr << "Error: couldn't accept connection" << endl;
+			break;
+		}
+
+		JoinFinished();
+
+		lock_guard<mutex> lock(connections_mutex_);
+		auto& connection = *connections_.emplace_back(make_unique<Connection>());
+		connection.socket = std::move(socket);
+		connection.worker = thread([this, &connection] { Serve(connection); });
+	}
+
+	// Idle connections are woken up, busy ones stop after their job
+	stopping_ = true;
+	{
+		lock_guard<mutex> lock(connections_mutex_);
+		for (auto& connection : connections_)
+		{
+			lock_guard<mutex> connection_lock(connection->busy_mutex);
+			if (!connection->busy)
+				connection->socket.Shutdown();
+		}
+	}
+
+	for (auto& connection : connections_)
+		connection->worker.join();
+	connections_.clear();
+
+	listener.RemoveFile();
+
+	cout << "Done: " << num_jobs_ << " jobs" << endl;
+	if (cache_)
+		cout << "Cache: " << cache_->GetHits() << " hits, " << cache_->GetMisses() << " misses" << endl;
+	return true;
+}
+
+void JobServer::Serve(Connection& connection)
+{
+	string request;
+	while (connection.socket.ReadLine(request))
+	{
+		{
+			lock_guard<mutex> lock(connection.busy_mutex);
+			if (stopping_)
+				break;
+			connection.busy = true;
+		}
+
+		const bool sent = connection.socket.WriteLine(Handle(request));
+
+		lock_guard<mutex> lock(connection.busy_mutex);
+		connection.busy = false;
+		if (!sent || stopping_)
+			break;
+	}
+
+	connection.finished = true;
+}
+
+std::string JobServer::Handle(const std::string& request)
+{
+	const auto fields = SplitFields(request);
+	if (fields[0] == "shutdown" && fields.size() == 1)
+	{
+		RequestStop();
+		return "{\"ok\": true}";
+	}
+
+	if (fields[0] == "job" && fields.size() == 4)
+		return ProcessJob(fs::u8path(fields[1]), fs::u8path(fields[2]), fields[3]);
+
+	return ErrorResponse("Unknown request: " + fields[0]);
+}
+
+std::string JobServer::ProcessJob(const fs::path& input, const fs::path& output, const std::string& chain_text)
+{
+	const auto start = chrono::steady_clock::now();
+	const double start_cpu = Stats::GetThreadCpuTime();
+	const size_t start_allocated = Stats::GetThreadAllocatedBytes();
+	++num_jobs_;
+
+	bool cached = false;
+	size_t num_frames = 0, num_channels = 0;
+	double load_seconds = 0, process_seconds = 0, save_seconds = 0;
+	try
+	{
+		const auto chain = GetChain(chain_text);
+
+		error_code ec;
+		fs::create_directories(output.parent_path(), ec);
+
+		// Key of the cache is hashed while the input is decoded, so the input is read once
+		PackedAudio audio;
+		Meter meter;
+		XxHash64 source_hash;
+		auto stage_start = chrono::steady_clock::now();
+		if (!audio.Load(input.string(), &meter, cache_ ? &source_hash : nullptr))
+			throw runtime_error("couldn't load " + input.u8string());
+
+		num_frames = audio.GetNumFrames();
+		num_channels = audio.GetNumChannels();
+		load_seconds = SecondsSince(stage_start);
+
+		string key;
+		if (cache_)
+		{
+			key = cache_->GetKey(source_hash.Digest(), *chain, options_.dither, output);
+			cached = cache_->Fetch(key, output);
+		}
+
+		if (!cached)
+		{
+			stage_start = chrono::steady_clock::now();
+			const auto levels = meter.GetLevels();
+			chain->Apply(audio, &levels, options_.dither, pool_);
+			process_seconds = SecondsSince(stage_start);
+
+			// Output may be a hard link to the cache entry, don't overwrite it in place
+			stage_start = chrono::steady_clock::now();
+			if (cache_)
+				fs::remove(output, ec);
+			if (!audio.Save(output.string()))
+				throw runtime_error("couldn't save " + output.u8string());
+			save_seconds = SecondsSince(stage_start);
+
+			if (!key.empty())
+				cache_->Store(key, output);
+		}
+	}
+	catch (exception& ex)
+	{
+		{
+			lock_guard<mutex> log_lock(log_mutex);
+			cerr << "Error: " << input.string() << ": " << ex.what() << endl;
+		}
+		return ErrorResponse(ex.what());
+	}
+
+	// CPU time and allocations are of the connection thread, segments on the pool aren't counted
+	ostringstream response;
+	response << "{\"ok\": true, "
+		<< "\"input\": " << QuoteJson(input.u8string()) << ", "
+		<< "\"output\": " << QuoteJson(output.u8string()) << ", "
+		<< "\"cached\": " << (cached ? "true" : "false") << ", "
+		<< "\"frames\": " << num_frames << ", "
+		<< "\"channels\": " << num_channels << ", "
+		<< "\"load_seconds\": " << load_seconds << ", "
+		<< "\"process_seconds\": " << process_seconds << ", "
+		<< "\"save_seconds\": " << save_seconds << ", "
+		<< "\"wall_seconds\": " << SecondsSince(start) << ", "
+		<< "\"cpu_seconds\": " << Stats::GetThreadCpuTime() - start_cpu << ", "
+		<< "\"bytes_allocated\": " << Stats::GetThreadAllocatedBytes() - start_allocated << ", "
+		<< "\"peak_rss\": " << Stats::GetPeakRss()
+		<< "}";
+	return response.str();
+}
+
+std::shared_ptr<const EffectChain> JobServer::GetChain(const std::string& text)
+{
+	{
+		lock_guard<mutex> lock(chains_mutex_);
+		const auto it = chains_.find(text);
+		if (it != chains_.end())
+			return it->second;
+	}
+
+	// Parsed outside of the lock, a chain parsed twice by concurrent jobs is the same
+	auto chain = make_shared<EffectChain>(EffectChain::Parse(text));
+	chain->SetSilenceThreshold(options_.silence_db);
+
+	lock_guard<mutex> lock(chains_mutex_);
+	if (chains_.size() >= kMaxCachedChains)
+		chains_.clear();
+	return chains_.emplace(text, std::move(chain)).first->second;
+}
+
+void JobServer::RequestStop()
+{
+	stopping_ = true;
+
+	// Accept of the serving loop returns on the next connection
+	const auto wake_up = LocalSocket::Connect(options_.socket_path);
+}
+
+void JobServer::JoinFinished()
+{
+	lock_guard<mutex> lock(connections_mutex_);
+	for (auto it = connections_.begin(); it != connections_.end(); )
+	{
+		if ((*it)->finished)
+		{
+			(*it)->worker.join();
+			it = connections_.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+bool JobClient::Connect(const fs::path& socket_path)
+{
+	socket_ = LocalSocket::Connect(socket_path);
+	if (!socket_.IsValid())
+	{
+		cerr << "Error: no job server on " << socket_path.string() << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool JobClient::Submit(const fs::path& input, const fs::path& output, const std::string& chain, std::string& response)
+{
+	// Server resolves paths from its own working directory
+	const string fields[] = { fs::absolute(input).u8string(), fs::absolute(output).u8string(), chain };
+	string request = "job";
+	for (const auto& field : fields)
+	{
+		if (field.find(kFieldSeparator) != string::npos || HasLineBreak(field))
+		{
+			cerr << "Error: job can't have tabs or line breaks: " << field << endl;
+			return false;
+		}
+
+		request += kFieldSeparator + field;
+	}
+
+	return Request(request, response);
+}
+
+bool JobClient::Shutdown(std::string& response)
+{
+	return Request("shutdown", response);
+}
+
+bool JobClient::IsSuccess(const std::string& response)
+{
+	return response.rfind("{\"ok\": true", 0) == 0;
+}
+
+bool JobClient::Request(const std::string& request, std::string& response)
+{
+	if (!socket_.WriteLine(request) || !socket_.ReadLine(response))
+	{
+		cerr << "Error: connection to the job server is lost" << endl;
+		return false;
+	}
+
+	return true;
+}
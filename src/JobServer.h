@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EffectChain.h"
+#include "LocalSocket.h"
+#include "RenderCache.h"
+#include "ThreadPool.h"
+
+/**
+ * \brief Options of the job server
+ */
+struct JobServerOptions
+{
+	// Socket file, that the server creates and listens on
+	std::filesystem::path socket_path;
+
+	// Workers of segment-parallel processing, shared by all jobs, 0 means hardware concurrency
+	size_t num_threads = 0;
+
+	// Render cache directory, empty means no cache
+	std::filesystem::path cache_dir;
+	// Produce cached outputs by hard links instead of copies
+	bool cache_link = false;
+
+	DitherOptions dither;
+	float silence_db = kDigitalSilence;
+};
+
+/**
+ * \brief Long-running process, that takes jobs over a Unix domain socket
+ *
+ * Every request is a line, tab separated, and it's answered by a line of JSON:
+ *   `job <TAB> input <TAB> output <TAB> chain` - process the file like --batch does, answer has stats of the job
+ *   `shutdown` - stop accepting jobs, running jobs are finished
+ * Every connection is served by its thread and runs its jobs one after another, so a client
+ * runs jobs in parallel over several connections. The thread pool, parsed chains, FFT plans,
+ * scratch arenas of the connection threads and the render cache stay warm between jobs,
+ * so a small file costs only its own processing.
+ */
+class JobServer
+{
+public:
+	explicit JobServer(JobServerOptions options);
+	~JobServer();
+
+	JobServer(const JobServer&) = delete;
+	JobServer& operator=(const JobServer&) = delete;
+
+	/**
+	 * \brief Serve connections until a shutdown request
+	 * \return false, if the socket couldn't be created
+	 */
+	bool Run();
+
+private:
+	struct Connection;
+
+	void Serve(Connection& connection);
+
+	/**
+	 * \brief Answer of the request line
+	 */
+	[[nodiscard]] std::string Handle(const std::string& request);
+
+	[[nodiscard]] std::string ProcessJob(const std::filesystem::path& input, const std::filesystem::path& output,
+		const std::string& chain_text);
+
+	/**
+	 * \brief Parsed chain of the text, parsed once for all jobs
+	 * \throw invalid_argument unknown effect or wrong number of parameters
+	 */
+	[[nodiscard]] std::shared_ptr<const EffectChain> GetChain(const std::string& text);
+
+	void RequestStop();
+
+	/**
+	 * \brief Join threads of closed connections
+	 */
+	void JoinFinished();
+
+	JobServerOptions options_;
+	ThreadPool pool_;
+	std::unique_ptr<RenderCache> cache_;
+
+	std::mutex chains_mutex_;
+	std::map<std::string, std::shared_ptr<const EffectChain>> chains_;
+
+	std::mutex connections_mutex_;
+	std::vector<std::unique_ptr<Connection>> connections_;
+
+	std::atomic<bool> stopping_ = false;
+	std::atomic<size_t> num_jobs_ = 0;
+};
+
+/**
+ * \brief Client of the job server, e.g. for tests and scripts
+ */
+class JobClient
+{
+public:
+	/**
+	 * \return false, if the server doesn't listen on the socket
+	 */
+	bool Connect(const std::filesystem::path& socket_path);
+
+	/**
+	 * \brief Run job and wait for it
+	 * \param response JSON answer of the server
+	 * \return false, if the paths or the chain can't be sent, or connection is lost
+	 */
+	bool Submit(const std::filesystem::path& input, const std::filesystem::path& output, const std::string& chain,
+		std::string& response);
+
+	/**
+	 * \brief Ask the server to stop
+	 */
+	bool Shutdown(std::string& response);
+
+	/**
+	 * \brief Whether the answer reports success
+	 */
+	[[nodiscard]] static bool IsSuccess(const std::string& response);
+
+private:
+	bool Request(const std::string& request, std::string& response);
+
+	LocalSocket socket_;
+};
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include "LocalSocket.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+#ifdef _WIN32
+	typedef SOCKET NativeSocket;
+	constexpr int kShutdownBoth = SD_BOTH;
+
+	bool InitSockets()
+	{
+		static const bool initialized = [] {
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		return initialized;
+	}
+
+	void CloseSocket(NativeSocket socket)
+	{
+		closesocket(socket);
+	}
+
+	/**
+	 * \brief Whether the entry at the path is a socket file, Windows has no identity of it to compare
+	 */
+	bool GetSocketFile(const fs::path& path, uint64_t& device, uint64_t& inode)
+	{
+#ifndef IO_REPARSE_TAG_AF_UNIX
+		constexpr DWORD IO_REPARSE_TAG_AF_UNIX = 0x80000023L;
+#endif
+		WIN32_FIND_DATAW data;
+		const HANDLE find = FindFirstFileW(path.c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+			return false;
+		FindClose(find);
+
+		device = 0;
+		inode = 0;
+		return (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 && data.dwReserved0 == IO_REPARSE_TAG_AF_UNIX;
+	}
+#else
+	typedef int NativeSocket;
+	constexpr int kShutdownBoth = SHUT_RDWR;
+
+	bool InitSockets()
+	{
+		return true;
+	}
+
+	void CloseSocket(NativeSocket socket)
+	{
+		close(socket);
+	}
+
+	/**
+	 * \brief Whether the entry at the path is a socket file, symbolic links aren't followed
+	 */
+	bool GetSocketFile(const fs::path& path, uint64_t& device, uint64_t& inode)
+	{
+		struct stat info;
+		if (lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode))
+			return false;
+
+		device = static_cast<uint64_t>(info.st_dev);
+		inode = static_cast<uint64_t>(info.st_ino);
+		return true;
+	}
+#endif
+
+	// Write to the closed connection fails instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+	constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+	constexpr int kSendFlags = 0;
+#endif
+
+	NativeSocket ToNative(intptr_t handle)
+	{
+		return static_cast<NativeSocket>(handle);
+	}
+
+	bool MakeAddress(const fs::path& path, sockaddr_un& address)
+	{
+		const string name = path.string();
+		if (name.size() >= sizeof(address.sun_path))
+		{
+			cerr << "Error: socket path is too long: " << name << endl;
+			return false;
+		}
+
+		address = {};
+		address.sun_family = AF_UNIX;
+		std::copy(name.begin(), name.end(), address.sun_path);
+		return true;
+	}
+}
+
+LocalSocket::LocalSocket(intptr_t handle) : handle_(handle)
+{
+
+}
+
+LocalSocket::~LocalSocket()
+{
+	Close();
+}
+
+LocalSocket::LocalSocket(LocalSocket&& other) noexcept
+	: handle_(std::exchange(other.handle_, kInvalidHandle)), buffer_(std::move(other.buffer_)),
+	  file_(std::exchange(other.file_, {})), file_device_(other.file_device_), file_inode_(other.file_inode_)
+{
+
+}
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		handle_ = std::exchange(other.handle_, kInvalidHandle);
+		buffer_ = std::move(other.buffer_);
+		file_ = std::exchange(other.file_, {});
+		file_device_ = other.file_device_;
+		file_inode_ = other.file_inode_;
+	}
+	return *this;
+}
+
+LocalSocket LocalSocket::Listen(const fs::path& path)
+{
+	sockaddr_un address;
+	if (!InitSockets() || !MakeAddress(path, address))
+		return LocalSocket();
+
+	LocalSocket socket(static_cast<intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0)));
+	if (!socket.IsValid())
+	{
+		cerr << "Error: couldn't create socket" << endl;
+		return socket;
+	}
+
+	// Only a socket file, e.g. left by a previous run, is replaced
+	error_code ec;
+	uint64_t device, inode;
+	if (fs::symlink_status(path, ec).type() != fs::file_type::not_found)
+	{
+		if (!GetSocketFile(path, device, inode))
+		{
+			cerr << "Error: " << path.string() << " exists and is not a socket" << endl;
+			return LocalSocket();
+		}
+		fs::remove(path, ec);
+	}
+
+	if (bind(ToNative(socket.handle_), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+		listen(ToNative(socket.handle_), SOMAXCONN) != 0)
+	{
+		cerr << "Error: couldn't listen on " << path.string() << endl;
+		return LocalSocket();
+	}
+
+	if (GetSocketFile(path, socket.file_device_, socket.file_inode_))
+		socket.file_ = path;
+	return socket;
+}
+
+void LocalSocket::RemoveFile() const
+{
+	// Another server may have replaced the file since, its socket is kept
+	uint64_t device, inode;
+	if (file_.empty() || !GetSocketFile(file_, device, inode) || device != file_device_ || inode != file_inode_)
+		return;
+
+	error_code ec;
+	fs::remove(file_, ec);
+}
+
+LocalSocket LocalSocket::Connect(const fs::path& path)
+{
+	sockaddr_un address;
+	if (!InitSockets() || !MakeAddress(path, address))
+		return LocalSocket();
+
+	LocalSocket socket(static_cast<intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0)));
+	if (!socket.IsValid() || connect(ToNative(socket.handle_), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		return LocalSocket();
+
+	return socket;
+}
+
+LocalSocket LocalSocket::Accept() const
+{
+	return LocalSocket(static_cast<intptr_t>(accept(ToNative(handle_), nullptr, nullptr)));
+}
+
+bool LocalSocket::ReadLine(std::string& line)
+{
+	size_t end;
+	while ((end = buffer_.find('\n')) == string::npos)
+	{
+		if (buffer_.size() > kMaxLineBytes)
+			return false;
+
+		char chunk[4096];
+		const auto received = recv(ToNative(handle_), chunk, static_cast<int>(sizeof(chunk)), 0);
+		if (received <= 0)
+			return false;
+
+		buffer_.append(chunk, static_cast<size_t>(received));
+	}
+
+	line.assign(buffer_, 0, end);
+	buffer_.erase(0, end + 1);
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+bool LocalSocket::WriteLine(const std::string& line) const
+{
+	const string data = line + '\n';
+	for (size_t sent = 0; sent < data.size(); )
+	{
+		const auto count = send(ToNative(handle_), data.data() + sent, static_cast<int>(data.size() - sent), kSendFlags);
+		if (count <= 0)
+			return false;
+
+		sent += static_cast<size_t>(count);
+	}
+
+	return true;
+}
+
+void LocalSocket::Shutdown() const
+{
+	if (IsValid())
+		shutdown(ToNative(handle_), kShutdownBoth);
+}
+
+bool LocalSocket::IsValid() const
+{
+	return handle_ != kInvalidHandle;
+}
+
+void LocalSocket::Close()
+{
+	if (IsValid())
+		CloseSocket(ToNative(handle_));
+	handle_ = kInvalidHandle;
+	buffer_.clear();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * \brief Owned stream socket of the Unix domain (AF_UNIX), on Windows since Windows 10 1803
+ *
+ * Messages are lines, that end with '\n'. Socket is closed by the destructor.
+ */
+class LocalSocket
+{
+public:
+	LocalSocket() = default;
+	~LocalSocket();
+
+	LocalSocket(LocalSocket&& other) noexcept;
+	LocalSocket& operator=(LocalSocket&& other) noexcept;
+
+	LocalSocket(const LocalSocket&) = delete;
+	LocalSocket& operator=(const LocalSocket&) = delete;
+
+	/**
+	 * \brief Create socket file and listen on it. Socket file left by a previous run is replaced,
+	 * any other file at the path is an error
+	 * \return invalid socket on error
+	 */
+	[[nodiscard]] static LocalSocket Listen(const std::filesystem::path& path);
+
+	/**
+	 * \brief Remove socket file, that Listen created, unless it was replaced since
+	 */
+	void RemoveFile() const;
+
+	/**
+	 * \brief Connect to the socket file
+	 * \return invalid socket on error, e.g. when nobody listens on it
+	 */
+	[[nodiscard]] static LocalSocket Connect(const std::filesystem::path& path);
+
+	/**
+	 * \brief Wait for connection to the listening socket
+	 * \return invalid socket on error
+	 */
+	[[nodiscard]] LocalSocket Accept() const;
+
+	/**
+	 * \brief Read line without its '\n'
+	 * \return false, if connection is closed or line is longer than kMaxLineBytes
+	 */
+	bool ReadLine(std::string& line);
+
+	/**
+	 * \brief Write line, '\n' is appended
+	 * \return false, if connection is closed
+	 */
+	bool WriteLine(const std::string& line) const;
+
+	/**
+	 * \brief Stop reading and writing, thread waiting in ReadLine returns false
+	 */
+	void Shutdown() const;
+
+	[[nodiscard]] bool IsValid() const;
+
+	static constexpr size_t kMaxLineBytes = 1 << 16;
+
+private:
+	explicit LocalSocket(intptr_t handle);
+
+	void Close();
+
+	static constexpr intptr_t kInvalidHandle = -1;
+
+	// SOCKET on Windows, file descriptor elsewhere
+	intptr_t handle_ = kInvalidHandle;
+	// Received bytes after the last read line
+	std::string buffer_;
+
+	// Socket file of the listening socket and its identity, device and inode, where they exist
+	std::filesystem::path file_;
+	uint64_t file_device_ = 0;
+	uint64_t file_inode_ = 0;
+};
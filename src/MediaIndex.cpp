@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include "MediaIndex.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr char kMagic[4] = { 'W', 'I', 'D', 'X' };
+	constexpr uint32_t kVersion = 1;
+	constexpr const char* kDefaultName = ".wav_effects_index";
+	// Files probed by one task
+	constexpr size_t kProbeBatch = 64;
+	// Sanity limit of strings and lists of the index file
+	constexpr uint32_t kMaxLength = 1 << 16;
+}
+
+MediaIndex::MediaIndex(std::filesystem::path root) : root_(std::move(root))
+{
+}
+
+bool MediaIndex::Load(const std::filesystem::path& path)
+{
+	StageTimer timer("index load");
+	entries_.clear();
+
+	ifstream file(path, ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const auto read = [&](auto& value) {
+		file.read(reinterpret_cast<char*>(&value), sizeof(value));
+		return file.good();
+	};
+	const auto read_string = [&](string& str) {
+		uint32_t length;
+		if (!read(length) || length > kMaxLength)
+			return false;
+		str.resize(length);
+		file.read(str.data(), length);
+		return file.good();
+	};
+
+	char magic[4];
+	uint32_t version;
+	uint64_t num_entries;
+	file.read(magic, sizeof(magic));
+	if (!file.good() || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || !read(version) || version != kVersion || !read(num_entries))
+		return false;
+
+	vector<Entry> entries;
+	for (uint64_t i = 0; i < num_entries; i++)
+	{
+		Entry entry;
+		string path;
+		uint8_t valid, is_flac;
+		uint32_t bit_depth, num_channels, num_chunks;
+		if (!read_string(path) || !read(entry.file_size) || !read(entry.mtime) || !read(valid) || !read(is_flac) ||
+			!read(entry.info.sample_rate) || !read(bit_depth) || !read(num_channels) || !read(entry.info.num_frames) ||
+			!read(num_chunks) || num_chunks > kMaxLength)
+			return false;
+
+		entry.path = fs::u8path(path);
+		entry.valid = valid != 0;
+		entry.info.is_flac = is_flac != 0;
+		entry.info.bit_depth = static_cast<int>(bit_depth);
+		entry.info.num_channels = num_channels;
+
+		entry.info.chunks.resize(num_chunks);
+		for (auto& chunk : entry.info.chunks)
+			if (!read_string(chunk.id) || !read(chunk.offset) || !read(chunk.size))
+				return false;
+
+		entries.push_back(std::move(entry));
+	}
+
+	entries_ = std::move(entries);
+	return true;
+}
+
+bool MediaIndex::Save(const std::filesystem::path& path) const
+{
+	StageTimer timer("index save");
+
+	ofstream file(path, ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const auto write = [&](const auto& value) {
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+	const auto write_string = [&](const string& str) {
+		write(static_cast<uint32_t>(str.size()));
+		file.write(str.data(), static_cast<streamsize>(str.size()));
+	};
+
+	file.write(kMagic, sizeof(kMagic));
+	write(kVersion);
+	write(static_cast<uint64_t>(entries_.size()));
+	for (const auto& entry : entries_)
+	{
+		write_string(entry.path.generic_u8string());
+		write(entry.file_size);
+		write(entry.mtime);
+		write(static_cast<uint8_t>(entry.valid));
+		write(static_cast<uint8_t>(entry.info.is_flac));
+		write(entry.info.sample_rate);
+		write(static_cast<uint32_t>(entry.info.bit_depth));
+		write(static_cast<uint32_t>(entry.info.num_channels));
+		write(entry.info.num_frames);
+		write(static_cast<uint32_t>(entry.info.chunks.size()));
+		for (const auto& chunk : entry.info.chunks)
+		{
+			write_string(chunk.id);
+			write(chunk.offset);
+			write(chunk.size);
+		}
+	}
+
+	return file.good();
+}
+
+size_t MediaIndex::Update(size_t num_threads)
+{
+	StageTimer timer("index update");
+
+	unordered_map<string, size_t> known;
+	known.reserve(entries_.size());
+	for (size_t idx = 0; idx < entries_.size(); idx++)
+		known.emplace(entries_[idx].path.generic_u8string(), idx);
+
+	// Unchanged entries are taken over, others are probed
+	vector<Entry> entries;
+	vector<size_t> to_probe;
+	error_code ec;
+	for (fs::recursive_directory_iterator it(root_, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (!it->is_regular_file(ec) || !IsAudioFile(it->path()))
+			continue;
+
+		Entry entry;
+		entry.path = it->path().lexically_relative(root_);
+		entry.file_size = it->file_size(ec);
+		const auto mtime = it->last_write_time(ec);
+		if (ec)
+		{
+			ec.clear();
+			continue;
+		}
+		entry.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+
+		const auto found = known.find(entry.path.generic_u8string());
+		if (found != known.end() && entries_[found->second].file_size == entry.file_size && entries_[found->second].mtime == entry.mtime)
+		{
+			entries.push_back(std::move(entries_[found->second]));
+		}
+		else
+		{
+			to_probe.push_back(entries.size());
+			entries.push_back(std::move(entry));
+		}
+	}
+
+	const auto probe = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			auto& entry = entries[to_probe[i]];
+			entry.valid = entry.info.Probe(root_ / entry.path);
+		}
+	};
+
+	if (to_probe.size() <= kProbeBatch || num_threads == 1)
+	{
+		probe(0, to_probe.size());
+	}
+	else
+	{
+		// Probing is bound by file opening latency, so batches run in parallel
+		ThreadPool pool(num_threads);
+		for (size_t begin = 0; begin < to_probe.size(); begin += kProbeBatch)
+			pool.Submit([&probe, &to_probe, begin] { probe(begin, std::min(begin + kProbeBatch, to_probe.size())); });
+		pool.Wait();
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+	entries_ = std::move(entries);
+	return to_probe.size();
+}
+
+const std::vector<MediaIndex::Entry>& MediaIndex::GetEntries() const
+{
+	return entries_;
+}
+
+const std::filesystem::path& MediaIndex::GetRoot() const
+{
+	return root_;
+}
+
+std::filesystem::path MediaIndex::GetDefaultPath(const std::filesystem::path& root)
+{
+	return root / kDefaultName;
+}
+
+bool MediaIndex::IsAudioFile(const std::filesystem::path& path)
+{
+	auto ext = path.extension().string();
+	transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+	return ext == ".wav" || ext == ".flac";
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "AudioInfo.h"
+
+/**
+ * \brief Persistent metadata index of the audio files of a directory tree
+ *
+ * Entries are keyed by size and modification time of the file. Update walks the tree
+ * and probes only new and changed files, so a warm index of a large library costs
+ * one directory walk. Index is saved to a binary file, by default `<root>/.wav_effects_index`.
+ */
+class MediaIndex
+{
+public:
+	struct Entry
+	{
+		// Path relative to the root
+		std::filesystem::path path;
+		uint64_t file_size = 0;
+		int64_t mtime = 0;
+		// false, if the file isn't a readable wave or FLAC file
+		bool valid = false;
+		AudioInfo info;
+	};
+
+	explicit MediaIndex(std::filesystem::path root);
+
+	/**
+	 * \brief Load saved index, its entries are checked against the files by the next Update
+	 * \return true, if loading was successful, otherwise false
+	 */
+	bool Load(const std::filesystem::path& path);
+
+	/**
+	 * \brief Save index
+	 * \return true, if saving was successful, otherwise false
+	 */
+	bool Save(const std::filesystem::path& path) const;
+
+	/**
+	 * \brief Walk the tree, probe new and changed audio files and drop entries of removed ones
+	 * \param num_threads Number of probing threads, 0 means hardware concurrency
+	 * \return number of probed files
+	 */
+	size_t Update(size_t num_threads = 0);
+
+	/**
+	 * \brief Entries sorted by path
+	 */
+	[[nodiscard]] const std::vector<Entry>& GetEntries() const;
+	[[nodiscard]] const std::filesystem::path& GetRoot() const;
+
+	[[nodiscard]] static std::filesystem::path GetDefaultPath(const std::filesystem::path& root);
+
+	/**
+	 * \brief Whether file has .wav or .flac extension
+	 */
+	[[nodiscard]] static bool IsAudioFile(const std::filesystem::path& path);
+
+private:
+	std::filesystem::path root_;
+	std::vector<Entry> entries_;
+};
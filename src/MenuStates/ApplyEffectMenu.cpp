@@ -1,9 +1,12 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "ApplyEffectMenu.h"
+#include "../EffectChain.h"
 #include "../Effects.h"
+#include "../utility.h"
 
 using namespace std;
-using namespace effects;
 
 ApplyEffectMenu::ApplyEffectMenu(MenuStack* menu_stack) : MenuStateBase(menu_stack)
 {
@@ -19,7 +22,15 @@ ApplyEffectMenu::ApplyEffectMenu(MenuStack* menu_stack) : MenuStateBase(menu_sta
 		"Tremolo",
 		"Delay",
 		"Compressor",
-		"Distortion"
+		"Distortion",
+		"Normalize",
+		"Filter",
+		"Time stretch",
+		"Pitch shift",
+		"Trim silence",
+		"Chorus",
+		"Flanger",
+		"Vibrato"
 	};
 }
 
@@ -75,6 +86,38 @@ void ApplyEffectMenu::OnSelect()
 			distortion();
 			break;
 
+		case 11: // Normalize
+			normalize();
+			break;
+
+		case 12: // Filter
+			filter();
+			break;
+
+		case 13: // Time stretch
+			time_stretch();
+			break;
+
+		case 14: // Pitch shift
+			pitch_shift();
+			break;
+
+		case 15: // Trim silence
+			trim();
+			break;
+
+		case 16: // Chorus
+			chorus();
+			break;
+
+		case 17: // Flanger
+			flanger();
+			break;
+
+		case 18: // Vibrato
+			vibrato();
+			break;
+
 		default: 
 			throw out_of_range("Effect idx out-of-range: " + to_string(selected_index_));
 	}
@@ -83,24 +126,52 @@ void ApplyEffectMenu::OnSelect()
 	WaitForEscape();
 }
 
+void ApplyEffectMenu::add_effect(EffectStep step) const
+{
+	if (step.name != "mono_to_stereo" && Ask("Apply only to a region of the file?"))
+	{
+		const auto& peaks = wm_.peaks;
+		const auto sample_rate = static_cast<float>(peaks.GetSampleRate());
+		const auto length = static_cast<float>(peaks.GetNumFrames()) / sample_rate;
+
+		cout << "Enter region begin in seconds: ";
+		step.region_begin = ReadValue<float>([&](auto value) {
+			return value >= 0 && value < length;
+		});
+
+		cout << "Enter region end in seconds: ";
+		step.region_end = ReadValue<float>([&](auto value) {
+			return value > step.region_begin && value <= length;
+		});
+
+		// Levels of the region come from the overview, so a quiet or clipped selection is seen before rendering
+		const FrameRange region{ static_cast<size_t>(step.region_begin * sample_rate), static_cast<size_t>(step.region_end * sample_rate) };
+		for (size_t channel = 0; channel < peaks.GetNumChannels(); channel++)
+		{
+			const auto bin = peaks.GetSummary(channel, region);
+			cout << "Region channel " << channel + 1 << ": peak " << lin_to_db(std::max(std::abs(bin.min), std::abs(bin.max)))
+				<< " dBFS, RMS " << lin_to_db(bin.rms) << " dBFS" << endl;
+		}
+	}
+
+	wm_.graph.AddEffect(std::move(step));
+	cout << "Added to the effect chain" << endl;
+}
+
 void ApplyEffectMenu::mono_to_stereo() const
 {
-	if (!wm_.wav.IsMono())
+	if (!wm_.graph.GetSource().IsMono())
 	{
 		cout << "File not in mono. Aborting." << endl;
 		return;
 	}
 
-	cout << "Converting mono to stereo...";
-	MonoToStereo(wm_.wav);
-	cout << "Done" << endl;
+	add_effect({ "mono_to_stereo", {} });
 }
 
 void ApplyEffectMenu::reverse() const
 {
-	cout << "Reversing audio...";
-	ApplyReverse(wm_.wav);
-	cout << "Done" << endl;
+	add_effect({ "reverse", {} });
 }
 
 void ApplyEffectMenu::volume() const
@@ -108,37 +179,29 @@ void ApplyEffectMenu::volume() const
 	cout << "Enter volume for increasing in dB: ";
 	const auto volume = ReadValue<float>();
 
-	cout << "Applying volume...";
-	ApplyVolume(wm_.wav, volume);
-	cout << "Done" << endl;
+	add_effect({ "volume", { volume } });
 }
 
 void ApplyEffectMenu::reverberation() const
 {
-	cout << "Applying reverberation...";
-	ApplyReverberation(wm_.wav);
-	cout << "Done" << endl;
+	add_effect({ "reverb", {} });
 }
 
 void ApplyEffectMenu::rotating() const
 {
-	if (wm_.wav.IsMono())
+	if (wm_.graph.GetSource().IsMono())
 	{
 		if (!Ask("File must be in stereo. Convert into it?"))
 		{
 			cout << "Aborting." << endl;
 			return;
 		}
-
-		mono_to_stereo();
 	}
 
 	cout << "Enter rotating rate in seconds: ";
 	const auto rate = ReadValue<float>(&GreaterThanZero);
 
-	cout << "Applying rotating...";
-	ApplyRotatingStereo(wm_.wav, rate);
-	cout << "Done" << endl;
+	add_effect({ "rotating", { rate } });
 }
 
 void ApplyEffectMenu::fade() const
@@ -153,7 +216,7 @@ void ApplyEffectMenu::fade() const
 	// Enter time
 	cout << "Enter fade time in seconds: ";
 	const auto fade_time = ReadValue<float>([&](auto value) {
-		return value > 0 && value < wm_.wav.GetLengthInSeconds();
+		return value > 0 && value < wm_.graph.GetSource().GetLengthInSeconds();
 	});
 
 	// Enter curve
@@ -162,17 +225,11 @@ void ApplyEffectMenu::fade() const
 		<< " 2 - Logarithmic" << endl
 		<< " 3 - Sine" << endl;
 	cout << "Enter curve type: ";
-	const auto curve_type = static_cast<CurveType>(ReadValue<int>([](auto value) {
+	const auto curve_type = ReadValue<int>([](auto value) {
 		return value >= 1 && value <= 3;
-	}));
+	});
 
-	// Apply fade
-	cout << "Applying fade...";
-	if (is_fade_in)
-		ApplyFadeIn(wm_.wav, fade_time, curve_type);
-	else
-		ApplyFadeOut(wm_.wav, fade_time, curve_type);
-	cout << "Done" << endl;
+	add_effect({ is_fade_in ? "fade_in" : "fade_out", { fade_time, static_cast<float>(curve_type) } });
 }
 
 void ApplyEffectMenu::tremolo() const
@@ -183,9 +240,7 @@ void ApplyEffectMenu::tremolo() const
 	cout << "Enter dry signal percent (0..1): ";
 	const auto dry = ReadValue<float>(&IsNormalizedValue);
 
-	cout << "Applying tremolo...";
-	ApplyTremolo(wm_.wav, freq, dry, 1.f - dry);
-	cout << "Done" << endl;
+	add_effect({ "tremolo", { freq, dry } });
 }
 
 void ApplyEffectMenu::delay() const
@@ -197,16 +252,14 @@ void ApplyEffectMenu::delay() const
 	const auto decay = ReadValue<float>(&IsNormalizedValue);
 
 	cout << "Enter channel num, or 0 for applying on all channels: ";
-	const auto channel_idx = ReadValue<size_t>([this](auto value) {
-		return value >= 0 && value <= wm_.wav.GetNumChannels();
-	}) - 1;
+	const auto channel_num = ReadValue<size_t>([this](auto value) {
+		return value <= wm_.graph.GetSource().GetNumChannels();
+	});
 
-	cout << "Applying delay...";
-	if (channel_idx == 0)
-		ApplyDelay(wm_.wav, delay_time, decay);
+	if (channel_num == 0)
+		add_effect({ "delay", { delay_time, decay } });
 	else
-		ApplyDelay(wm_.wav, channel_idx - 1, delay_time, decay);
-	cout << "Done" << endl;
+		add_effect({ "delay", { delay_time, decay, static_cast<float>(channel_num - 1) } });
 }
 
 void ApplyEffectMenu::compressor() const
@@ -223,9 +276,7 @@ void ApplyEffectMenu::compressor() const
 
 	const bool downward = Ask("Compress downward?");
 
-	cout << "Applying compressor...";
-	ApplyCompressor(wm_.wav, threshold, ratio, downward);
-	cout << "Done" << endl;
+	add_effect({ "compressor", { threshold, ratio, downward ? 1.f : 0.f } });
 }
 
 void ApplyEffectMenu::distortion() const
@@ -236,7 +287,178 @@ void ApplyEffectMenu::distortion() const
 	cout << "Enter blend (0..1): ";
 	const auto blend = ReadValue<float>(&IsNormalizedValue);
 
-	cout << "Applying distortion...";
-	ApplyDistortion(wm_.wav, drive, blend);
-	cout << "Done" << endl;
+	add_effect({ "distortion", { drive, blend } });
+}
+
+void ApplyEffectMenu::normalize() const
+{
+	cout << "Normalize type:" << endl
+		<< " 1 - Loudness, LUFS" << endl
+		<< " 2 - Peak, dBFS" << endl
+		<< " 3 - True peak, dBTP" << endl;
+	cout << "Enter normalize type: ";
+	const auto type = ReadValue<int>([](auto value) {
+		return value >= kNormalizeLoudness && value <= kNormalizeTruePeak;
+	});
+
+	cout << "Enter target level: ";
+	const auto target = ReadValue<float>();
+
+	if (type != kNormalizeLoudness)
+	{
+		add_effect({ "normalize", { target, static_cast<float>(type) } });
+		return;
+	}
+
+	cout << "Enter true peak ceiling in dBTP: ";
+	const auto ceiling = ReadValue<float>();
+
+	add_effect({ "normalize", { target, static_cast<float>(type), ceiling } });
+}
+
+void ApplyEffectMenu::filter() const
+{
+	cout << "Filter type:" << endl
+		<< " 1 - Low-pass" << endl
+		<< " 2 - High-pass" << endl
+		<< " 3 - Band-pass" << endl
+		<< " 4 - Notch" << endl
+		<< " 5 - Peak" << endl
+		<< " 6 - Low shelf" << endl
+		<< " 7 - High shelf" << endl;
+	cout << "Enter filter type: ";
+	const auto type = ReadValue<int>([](auto value) {
+		return value >= kLowPass && value <= kHighShelf;
+	});
+
+	cout << "Enter frequency in Hz: ";
+	const auto freq = ReadValue<float>([this](auto value) {
+		return value > 0 && value < wm_.graph.GetSource().sampleRate / 2.f;
+	});
+
+	cout << "Enter Q (0.707 for Butterworth): ";
+	const auto q = ReadValue<float>(&GreaterThanZero);
+
+	auto gain = 0.f;
+	if (type == kPeak || type == kLowShelf || type == kHighShelf)
+	{
+		cout << "Enter gain in dB: ";
+		gain = ReadValue<float>();
+	}
+
+	add_effect({ "filter", { static_cast<float>(type), freq, q, gain } });
+}
+
+void ApplyEffectMenu::time_stretch() const
+{
+	cout << "Enter duration factor (0.25..4, 2 makes it twice longer): ";
+	const auto factor = ReadValue<float>([](auto value) {
+		return value >= 0.25f && value <= 4.f;
+	});
+
+	add_effect({ "time_stretch", { factor } });
+}
+
+void ApplyEffectMenu::pitch_shift() const
+{
+	cout << "Enter pitch shift in semitones (-24..24): ";
+	const auto semitones = ReadValue<float>([](auto value) {
+		return value >= -24.f && value <= 24.f;
+	});
+
+	add_effect({ "pitch_shift", { semitones } });
+}
+
+void ApplyEffectMenu::trim() const
+{
+	cout << "Enter silence threshold in dBFS (e.g. -60): ";
+	const auto threshold = ReadValue<float>([](auto value) {
+		return value < 0;
+	});
+
+	// Overview tells the silence to its bins without scanning the samples
+	const auto& peaks = wm_.peaks;
+	const auto content = peaks.FindContent(threshold);
+	if (content.IsEmpty())
+	{
+		cout << "Whole file is silent. Aborting." << endl;
+		return;
+	}
+
+	cout << "Leading silence: about " << static_cast<double>(content.begin) / peaks.GetSampleRate() << " s, trailing silence: about "
+		<< static_cast<double>(peaks.GetNumFrames() - content.end) / peaks.GetSampleRate() << " s" << endl;
+
+	cout << "Enter padding in seconds, kept before and after the sound: ";
+	const auto padding = ReadValue<float>([](auto value) {
+		return value >= 0;
+	});
+
+	add_effect({ "trim", { threshold, padding } });
+}
+
+void ApplyEffectMenu::chorus() const
+{
+	cout << "Enter LFO rate in Hz (e.g. 0.8): ";
+	const auto rate = ReadValue<float>(&GreaterThanZero);
+
+	cout << "Enter depth in ms (e.g. 3): ";
+	const auto depth = ReadValue<float>(&GreaterThanZero);
+
+	cout << "Enter number of voices (1.." << ModulatedDelay::kMaxVoices << "): ";
+	const auto voices = ReadValue<size_t>([](auto value) {
+		return value >= 1 && value <= ModulatedDelay::kMaxVoices;
+	});
+
+	cout << "Enter mix of the delayed signal (0..1): ";
+	const auto mix = ReadValue<float>(&IsNormalizedValue);
+
+	const auto interpolation = read_interpolation();
+
+	add_effect({ "chorus", { rate, depth, static_cast<float>(voices), mix, static_cast<float>(interpolation) } });
+}
+
+void ApplyEffectMenu::flanger() const
+{
+	cout << "Enter LFO rate in Hz (e.g. 0.25): ";
+	const auto rate = ReadValue<float>(&GreaterThanZero);
+
+	cout << "Enter depth in ms (e.g. 2): ";
+	const auto depth = ReadValue<float>(&GreaterThanZero);
+
+	cout << "Enter feedback (-0.95..0.95): ";
+	const auto feedback = ReadValue<float>([](auto value) {
+		return value >= -0.95f && value <= 0.95f;
+	});
+
+	cout << "Enter mix of the delayed signal (0..1): ";
+	const auto mix = ReadValue<float>(&IsNormalizedValue);
+
+	const auto interpolation = read_interpolation();
+
+	add_effect({ "flanger", { rate, depth, feedback, mix, static_cast<float>(interpolation) } });
+}
+
+void ApplyEffectMenu::vibrato() const
+{
+	cout << "Enter LFO rate in Hz (e.g. 5): ";
+	const auto rate = ReadValue<float>(&GreaterThanZero);
+
+	cout << "Enter depth in ms (e.g. 1): ";
+	const auto depth = ReadValue<float>(&GreaterThanZero);
+
+	const auto interpolation = read_interpolation();
+
+	add_effect({ "vibrato", { rate, depth, static_cast<float>(interpolation) } });
+}
+
+InterpolationType ApplyEffectMenu::read_interpolation() const
+{
+	cout << "Interpolation:" << endl
+		<< " 1 - Linear" << endl
+		<< " 2 - Cubic" << endl
+		<< " 3 - Allpass" << endl;
+	cout << "Enter interpolation type: ";
+	return static_cast<InterpolationType>(ReadValue<int>([](auto value) {
+		return value >= kInterpolateLinear && value <= kInterpolateAllpass;
+	}));
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "../Menu/MenuStateBase.h"
+#include "../ModulatedDelay.h"
 #include "../WavManager.h"
 
 class ApplyEffectMenu final : public MenuStateBase
@@ -12,6 +13,8 @@ public:
 private:
 	WavManager& wm_ = WavManager::get();
 
+	void add_effect(EffectStep step) const;
+
 	void mono_to_stereo() const;
 	void reverse() const;
 	void volume() const;
@@ -22,6 +25,16 @@ private:
 	void delay() const;
 	void compressor() const;
 	void distortion() const;
+	void normalize() const;
+	void filter() const;
+	void time_stretch() const;
+	void pitch_shift() const;
+	void trim() const;
+	void chorus() const;
+	void flanger() const;
+	void vibrato() const;
+
+	[[nodiscard]] InterpolationType read_interpolation() const;
 
 	static bool GreaterThanZero(float value)
 	{
@@ -0,0 +1,89 @@
+#include <iostream>
+#include "EffectChainMenu.h"
+
+using namespace std;
+
+EffectChainMenu::EffectChainMenu(MenuStack* menu_stack) : MenuStateBase(menu_stack)
+{
+	title_ = "Effect chain";
+	update_items();
+}
+
+void EffectChainMenu::OnSelect()
+{
+	// Back
+	if (selected_index_ == 0)
+	{
+		Back();
+		return;
+	}
+
+	system("cls");
+	edit_effect(selected_index_ - 1);
+
+	update_items();
+	if (selected_index_ >= menu_items_.size())
+		selected_index_ = menu_items_.size() - 1;
+
+	wm_.isFileUnsaved = true;
+	WaitForEscape();
+}
+
+void EffectChainMenu::update_items()
+{
+	menu_items_ = { "Back" };
+
+	const auto chain = wm_.graph.GetChain();
+	for (const auto& step : chain.GetSteps())
+	{
+		EffectChain single;
+		single.Add(step);
+		menu_items_.push_back(single.ToString());
+	}
+}
+
+void EffectChainMenu::edit_effect(size_t idx) const
+{
+	const auto& step = wm_.graph.GetEffect(idx);
+	cout << "Effect: " << menu_items_[idx + 1] << endl;
+
+	if (Ask("Remove effect from the chain?"))
+	{
+		wm_.graph.RemoveEffect(idx);
+		cout << "Removed" << endl;
+		return;
+	}
+
+	const string usage = EffectChain::GetUsage(step.name);
+	if (usage.empty())
+	{
+		cout << "Effect has no parameters" << endl;
+		return;
+	}
+
+	cout << "Enter new parameters (" << usage << "): ";
+	while (true)
+	{
+		const auto params = ReadValue<string>();
+		try
+		{
+			auto new_step = EffectChain::Parse(step.name + ":" + params).GetSteps()[0];
+
+			// Region is kept, unless new one is given
+			if (!new_step.HasRegion())
+			{
+				new_step.region_begin = step.region_begin;
+				new_step.region_end = step.region_end;
+			}
+
+			wm_.graph.SetEffect(idx, new_step);
+			break;
+		}
+		catch (invalid_argument& ex)
+		{
+			cout << ex.what() << ". Try again: ";
+		}
+	}
+
+	cout << "Parameters changed" << endl;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "../Menu/MenuStateBase.h"
+#include "../WavManager.h"
+
+class EffectChainMenu final : public MenuStateBase
+{
+public:
+	explicit EffectChainMenu(MenuStack* menu_stack);
+
+	void OnSelect() override;
+
+private:
+	WavManager& wm_ = WavManager::get();
+
+	void update_items();
+	void edit_effect(size_t idx) const;
+};
@@ -1,6 +1,9 @@
 #include <iostream>
 #include "MainMenu.h"
 #include "ApplyEffectMenu.h"
+#include "EffectChainMenu.h"
+#include "../AudioInfo.h"
+#include "../Stats.h"
 
 using namespace std;
 
@@ -9,7 +12,11 @@ MainMenu::MainMenu(MenuStack* menu_stack) : MenuStateBase(menu_stack)
 	title_ = "Main menu";
 	menu_items_ = {
 		"Show file summary",
+		"Show stats",
 		"Apply effect",
+		"Effect chain",
+		"Undo",
+		"Redo",
 		"Save",
 		"Quit"
 	};
@@ -23,15 +30,31 @@ void MainMenu::OnSelect()
 			show_file_summary();
 			break;
 
-		case 1: // Apply effect
+		case 1: // Show stats
+			show_stats();
+			break;
+
+		case 2: // Apply effect
 			NavigateTo<ApplyEffectMenu>();
 			break;
 
-		case 2: // Save
+		case 3: // Effect chain
+			NavigateTo<EffectChainMenu>();
+			break;
+
+		case 4: // Undo
+			undo();
+			break;
+
+		case 5: // Redo
+			redo();
+			break;
+
+		case 6: // Save
 			save();
 			break;
 
-		case 3: // Quit
+		case 7: // Quit
 			quit();
 			break;
 
@@ -44,7 +67,91 @@ void MainMenu::show_file_summary() const
 {
 	system("cls");
 	cout << " Loaded file: " << wm_.filepath.string() << endl;
-	wm_.wav.PrintSummary();
+
+	// Headers tell the format and chunks of the file on disk, loaded samples are the fallback
+	AudioInfo info;
+	if (info.Probe(wm_.filepath))
+		info.PrintSummary();
+	else
+		wm_.graph.GetSource().PrintSummary();
+	wm_.graph.GetSourceLevels().PrintSummary();
+	wm_.peaks.PrintOverview();
+	print_silence();
+
+	if (wm_.graph.GetNumEffects() > 0)
+	{
+		cout << " Effect chain: " << wm_.graph.GetChain().ToString() << endl;
+		try
+		{
+			cout << " Rendering..." << endl;
+			const auto& rendered = wm_.graph.Render();
+			rendered.PrintSummary();
+			Meter::Analyze(rendered).PrintSummary();
+			cout << " Rendered frames: " << wm_.graph.GetLastRenderedFrames() << endl;
+		}
+		catch (exception& ex)
+		{
+			cout << " Rendering failed: " << ex.what() << endl;
+		}
+	}
+
+	WaitForEscape();
+}
+
+void MainMenu::print_silence() const
+{
+	// Gaps quieter than -60 dBFS and longer than half a second
+	constexpr float kThreshold = -60.f;
+	constexpr double kMinGap = 0.5;
+
+	// Overview answers without scanning the samples
+	const auto sample_rate = wm_.peaks.GetSampleRate();
+	const auto gaps = wm_.peaks.FindGaps(kThreshold, static_cast<size_t>(kMinGap * sample_rate));
+	size_t silent_frames = 0;
+	for (const auto& gap : gaps)
+		silent_frames += gap.GetLength();
+
+	cout << " Silence below " << kThreshold << " dBFS: " << gaps.size() << " gaps, "
+		<< static_cast<double>(silent_frames) / sample_rate << " s of "
+		<< static_cast<double>(wm_.peaks.GetNumFrames()) / sample_rate << " s" << endl;
+}
+
+void MainMenu::show_stats() const
+{
+	system("cls");
+	Stats::get().Print(cout);
+	WaitForEscape();
+}
+
+void MainMenu::undo() const
+{
+	system("cls");
+
+	if (wm_.graph.Undo())
+	{
+		cout << "Undone. Effect chain: " << wm_.graph.GetChain().ToString() << endl;
+		wm_.isFileUnsaved = true;
+	}
+	else
+		cout << "Nothing to undo" << endl;
+
+	cout << "Cache and history memory: " << wm_.graph.GetMemoryUsage() / 1024 << " KB" << endl;
+	WaitForEscape();
+}
+
+void MainMenu::redo() const
+{
+	system("cls");
+
+	if (wm_.graph.Redo())
+	{
+		cout << "Redone. Effect chain: " << wm_.graph.GetChain().ToString() << endl;
+		wm_.isFileUnsaved = true;
+	}
+	else
+		cout << "Nothing to redo" << endl;
+
+	cout << "Cache and history memory: " << wm_.graph.GetMemoryUsage() / 1024 << " KB" << endl;
 	WaitForEscape();
 }
 
@@ -53,12 +160,21 @@ void MainMenu::save() const
 	system("cls");
 
 	cout << "Saving to: " << wm_.out_filepath << endl;
-	if (wm_.wav.Save(wm_.out_filepath.string()))
-		cout << "Done" << endl;
-	else
-		cout << "Failed" << endl;
+	try
+	{
+		if (wm_.graph.Render().Save(wm_.out_filepath.string()))
+		{
+			cout << "Done" << endl;
+			wm_.isFileUnsaved = false;
+		}
+		else
+			cout << "Failed" << endl;
+	}
+	catch (exception& ex)
+	{
+		cout << "Failed: " << ex.what() << endl;
+	}
 
-	wm_.isFileUnsaved = false;
 	WaitForEscape();
 }
 
@@ -13,6 +13,10 @@ private:
 	WavManager& wm_ = WavManager::get();
 
 	void show_file_summary() const;
+	void print_silence() const;
+	void show_stats() const;
+	void undo() const;
+	void redo() const;
 	void save() const;
 	void quit() const;
 };
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include "Meter.h"
+#include "SimdKernels.h"
+
+using namespace std;
+
+namespace
+{
+	// Samples converted at once, small enough to stay in L1 cache
+	constexpr size_t kChunkSize = 1024;
+	constexpr double kPi = 3.14159265358979323846;
+
+	// 4x oversampling polyphase FIR, ITU-R BS.1770-4 Annex 2
+	constexpr float kTruePeakCoefficients[4][12] = {
+		{ 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f,
+		  0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+		{ -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f,
+		  0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+		{ -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f,
+		  0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+		{ -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f,
+		  0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+	};
+
+	// Gating block is 400 ms, made of 4 sub-blocks with 75% overlap
+	constexpr size_t kSubBlocksPerBlock = 4;
+	constexpr double kAbsoluteGate = -70.;
+	constexpr double kRelativeGate = -10.;
+
+	double EnergyToLoudness(double energy)
+	{
+		return -0.691 + 10. * log10(energy);
+	}
+
+	double LoudnessToEnergy(double loudness)
+	{
+		return pow(10., (loudness + 0.691) / 10.);
+	}
+
+	/**
+	 * \brief BS.1770 channel weight, 5.1 layout is L, R, C, LFE, Ls, Rs
+	 */
+	double GetChannelWeight(size_t channel, size_t num_channels)
+	{
+		if (num_channels != 6)
+			return 1.;
+
+		const double weights[] = { 1., 1., 1., 0., 1.41, 1.41 };
+		return weights[channel];
+	}
+}
+
+float Levels::GetPeak() const
+{
+	float peak = 0;
+	for (const auto& channel : channels)
+		peak = std::max(peak, channel.peak);
+	return peak;
+}
+
+float Levels::GetTruePeak() const
+{
+	float peak = 0;
+	for (const auto& channel : channels)
+		peak = std::max(peak, channel.true_peak);
+	return peak;
+}
+
+void Levels::PrintSummary() const
+{
+	const auto to_db = [](double value) {
+		return value > 0 ? 20. * log10(value) : -numeric_limits<double>::infinity();
+	};
+
+	cout << "|======================================|" << endl
+		 << "| Integrated Loudness: " << loudness << " LUFS" << endl;
+
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		const auto& channel = channels[i];
+		cout << "| Channel " << i + 1 << ":" << endl
+			 << "|   Peak: " << to_db(channel.peak) << " dBFS" << endl
+			 << "|   True Peak: " << to_db(channel.true_peak) << " dBTP" << endl
+			 << "|   RMS: " << to_db(channel.rms) << " dBFS" << endl
+			 << "|   DC Offset: " << channel.dc_offset << endl;
+	}
+
+	cout << "|======================================|" << endl;
+}
+
+Meter::Meter(uint32_t sample_rate, size_t num_channels)
+{
+	Reset(sample_rate, num_channels);
+}
+
+void Meter::Reset(uint32_t sample_rate, size_t num_channels)
+{
+	sample_rate_ = sample_rate;
+	block_size_ = std::max<size_t>(1, (sample_rate + 5) / 10);
+	channels_.assign(num_channels, ChannelState());
+
+	// K-weighting filters for any sample rate, pre-filter is a high shelf, RLB is a high pass
+	const double fs = sample_rate;
+	{
+		const double f0 = 1681.974450955533;
+		const double gain = 3.999843853973347;
+		const double q = 0.7071752369554196;
+
+		const double k = tan(kPi * f0 / fs);
+		const double vh = pow(10., gain / 20.);
+		const double vb = pow(vh, 0.4996667741545416);
+		const double a0 = 1. + k / q + k * k;
+
+		shelf_ = {
+			(vh + vb * k / q + k * k) / a0,
+			2. * (k * k - vh) / a0,
+			(vh - vb * k / q + k * k) / a0,
+			2. * (k * k - 1.) / a0,
+			(1. - k / q + k * k) / a0
+		};
+	}
+	{
+		const double f0 = 38.13547087602444;
+		const double q = 0.5003270373238773;
+
+		const double k = tan(kPi * f0 / fs);
+		const double a0 = 1. + k / q + k * k;
+
+		high_pass_ = { 1., -2., 1., 2. * (k * k - 1.) / a0, (1. - k / q + k * k) / a0 };
+	}
+}
+
+template <typename T>
+void Meter::Process(size_t channel, const T* samples, size_t count)
+{
+	auto& state = channels_.at(channel);
+
+	// History of previous samples followed by the current chunk
+	float buffer[kHistorySize + kChunkSize];
+	std::copy(std::begin(state.history), std::end(state.history), buffer);
+
+	for (size_t offset = 0; offset < count; offset += kChunkSize)
+	{
+		const auto n = std::min(kChunkSize, count - offset);
+		for (size_t i = 0; i < n; i++)
+			buffer[kHistorySize + i] = static_cast<float>(samples[offset + i]);
+
+		ProcessChunk(state, buffer, n);
+		std::copy(buffer + n, buffer + n + kHistorySize, buffer);
+	}
+
+	std::copy(buffer, buffer + kHistorySize, state.history);
+}
+
+void Meter::ProcessChunk(ChannelState& state, const float* buffer, size_t count) const
+{
+	const float* x = buffer + kHistorySize;
+
+	// Independent accumulators of 4 lanes, that the kernel keeps in vector registers
+	float peak[4] = { state.peak, 0, 0, 0 };
+	double sum[4] = {};
+	double sum_squares[4] = {};
+
+	SimdKernels::Get().accumulate_levels(x, count, peak, sum, sum_squares);
+	size_t i = count / 4 * 4;
+	for (; i < count; i++)
+	{
+		peak[0] = std::max(peak[0], std::abs(x[i]));
+		sum[0] += x[i];
+		sum_squares[0] += static_cast<double>(x[i]) * x[i];
+	}
+
+	state.peak = std::max({ peak[0], peak[1], peak[2], peak[3] });
+	state.sum += sum[0] + sum[1] + sum[2] + sum[3];
+	state.sum_squares += sum_squares[0] + sum_squares[1] + sum_squares[2] + sum_squares[3];
+	state.count += count;
+
+	// True peak, every input sample gives 4 interpolated ones
+	float true_peak = state.true_peak;
+	for (i = 0; i < count; i++)
+	{
+		const float* window = x + i;
+		for (const auto& phase : kTruePeakCoefficients)
+		{
+			float value = 0;
+			for (size_t tap = 0; tap < kTruePeakTaps; tap++)
+				value += phase[tap] * window[-static_cast<ptrdiff_t>(tap)];
+			true_peak = std::max(true_peak, std::abs(value));
+		}
+	}
+	state.true_peak = true_peak;
+
+	// K-weighting and gating sub-blocks energy
+	for (i = 0; i < count; i++)
+	{
+		const double input = x[i];
+
+		const double shelf = shelf_.b0 * input + state.shelf_z1;
+		state.shelf_z1 = shelf_.b1 * input - shelf_.a1 * shelf + state.shelf_z2;
+		state.shelf_z2 = shelf_.b2 * input - shelf_.a2 * shelf;
+
+		const double weighted = high_pass_.b0 * shelf + state.high_pass_z1;
+		state.high_pass_z1 = high_pass_.b1 * shelf - high_pass_.a1 * weighted + state.high_pass_z2;
+		state.high_pass_z2 = high_pass_.b2 * shelf - high_pass_.a2 * weighted;
+
+		state.block_energy += weighted * weighted;
+		if (++state.block_fill == block_size_)
+		{
+			state.block_energies.push_back(state.block_energy);
+			state.block_energy = 0;
+			state.block_fill = 0;
+		}
+	}
+}
+
+Levels Meter::GetLevels() const
+{
+	Levels levels;
+	size_t num_sub_blocks = channels_.empty() ? 0 : numeric_limits<size_t>::max();
+
+	for (const auto& state : channels_)
+	{
+		ChannelLevels channel;
+		if (state.count > 0)
+		{
+			channel.peak = state.peak;
+			// Interpolated signal of a short burst may be lower, than the samples
+			channel.true_peak = std::max(state.true_peak, state.peak);
+			channel.rms = sqrt(state.sum_squares / static_cast<double>(state.count));
+			channel.dc_offset = state.sum / static_cast<double>(state.count);
+		}
+
+		levels.channels.push_back(channel);
+		num_sub_blocks = std::min(num_sub_blocks, state.block_energies.size());
+	}
+
+	if (num_sub_blocks < kSubBlocksPerBlock)
+		return levels;
+
+	// Weighted energy of every gating block
+	vector<double> energies(num_sub_blocks - kSubBlocksPerBlock + 1, 0.);
+	for (size_t channel = 0; channel < channels_.size(); channel++)
+	{
+		const double weight = GetChannelWeight(channel, channels_.size());
+		const auto& sub_blocks = channels_[channel].block_energies;
+		if (weight == 0.)
+			continue;
+
+		for (size_t block = 0; block < energies.size(); block++)
+		{
+			double energy = 0;
+			for (size_t j = 0; j < kSubBlocksPerBlock; j++)
+				energy += sub_blocks[block + j];
+			energies[block] += weight * energy / static_cast<double>(kSubBlocksPerBlock * block_size_);
+		}
+	}
+
+	const auto gated_mean = [&](double threshold) {
+		double sum = 0;
+		size_t count = 0;
+		for (double energy : energies)
+		{
+			if (energy > threshold)
+			{
+				sum += energy;
+				count++;
+			}
+		}
+		return count > 0 ? sum / static_cast<double>(count) : 0.;
+	};
+
+	const double absolute_mean = gated_mean(LoudnessToEnergy(kAbsoluteGate));
+	if (absolute_mean <= 0.)
+		return levels;
+
+	const double relative_threshold = LoudnessToEnergy(EnergyToLoudness(absolute_mean) + kRelativeGate);
+	const double mean = gated_mean(std::max(relative_threshold, LoudnessToEnergy(kAbsoluteGate)));
+	if (mean > 0.)
+		levels.loudness = EnergyToLoudness(mean);
+
+	return levels;
+}
+
+Levels Meter::Analyze(const WavFile<float>& wav)
+{
+	Meter meter(wav.sampleRate, wav.GetNumChannels());
+	for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+		meter.Process(channel, wav.samples[channel].data(), wav.samples[channel].size());
+
+	return meter.GetLevels();
+}
+
+template void Meter::Process<float>(size_t, const float*, size_t);
+template void Meter::Process<double>(size_t, const double*, size_t);
@@ -0,0 +1,110 @@
+#pragma once
+#include <limits>
+#include <vector>
+#include "WavFile.h"
+
+/**
+ * \brief Levels of the single channel
+ */
+struct ChannelLevels
+{
+	// Maximal absolute sample value
+	float peak = 0;
+	// Maximal absolute value of the 4x oversampled signal
+	float true_peak = 0;
+	double rms = 0;
+	double dc_offset = 0;
+};
+
+/**
+ * \brief Levels of the whole wave file
+ */
+struct Levels
+{
+	std::vector<ChannelLevels> channels;
+
+	// Integrated loudness by ITU-R BS.1770, LUFS. -inf if the file is silent or shorter than 400 ms
+	double loudness = -std::numeric_limits<double>::infinity();
+
+	[[nodiscard]] float GetPeak() const;
+	[[nodiscard]] float GetTruePeak() const;
+
+	/**
+	 * \brief Prints levels to standart output
+	 */
+	void PrintSummary() const;
+};
+
+/**
+ * \brief Measures peak, true peak, RMS, DC offset and integrated loudness in one pass
+ *
+ * Samples are fed by blocks in order, every channel independently, so meter can be driven
+ * by the decoder while decoded samples are still in cache.
+ */
+class Meter
+{
+public:
+	Meter() = default;
+	Meter(uint32_t sample_rate, size_t num_channels);
+
+	/**
+	 * \brief Clear measurements and set the format of the signal
+	 */
+	void Reset(uint32_t sample_rate, size_t num_channels);
+
+	/**
+	 * \brief Feed next block of the channel samples
+	 * \param channel channel index
+	 * \param samples block of samples
+	 * \param count number of samples in block
+	 * \throw out_of_range channel out of range
+	 */
+	template<typename T>
+	void Process(size_t channel, const T* samples, size_t count);
+
+	[[nodiscard]] Levels GetLevels() const;
+
+	/**
+	 * \brief Measure levels of the whole wave file
+	 */
+	[[nodiscard]] static Levels Analyze(const WavFile<float>& wav);
+
+private:
+	// Taps of each of 4 polyphase true peak filters
+	static constexpr size_t kTruePeakTaps = 12;
+	static constexpr size_t kHistorySize = kTruePeakTaps - 1;
+
+	struct Biquad
+	{
+		double b0, b1, b2, a1, a2;
+	};
+
+	struct ChannelState
+	{
+		size_t count = 0;
+		double sum = 0;
+		double sum_squares = 0;
+		float peak = 0;
+		float true_peak = 0;
+
+		// Last samples, needed by true peak filter
+		float history[kHistorySize] = {};
+
+		// Transposed direct form II states of K-weighting filters
+		double shelf_z1 = 0, shelf_z2 = 0;
+		double high_pass_z1 = 0, high_pass_z2 = 0;
+
+		// K-weighted energy of 100 ms gating sub-blocks
+		std::vector<double> block_energies;
+		double block_energy = 0;
+		size_t block_fill = 0;
+	};
+
+	void ProcessChunk(ChannelState& state, const float* buffer, size_t count) const;
+
+	uint32_t sample_rate_ = 0;
+	size_t block_size_ = 0;
+	Biquad shelf_{};
+	Biquad high_pass_{};
+	std::vector<ChannelState> channels_;
+};
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include "Mixer.h"
+#include "AudioStream.h"
+#include "Biquad.h"
+#include "SimdKernels.h"
+#include "Stats.h"
+#include "utility.h"
+
+using namespace std;
+
+namespace
+{
+	// Frames mixed at once, accumulator and input block of a stereo mix fit into L2 cache
+	constexpr size_t kBlockFrames = 4096;
+
+	/**
+	 * \brief Frames of the input after resampling to the sample rate
+	 */
+	size_t GetConformedFrames(uint64_t num_frames, uint32_t from_rate, uint32_t to_rate)
+	{
+		return static_cast<size_t>((num_frames * to_rate + from_rate - 1) / from_rate);
+	}
+
+	/**
+	 * \brief Input, converted to the sample rate and channel count of the output while it's read
+	 */
+	class ConformedInput
+	{
+	public:
+		ConformedInput(uint32_t sample_rate, size_t num_channels) : sample_rate_(sample_rate), num_channels_(num_channels)
+		{
+		}
+
+		bool Open(const std::string& filename)
+		{
+			if (!reader_.Open(filename))
+				return false;
+
+			ratio_ = static_cast<double>(reader_.GetSampleRate()) / sample_rate_;
+			if (ratio_ == 1.)
+				return true;
+
+			// Resampling to lower rate drops samples, band-limit before it (4th order Butterworth)
+			if (ratio_ > 1.)
+			{
+				const auto cutoff = static_cast<float>(0.45 * sample_rate_);
+				lowpass_ = make_unique<BiquadCascade>(num_channels_, reader_.GetSampleRate(),
+					vector<BiquadParams>{ { kLowPass, cutoff, 0.54119610f }, { kLowPass, cutoff, 1.30656296f } });
+			}
+
+			// Interpolation reads a frame before its position, the frame before the input is silent
+			source_.assign(num_channels_, vector<float>(1, 0.f));
+			return true;
+		}
+
+		[[nodiscard]] size_t GetNumFrames() const
+		{
+			return GetConformedFrames(reader_.GetNumFrames(), reader_.GetSampleRate(), sample_rate_);
+		}
+
+		/**
+		 * \brief Read next frames, past the end of the input they are silent
+		 */
+		void Read(float* const* out, size_t count)
+		{
+			if (ratio_ == 1.)
+			{
+				ReadMapped(out, count);
+				return;
+			}
+
+			// Cubic interpolation reads frames from i - 1 to i + 2 of the position i
+			const auto last = static_cast<ptrdiff_t>(std::floor(static_cast<double>(position_ + count - 1) * ratio_));
+			const auto needed = static_cast<size_t>(last + 3 - source_start_);
+			if (needed > source_[0].size())
+			{
+				const size_t start = source_[0].size();
+				const size_t added = needed - start;
+				vector<float*> tail(num_channels_);
+				for (size_t channel = 0; channel < num_channels_; channel++)
+				{
+					source_[channel].resize(needed);
+					tail[channel] = source_[channel].data() + start;
+				}
+
+				ReadMapped(tail.data(), added);
+				if (lowpass_)
+					lowpass_->Process(tail.data(), added);
+			}
+
+			for (size_t channel = 0; channel < num_channels_; channel++)
+			{
+				const float* samples = source_[channel].data();
+				for (size_t j = 0; j < count; j++)
+				{
+					const double position = static_cast<double>(position_ + j) * ratio_ - static_cast<double>(source_start_);
+					const auto i = static_cast<size_t>(position);
+					const auto t = static_cast<float>(position - static_cast<double>(i));
+
+					const float y0 = samples[i - 1], y1 = samples[i], y2 = samples[i + 1], y3 = samples[i + 2];
+					const float c1 = 0.5f * (y2 - y0);
+					const float c2 = y0 - 2.5f * y1 + 2.f * y2 - 0.5f * y3;
+					const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+					out[channel][j] = ((c3 * t + c2) * t + c1) * t + y1;
+				}
+			}
+
+			// Keep frames from the one before the next position
+			position_ += count;
+			const auto first = static_cast<ptrdiff_t>(std::floor(static_cast<double>(position_) * ratio_)) - 1;
+			if (first > source_start_)
+			{
+				const auto drop = std::min(static_cast<size_t>(first - source_start_), source_[0].size());
+				for (auto& channel : source_)
+					channel.erase(channel.begin(), channel.begin() + static_cast<ptrdiff_t>(drop));
+				source_start_ += static_cast<ptrdiff_t>(drop);
+			}
+		}
+
+	private:
+		/**
+		 * \brief Read next frames of the input in its sample rate and map them to the output channels
+		 */
+		void ReadMapped(float* const* out, size_t count)
+		{
+			const size_t in_channels = reader_.GetNumChannels();
+			if (in_channels == num_channels_)
+			{
+				const size_t read = reader_.Read(out, count);
+				for (size_t channel = 0; channel < num_channels_; channel++)
+					std::fill(out[channel] + read, out[channel] + count, 0.f);
+				return;
+			}
+
+			block_.resize(in_channels);
+			vector<float*> in(in_channels);
+			for (size_t channel = 0; channel < in_channels; channel++)
+			{
+				block_[channel].resize(count);
+				in[channel] = block_[channel].data();
+			}
+
+			const size_t read = reader_.Read(in.data(), count);
+			for (size_t channel = 0; channel < in_channels; channel++)
+				std::fill(in[channel] + read, in[channel] + count, 0.f);
+
+			if (in_channels == 1)
+			{
+				for (size_t channel = 0; channel < num_channels_; channel++)
+					std::copy(in[0], in[0] + count, out[channel]);
+			}
+			else if (num_channels_ == 1)
+			{
+				std::fill(out[0], out[0] + count, 0.f);
+				for (size_t channel = 0; channel < in_channels; channel++)
+					SimdKernels::Get().mix_add(out[0], in[channel], 1.f / static_cast<float>(in_channels), count);
+			}
+			else
+			{
+				for (size_t channel = 0; channel < num_channels_; channel++)
+				{
+					if (channel < in_channels)
+						std::copy(in[channel], in[channel] + count, out[channel]);
+					else
+						std::fill(out[channel], out[channel] + count, 0.f);
+				}
+			}
+		}
+
+		uint32_t sample_rate_;
+		size_t num_channels_;
+		AudioReader reader_;
+		// Input frames per output frame
+		double ratio_ = 1.;
+		unique_ptr<BiquadCascade> lowpass_;
+		// Mapped frames of the input from source_start_ on
+		vector<vector<float>> source_;
+		ptrdiff_t source_start_ = -1;
+		// Output frames read
+		size_t position_ = 0;
+		vector<vector<float>> block_;
+	};
+
+	bool ProbeInputs(const vector<string>& filenames, vector<AudioInfo>& infos)
+	{
+		if (filenames.empty())
+		{
+			cerr << "Error: there are no files to mix" << endl;
+			return false;
+		}
+
+		infos.resize(filenames.size());
+		for (size_t i = 0; i < filenames.size(); i++)
+		{
+			if (!infos[i].Probe(filenames[i]))
+			{
+				cerr << "Error: " << filenames[i] << " isn't a wave or FLAC file" << endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Take zero values of the format from the inputs
+	 */
+	bool ResolveFormat(const vector<AudioInfo>& infos, MixOptions& options)
+	{
+		const MixOptions requested = options;
+		for (const auto& info : infos)
+		{
+			if (requested.sample_rate == 0)
+				options.sample_rate = std::max(options.sample_rate, info.sample_rate);
+			if (requested.num_channels == 0)
+				options.num_channels = std::max(options.num_channels, info.num_channels);
+			if (requested.bit_depth == 0)
+				options.bit_depth = std::max(options.bit_depth, info.bit_depth);
+		}
+
+		if (options.bit_depth != 8 && options.bit_depth != 16 && options.bit_depth != 24 && options.bit_depth != 32)
+		{
+			cerr << "Error: bit depth of the mix must be 8, 16, 24 or 32" << endl;
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool Mixer::Mix(const std::vector<MixInput>& inputs, const std::string& output, const MixOptions& options)
+{
+	vector<string> filenames;
+	for (const auto& input : inputs)
+		filenames.push_back(input.filename);
+
+	vector<AudioInfo> infos;
+	MixOptions format = options;
+	if (!ProbeInputs(filenames, infos) || !ResolveFormat(infos, format))
+		return false;
+
+	const size_t num_channels = format.num_channels;
+	const double rate = format.sample_rate;
+
+	struct Track
+	{
+		unique_ptr<ConformedInput> input;
+		size_t start;
+		size_t num_frames;
+		size_t fade_in;
+		size_t fade_out;
+		vector<float> gains;
+	};
+
+	vector<Track> tracks;
+	size_t num_frames = 0;
+	for (const auto& input : inputs)
+	{
+		Track track;
+		track.input = make_unique<ConformedInput>(format.sample_rate, num_channels);
+		if (!track.input->Open(input.filename))
+			return false;
+
+		track.start = static_cast<size_t>(std::llround(std::max(input.offset, 0.) * rate));
+		track.num_frames = track.input->GetNumFrames();
+		track.fade_in = std::min(track.num_frames, static_cast<size_t>(std::llround(std::max(input.fade_in, 0.) * rate)));
+		track.fade_out = std::min(track.num_frames, static_cast<size_t>(std::llround(std::max(input.fade_out, 0.) * rate)));
+
+		const float gain = db_to_lin(input.gain_db);
+		track.gains.assign(num_channels, gain);
+		if (num_channels == 2)
+		{
+			const float pan = std::clamp(input.pan, -1.f, 1.f);
+			track.gains[0] = gain * std::min(1.f, 1.f - pan);
+			track.gains[1] = gain * std::min(1.f, 1.f + pan);
+		}
+
+		num_frames = std::max(num_frames, track.start + track.num_frames);
+		tracks.push_back(std::move(track));
+	}
+
+	StageTimer timer("mix", num_frames * num_channels);
+
+	AudioWriter writer;
+	if (!writer.Open(output, format.sample_rate, format.bit_depth, num_channels, num_frames, format.dither))
+		return false;
+
+	vector<vector<float>> mix(num_channels, vector<float>(kBlockFrames));
+	vector<vector<float>> block(num_channels, vector<float>(kBlockFrames));
+	vector<float*> mix_channels, block_channels;
+	for (size_t channel = 0; channel < num_channels; channel++)
+	{
+		mix_channels.push_back(mix[channel].data());
+		block_channels.push_back(block[channel].data());
+	}
+
+	float peak = 0.f;
+	for (size_t block_start = 0; block_start < num_frames; block_start += kBlockFrames)
+	{
+		const size_t block_end = std::min(block_start + kBlockFrames, num_frames);
+		for (auto& channel : mix)
+			std::fill(channel.begin(), channel.end(), 0.f);
+
+		for (auto& track : tracks)
+		{
+			// Frames of the track in the block, tracks are read in order, so every frame is read once
+			const size_t begin = std::max(block_start, track.start);
+			const size_t end = std::min(block_end, track.start + track.num_frames);
+			if (begin >= end)
+				continue;
+
+			const size_t count = end - begin;
+			track.input->Read(block_channels.data(), count);
+
+			const size_t first = begin - track.start;
+			const size_t fade_out_start = track.num_frames - track.fade_out;
+			if (first < track.fade_in || first + count > fade_out_start)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					const size_t frame = first + i;
+					float fade = 1.f;
+					if (frame < track.fade_in)
+						fade *= ApplyCurve(static_cast<float>(frame) / track.fade_in, format.fade_curve);
+					if (frame >= fade_out_start)
+						fade *= 1.f - ApplyCurve(static_cast<float>(frame - fade_out_start) / track.fade_out, format.fade_curve);
+
+					for (size_t channel = 0; channel < num_channels; channel++)
+						block[channel][i] *= fade;
+				}
+			}
+
+			for (size_t channel = 0; channel < num_channels; channel++)
+				SimdKernels::Get().mix_add(mix[channel].data() + (begin - block_start), block[channel].data(), track.gains[channel], count);
+		}
+
+		for (const auto& channel : mix)
+			peak = std::max(peak, SimdKernels::Get().peak(channel.data(), block_end - block_start));
+
+		if (!writer.Write(mix_channels.data(), block_end - block_start))
+			return false;
+	}
+
+	if (!writer.Close())
+		return false;
+
+	if (peak > 1.f)
+		cout << "Mix peaks at +" << lin_to_db(peak) << " dBFS, samples above full scale are clipped" << endl;
+
+	return true;
+}
+
+bool Mixer::Concatenate(const std::vector<std::string>& inputs, const std::string& output, double crossfade, const MixOptions& options)
+{
+	vector<AudioInfo> infos;
+	MixOptions format = options;
+	if (!ProbeInputs(inputs, infos) || !ResolveFormat(infos, format))
+		return false;
+
+	vector<size_t> lengths;
+	for (const auto& info : infos)
+		lengths.push_back(GetConformedFrames(info.num_frames, info.sample_rate, format.sample_rate));
+
+	// Offsets and fades are whole frames of the output, so they are exact after conversion to seconds and back
+	const double rate = format.sample_rate;
+	const auto crossfade_frames = static_cast<size_t>(std::llround(std::max(crossfade, 0.) * rate));
+
+	vector<MixInput> mix(inputs.size());
+	size_t start = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		mix[i].filename = inputs[i];
+		mix[i].offset = static_cast<double>(start) / rate;
+		if (i + 1 < inputs.size())
+		{
+			const size_t fade = std::min({ crossfade_frames, lengths[i] / 2, lengths[i + 1] / 2 });
+			mix[i].fade_out = static_cast<double>(fade) / rate;
+			mix[i + 1].fade_in = mix[i].fade_out;
+			start += lengths[i] - fade;
+		}
+	}
+
+	return Mix(mix, output, format);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "curve.h"
+#include "WavFile.h"
+
+/**
+ * \brief Input of the mix
+ */
+struct MixInput
+{
+	std::string filename;
+	float gain_db = 0.f;
+	// Balance of stereo output, -1 is left, 1 is right, the opposite channel is attenuated linearly
+	float pan = 0.f;
+	// Start of the input in the output, seconds
+	double offset = 0.;
+	// Fade lengths, seconds
+	double fade_in = 0.;
+	double fade_out = 0.;
+};
+
+/**
+ * \brief Format of the mix, zero values are taken from the inputs
+ */
+struct MixOptions
+{
+	// 0 means the highest sample rate of the inputs
+	uint32_t sample_rate = 0;
+	// 0 means the most channels of the inputs
+	size_t num_channels = 0;
+	// 0 means the highest bit depth of the inputs
+	int bit_depth = 0;
+	CurveType fade_curve = kLinear;
+	DitherOptions dither;
+};
+
+/**
+ * \brief Streaming mixer of wave and FLAC files
+ *
+ * Inputs are read by blocks, conformed to the output format and accumulated into a block buffer,
+ * so memory doesn't depend on the length of the files (FLAC inputs are decoded whole).
+ * Mono input is spread to every output channel, mono output is the average of the input channels,
+ * other layouts are mapped channel to channel. Input of other sample rate is resampled
+ * with cubic interpolation, and band-limited before it, when its rate is higher.
+ */
+class Mixer
+{
+public:
+	/**
+	 * \brief Mix inputs into the output file, that lasts until the end of the last input
+	 * \return true, if mixing was successful, otherwise false
+	 */
+	static bool Mix(const std::vector<MixInput>& inputs, const std::string& output, const MixOptions& options = MixOptions());
+
+	/**
+	 * \brief Join inputs one after another, every join is crossfaded
+	 * \param crossfade length of the crossfades, seconds, shortened to half of the shorter of the two files
+	 * \return true, if joining was successful, otherwise false
+	 */
+	static bool Concatenate(const std::vector<std::string>& inputs, const std::string& output, double crossfade,
+		const MixOptions& options = MixOptions());
+};
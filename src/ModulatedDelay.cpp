@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "DenormalGuard.h"
+#include "ModulatedDelay.h"
+#include "ScratchArena.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MODULATED_DELAY_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+
+	// Frames, after which the LFO rotation is set from the position again, so its error doesn't grow
+	constexpr size_t kBlockSize = 256;
+
+	// Read position of the cubic reaches 1 frame after the delay, so it stays before the written frame
+	constexpr float kMinDelayFrames = 2.f;
+
+	// Fraction of the allpass delay is in [kAllpassMinFraction, 1 + kAllpassMinFraction),
+	// so its coefficient stays away from -1, where the pole is on the unit circle
+	constexpr float kAllpassMinFraction = 0.1f;
+
+	size_t NextPowerOf2(size_t value)
+	{
+		size_t result = 1;
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+
+	/**
+	 * \brief Taps of kLanes lanes, tap k of the lane is taps[k][lane]
+	 */
+	struct alignas(16) LaneTaps
+	{
+		float taps[4][4];
+		// Fraction of the frame between taps[1] and taps[2], or allpass coefficient
+		float fraction[4];
+	};
+}
+
+ModulatedDelay::ModulatedDelay(size_t num_channels, double sample_rate, const ModulatedDelayParams& params)
+	: num_channels_(num_channels), num_lanes_(num_channels * params.num_voices), sample_rate_(sample_rate), params_(params)
+{
+	if (!(params.delay_ms >= 0.f && params.depth_ms >= 0.f))
+		throw std::invalid_argument("Delay and depth must not be negative");
+
+	if (!(params.rate >= 0.f))
+		throw std::invalid_argument("LFO rate must not be negative");
+
+	if (params.num_voices < 1 || params.num_voices > kMaxVoices)
+		throw std::invalid_argument("Number of voices must be between 1 and " + std::to_string(kMaxVoices));
+
+	if (!(std::abs(params.feedback) < 1.f))
+		throw std::invalid_argument("Feedback must be between -1 and 1");
+
+	if (!(params.mix >= 0.f && params.mix <= 1.f))
+		throw std::invalid_argument("Mix must be between 0 and 1");
+
+	if (params.interpolation < kInterpolateLinear || params.interpolation > kInterpolateAllpass)
+		throw std::invalid_argument("Unknown interpolation type");
+
+	min_delay_ = std::max(kMinDelayFrames, static_cast<float>(params.delay_ms * sample_rate / 1000.));
+	depth_ = static_cast<float>(params.depth_ms * sample_rate / 1000.);
+
+	// Cubic reads 2 frames before the delay
+	const size_t line_length = NextPowerOf2(static_cast<size_t>(std::ceil(min_delay_ + depth_)) + 3);
+	line_mask_ = line_length - 1;
+	lines_.assign(num_channels * line_length, 0.f);
+
+	const size_t num_padded = (num_lanes_ + kLanes - 1) / kLanes * kLanes;
+	lane_offsets_.assign(num_padded, 0);
+	lane_phases_.assign(num_padded, 0.);
+	for (size_t lane = 0; lane < num_lanes_; lane++)
+	{
+		const size_t channel = lane / params.num_voices;
+		const size_t voice = lane % params.num_voices;
+		lane_offsets_[lane] = channel * line_length;
+		lane_phases_[lane] = static_cast<double>(voice) / params.num_voices + static_cast<double>(channel) * params.stereo_phase;
+	}
+
+	const double rotation = 2. * kPi * params.rate / sample_rate;
+	rotation_sin_ = static_cast<float>(std::sin(rotation));
+	rotation_cos_ = static_cast<float>(std::cos(rotation));
+
+	lfo_sin_.assign(num_padded, 0.f);
+	lfo_cos_.assign(num_padded, 0.f);
+	allpass_state_.assign(num_padded, 0.f);
+}
+
+void ModulatedDelay::Reset()
+{
+	std::fill(lines_.begin(), lines_.end(), 0.f);
+	std::fill(allpass_state_.begin(), allpass_state_.end(), 0.f);
+	write_ = 0;
+	position_ = 0;
+}
+
+void ModulatedDelay::Process(float* const* channels, size_t count)
+{
+	DenormalGuard guard;
+
+	ScratchScope scratch;
+	float* wet = scratch.Allocate<float>(lfo_sin_.size());
+
+	size_t num_frames = 0;
+	for (size_t offset = 0; offset < count; offset += num_frames)
+	{
+		num_frames = std::min(count - offset, kBlockSize);
+		ResetLfo();
+
+		for (size_t i = 0; i < num_frames; i++)
+			ProcessFrame(channels, offset + i, wet);
+
+		position_ += num_frames;
+	}
+}
+
+void ModulatedDelay::ResetLfo()
+{
+	// Phase is counted in double from the position, float rotation drifts only inside the block
+	const double periods = static_cast<double>(position_) * params_.rate / sample_rate_;
+	for (size_t lane = 0; lane < lfo_sin_.size(); lane++)
+	{
+		double phase = periods + lane_phases_[lane];
+		phase -= std::floor(phase);
+		lfo_sin_[lane] = static_cast<float>(std::sin(2. * kPi * phase));
+		lfo_cos_[lane] = static_cast<float>(std::cos(2. * kPi * phase));
+	}
+}
+
+void ModulatedDelay::ProcessFrame(float* const* channels, size_t i, float* wet)
+{
+	const size_t num_padded = lfo_sin_.size();
+	const float half_depth = depth_ * 0.5f;
+	const auto interpolation = params_.interpolation;
+	for (size_t group = 0; group < num_padded; group += kLanes)
+	{
+		alignas(16) float delays[kLanes];
+		for (size_t lane = 0; lane < kLanes; lane++)
+			delays[lane] = min_delay_ + half_depth * (1.f + lfo_sin_[group + lane]);
+
+		// Taps are gathered lane by lane, they are in different places of the lines
+		LaneTaps taps;
+		for (size_t lane = 0; lane < kLanes; lane++)
+		{
+			const float* line = &lines_[lane_offsets_[group + lane]];
+			const float delay = delays[lane];
+			if (interpolation == kInterpolateAllpass)
+			{
+				// Delay of (1 - a) / (1 + a) frames after the integer one
+				const auto frames = static_cast<size_t>(delay - kAllpassMinFraction);
+				const float fraction = delay - static_cast<float>(frames);
+				taps.taps[1][lane] = line[(write_ - frames - 1) & line_mask_];
+				taps.taps[2][lane] = line[(write_ - frames) & line_mask_];
+				taps.fraction[lane] = (1.f - fraction) / (1.f + fraction);
+				continue;
+			}
+
+			// Delayed frame is between taps[1] and taps[2], taps[2] is the integer delay
+			const auto frames = static_cast<size_t>(delay);
+			const size_t base = write_ - frames;
+			taps.taps[0][lane] = line[(base - 2) & line_mask_];
+			taps.taps[1][lane] = line[(base - 1) & line_mask_];
+			taps.taps[2][lane] = line[base & line_mask_];
+			taps.taps[3][lane] = line[(base + 1) & line_mask_];
+			taps.fraction[lane] = 1.f - (delay - static_cast<float>(frames));
+		}
+
+		float* out = wet + group;
+		float* state = &allpass_state_[group];
+#ifdef MODULATED_DELAY_SSE
+		const __m128 y1 = _mm_load_ps(taps.taps[1]);
+		const __m128 y2 = _mm_load_ps(taps.taps[2]);
+		const __m128 t = _mm_load_ps(taps.fraction);
+		switch (interpolation)
+		{
+			case kInterpolateLinear:
+				_mm_storeu_ps(out, _mm_add_ps(y1, _mm_mul_ps(t, _mm_sub_ps(y2, y1))));
+				break;
+
+			case kInterpolateCubic:
+			{
+				const __m128 y0 = _mm_load_ps(taps.taps[0]);
+				const __m128 y3 = _mm_load_ps(taps.taps[3]);
+				const __m128 half = _mm_set1_ps(0.5f);
+				const __m128 c1 = _mm_mul_ps(half, _mm_sub_ps(y2, y0));
+				const __m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(y0, _mm_mul_ps(_mm_set1_ps(2.5f), y1)), _mm_mul_ps(_mm_set1_ps(2.f), y2)),
+					_mm_mul_ps(half, y3));
+				const __m128 c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(y3, y0)), _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(y1, y2)));
+				const __m128 y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), y1);
+				_mm_storeu_ps(out, y);
+				break;
+			}
+
+			case kInterpolateAllpass:
+			{
+				const __m128 y = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(t, y2), y1), _mm_mul_ps(t, _mm_loadu_ps(state)));
+				_mm_storeu_ps(state, y);
+				_mm_storeu_ps(out, y);
+				break;
+			}
+		}
+#else
+		for (size_t lane = 0; lane < kLanes; lane++)
+		{
+			const float y1 = taps.taps[1][lane];
+			const float y2 = taps.taps[2][lane];
+			const float t = taps.fraction[lane];
+			switch (interpolation)
+			{
+				case kInterpolateLinear:
+					out[lane] = y1 + t * (y2 - y1);
+					break;
+
+				case kInterpolateCubic:
+				{
+					const float y0 = taps.taps[0][lane];
+					const float y3 = taps.taps[3][lane];
+					const float c1 = 0.5f * (y2 - y0);
+					const float c2 = y0 - 2.5f * y1 + 2.f * y2 - 0.5f * y3;
+					const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+					out[lane] = ((c3 * t + c2) * t + c1) * t + y1;
+					break;
+				}
+
+				case kInterpolateAllpass:
+					state[lane] = t * y2 + y1 - t * state[lane];
+					out[lane] = state[lane];
+					break;
+			}
+		}
+#endif
+	}
+
+	// Lanes of the channel are its voices
+	const float mix = params_.mix;
+	const float voice_weight = 1.f / static_cast<float>(params_.num_voices);
+	const size_t line_length = line_mask_ + 1;
+	for (size_t channel = 0; channel < num_channels_; channel++)
+	{
+		float delayed = 0.f;
+		for (size_t voice = 0; voice < params_.num_voices; voice++)
+			delayed += wet[channel * params_.num_voices + voice];
+		delayed *= voice_weight;
+
+		float& sample = channels[channel][i];
+		lines_[channel * line_length + write_] = sample + params_.feedback * delayed;
+		sample = sample * (1.f - mix) + delayed * mix;
+	}
+	write_ = (write_ + 1) & line_mask_;
+
+	for (size_t lane = 0; lane < num_padded; lane++)
+	{
+		const float s = lfo_sin_[lane];
+		const float c = lfo_cos_[lane];
+		lfo_sin_[lane] = s * rotation_cos_ + c * rotation_sin_;
+		lfo_cos_[lane] = c * rotation_cos_ - s * rotation_sin_;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum InterpolationType
+{
+	// Two taps, attenuates highs a bit while the delay is between samples
+	kInterpolateLinear = 1,
+	// Four taps, cubic Hermite (Catmull-Rom)
+	kInterpolateCubic,
+	// First order allpass, flat magnitude, but its state rings when the delay moves fast
+	kInterpolateAllpass
+};
+
+/**
+ * \brief Parameters of the modulated delay
+ */
+struct ModulatedDelayParams
+{
+	// Shortest delay, ms. LFO sweeps the delay from it up to delay_ms + depth_ms
+	float delay_ms = 20.f;
+	float depth_ms = 3.f;
+	// LFO frequency, Hz
+	float rate = 1.f;
+
+	// Delayed copies of every channel, their LFO phases are spread over the period
+	size_t num_voices = 1;
+	// Phase difference of LFOs of adjacent channels, periods
+	float stereo_phase = 0.f;
+
+	// Part of the delayed signal fed back into the delay line (-1..1 exclusive)
+	float feedback = 0.f;
+	// Part of the delayed signal in the output (0..1), 1 leaves no dry signal
+	float mix = 0.5f;
+
+	InterpolationType interpolation = kInterpolateCubic;
+};
+
+/**
+ * \brief Delay line, that LFO modulates, with fractional reads
+ *
+ * Every voice of every channel is a lane, lanes are processed in groups of 4:
+ * taps of the group are gathered lane by lane, then interpolated at once in SIMD
+ * registers, so voices and channels of a frame share one pass of the interpolation.
+ * Output of a channel is its dry signal mixed with the average of its voices.
+ */
+class ModulatedDelay
+{
+public:
+	static constexpr size_t kMaxVoices = 8;
+
+	/**
+	 * \param num_channels number of channels
+	 * \param sample_rate sample rate
+	 * \param params delay parameters
+	 * \throw invalid_argument negative times or rate, voices not in 1..kMaxVoices,
+	 *  feedback not in (-1, 1), mix not in 0..1 or unknown interpolation
+	 */
+	ModulatedDelay(size_t num_channels, double sample_rate, const ModulatedDelayParams& params);
+
+	/**
+	 * \brief Clear delay lines and start LFO from the beginning
+	 */
+	void Reset();
+
+	/**
+	 * \brief Process samples in place, LFO continues from the previous call
+	 * \param channels pointers to num_channels buffers
+	 * \param count number of frames in every buffer
+	 */
+	void Process(float* const* channels, size_t count);
+
+private:
+	static constexpr size_t kLanes = 4;
+
+	void ResetLfo();
+	/**
+	 * \brief Process frame i of the channels and advance LFO by a frame
+	 * \param wet buffer for the delayed signal of every lane
+	 */
+	void ProcessFrame(float* const* channels, size_t i, float* wet);
+
+	size_t num_channels_;
+	size_t num_lanes_;
+	double sample_rate_;
+	ModulatedDelayParams params_;
+
+	// Delays in frames, the shortest one keeps every tap before the frame being written
+	float min_delay_;
+	float depth_;
+
+	// Delay lines of all channels one after another, every one is a power of 2 long
+	std::vector<float> lines_;
+	size_t line_mask_;
+	size_t write_ = 0;
+
+	// Frames processed since the beginning
+	uint64_t position_ = 0;
+
+	// Per lane, padded to whole groups: offset of its channel line and LFO phase at the beginning, periods
+	std::vector<size_t> lane_offsets_;
+	std::vector<double> lane_phases_;
+
+	// LFO of every lane as a rotating vector, set exactly at the start of every block
+	std::vector<float> lfo_sin_;
+	std::vector<float> lfo_cos_;
+	float rotation_sin_;
+	float rotation_cos_;
+
+	// Previous output of the allpass of every lane
+	std::vector<float> allpass_state_;
+};
@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "PackedAudio.h"
+#include "Flac.h"
+#include "Hash.h"
+#include "Meter.h"
+#include "SimdKernels.h"
+#include "Stats.h"
+
+using namespace std;
+
+namespace
+{
+	// Bytes of the data chunk read or written at once
+	constexpr size_t kIoBlockBytes = 64 * 1024;
+
+	uint32_t ReadUInt32(const uint8_t* data)
+	{
+		return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+	}
+
+	uint16_t ReadUInt16(const uint8_t* data)
+	{
+		return static_cast<uint16_t>(data[0] | (data[1] << 8));
+	}
+
+	void WriteUInt32(vector<uint8_t>& data, uint32_t value)
+	{
+		for (int byte = 0; byte < 4; byte++)
+			data.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+	}
+
+	void WriteUInt16(vector<uint8_t>& data, uint16_t value)
+	{
+		data.push_back(static_cast<uint8_t>(value));
+		data.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	void WriteString(vector<uint8_t>& data, const char* str)
+	{
+		data.insert(data.end(), str, str + 4);
+	}
+
+	/**
+	 * \brief Copy count samples of kBytes bytes, in_stride and out_stride bytes apart
+	 */
+	template <size_t kBytes>
+	void CopySamples(const uint8_t* in, size_t in_stride, uint8_t* out, size_t out_stride, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, in += in_stride, out += out_stride)
+			std::memcpy(out, in, kBytes);
+	}
+
+	void CopySamples(size_t bytes_per_sample, const uint8_t* in, size_t in_stride, uint8_t* out, size_t out_stride, size_t count)
+	{
+		switch (bytes_per_sample)
+		{
+			case 1:
+				CopySamples<1>(in, in_stride, out, out_stride, count);
+				break;
+
+			case 2:
+				CopySamples<2>(in, in_stride, out, out_stride, count);
+				break;
+
+			case 3:
+				CopySamples<3>(in, in_stride, out, out_stride, count);
+				break;
+
+			default:
+				CopySamples<4>(in, in_stride, out, out_stride, count);
+				break;
+		}
+	}
+
+	template <size_t kBytes>
+	void UnpackInt(const uint8_t* in, size_t count, int32_t* out)
+	{
+		for (size_t i = 0; i < count; i++, in += kBytes)
+		{
+			if constexpr (kBytes == 1)
+				out[i] = in[0] - 128;
+			else if constexpr (kBytes == 2)
+				out[i] = static_cast<int16_t>(in[0] | (in[1] << 8));
+			else if constexpr (kBytes == 3)
+				out[i] = static_cast<int32_t>(static_cast<uint32_t>(in[0] << 8 | in[1] << 16 | in[2] << 24)) >> 8;
+			else
+				out[i] = static_cast<int32_t>(static_cast<uint32_t>(in[0]) | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24);
+		}
+	}
+
+	template <size_t kBytes>
+	void PackInt(const int32_t* in, size_t count, uint8_t* out)
+	{
+		for (size_t i = 0; i < count; i++, out += kBytes)
+		{
+			// 8 bit samples are unsigned
+			const auto sample = static_cast<uint32_t>(kBytes == 1 ? in[i] + 128 : in[i]);
+			for (size_t byte = 0; byte < kBytes; byte++)
+				out[byte] = static_cast<uint8_t>(sample >> (8 * byte));
+		}
+	}
+
+	/**
+	 * \brief Decode FLAC file, the stream is read whole, as its frames are decoded in parallel
+	 */
+	bool LoadFlac(ifstream& file, const string& filename, const FrameRange& range, PackedAudio& audio, Meter* meter)
+	{
+		file.seekg(0, ios::end);
+		vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<streamsize>(data.size())))
+		{
+			cerr << "Error: Unexpected end of file: " << filename << endl;
+			return false;
+		}
+
+		if (!FlacCodec::Decode(data, audio, range))
+			return false;
+
+		if (meter != nullptr)
+		{
+			meter->Reset(audio.GetSampleRate(), audio.GetNumChannels());
+
+			const size_t frames_per_block = kIoBlockBytes / sizeof(float);
+			ScratchScope scratch;
+			float* decoded = scratch.Allocate<float>(frames_per_block);
+			for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+			{
+				for (size_t block_start = 0; block_start < audio.GetNumFrames(); block_start += frames_per_block)
+				{
+					const size_t count = std::min(frames_per_block, audio.GetNumFrames() - block_start);
+					audio.Read(channel, block_start, count, decoded);
+					meter->Process(channel, decoded, count);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool IsSupportedBitDepth(int bit_depth)
+	{
+		return bit_depth == 8 || bit_depth == 16 || bit_depth == 24 || bit_depth == 32;
+	}
+}
+
+PackedAudio::PackedAudio(uint32_t sample_rate, int bit_depth, size_t num_channels, size_t num_frames)
+	: sample_rate_(sample_rate), bit_depth_(bit_depth), num_frames_(num_frames)
+{
+	if (!IsSupportedBitDepth(bit_depth))
+		throw invalid_argument("Bit depth must be 8, 16, 24 or 32");
+
+	// Silence of 8 bit unsigned samples is 128
+	channels_.resize(num_channels);
+	for (auto& channel : channels_)
+		channel.assign(num_frames * GetBytesPerSample(), bit_depth == 8 ? 128 : 0);
+}
+
+PackedAudio PackedAudio::FromWav(const WavFile<float>& wav, const DitherOptions& dither)
+{
+	PackedAudio audio(wav.sampleRate, wav.bitDepth, wav.GetNumChannels(), wav.GetNumSamplesPerChannel());
+	for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+	{
+		Quantizer quantizer(wav.bitDepth, dither, channel);
+		audio.Write(channel, 0, audio.num_frames_, wav.samples[channel].data(), quantizer);
+	}
+
+	return audio;
+}
+
+WavFile<float> PackedAudio::ToWav() const
+{
+	WavFile<float>::AudioData samples(GetNumChannels(), vector<float>(num_frames_));
+	for (size_t channel = 0; channel < GetNumChannels(); channel++)
+		Read(channel, 0, num_frames_, samples[channel].data());
+
+	return WavFile<float>(sample_rate_, bit_depth_, std::move(samples));
+}
+
+bool PackedAudio::Load(const std::string& filename, Meter* meter, XxHash64* hash)
+{
+	return Load(filename, FrameRange(), meter, hash);
+}
+
+bool PackedAudio::Load(const std::string& filename, const FrameRange& range, Meter* meter, XxHash64* hash)
+{
+	StageTimer timer("packed load");
+
+	ifstream file(filename, ios::binary);
+	if (!file.good())
+	{
+		cerr << "Error: Can`t open file: " << filename << endl;
+		return false;
+	}
+
+	uint8_t header[12];
+	if (file.read(reinterpret_cast<char*>(header), 12) && FlacCodec::IsFlac(header, 4))
+	{
+		if (!LoadFlac(file, filename, range, *this, meter))
+			return false;
+
+		// Decoded channels are hashed in memory, the stream isn't read again
+		if (hash != nullptr)
+		{
+			HashFormat(*hash, false);
+			for (const auto& channel : channels_)
+				hash->Update(channel.data(), channel.size());
+		}
+		return true;
+	}
+
+	if (!file || string(header, header + 4) != "RIFF" || string(header + 8, header + 12) != "WAVE")
+	{
+		cerr << "Error: Invalid .wav file." << endl;
+		return false;
+	}
+
+	// Walk chunks until the data chunk, samples are read from the stream without copying the whole file
+	uint8_t format[16] = {};
+	bool has_format = false;
+	size_t data_size = 0;
+	bool has_data = false;
+	while (file.read(reinterpret_cast<char*>(header), 8))
+	{
+		const string chunk_id(header, header + 4);
+		const size_t chunk_size = ReadUInt32(header + 4);
+
+		if (chunk_id == "data")
+		{
+			data_size = chunk_size;
+			has_data = true;
+			break;
+		}
+
+		size_t skip = chunk_size + (chunk_size & 1);
+		if (chunk_id == "fmt " && chunk_size >= 16)
+		{
+			file.read(reinterpret_cast<char*>(format), 16);
+			has_format = true;
+			skip -= 16;
+		}
+
+		file.seekg(static_cast<streamoff>(skip), ios::cur);
+	}
+
+	if (!has_format || !has_data)
+	{
+		cerr << "Error: Invalid .wav file." << endl;
+		return false;
+	}
+
+	const uint16_t audio_format = ReadUInt16(format);
+	const uint16_t num_channels = ReadUInt16(format + 2);
+	const uint32_t sample_rate = ReadUInt32(format + 4);
+	const uint32_t byte_rate = ReadUInt32(format + 8);
+	const uint16_t block_align = ReadUInt16(format + 12);
+	const uint16_t bit_depth = ReadUInt16(format + 14);
+
+	if (audio_format != 1)
+	{
+		cerr << "Error: Compressed files doesn`t supported." << endl;
+		return false;
+	}
+
+	if (num_channels < 1)
+	{
+		cerr << "Error: File has no channels." << endl;
+		return false;
+	}
+
+	if (!IsSupportedBitDepth(bit_depth))
+	{
+		cerr << "Error: this file has a bit depth that is not 8, 16, 24 or 32 bits" << endl;
+		return false;
+	}
+
+	if (byte_rate != num_channels * sample_rate * bit_depth / 8 || block_align != num_channels * bit_depth / 8)
+	{
+		cerr << "Error: the header data in this WAV file seems to be inconsistent" << endl;
+		return false;
+	}
+
+	// Samples before the range are skipped by seeking
+	const auto frames = range.Clamp(data_size / block_align);
+	file.seekg(static_cast<streamoff>(frames.begin * block_align), ios::cur);
+	*this = PackedAudio(sample_rate, bit_depth, num_channels, frames.GetLength());
+
+	if (meter != nullptr)
+		meter->Reset(sample_rate_, num_channels);
+	if (hash != nullptr)
+		HashFormat(*hash, true);
+
+	// Deinterleave by blocks, the meter and the hash read the block while it's in cache
+	const size_t bytes_per_sample = GetBytesPerSample();
+	const size_t frames_per_block = std::max<size_t>(1, kIoBlockBytes / block_align);
+	vector<uint8_t> buffer(frames_per_block * block_align);
+
+	ScratchScope scratch;
+	float* decoded = meter != nullptr ? scratch.Allocate<float>(frames_per_block) : nullptr;
+
+	for (size_t block_start = 0; block_start < num_frames_; block_start += frames_per_block)
+	{
+		const size_t count = std::min(frames_per_block, num_frames_ - block_start);
+		if (!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<streamsize>(count * block_align)))
+		{
+			cerr << "Error: Unexpected end of file: " << filename << endl;
+			return false;
+		}
+
+		if (hash != nullptr)
+			hash->Update(buffer.data(), count * block_align);
+
+		for (size_t channel = 0; channel < num_channels; channel++)
+		{
+			CopySamples(bytes_per_sample, buffer.data() + channel * bytes_per_sample, block_align,
+				channels_[channel].data() + block_start * bytes_per_sample, bytes_per_sample, count);
+
+			if (meter != nullptr)
+			{
+				Read(channel, block_start, count, decoded);
+				meter->Process(channel, decoded, count);
+			}
+		}
+	}
+
+	timer.SetSamples(num_frames_ * num_channels);
+	timer.SetBytes(num_frames_ * block_align);
+	return true;
+}
+
+bool PackedAudio::Save(const std::string& filename) const
+{
+	if (FlacCodec::HasFlacExtension(filename))
+	{
+		vector<uint8_t> data;
+		if (!FlacCodec::Encode(*this, data))
+			return false;
+
+		ofstream file(filename, ios::binary);
+		if (!file.good() || !file.write(reinterpret_cast<const char*>(data.data()), static_cast<streamsize>(data.size())))
+		{
+			cerr << "Error: couldn't Save file to " << filename << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	StageTimer timer("packed save", num_frames_ * GetNumChannels());
+
+	const size_t bytes_per_sample = GetBytesPerSample();
+	const size_t block_align = GetNumChannels() * bytes_per_sample;
+	const size_t data_chunk_size = num_frames_ * block_align;
+
+	vector<uint8_t> header;
+	WriteString(header, "RIFF");
+	WriteUInt32(header, static_cast<uint32_t>(4 + 24 + 8 + data_chunk_size));
+	WriteString(header, "WAVE");
+	WriteString(header, "fmt ");
+	WriteUInt32(header, 16);
+	WriteUInt16(header, 1);
+	WriteUInt16(header, static_cast<uint16_t>(GetNumChannels()));
+	WriteUInt32(header, sample_rate_);
+	WriteUInt32(header, static_cast<uint32_t>(sample_rate_ * block_align));
+	WriteUInt16(header, static_cast<uint16_t>(block_align));
+	WriteUInt16(header, static_cast<uint16_t>(bit_depth_));
+	WriteString(header, "data");
+	WriteUInt32(header, static_cast<uint32_t>(data_chunk_size));
+
+	ofstream file(filename, ios::binary);
+	if (!file.good() || !file.write(reinterpret_cast<const char*>(header.data()), static_cast<streamsize>(header.size())))
+	{
+		cerr << "Error: couldn't Save file to " << filename << endl;
+		return false;
+	}
+
+	// Interleave by blocks
+	const size_t frames_per_block = std::max<size_t>(1, kIoBlockBytes / block_align);
+	vector<uint8_t> buffer(frames_per_block * block_align);
+	for (size_t block_start = 0; block_start < num_frames_; block_start += frames_per_block)
+	{
+		const size_t count = std::min(frames_per_block, num_frames_ - block_start);
+		for (size_t channel = 0; channel < GetNumChannels(); channel++)
+		{
+			CopySamples(bytes_per_sample, channels_[channel].data() + block_start * bytes_per_sample, bytes_per_sample,
+				buffer.data() + channel * bytes_per_sample, block_align, count);
+		}
+
+		if (!file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<streamsize>(count * block_align)))
+		{
+			cerr << "Error: couldn't Save file to " << filename << endl;
+			return false;
+		}
+	}
+
+	timer.SetBytes(header.size() + data_chunk_size);
+	return true;
+}
+
+void PackedAudio::Read(size_t channel, size_t start, size_t count, float* out) const
+{
+	const size_t bytes_per_sample = GetBytesPerSample();
+	if (bit_depth_ == 16)
+	{
+		SimdKernels::Get().decode16(channels_[channel].data() + start * bytes_per_sample, count, out);
+		return;
+	}
+
+	DecodePcm(bit_depth_, channels_[channel].data() + start * bytes_per_sample, count, bytes_per_sample, out);
+}
+
+void PackedAudio::Write(size_t channel, size_t start, size_t count, const float* in, Quantizer& quantizer)
+{
+	const size_t bytes_per_sample = GetBytesPerSample();
+	if (bit_depth_ == 16 && quantizer.IsRoundingOnly())
+	{
+		SimdKernels::Get().encode16(in, count, channels_[channel].data() + start * bytes_per_sample);
+		return;
+	}
+
+	quantizer.Encode(bit_depth_, in, count, channels_[channel].data() + start * bytes_per_sample, bytes_per_sample);
+}
+
+void PackedAudio::ReadInt(size_t channel, size_t start, size_t count, int32_t* out) const
+{
+	const uint8_t* in = channels_[channel].data() + start * GetBytesPerSample();
+	switch (bit_depth_)
+	{
+		case 8:
+			UnpackInt<1>(in, count, out);
+			break;
+
+		case 16:
+			UnpackInt<2>(in, count, out);
+			break;
+
+		case 24:
+			UnpackInt<3>(in, count, out);
+			break;
+
+		default:
+			UnpackInt<4>(in, count, out);
+			break;
+	}
+}
+
+void PackedAudio::WriteInt(size_t channel, size_t start, size_t count, const int32_t* in)
+{
+	uint8_t* out = channels_[channel].data() + start * GetBytesPerSample();
+	switch (bit_depth_)
+	{
+		case 8:
+			PackInt<1>(in, count, out);
+			break;
+
+		case 16:
+			PackInt<2>(in, count, out);
+			break;
+
+		case 24:
+			PackInt<3>(in, count, out);
+			break;
+
+		default:
+			PackInt<4>(in, count, out);
+			break;
+	}
+}
+
+uint32_t PackedAudio::GetSampleRate() const
+{
+	return sample_rate_;
+}
+
+int PackedAudio::GetBitDepth() const
+{
+	return bit_depth_;
+}
+
+size_t PackedAudio::GetNumChannels() const
+{
+	return channels_.size();
+}
+
+size_t PackedAudio::GetNumFrames() const
+{
+	return num_frames_;
+}
+
+double PackedAudio::GetLengthInSeconds() const
+{
+	return static_cast<double>(num_frames_) / sample_rate_;
+}
+
+size_t PackedAudio::GetMemoryBytes() const
+{
+	return num_frames_ * GetNumChannels() * GetBytesPerSample();
+}
+
+size_t PackedAudio::GetBytesPerSample() const
+{
+	return static_cast<size_t>(bit_depth_ / 8);
+}
+
+void PackedAudio::HashFormat(XxHash64& hash, bool interleaved) const
+{
+	const uint64_t fields[] = { sample_rate_, static_cast<uint64_t>(bit_depth_), GetNumChannels(), num_frames_, interleaved };
+	hash.Update(fields, sizeof(fields));
+}
+
+PackedBlockIterator::PackedBlockIterator(const PackedAudio& audio, const FrameRange& range)
+	: audio_(audio), range_(range.Clamp(audio.GetNumFrames())),
+	  block_frames_(GetBlockFrames(audio.GetNumChannels(), audio.GetBitDepth()))
+{
+	block_ = { range_.begin, range_.begin };
+
+	channels_ = scratch_.Allocate<float*>(audio_.GetNumChannels());
+	for (size_t channel = 0; channel < audio_.GetNumChannels(); channel++)
+		channels_[channel] = scratch_.Allocate<float>(block_frames_);
+}
+
+PackedBlockIterator::PackedBlockIterator(PackedAudio& audio, const DitherOptions& dither, const FrameRange& range)
+	: PackedBlockIterator(static_cast<const PackedAudio&>(audio), range)
+{
+	writable_ = &audio;
+	quantizers_.reserve(audio.GetNumChannels());
+	for (size_t channel = 0; channel < audio.GetNumChannels(); channel++)
+		quantizers_.emplace_back(audio.GetBitDepth(), dither, channel);
+}
+
+PackedBlockIterator::~PackedBlockIterator()
+{
+	Flush();
+}
+
+bool PackedBlockIterator::Next()
+{
+	Flush();
+
+	const size_t begin = block_.end;
+	if (begin >= range_.end)
+	{
+		block_ = { range_.end, range_.end };
+		return false;
+	}
+
+	block_ = { begin, std::min(begin + block_frames_, range_.end) };
+	for (size_t channel = 0; channel < audio_.GetNumChannels(); channel++)
+		audio_.Read(channel, block_.begin, block_.GetLength(), channels_[channel]);
+
+	return true;
+}
+
+FrameRange PackedBlockIterator::GetRange() const
+{
+	return block_;
+}
+
+size_t PackedBlockIterator::GetNumFrames() const
+{
+	return block_.GetLength();
+}
+
+float* PackedBlockIterator::GetChannel(size_t channel)
+{
+	return channels_[channel];
+}
+
+float* const* PackedBlockIterator::GetChannels()
+{
+	return channels_;
+}
+
+size_t PackedBlockIterator::GetBlockFrames(size_t num_channels, int bit_depth)
+{
+	const size_t frame_bytes = std::max<size_t>(1, num_channels) * (sizeof(float) + static_cast<size_t>(bit_depth / 8));
+	return std::max<size_t>(64, kBlockBytes / frame_bytes);
+}
+
+void PackedBlockIterator::Flush()
+{
+	if (writable_ == nullptr || block_.IsEmpty())
+		return;
+
+	for (size_t channel = 0; channel < writable_->GetNumChannels(); channel++)
+		writable_->Write(channel, block_.begin, block_.GetLength(), channels_[channel], quantizers_[channel]);
+}
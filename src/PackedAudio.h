@@ -0,0 +1,185 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FrameRange.h"
+#include "Quantizer.h"
+#include "ScratchArena.h"
+#include "WavFile.h"
+
+class Meter;
+class XxHash64;
+
+/**
+ * \brief Samples kept in their packed PCM format, e.g. 2 bytes per 16 bit sample instead of 4 bytes of float
+ *
+ * Channels are stored one after another, so a block of one channel is contiguous.
+ * Samples are converted to float by blocks with PackedBlockIterator, with the same scales
+ * as WavFile::Load and Save, so load, save and conversions without processing are bit-exact.
+ */
+class PackedAudio
+{
+public:
+	PackedAudio() = default;
+
+	/**
+	 * \brief Silent audio
+	 * \throw invalid_argument bit depth is not 8, 16, 24 or 32
+	 */
+	PackedAudio(uint32_t sample_rate, int bit_depth, size_t num_channels, size_t num_frames);
+
+	/**
+	 * \brief Pack samples of the wave file in its bit depth
+	 * \param wav wave file
+	 * \param dither dither and noise shaping of 8, 16 and 24 bit formats
+	 * \throw invalid_argument bit depth is not 8, 16, 24 or 32
+	 */
+	static PackedAudio FromWav(const WavFile<float>& wav, const DitherOptions& dither = DitherOptions{ kDitherNone });
+
+	/**
+	 * \brief Unpack samples to floats
+	 */
+	[[nodiscard]] WavFile<float> ToWav() const;
+
+	/**
+	 * \brief Load wave file without converting the samples, data chunk is read by blocks.
+	 * FLAC files are recognized by their stream marker and decoded.
+	 * \param filename File to load
+	 * \param meter if not null, measures levels of the samples while they are loaded
+	 * \param hash if not null, is fed with the format and the samples while they are loaded
+	 * \return true, if loading was successful, otherwise false
+	 */
+	bool Load(const std::string& filename, Meter* meter = nullptr, XxHash64* hash = nullptr);
+
+	/**
+	 * \brief Load frames of the range, wave file is read from the offset of its first frame,
+	 * FLAC file decodes only frames, that overlap the range
+	 * \param filename File to load
+	 * \param range frames to load, clamped to the file length
+	 * \param meter if not null, measures levels of the loaded samples
+	 * \param hash if not null, is fed with the format and the loaded samples
+	 * \return true, if loading was successful, otherwise false
+	 */
+	bool Load(const std::string& filename, const FrameRange& range, Meter* meter = nullptr, XxHash64* hash = nullptr);
+
+	/**
+	 * \brief Save wave file, packed samples are written as they are.
+	 * Files with .flac extension are encoded to FLAC.
+	 * \return true, if saving was successful, otherwise false
+	 */
+	bool Save(const std::string& filename) const;
+
+	/**
+	 * \brief Convert count samples of the channel from start to floats
+	 */
+	void Read(size_t channel, size_t start, size_t count, float* out) const;
+
+	/**
+	 * \brief Pack count float samples into the channel from start
+	 * \param quantizer quantizer of the channel, keeps dither and noise shaping state between calls
+	 */
+	void Write(size_t channel, size_t start, size_t count, const float* in, Quantizer& quantizer);
+
+	/**
+	 * \brief Integer samples of the channel from start, 8 bit samples are made signed
+	 */
+	void ReadInt(size_t channel, size_t start, size_t count, int32_t* out) const;
+
+	/**
+	 * \brief Store integer samples into the channel from start, 8 bit samples are signed
+	 */
+	void WriteInt(size_t channel, size_t start, size_t count, const int32_t* in);
+
+	[[nodiscard]] uint32_t GetSampleRate() const;
+	[[nodiscard]] int GetBitDepth() const;
+	[[nodiscard]] size_t GetNumChannels() const;
+	[[nodiscard]] size_t GetNumFrames() const;
+	[[nodiscard]] double GetLengthInSeconds() const;
+
+	/**
+	 * \brief Bytes taken by the samples
+	 */
+	[[nodiscard]] size_t GetMemoryBytes() const;
+
+private:
+	[[nodiscard]] size_t GetBytesPerSample() const;
+
+	/**
+	 * \brief Feed the format, that the samples are hashed after
+	 * \param interleaved whether samples are hashed interleaved, as they are in a wave file, or channel by channel
+	 */
+	void HashFormat(XxHash64& hash, bool interleaved) const;
+
+	uint32_t sample_rate_ = 44100;
+	int bit_depth_ = 16;
+	size_t num_frames_ = 0;
+	// Packed samples of every channel
+	std::vector<std::vector<uint8_t>> channels_;
+};
+
+/**
+ * \brief Walks packed audio by blocks of float samples, that fit into L1 cache with their packed source
+ *
+ * Block buffers are taken from the scratch arena of the calling thread, so the iterator
+ * must stay on the thread, that created it. Writable iterator packs the block back,
+ * when it moves to the next one or is destroyed.
+ */
+class PackedBlockIterator
+{
+public:
+	// Float and packed bytes of a block, half of 32 KiB L1 data cache
+	static constexpr size_t kBlockBytes = 16 * 1024;
+
+	/**
+	 * \brief Read-only iterator
+	 */
+	explicit PackedBlockIterator(const PackedAudio& audio, const FrameRange& range = FrameRange());
+
+	/**
+	 * \brief Writable iterator
+	 * \param dither dither and noise shaping of written samples
+	 */
+	PackedBlockIterator(PackedAudio& audio, const DitherOptions& dither, const FrameRange& range = FrameRange());
+
+	~PackedBlockIterator();
+
+	PackedBlockIterator(const PackedBlockIterator&) = delete;
+	PackedBlockIterator& operator=(const PackedBlockIterator&) = delete;
+
+	/**
+	 * \brief Move to the next block and convert it
+	 * \return false, if there are no more blocks
+	 */
+	bool Next();
+
+	/**
+	 * \brief Frames of the current block
+	 */
+	[[nodiscard]] FrameRange GetRange() const;
+	[[nodiscard]] size_t GetNumFrames() const;
+
+	/**
+	 * \brief Samples of the channel in the current block
+	 */
+	[[nodiscard]] float* GetChannel(size_t channel);
+	[[nodiscard]] float* const* GetChannels();
+
+	/**
+	 * \brief Frames per block for the number of channels and bit depth
+	 */
+	[[nodiscard]] static size_t GetBlockFrames(size_t num_channels, int bit_depth);
+
+private:
+	void Flush();
+
+	const PackedAudio& audio_;
+	PackedAudio* writable_ = nullptr;
+	std::vector<Quantizer> quantizers_;
+
+	FrameRange range_;
+	FrameRange block_ = FrameRange::Empty();
+	size_t block_frames_;
+
+	ScratchScope scratch_;
+	float** channels_;
+};
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "PeakCache.h"
+#include "Stats.h"
+#include "utility.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr char kMagic[4] = { 'W', 'P', 'K', 'C' };
+	constexpr uint32_t kVersion = 1;
+}
+
+PeakCache PeakCache::Build(const WavFile<float>& wav)
+{
+	const auto num_frames = wav.GetNumSamplesPerChannel();
+	StageTimer timer("peak cache build", num_frames * wav.GetNumChannels());
+
+	PeakCache cache;
+	cache.sample_rate_ = wav.sampleRate;
+	cache.num_frames_ = num_frames;
+
+	Level base{ kBaseBinSize, vector<vector<PeakBin>>(wav.GetNumChannels()) };
+	const auto num_bins = (num_frames + kBaseBinSize - 1) / kBaseBinSize;
+
+	for (size_t channel = 0; channel < wav.GetNumChannels(); channel++)
+	{
+		const auto& samples = wav.samples[channel];
+		auto& bins = base.bins[channel];
+		bins.resize(num_bins);
+
+		for (size_t bin = 0; bin < num_bins; bin++)
+		{
+			const auto begin = bin * kBaseBinSize;
+			const auto end = std::min(num_frames, begin + kBaseBinSize);
+
+			float min = samples[begin];
+			float max = samples[begin];
+			double sum_squares = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				min = std::min(min, samples[i]);
+				max = std::max(max, samples[i]);
+				sum_squares += static_cast<double>(samples[i]) * samples[i];
+			}
+
+			bins[bin] = { min, max, static_cast<float>(sqrt(sum_squares / static_cast<double>(end - begin))) };
+		}
+	}
+	cache.levels_.push_back(std::move(base));
+
+	// Every next level merges kDecimation bins of the previous one
+	while (!cache.levels_.back().bins.empty() && cache.levels_.back().bins[0].size() > 1)
+	{
+		const auto& prev = cache.levels_.back();
+		Level level{ prev.bin_size * kDecimation, vector<vector<PeakBin>>(prev.bins.size()) };
+		const auto level_bins = (prev.bins[0].size() + kDecimation - 1) / kDecimation;
+
+		for (size_t channel = 0; channel < level.bins.size(); channel++)
+		{
+			level.bins[channel].resize(level_bins);
+			for (size_t bin = 0; bin < level_bins; bin++)
+				level.bins[channel][bin] = cache.Merge(prev, channel, bin * level.bin_size, (bin + 1) * level.bin_size);
+		}
+
+		cache.levels_.push_back(std::move(level));
+	}
+
+	return cache;
+}
+
+bool PeakCache::Open(const std::filesystem::path& path, const WavFile<float>* wav)
+{
+	if (Load(path))
+		return true;
+
+	WavFile<float> loaded;
+	if (wav == nullptr)
+	{
+		if (!loaded.Load(path.string()))
+			return false;
+		wav = &loaded;
+	}
+
+	*this = Build(*wav);
+
+	// Sidecar is only an optimization, e.g. directory may be read-only
+	Save(path);
+	return true;
+}
+
+bool PeakCache::Save(const std::filesystem::path& path) const
+{
+	Key key;
+	if (!GetKey(path, key))
+		return false;
+
+	ofstream file(GetSidecarPath(path), ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const auto write = [&](const auto& value) {
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+
+	file.write(kMagic, sizeof(kMagic));
+	write(kVersion);
+	write(key.file_size);
+	write(key.mtime);
+	write(sample_rate_);
+	write(static_cast<uint64_t>(num_frames_));
+	write(static_cast<uint32_t>(GetNumChannels()));
+	write(static_cast<uint32_t>(levels_.size()));
+
+	for (const auto& level : levels_)
+	{
+		write(static_cast<uint64_t>(level.bin_size));
+		for (const auto& bins : level.bins)
+			file.write(reinterpret_cast<const char*>(bins.data()), bins.size() * sizeof(PeakBin));
+	}
+
+	return file.good();
+}
+
+bool PeakCache::Load(const std::filesystem::path& path)
+{
+	StageTimer timer("peak cache load");
+
+	Key key;
+	if (!GetKey(path, key))
+		return false;
+
+	ifstream file(GetSidecarPath(path), ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const auto read = [&](auto& value) {
+		file.read(reinterpret_cast<char*>(&value), sizeof(value));
+		return file.good();
+	};
+
+	char magic[4];
+	uint32_t version;
+	Key sidecar_key;
+	file.read(magic, sizeof(magic));
+	if (!file.good() || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || !read(version) || version != kVersion ||
+		!read(sidecar_key.file_size) || !read(sidecar_key.mtime))
+		return false;
+
+	// Wave file was changed since the sidecar was saved
+	if (sidecar_key.file_size != key.file_size || sidecar_key.mtime != key.mtime)
+		return false;
+
+	PeakCache cache;
+	uint64_t num_frames;
+	uint32_t num_channels, num_levels;
+	if (!read(cache.sample_rate_) || !read(num_frames) || !read(num_channels) || !read(num_levels))
+		return false;
+	cache.num_frames_ = static_cast<size_t>(num_frames);
+
+	// Every sample takes at least a byte of the wave file
+	if (num_channels == 0 || num_frames > key.file_size)
+		return false;
+
+	for (uint32_t i = 0; i < num_levels; i++)
+	{
+		uint64_t bin_size;
+		if (!read(bin_size) || bin_size == 0)
+			return false;
+
+		Level level{ static_cast<size_t>(bin_size), vector<vector<PeakBin>>(num_channels) };
+		const auto num_bins = (cache.num_frames_ + level.bin_size - 1) / level.bin_size;
+		for (auto& bins : level.bins)
+		{
+			bins.resize(num_bins);
+			file.read(reinterpret_cast<char*>(bins.data()), num_bins * sizeof(PeakBin));
+			if (!file.good())
+				return false;
+		}
+
+		cache.levels_.push_back(std::move(level));
+	}
+
+	if (cache.levels_.empty())
+		return false;
+
+	timer.SetBytes(static_cast<size_t>(file.tellg()));
+	*this = std::move(cache);
+	return true;
+}
+
+std::filesystem::path PeakCache::GetSidecarPath(const std::filesystem::path& path)
+{
+	auto sidecar = path;
+	sidecar += ".peaks";
+	return sidecar;
+}
+
+std::vector<PeakBin> PeakCache::GetBins(size_t channel, const FrameRange& range, size_t num_bins) const
+{
+	if (channel >= GetNumChannels())
+		throw std::out_of_range("Channel");
+
+	vector<PeakBin> result(num_bins);
+	const auto frames = range.Clamp(num_frames_);
+	if (frames.IsEmpty() || num_bins == 0)
+		return result;
+
+	// The coarsest level, that still has at least one bin per result bin
+	const double step = static_cast<double>(frames.GetLength()) / static_cast<double>(num_bins);
+	const Level* level = &levels_[0];
+	for (const auto& candidate : levels_)
+		if (static_cast<double>(candidate.bin_size) <= step)
+			level = &candidate;
+
+	for (size_t i = 0; i < num_bins; i++)
+	{
+		const auto begin = frames.begin + static_cast<size_t>(static_cast<double>(i) * step);
+		const auto end = frames.begin + static_cast<size_t>(static_cast<double>(i + 1) * step);
+		result[i] = Merge(*level, channel, begin, std::max(end, begin + 1));
+	}
+
+	return result;
+}
+
+PeakBin PeakCache::GetSummary(size_t channel, const FrameRange& range) const
+{
+	return GetBins(channel, range, 1)[0];
+}
+
+FrameRange PeakCache::FindContent(float threshold_db) const
+{
+	const float threshold = db_to_lin(threshold_db);
+	const size_t num_bins = GetNumChannels() == 0 ? 0 : levels_[0].bins[0].size();
+
+	size_t first = 0;
+	while (first < num_bins && IsSilentBin(first, threshold))
+		first++;
+	if (first == num_bins)
+		return FrameRange::Empty();
+
+	size_t last = num_bins;
+	while (IsSilentBin(last - 1, threshold))
+		last--;
+
+	return { first * kBaseBinSize, std::min(num_frames_, last * kBaseBinSize) };
+}
+
+std::vector<FrameRange> PeakCache::FindGaps(float threshold_db, size_t min_frames) const
+{
+	const float threshold = db_to_lin(threshold_db);
+	const size_t num_bins = GetNumChannels() == 0 ? 0 : levels_[0].bins[0].size();
+	min_frames = std::max<size_t>(min_frames, 1);
+
+	vector<FrameRange> gaps;
+	size_t gap_begin = 0;
+	for (size_t bin = 0; bin < num_bins; bin++)
+	{
+		if (IsSilentBin(bin, threshold))
+			continue;
+
+		const auto begin = bin * kBaseBinSize;
+		if (begin - gap_begin >= min_frames)
+			gaps.push_back({ gap_begin, begin });
+		gap_begin = std::min(num_frames_, begin + kBaseBinSize);
+	}
+
+	if (num_frames_ - gap_begin >= min_frames)
+		gaps.push_back({ gap_begin, num_frames_ });
+
+	return gaps;
+}
+
+bool PeakCache::IsEmpty() const
+{
+	return levels_.empty();
+}
+
+size_t PeakCache::GetNumChannels() const
+{
+	return levels_.empty() ? 0 : levels_[0].bins.size();
+}
+
+size_t PeakCache::GetNumFrames() const
+{
+	return num_frames_;
+}
+
+uint32_t PeakCache::GetSampleRate() const
+{
+	return sample_rate_;
+}
+
+void PeakCache::PrintOverview(size_t width) const
+{
+	static const char kLevels[] = " .:-=+*#%@";
+	constexpr size_t num_levels = sizeof(kLevels) - 2;
+
+	for (size_t channel = 0; channel < GetNumChannels(); channel++)
+	{
+		cout << "| " << channel + 1 << " |";
+		for (const auto& bin : GetBins(channel, FrameRange(), width))
+		{
+			const float peak = std::min(1.f, std::max(std::abs(bin.min), std::abs(bin.max)));
+			cout << kLevels[static_cast<size_t>(std::lround(peak * num_levels))];
+		}
+		cout << "|" << endl;
+	}
+}
+
+bool PeakCache::GetKey(const std::filesystem::path& path, Key& key)
+{
+	error_code ec;
+	key.file_size = fs::file_size(path, ec);
+	if (ec)
+		return false;
+
+	const auto mtime = fs::last_write_time(path, ec);
+	if (ec)
+		return false;
+
+	key.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+	return true;
+}
+
+PeakBin PeakCache::Merge(const Level& level, size_t channel, size_t begin, size_t end) const
+{
+	const auto& bins = level.bins[channel];
+	const auto first = begin / level.bin_size;
+	const auto last = std::min(bins.size(), (end + level.bin_size - 1) / level.bin_size);
+
+	PeakBin result;
+	double sum_squares = 0;
+	size_t count = 0;
+	for (size_t bin = first; bin < last; bin++)
+	{
+		// The last bin of the file may be partial
+		const auto bin_frames = std::min(level.bin_size, num_frames_ - bin * level.bin_size);
+
+		result.min = bin == first ? bins[bin].min : std::min(result.min, bins[bin].min);
+		result.max = bin == first ? bins[bin].max : std::max(result.max, bins[bin].max);
+		sum_squares += static_cast<double>(bins[bin].rms) * bins[bin].rms * static_cast<double>(bin_frames);
+		count += bin_frames;
+	}
+
+	if (count > 0)
+		result.rms = static_cast<float>(sqrt(sum_squares / static_cast<double>(count)));
+
+	return result;
+}
+
+bool PeakCache::IsSilentBin(size_t bin, float threshold) const
+{
+	for (const auto& bins : levels_[0].bins)
+		if (std::max(std::abs(bins[bin].min), std::abs(bins[bin].max)) > threshold)
+			return false;
+
+	return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "FrameRange.h"
+#include "WavFile.h"
+
+/**
+ * \brief Min, max and RMS of the block of samples
+ */
+struct PeakBin
+{
+	float min = 0;
+	float max = 0;
+	float rms = 0;
+};
+
+/**
+ * \brief Multi-resolution min/max/RMS overview of the wave file
+ *
+ * The finest level has a bin per kBaseBinSize frames, every next level merges kDecimation bins
+ * of the previous one, down to a single bin. Cache is persisted in the sidecar file `<file>.peaks`,
+ * keyed by size and modification time of the wave file.
+ */
+class PeakCache
+{
+public:
+	static constexpr size_t kBaseBinSize = 256;
+	static constexpr size_t kDecimation = 4;
+
+	PeakCache() = default;
+
+	/**
+	 * \brief Build overview from samples
+	 */
+	static PeakCache Build(const WavFile<float>& wav);
+
+	/**
+	 * \brief Load overview of the wave file from its sidecar, or build and save it if sidecar is missing or stale
+	 * \param path wave file path
+	 * \param wav loaded wave file, if null it's loaded when the overview has to be built
+	 * \return true, if overview is loaded or built
+	 */
+	bool Open(const std::filesystem::path& path, const WavFile<float>* wav = nullptr);
+
+	/**
+	 * \brief Save overview to the sidecar of the wave file
+	 * \return true, if saving was successful, otherwise false
+	 */
+	bool Save(const std::filesystem::path& path) const;
+
+	/**
+	 * \brief Load overview from the sidecar, if it matches current wave file
+	 * \return true, if loading was successful, otherwise false
+	 */
+	bool Load(const std::filesystem::path& path);
+
+	[[nodiscard]] static std::filesystem::path GetSidecarPath(const std::filesystem::path& path);
+
+	/**
+	 * \brief Overview of the range, split into num_bins equal bins
+	 *
+	 * Range edges are rounded to kBaseBinSize frames.
+	 * \throw out_of_range channel out of range
+	 */
+	[[nodiscard]] std::vector<PeakBin> GetBins(size_t channel, const FrameRange& range, size_t num_bins) const;
+
+	/**
+	 * \brief Min, max and RMS of the whole range
+	 * \throw out_of_range channel out of range
+	 */
+	[[nodiscard]] PeakBin GetSummary(size_t channel, const FrameRange& range = FrameRange()) const;
+
+	/**
+	 * \brief Frames from the first to the last finest bin, that isn't silent. Empty range, if whole file is silent
+	 *
+	 * Bin is silent, when its peak in every channel is at or below the threshold in dBFS.
+	 */
+	[[nodiscard]] FrameRange FindContent(float threshold_db) const;
+
+	/**
+	 * \brief Silent runs of finest bins of at least min_frames frames, leading and trailing silence included
+	 */
+	[[nodiscard]] std::vector<FrameRange> FindGaps(float threshold_db, size_t min_frames) const;
+
+	[[nodiscard]] bool IsEmpty() const;
+	[[nodiscard]] size_t GetNumChannels() const;
+	[[nodiscard]] size_t GetNumFrames() const;
+	[[nodiscard]] uint32_t GetSampleRate() const;
+
+	/**
+	 * \brief Prints waveform overview of every channel to standart output
+	 * \param width number of columns
+	 */
+	void PrintOverview(size_t width = 64) const;
+
+private:
+	struct Level
+	{
+		size_t bin_size;
+		// Outer container is channels, inner is bins
+		std::vector<std::vector<PeakBin>> bins;
+	};
+
+	struct Key
+	{
+		uint64_t file_size = 0;
+		int64_t mtime = 0;
+	};
+
+	[[nodiscard]] static bool GetKey(const std::filesystem::path& path, Key& key);
+
+	/**
+	 * \brief Merge bins of the level, that cover frames [begin, end)
+	 */
+	[[nodiscard]] PeakBin Merge(const Level& level, size_t channel, size_t begin, size_t end) const;
+
+	/**
+	 * \brief Whether peaks of the finest bin in every channel are at or below the linear threshold
+	 */
+	[[nodiscard]] bool IsSilentBin(size_t bin, float threshold) const;
+
+	uint32_t sample_rate_ = 0;
+	size_t num_frames_ = 0;
+	std::vector<Level> levels_;
+};
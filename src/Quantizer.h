@@ -0,0 +1,307 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include "SimdKernels.h"
+#include "WavFile.h"
+
+/**
+ * \brief Quantizer of one channel: scaling, noise shaping, dither, rounding, clamping and packing in one pass
+ *
+ * Scales match the decoder, so undithered 8, 16 and 24 bit files are saved back bit-exact.
+ * Samples, that are on the grid of the format already (e.g. unprocessed or silent), are only rounded,
+ * so they are saved back bit-exact with dither too.
+ * Shaping error is taken before clamping, so clipped samples don't destabilize the feedback.
+ * Without noise shaping blocks are quantized by the SIMD kernel. Dither is drawn by scalar generators
+ * in the order of the samples, so the output depends neither on the SIMD level nor on the block sizes.
+ */
+class Quantizer
+{
+public:
+	Quantizer(int bit_depth, const DitherOptions& options, size_t channel)
+		: scale_(bit_depth == 32 ? std::numeric_limits<int32_t>::max() : std::ldexp(1., bit_depth - 1)),
+		  min_(bit_depth == 32 ? std::numeric_limits<int32_t>::min() : -scale_),
+		  max_(bit_depth == 32 ? scale_ : scale_ - 1.)
+	{
+		uint64_t seed = options.seed + channel;
+		for (auto& state : states_)
+			state = (seed = SplitMix64(seed)) | 1;
+
+		// 32 bit integers are finer than float samples, there is nothing to dither
+		if (bit_depth == 32)
+			return;
+
+		dither_ = options.type == kDitherTpdf;
+		switch (options.shaping)
+		{
+			case kShapingFirstOrder:
+				coefficients_ = kFirstOrderShaping;
+				num_taps_ = std::size(kFirstOrderShaping);
+				break;
+
+			case kShapingLipshitz:
+				coefficients_ = kLipshitzShaping;
+				num_taps_ = std::size(kLipshitzShaping);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	/**
+	 * \brief Whether samples are only rounded, without dither and noise shaping
+	 */
+	[[nodiscard]] bool IsRoundingOnly() const
+	{
+		return !dither_ && num_taps_ == 0;
+	}
+
+	/**
+	 * \brief Encode count samples into little-endian integers of kBytes bytes, stride bytes apart
+	 */
+	template <int kBytes, typename T>
+	void Encode(const T* in, size_t count, uint8_t* out, size_t stride)
+	{
+		// Exact samples have no quantization error to decorrelate or shape, their errors are zero
+		const bool exact = !IsRoundingOnly() && IsOnGrid(in, count);
+		if (exact)
+		{
+			const size_t shift = std::min(count, num_taps_);
+			std::copy_backward(errors_, errors_ + num_taps_ - shift, errors_ + num_taps_);
+			std::fill(errors_, errors_ + shift, 0.);
+		}
+
+		const bool dither = dither_ && !exact;
+		const size_t num_taps = exact ? 0 : num_taps_;
+		if constexpr (std::is_same_v<T, float>)
+		{
+			// Without noise shaping samples are independent, so they are quantized by the SIMD kernel
+			if (num_taps == 0)
+			{
+				EncodeIndependent<kBytes>(in, count, out, stride, dither);
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++, out += stride)
+		{
+			double value = static_cast<double>(in[i]) * scale_;
+			for (size_t k = 0; k < num_taps; k++)
+				value -= coefficients_[k] * errors_[k];
+
+			const double quantized = std::nearbyint(dither ? value + NextTpdf() : value);
+			if (num_taps != 0)
+			{
+				std::copy_backward(errors_, errors_ + num_taps - 1, errors_ + num_taps);
+				errors_[0] = quantized - value;
+			}
+
+			Pack<kBytes>(static_cast<int64_t>(std::clamp(quantized, min_, max_)), out);
+		}
+	}
+
+	/**
+	 * \brief Encode samples of the bit depth, chosen at run time
+	 */
+	template <typename T>
+	void Encode(int bit_depth, const T* in, size_t count, uint8_t* out, size_t stride)
+	{
+		switch (bit_depth)
+		{
+			case 8:
+				Encode<1>(in, count, out, stride);
+				break;
+
+			case 16:
+				Encode<2>(in, count, out, stride);
+				break;
+
+			case 24:
+				Encode<3>(in, count, out, stride);
+				break;
+
+			default:
+				Encode<4>(in, count, out, stride);
+				break;
+		}
+	}
+
+private:
+	static constexpr double kFirstOrderShaping[] = { 1. };
+	static constexpr double kLipshitzShaping[] = { 2.033, -2.165, 1.959, -1.590, 0.6149 };
+
+	static uint64_t SplitMix64(uint64_t value)
+	{
+		value += 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		return value ^ (value >> 31);
+	}
+
+	/**
+	 * \brief Store the sample as a little-endian integer of kBytes bytes
+	 */
+	template <int kBytes>
+	static void Pack(int64_t sample, uint8_t* out)
+	{
+		// 8 bit samples are unsigned
+		if constexpr (kBytes == 1)
+			sample += 128;
+
+		for (int byte = 0; byte < kBytes; byte++)
+			out[byte] = static_cast<uint8_t>(sample >> (8 * byte));
+	}
+
+	/**
+	 * \brief Encode samples without noise shaping: dither of a block is drawn first, then the kernel quantizes it
+	 */
+	template <int kBytes>
+	void EncodeIndependent(const float* in, size_t count, uint8_t* out, size_t stride, bool dither)
+	{
+		constexpr size_t kBlockSize = 256;
+		double noise[kBlockSize];
+		int32_t samples[kBlockSize];
+		for (size_t block_start = 0; block_start < count; block_start += kBlockSize)
+		{
+			const size_t block_size = std::min(kBlockSize, count - block_start);
+			if (dither)
+				FillTpdf(noise, block_size);
+
+			SimdKernels::Get().quantize(in + block_start, dither ? noise : nullptr, block_size, scale_, min_, max_, samples);
+			for (size_t i = 0; i < block_size; i++, out += stride)
+				Pack<kBytes>(samples[i], out);
+		}
+	}
+
+	/**
+	 * \brief Whether all samples are integers of the format after scaling, stops at the first one, that isn't
+	 */
+	template <typename T>
+	bool IsOnGrid(const T* in, size_t count) const
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const double value = static_cast<double>(in[i]) * scale_;
+			if (value != std::nearbyint(value) || value < min_ || value > max_)
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * \brief Fill noise with the next count values of NextTpdf, whole turns of the generators at once
+	 */
+	void FillTpdf(double* noise, size_t count)
+	{
+		size_t i = 0;
+		for (; i < count && next_generator_ != 0; i++)
+			noise[i] = NextTpdf();
+		for (; i + kNumGenerators <= count; i += kNumGenerators)
+		{
+			for (size_t generator = 0; generator < kNumGenerators; generator++)
+				noise[i + generator] = NextTpdf(generator);
+		}
+		for (; i < count; i++)
+			noise[i] = NextTpdf();
+	}
+
+	/**
+	 * \brief TPDF value of the generator, whose turn it is
+	 */
+	double NextTpdf()
+	{
+		const size_t generator = next_generator_;
+		next_generator_ = (generator + 1) % kNumGenerators;
+		return NextTpdf(generator);
+	}
+
+	/**
+	 * \brief Sum of two uniform values in [-0.5, 0.5) LSB, both taken from one xorshift64* output of the generator
+	 */
+	double NextTpdf(size_t generator)
+	{
+		auto& state = states_[generator];
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		const uint64_t value = state * 2685821657736338717ULL;
+
+		// Sum of the two 24 bit values is exact, so it's converted and scaled once
+		constexpr double kScale = 1. / (1 << 24);
+		return static_cast<double>((value >> 40) + ((value >> 16) & 0xFFFFFF)) * kScale - 1.;
+	}
+
+	double scale_;
+	double min_;
+	double max_;
+
+	bool dither_ = false;
+	// Generators take turns sample by sample, so their recursions overlap in the pipeline
+	static constexpr size_t kNumGenerators = 4;
+	uint64_t states_[kNumGenerators];
+	size_t next_generator_ = 0;
+
+	const double* coefficients_ = nullptr;
+	size_t num_taps_ = 0;
+	// Quantization errors of previous samples, the latest first
+	double errors_[std::size(kLipshitzShaping)] = {};
+};
+
+/**
+ * \brief Decode count little-endian integers of kBytes bytes, stride bytes apart, with the scales of WavFile::Load
+ */
+template <int kBytes>
+void DecodePcm(const uint8_t* in, size_t count, size_t stride, float* out)
+{
+	for (size_t i = 0; i < count; i++, in += stride)
+	{
+		if constexpr (kBytes == 1)
+		{
+			out[i] = static_cast<float>(in[0] - 128) / 128.f;
+		}
+		else if constexpr (kBytes == 2)
+		{
+			out[i] = static_cast<float>(static_cast<int16_t>(in[0] | (in[1] << 8))) / 32768.f;
+		}
+		else if constexpr (kBytes == 3)
+		{
+			// Sign is extended by shifting the top byte into the top of 32 bits
+			const auto value = static_cast<int32_t>(static_cast<uint32_t>(in[0] << 8 | in[1] << 16 | in[2] << 24)) >> 8;
+			out[i] = static_cast<float>(value) / static_cast<float>(1 << 23);
+		}
+		else
+		{
+			const auto value = static_cast<int32_t>(static_cast<uint32_t>(in[0]) | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24);
+			out[i] = static_cast<float>(value) / static_cast<float>(std::numeric_limits<int32_t>::max());
+		}
+	}
+}
+
+/**
+ * \brief Decode samples of the bit depth, chosen at run time, 24 bit ones by the SIMD kernel
+ */
+inline void DecodePcm(int bit_depth, const uint8_t* in, size_t count, size_t stride, float* out)
+{
+	switch (bit_depth)
+	{
+		case 8:
+			DecodePcm<1>(in, count, stride, out);
+			break;
+
+		case 16:
+			DecodePcm<2>(in, count, stride, out);
+			break;
+
+		case 24:
+			SimdKernels::Get().decode24(in, count, stride, out);
+			break;
+
+		default:
+			DecodePcm<4>(in, count, stride, out);
+			break;
+	}
+}
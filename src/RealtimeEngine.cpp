@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+#include "RealtimeEngine.h"
+#include "ScratchArena.h"
+#include "Stats.h"
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+	/**
+	 * \brief Silent buffer of the format and channels of the stage
+	 */
+	WavFile<float> MakeBuffer(const AudioInfo& format, size_t num_frames)
+	{
+		return WavFile<float>(format.sample_rate, format.bit_depth,
+			WavFile<float>::AudioData(format.num_channels, vector<float>(num_frames, 0.f)));
+	}
+}
+
+void NullSink::Write(const float* const*, size_t, size_t count)
+{
+	frames_.fetch_add(count, memory_order_relaxed);
+}
+
+size_t NullSink::GetFrames() const
+{
+	return frames_.load(memory_order_relaxed);
+}
+
+RecordingSink::RecordingSink(size_t num_frames, int bit_depth)
+	: num_frames_(num_frames)
+{
+	recording_.bitDepth = bit_depth;
+}
+
+void RecordingSink::Start(uint32_t sample_rate, size_t num_channels)
+{
+	recording_ = WavFile<float>(sample_rate, recording_.bitDepth,
+		WavFile<float>::AudioData(num_channels, vector<float>(num_frames_, 0.f)));
+	position_ = 0;
+}
+
+void RecordingSink::Write(const float* const* channels, size_t num_channels, size_t count)
+{
+	count = min(count, num_frames_ - position_);
+	for (size_t channel = 0; channel < num_channels; channel++)
+		std::copy_n(channels[channel], count, recording_.samples[channel].begin() + position_);
+	position_ += count;
+}
+
+const WavFile<float>& RecordingSink::GetRecording() const
+{
+	return recording_;
+}
+
+RealtimeEngine::RealtimeEngine(const WavFile<float>& source, EffectChain chain, const RealtimeOptions& options)
+	: source_(source), chain_(std::move(chain)), options_(options),
+	  latency_("latency", "ms", 0.1, 12), callback_time_("callback", "us", 1., 20)
+{
+}
+
+void RealtimeEngine::Prepare()
+{
+	if (options_.block_size == 0 || options_.read_size == 0)
+		throw invalid_argument("Block and read sizes must be greater than 0");
+
+	if (options_.buffer_size < options_.block_size)
+		throw invalid_argument("Buffer must be at least as large as block");
+
+	const size_t num_channels = source_.GetNumChannels();
+
+	AudioInfo format;
+	format.sample_rate = source_.sampleRate;
+	format.bit_depth = source_.bitDepth;
+	format.num_channels = num_channels;
+	format.num_frames = source_.GetNumSamplesPerChannel();
+
+	stages_.clear();
+	stages_.push_back({ MakeBuffer(format, options_.block_size), {} });
+	for (const auto& step : chain_.GetSteps())
+	{
+		// Steps validate their parameters and change layout (e.g. mono to stereo) here, not on the audio thread
+		auto processor = EffectChain::MakeProcessor(step, format);
+		if (format.num_channels != stages_.back().buffer.GetNumChannels())
+			stages_.push_back({ MakeBuffer(format, options_.block_size), {} });
+
+		stages_.back().processors.push_back(std::move(processor));
+	}
+
+	controls_.clear();
+	for (const auto& step : chain_.GetSteps())
+	{
+		StepControls controls;
+		for (size_t i = 0; i < step.params.size(); i++)
+		{
+			const bool has_envelope = i < step.envelopes.size() && !step.envelopes[i].IsEmpty();
+			controls.parameters.emplace_back(step.params[i]);
+			controls.parameters.back().SetSmoothing(source_.sampleRate);
+			controls.settable.push_back(!has_envelope && EffectChain::IsAutomatable(step, i));
+			controls.ramps.emplace_back(controls.settable.back() ? options_.block_size : 0, 0.f);
+		}
+
+		if (std::find(controls.settable.begin(), controls.settable.end(), true) != controls.settable.end())
+			for (size_t i = 0; i < step.params.size(); i++)
+				controls.ramp_pointers.push_back(controls.settable[i] ? controls.ramps[i].data() : nullptr);
+
+		controls_.push_back(std::move(controls));
+	}
+
+	ring_.Reset(options_.buffer_size * num_channels);
+	read_buffer_.assign(options_.read_size * num_channels, 0.f);
+	block_buffer_.assign(options_.block_size * num_channels, 0.f);
+	silence_.assign(options_.block_size, 0.f);
+	channel_pointers_.assign(stages_.back().buffer.GetNumChannels(), nullptr);
+
+	stopping_ = false;
+	reader_done_ = false;
+	position_ = 0;
+	underruns_ = 0;
+	late_callbacks_ = 0;
+	latency_.Reset();
+	callback_time_.Reset();
+	prepared_ = true;
+}
+
+void RealtimeEngine::Run(AudioSink& sink)
+{
+	if (!prepared_)
+		throw logic_error("Real-time engine is not prepared");
+
+	exception_ptr audio_error;
+	thread reader(&RealtimeEngine::ReaderLoop, this);
+	thread audio([this, &sink, &audio_error] {
+		try
+		{
+			AudioLoop(sink);
+		}
+		catch (...)
+		{
+			audio_error = current_exception();
+			Stop();
+		}
+	});
+
+	audio.join();
+	// Reader may wait for free space, that audio thread won't make anymore
+	Stop();
+	reader.join();
+	prepared_ = false;
+
+	if (audio_error)
+		rethrow_exception(audio_error);
+}
+
+void RealtimeEngine::Stop()
+{
+	stopping_.store(true, memory_order_release);
+}
+
+void RealtimeEngine::SetParameter(size_t step_idx, size_t param_idx, float value)
+{
+	if (step_idx >= controls_.size() || param_idx >= controls_[step_idx].parameters.size())
+		throw out_of_range("No parameter " + to_string(param_idx) + " of step " + to_string(step_idx));
+
+	auto& controls = controls_[step_idx];
+	if (!controls.settable[param_idx])
+		throw invalid_argument("Parameter " + to_string(param_idx) + " of step " + to_string(step_idx) + " can't be changed while playing");
+
+	controls.parameters[param_idx].SetTarget(value);
+}
+
+size_t RealtimeEngine::GetProcessedFrames() const
+{
+	return position_.load(memory_order_acquire);
+}
+
+size_t RealtimeEngine::GetUnderruns() const
+{
+	return underruns_.load(memory_order_relaxed);
+}
+
+size_t RealtimeEngine::GetLateCallbacks() const
+{
+	return late_callbacks_.load(memory_order_relaxed);
+}
+
+size_t RealtimeEngine::GetAudioThreadAllocatedBytes() const
+{
+	return audio_allocated_bytes_;
+}
+
+const Histogram& RealtimeEngine::GetLatency() const
+{
+	return latency_;
+}
+
+const Histogram& RealtimeEngine::GetCallbackTime() const
+{
+	return callback_time_;
+}
+
+void RealtimeEngine::PrintReport(std::ostream& out) const
+{
+	const double block_ms = 1000. * static_cast<double>(options_.block_size) / source_.sampleRate;
+
+	out << "Real-time: " << GetProcessedFrames() << " frames, block " << options_.block_size << " frames ("
+		<< fixed << setprecision(3) << block_ms << " ms), " << (options_.wall_clock ? "wall" : "simulated") << " clock" << endl
+		<< "Underruns: " << GetUnderruns() << ", late callbacks: " << GetLateCallbacks()
+		<< ", audio thread allocations: " << GetAudioThreadAllocatedBytes() << " bytes"
+		<< ", scratch: " << scratch_high_water_ << " of " << options_.scratch_size << " bytes" << endl;
+	out.unsetf(ios::floatfield);
+
+	latency_.Print(out);
+	callback_time_.Print(out);
+}
+
+void RealtimeEngine::ReaderLoop()
+{
+	const size_t num_channels = source_.GetNumChannels();
+	const size_t num_frames = source_.GetNumSamplesPerChannel();
+	const auto wait = chrono::microseconds(static_cast<int64_t>(2.5e5 * options_.block_size / source_.sampleRate));
+
+	size_t read_position = 0;
+	while (read_position < num_frames && !stopping_.load(memory_order_acquire))
+	{
+		const size_t free_frames = options_.buffer_size - ring_.GetReadAvailable() / num_channels;
+		const size_t count = min({ options_.read_size, num_frames - read_position, free_frames });
+		if (count == 0)
+		{
+			// Buffer is full, come back in a quarter of the block
+			this_thread::sleep_for(wait);
+			continue;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			for (size_t channel = 0; channel < num_channels; channel++)
+				read_buffer_[i * num_channels + channel] = source_.samples[channel][read_position + i];
+
+		ring_.Write(read_buffer_.data(), count * num_channels);
+		read_position += count;
+	}
+
+	reader_done_.store(true, memory_order_release);
+}
+
+void RealtimeEngine::AudioLoop(AudioSink& sink)
+{
+	const size_t num_frames = source_.GetNumSamplesPerChannel();
+	const auto period = chrono::duration<double>(static_cast<double>(options_.block_size) / source_.sampleRate);
+
+	const auto& output = stages_.back().buffer;
+	sink.Start(output.sampleRate, output.GetNumChannels());
+
+	// Prefill the buffer before the stream starts
+	const size_t prefill = min(options_.buffer_size, num_frames) * source_.GetNumChannels();
+	while (ring_.GetReadAvailable() < prefill && !reader_done_.load(memory_order_acquire) && !stopping_.load(memory_order_acquire))
+		this_thread::yield();
+
+	// Scratch arena belongs to the audio thread, reserve it before the stream starts
+	auto& scratch = ScratchArena::GetThreadArena();
+	scratch.Reserve(options_.scratch_size);
+
+	const size_t start_allocated = Stats::GetThreadAllocatedBytes();
+	auto deadline = Clock::now();
+	while (position_.load(memory_order_relaxed) < num_frames && !stopping_.load(memory_order_acquire))
+	{
+		if (options_.wall_clock)
+		{
+			deadline += chrono::duration_cast<Clock::duration>(period);
+			this_thread::sleep_until(deadline);
+		}
+		else
+		{
+			// Simulated clock stops, until the reader delivers the block
+			const size_t needed = min(options_.block_size, num_frames - position_.load(memory_order_relaxed)) * source_.GetNumChannels();
+			while (ring_.GetReadAvailable() < needed && !reader_done_.load(memory_order_acquire) && !stopping_.load(memory_order_acquire))
+				this_thread::yield();
+		}
+
+		const auto start = Clock::now();
+		{
+			// Effect temporaries live for one block
+			ScratchScope block_scratch(scratch);
+			Callback(sink);
+		}
+		const chrono::duration<double> duration = Clock::now() - start;
+
+		callback_time_.Record(duration.count() * 1e6);
+		if (duration > period)
+			late_callbacks_.fetch_add(1, memory_order_relaxed);
+	}
+
+	audio_allocated_bytes_ = Stats::GetThreadAllocatedBytes() - start_allocated;
+	scratch_high_water_ = scratch.GetHighWater();
+}
+
+void RealtimeEngine::Callback(AudioSink& sink)
+{
+	const size_t in_channels = source_.GetNumChannels();
+	const size_t out_channels = stages_.back().buffer.GetNumChannels();
+	const size_t position = position_.load(memory_order_relaxed);
+	const size_t count = min(options_.block_size, source_.GetNumSamplesPerChannel() - position);
+
+	const size_t available = ring_.GetReadAvailable() / in_channels;
+	if (available < count)
+	{
+		underruns_.fetch_add(1, memory_order_relaxed);
+		for (auto& pointer : channel_pointers_)
+			pointer = silence_.data();
+		sink.Write(channel_pointers_.data(), out_channels, options_.block_size);
+		return;
+	}
+
+	// Time from reading a frame to hearing it: buffered frames plus the block in the output device
+	latency_.Record(1000. * static_cast<double>(available + options_.block_size) / source_.sampleRate);
+
+	ring_.Read(block_buffer_.data(), count * in_channels);
+
+	auto& input = stages_[0].buffer;
+	for (size_t channel = 0; channel < in_channels; channel++)
+	{
+		float* out = input.samples[channel].data();
+		for (size_t i = 0; i < count; i++)
+			out[i] = block_buffer_[i * in_channels + channel];
+	}
+
+	const FrameRange range{ 0, count };
+	size_t step_idx = 0;
+	for (size_t i = 0; i < stages_.size(); i++)
+	{
+		// Channels added by the chain (mono to stereo) get copies of the last channel
+		auto& buffer = stages_[i].buffer;
+		if (i != 0)
+		{
+			const auto& previous = stages_[i - 1].buffer;
+			for (size_t channel = 0; channel < buffer.GetNumChannels(); channel++)
+			{
+				const auto& from = previous.samples[min(channel, previous.GetNumChannels() - 1)];
+				std::copy_n(from.begin(), count, buffer.samples[channel].begin());
+			}
+		}
+
+		for (const auto& processor : stages_[i].processors)
+		{
+			auto& controls = controls_[step_idx++];
+			if (controls.ramp_pointers.empty())
+			{
+				processor->Process(buffer, range, position, nullptr);
+				continue;
+			}
+
+			for (size_t param = 0; param < controls.parameters.size(); param++)
+				if (controls.settable[param])
+					controls.parameters[param].Render(controls.ramps[param].data(), count);
+			processor->Process(buffer, range, position, controls.ramp_pointers.data());
+		}
+	}
+
+	const auto& output = stages_.back().buffer;
+	for (size_t channel = 0; channel < out_channels; channel++)
+		channel_pointers_[channel] = output.samples[channel].data();
+	sink.Write(channel_pointers_.data(), out_channels, count);
+
+	position_.store(position + count, memory_order_release);
+}
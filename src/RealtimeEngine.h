@@ -0,0 +1,226 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "Automation.h"
+#include "BlockProcessor.h"
+#include "EffectChain.h"
+#include "Histogram.h"
+#include "RingBuffer.h"
+#include "WavFile.h"
+
+/**
+ * \brief Audio output of the real-time engine
+ */
+class AudioSink
+{
+public:
+	virtual ~AudioSink() = default;
+
+	/**
+	 * \brief Called on the audio thread with the sample rate and number of channels of the output
+	 * before the first block and before the stream starts, so it may allocate
+	 */
+	virtual void Start(uint32_t, size_t) {}
+
+	/**
+	 * \brief Consume block of frames. Called on the audio thread, must neither block nor allocate
+	 * \param channels pointers to num_channels buffers
+	 * \param num_channels number of channels
+	 * \param count number of frames in every buffer
+	 */
+	virtual void Write(const float* const* channels, size_t num_channels, size_t count) = 0;
+};
+
+/**
+ * \brief Sink without sound hardware, counts consumed frames
+ */
+class NullSink final : public AudioSink
+{
+public:
+	void Write(const float* const* channels, size_t num_channels, size_t count) override;
+
+	[[nodiscard]] size_t GetFrames() const;
+
+private:
+	std::atomic<size_t> frames_ = 0;
+};
+
+/**
+ * \brief Sink, that keeps the played frames, up to the given number
+ */
+class RecordingSink final : public AudioSink
+{
+public:
+	/**
+	 * \param num_frames frames to keep, e.g. length of the source
+	 * \param bit_depth bit depth of the recording
+	 */
+	RecordingSink(size_t num_frames, int bit_depth);
+
+	void Start(uint32_t sample_rate, size_t num_channels) override;
+	void Write(const float* const* channels, size_t num_channels, size_t count) override;
+
+	/**
+	 * \brief Played frames, not thread-safe while playing
+	 */
+	[[nodiscard]] const WavFile<float>& GetRecording() const;
+
+private:
+	size_t num_frames_;
+	WavFile<float> recording_;
+	size_t position_ = 0;
+};
+
+struct RealtimeOptions
+{
+	// Frames per callback
+	size_t block_size = 256;
+	// Frames buffered between reader and callback, bounds the latency
+	size_t buffer_size = 4096;
+	// Frames read at once by the reader thread
+	size_t read_size = 1024;
+	// Scratch memory reserved for effect temporaries on the audio thread, bytes
+	size_t scratch_size = 64 * 1024;
+	// Wait for callback deadlines by the wall clock. Otherwise the clock is simulated:
+	// callbacks run back to back and the clock stops while the reader catches up
+	bool wall_clock = false;
+};
+
+/**
+ * \brief Plays wave file through the effect chain with bounded latency
+ *
+ * Reader thread interleaves source frames into a lock-free ring buffer, audio thread pulls
+ * fixed-size blocks from it on deadlines, runs the chain over them and passes them to the sink.
+ * Every step runs by its block processor in a block sized buffer: time-dependent effects
+ * see the same frame positions as whole file processing, delays, filters and modulated delays
+ * keep their state between the blocks. Everything is allocated by Prepare,
+ * audio thread neither allocates nor locks. Automatable parameters without envelopes
+ * may be changed while playing, the audio thread glides to new values.
+ */
+class RealtimeEngine
+{
+public:
+	/**
+	 * \param source source wave file, must outlive the engine
+	 * \param chain effects, every step must have a block processor (see EffectChain::MakeProcessor)
+	 * \param options block and buffer sizes, clock
+	 */
+	RealtimeEngine(const WavFile<float>& source, EffectChain chain, const RealtimeOptions& options = RealtimeOptions());
+
+	RealtimeEngine(const RealtimeEngine&) = delete;
+	RealtimeEngine& operator=(const RealtimeEngine&) = delete;
+
+	/**
+	 * \brief Allocate buffers and validate the chain
+	 * \throw invalid_argument chain has steps, that process whole file, or invalid parameters,
+	 * block or read size is 0, or buffer is smaller than block
+	 */
+	void Prepare();
+
+	/**
+	 * \brief Play the whole source into the sink, until it ends or Stop is called. Blocks the calling thread
+	 * \throw logic_error engine is not prepared
+	 */
+	void Run(AudioSink& sink);
+
+	/**
+	 * \brief Stop playback, thread-safe
+	 */
+	void Stop();
+
+	/**
+	 * \brief Change parameter of the prepared chain, thread-safe and lock-free.
+	 * Value is smoothed, so the change doesn't click
+	 * \param step_idx step index in the chain
+	 * \param param_idx parameter index of the step
+	 * \param value new value
+	 * \throw out_of_range no such step or parameter, or engine is not prepared
+	 * \throw invalid_argument parameter is not automatable or follows an envelope
+	 */
+	void SetParameter(size_t step_idx, size_t param_idx, float value);
+
+	[[nodiscard]] size_t GetProcessedFrames() const;
+
+	/**
+	 * \brief Callbacks, that had not enough buffered frames and played silence
+	 */
+	[[nodiscard]] size_t GetUnderruns() const;
+
+	/**
+	 * \brief Callbacks, that took longer than the block duration
+	 */
+	[[nodiscard]] size_t GetLateCallbacks() const;
+
+	/**
+	 * \brief Bytes allocated on the audio thread while it was running
+	 */
+	[[nodiscard]] size_t GetAudioThreadAllocatedBytes() const;
+
+	[[nodiscard]] const Histogram& GetLatency() const;
+	[[nodiscard]] const Histogram& GetCallbackTime() const;
+
+	/**
+	 * \brief Print counters and histograms
+	 */
+	void PrintReport(std::ostream& out) const;
+
+private:
+	/**
+	 * \brief Steps, that share one block buffer, the buffer changes with the channel layout
+	 */
+	struct Stage
+	{
+		WavFile<float> buffer;
+		std::vector<std::unique_ptr<BlockProcessor>> processors;
+	};
+
+	/**
+	 * \brief Parameters of the step, that are changed while playing
+	 */
+	struct StepControls
+	{
+		// Indexed like params, only settable ones are used
+		std::vector<SmoothedParameter> parameters;
+		std::vector<bool> settable;
+		// Block of smoothed values for every parameter
+		std::vector<std::vector<float>> ramps;
+		// Pointers to ramps of settable parameters, empty if step has none
+		std::vector<const float*> ramp_pointers;
+	};
+
+	void ReaderLoop();
+	void AudioLoop(AudioSink& sink);
+
+	/**
+	 * \brief Process one block, runs on the audio thread
+	 */
+	void Callback(AudioSink& sink);
+
+	const WavFile<float>& source_;
+	EffectChain chain_;
+	RealtimeOptions options_;
+	bool prepared_ = false;
+
+	std::vector<Stage> stages_;
+	// Indexed like chain steps
+	std::vector<StepControls> controls_;
+	RingBuffer<float> ring_;
+	std::vector<float> read_buffer_;
+	std::vector<float> block_buffer_;
+	std::vector<float> silence_;
+	std::vector<const float*> channel_pointers_;
+
+	std::atomic<bool> stopping_ = false;
+	std::atomic<bool> reader_done_ = false;
+	std::atomic<size_t> position_ = 0;
+	std::atomic<size_t> underruns_ = 0;
+	std::atomic<size_t> late_callbacks_ = 0;
+	size_t audio_allocated_bytes_ = 0;
+	size_t scratch_high_water_ = 0;
+
+	Histogram latency_;
+	Histogram callback_time_;
+};
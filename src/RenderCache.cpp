@@ -0,0 +1,141 @@
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "RenderCache.h"
+#include "Flac.h"
+#include "Hash.h"
+#include "Stats.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Change it when output of any effect changes, so old entries are not used
+	constexpr uint32_t kCacheVersion = 5;
+}
+
+RenderCache::RenderCache(std::filesystem::path dir, bool hard_link) : dir_(std::move(dir)), hard_link_(hard_link)
+{
+	error_code ec;
+	fs::create_directories(dir_, ec);
+}
+
+std::string RenderCache::GetKey(uint64_t source_hash, const EffectChain& chain, const DitherOptions& dither,
+	const std::filesystem::path& output) const
+{
+	XxHash64 hash;
+	hash.Update(&kCacheVersion, sizeof(kCacheVersion));
+	hash.Update(&source_hash, sizeof(source_hash));
+	hash.Update(GetCanonicalText(chain));
+
+	const float silence_db = chain.GetSilenceThreshold();
+	hash.Update(&silence_db, sizeof(silence_db));
+
+	const int32_t dither_fields[] = { dither.type, dither.shaping };
+	hash.Update(dither_fields, sizeof(dither_fields));
+	hash.Update(&dither.seed, sizeof(dither.seed));
+
+	// Entries hold the saved file, so a wave and a FLAC output of the same render differ
+	const bool flac = FlacCodec::HasFlacExtension(output.string());
+	hash.Update(&flac, sizeof(flac));
+
+	stringstream ss;
+	ss << hex << setw(16) << setfill('0') << hash.Digest();
+	return ss.str();
+}
+
+bool RenderCache::Fetch(const std::string& key, const std::filesystem::path& output)
+{
+	StageTimer timer("cache fetch");
+	const auto entry = dir_ / (key + ".wav");
+
+	error_code ec;
+	if (!fs::is_regular_file(entry, ec))
+	{
+		++misses_;
+		return false;
+	}
+
+	fs::remove(output, ec);
+
+	bool linked = false;
+	if (hard_link_)
+	{
+		fs::create_hard_link(entry, output, ec);
+		linked = !ec;
+	}
+
+	// Hard links don't work across volumes, copy instead
+	if (!linked)
+		fs::copy_file(entry, output, fs::copy_options::overwrite_existing, ec);
+
+	if (ec)
+	{
+		++misses_;
+		return false;
+	}
+
+	timer.SetBytes(static_cast<size_t>(fs::file_size(output, ec)));
+	++hits_;
+	return true;
+}
+
+bool RenderCache::Store(const std::string& key, const std::filesystem::path& output) const
+{
+	StageTimer timer("cache store");
+	const auto entry = dir_ / (key + ".wav");
+
+	// Jobs may store the same key concurrently, renaming makes the entry appear at once
+	stringstream temp_name;
+	temp_name << key << "." << this_thread::get_id() << ".tmp";
+	const auto temp = dir_ / temp_name.str();
+
+	error_code ec;
+	fs::copy_file(output, temp, fs::copy_options::overwrite_existing, ec);
+	if (ec)
+		return false;
+
+	fs::rename(temp, entry, ec);
+	if (ec)
+	{
+		fs::remove(temp, ec);
+		return false;
+	}
+
+	timer.SetBytes(static_cast<size_t>(fs::file_size(entry, ec)));
+	return true;
+}
+
+size_t RenderCache::GetHits() const
+{
+	return hits_;
+}
+
+size_t RenderCache::GetMisses() const
+{
+	return misses_;
+}
+
+std::string RenderCache::GetCanonicalText(const EffectChain& chain)
+{
+	stringstream ss;
+	ss << hexfloat;
+	for (const auto& step : chain.GetSteps())
+	{
+		ss << step.name;
+		for (size_t i = 0; i < step.params.size(); i++)
+		{
+			ss << (i == 0 ? ':' : ',');
+			if (i < step.envelopes.size() && !step.envelopes[i].IsEmpty())
+				ss << step.envelopes[i].ToExactString();
+			else
+				ss << step.params[i];
+		}
+		if (step.HasRegion())
+			ss << '[' << step.region_begin << '-' << step.region_end << ']';
+		ss << ';';
+	}
+
+	return ss.str();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include "EffectChain.h"
+
+/**
+ * \brief On-disk cache of rendered files
+ *
+ * Key is a hash of the source format and samples, taken while the source is decoded, exact text of the effect chain,
+ * dither settings and the output format.
+ * Entries are `<dir>/<key>.wav`. With hard links, the output shares the entry,
+ * so outputs must not be modified in place.
+ */
+class RenderCache
+{
+public:
+	/**
+	 * \param dir cache directory, created if it doesn't exist
+	 * \param hard_link produce outputs by hard linking entries instead of copying them
+	 */
+	explicit RenderCache(std::filesystem::path dir, bool hard_link = false);
+
+	/**
+	 * \brief Key of rendering the source by the chain and saving it with the dither to the output
+	 * \param source_hash hash of the source, fed by PackedAudio::Load
+	 * \param output output file, its extension selects the saved format
+	 */
+	[[nodiscard]] std::string GetKey(uint64_t source_hash, const EffectChain& chain, const DitherOptions& dither,
+		const std::filesystem::path& output) const;
+
+	/**
+	 * \brief Produce output from the cached entry
+	 * \return true on cache hit, otherwise false
+	 */
+	bool Fetch(const std::string& key, const std::filesystem::path& output);
+
+	/**
+	 * \brief Put rendered output into the cache
+	 * \return true, if entry was stored, otherwise false
+	 */
+	bool Store(const std::string& key, const std::filesystem::path& output) const;
+
+	[[nodiscard]] size_t GetHits() const;
+	[[nodiscard]] size_t GetMisses() const;
+
+	/**
+	 * \brief Chain text with exact parameters, so different chains never have the same text
+	 */
+	[[nodiscard]] static std::string GetCanonicalText(const EffectChain& chain);
+
+private:
+	std::filesystem::path dir_;
+	bool hard_link_;
+
+	std::atomic<size_t> hits_ = 0;
+	std::atomic<size_t> misses_ = 0;
+};
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <stdexcept>
+#include "RenderGraph.h"
+
+void RenderGraph::SetSource(WavFile<float> source, std::optional<Levels> levels)
+{
+	source_ = std::move(source);
+	source_chunks_ = ChunkedAudio(source_);
+	source_levels_ = std::move(levels);
+
+	// Caches of the chain and of the undo states were rendered from the old source
+	for (auto& node : nodes_)
+		node.rendered = false;
+	history_.Clear();
+}
+
+const WavFile<float>& RenderGraph::GetSource() const
+{
+	return source_;
+}
+
+const Levels& RenderGraph::GetSourceLevels()
+{
+	if (!source_levels_)
+		source_levels_ = Meter::Analyze(source_);
+
+	return *source_levels_;
+}
+
+void RenderGraph::AddEffect(EffectStep step)
+{
+	EffectChain::Validate(step);
+
+	history_.Commit(nodes_);
+	Insert(nodes_.size(), std::move(step));
+}
+
+void RenderGraph::SetEffect(size_t idx, EffectStep step)
+{
+	if (idx >= nodes_.size())
+		throw std::out_of_range("Effect idx out-of-range: " + std::to_string(idx));
+
+	EffectChain::Validate(step);
+
+	history_.Commit(nodes_);
+	Replace(idx, std::move(step));
+}
+
+void RenderGraph::RemoveEffect(size_t idx)
+{
+	if (idx >= nodes_.size())
+		throw std::out_of_range("Effect idx out-of-range: " + std::to_string(idx));
+
+	history_.Commit(nodes_);
+	Erase(idx);
+}
+
+EffectChain RenderGraph::GetChain() const
+{
+	EffectChain chain;
+	for (const auto& node : nodes_)
+		chain.Add(node.step);
+	return chain;
+}
+
+size_t RenderGraph::GetNumEffects() const
+{
+	return nodes_.size();
+}
+
+const EffectStep& RenderGraph::GetEffect(size_t idx) const
+{
+	return nodes_.at(idx).step;
+}
+
+bool RenderGraph::Undo()
+{
+	// Nodes of the state come back with their caches, so nothing is rendered again
+	return history_.Undo(nodes_);
+}
+
+bool RenderGraph::Redo()
+{
+	return history_.Redo(nodes_);
+}
+
+bool RenderGraph::CanUndo() const
+{
+	return history_.CanUndo();
+}
+
+bool RenderGraph::CanRedo() const
+{
+	return history_.CanRedo();
+}
+
+const WavFile<float>& RenderGraph::Render()
+{
+	last_rendered_frames_ = 0;
+
+	FrameRange dirty = FrameRange::Empty();
+	const ChunkedAudio* input = &source_chunks_;
+	for (size_t i = 0; i < nodes_.size(); i++)
+	{
+		try
+		{
+			// Source levels are known without measuring
+			RenderNode(nodes_[i], *input, i == 0 && source_levels_ ? &*source_levels_ : nullptr, dirty);
+		}
+		catch (...)
+		{
+			// Rest of the chain didn't receive changes, render it from scratch next time.
+			// Mirror buffer was left half processed
+			for (size_t j = i; j < nodes_.size(); j++)
+				nodes_[j].rendered = false;
+			mirror_.Invalidate();
+			throw;
+		}
+
+		input = &nodes_[i].output;
+	}
+
+	mirror_.Sync(*input);
+	return mirror_.GetBuffer();
+}
+
+size_t RenderGraph::GetLastRenderedFrames() const
+{
+	return last_rendered_frames_;
+}
+
+size_t RenderGraph::GetMemoryUsage() const
+{
+	std::vector<const ChunkedAudio*> storages = { &source_chunks_ };
+	const auto add_nodes = [&storages](const std::vector<Node>& nodes) {
+		for (const auto& node : nodes)
+			storages.push_back(&node.output);
+	};
+
+	add_nodes(nodes_);
+	history_.ForEachState(add_nodes);
+	return ChunkedAudio::GetMemoryUsage(storages);
+}
+
+void RenderGraph::Insert(size_t idx, EffectStep step)
+{
+	Node node;
+	node.step = std::move(step);
+	nodes_.insert(nodes_.begin() + idx, std::move(node));
+}
+
+void RenderGraph::Erase(size_t idx)
+{
+	const auto& node = nodes_[idx];
+	if (idx + 1 < nodes_.size())
+	{
+		auto& next = nodes_[idx + 1];
+		const auto changed = node.rendered ? GetChangedRange(node.step, GetFormat(node.output)) : FrameRange();
+		next.input_dirty = next.input_dirty.Union(changed);
+	}
+
+	nodes_.erase(nodes_.begin() + idx);
+}
+
+void RenderGraph::Replace(size_t idx, EffectStep step)
+{
+	auto& node = nodes_[idx];
+	if (node.rendered)
+	{
+		const auto& format = GetFormat(node.output);
+		node.self_dirty = node.self_dirty
+			.Union(GetChangedRange(node.step, format))
+			.Union(GetChangedRange(step, format));
+	}
+
+	node.step = std::move(step);
+}
+
+void RenderGraph::RenderNode(Node& node, const ChunkedAudio& input, const Levels* levels, FrameRange& dirty)
+{
+	const auto num_frames = input.GetNumFrames();
+	const bool was_rendered = node.rendered;
+	const bool layout_changed = was_rendered && (
+		node.input_channels != input.GetNumChannels() ||
+		node.input_frames != num_frames ||
+		node.input_sample_rate != input.GetSampleRate());
+
+	dirty = dirty.Union(node.input_dirty).Union(node.self_dirty);
+	node.input_dirty = FrameRange::Empty();
+	node.self_dirty = FrameRange::Empty();
+
+	// Effect, that changed file layout, can't be rendered partially.
+	// Step with a region changes only its region and renders it whole
+	auto locality = node.step.HasRegion() ? kPointwise : EffectChain::GetLocality(node.step);
+	if (was_rendered && (node.output.GetNumChannels() != input.GetNumChannels() ||
+		node.output.GetNumFrames() != num_frames))
+		locality = kGlobal;
+
+	auto& wav = mirror_.GetBuffer();
+	if (!was_rendered || layout_changed || (locality == kGlobal && !dirty.IsEmpty()))
+	{
+		node.rendered = false;
+		mirror_.Sync(input);
+		mirror_.Invalidate();
+		EffectChain::ApplyStep(node.step, wav, FrameRange(), levels);
+
+		// Output shares the chunks, that the effect doesn't change, with the input
+		const bool same_layout = wav.GetNumChannels() == input.GetNumChannels() &&
+			wav.GetNumSamplesPerChannel() == num_frames;
+		const auto changed = same_layout ? GetChangedRange(node.step, wav).Clamp(num_frames) : FrameRange();
+		if (same_layout && changed.GetLength() < num_frames)
+		{
+			node.output = input;
+			node.output.Write(wav, changed);
+		}
+		else
+			node.output = ChunkedAudio(wav);
+		mirror_.Hold(node.output);
+
+		node.rendered = true;
+		node.input_channels = input.GetNumChannels();
+		node.input_frames = num_frames;
+		node.input_sample_rate = input.GetSampleRate();
+		last_rendered_frames_ += num_frames;
+
+		// New node changes only its own frames comparing to the chain without it
+		dirty = !was_rendered && !layout_changed && same_layout ? dirty.Union(changed) : FrameRange();
+		return;
+	}
+
+	if (dirty.IsEmpty())
+		return;
+
+	// Delay feedback reaches the end of the file
+	if (locality == kCausal)
+		dirty.end = FrameRange::kEnd;
+
+	const auto region = EffectChain::GetRegion(node.step, GetFormat(input));
+	if (node.step.HasRegion() && dirty.Intersects(region))
+		dirty = dirty.Union(region);
+
+	const auto frames = dirty.Clamp(num_frames);
+	node.rendered = false;
+
+	// Buffer holds the cached output around the frames, delay reads its output before them too.
+	// Whole chunks of the frames are written back, so the rest of them must hold the cache
+	mirror_.Sync(node.output, locality == kCausal ? FrameRange{ 0, frames.end } : frames);
+	mirror_.Invalidate(frames);
+	input.Read(wav, frames);
+	EffectChain::ApplyStep(node.step, wav, frames);
+
+	node.rendered = true;
+	if (wav.GetNumChannels() != input.GetNumChannels() || wav.GetNumSamplesPerChannel() != num_frames)
+	{
+		// Step with a region changed length of the region, frames after it moved
+		node.output = ChunkedAudio(wav);
+		mirror_.Hold(node.output);
+		last_rendered_frames_ += num_frames;
+		dirty = FrameRange();
+		return;
+	}
+
+	node.output.Write(wav, frames);
+	mirror_.Hold(node.output, frames);
+	last_rendered_frames_ += frames.GetLength();
+	dirty = frames;
+}
+
+const WavFile<float>& RenderGraph::GetFormat(const ChunkedAudio& audio)
+{
+	mirror_.Sync(audio, FrameRange::Empty());
+	return mirror_.GetBuffer();
+}
+
+FrameRange RenderGraph::GetChangedRange(const EffectStep& step, const WavFile<float>& wav)
+{
+	if (step.HasRegion())
+		return EffectChain::GetRegion(step, wav);
+
+	switch (EffectChain::GetLocality(step))
+	{
+		case kPointwise:
+			return EffectChain::GetAffectedRange(step, wav);
+
+		case kCausal:
+			return { EffectChain::GetAffectedRange(step, wav).begin, FrameRange::kEnd };
+
+		default:
+			return FrameRange();
+	}
+}
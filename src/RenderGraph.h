@@ -0,0 +1,143 @@
+#pragma once
+#include <optional>
+#include <vector>
+#include "ChunkedAudio.h"
+#include "EffectChain.h"
+#include "FrameRange.h"
+#include "UndoHistory.h"
+#include "WavFile.h"
+
+/**
+ * \brief Lazily rendered effect chain
+ *
+ * Keeps the source file and an effect chain. Every effect node caches its output,
+ * and editing the chain marks only frames that the edit may change as dirty.
+ * Render() recomputes dirty frames only:
+ * pointwise effects re-render the dirty frames, causal effects (delay) re-render
+ * from the first dirty frame to the end, global effects re-render the whole file.
+ *
+ * Outputs are kept in ChunkedAudio, a node shares the chunks, that it doesn't change,
+ * with its input, and undo states share them with the current chain. Effects process
+ * one flat mirror buffer, that copies only the chunks, that differ from the ones it holds.
+ */
+class RenderGraph
+{
+public:
+	RenderGraph() = default;
+
+	/**
+	 * \brief Replace source file, whole chain becomes dirty
+	 * \param source source file
+	 * \param levels levels of the source, if they were measured while loading
+	 */
+	void SetSource(WavFile<float> source, std::optional<Levels> levels = std::nullopt);
+	[[nodiscard]] const WavFile<float>& GetSource() const;
+
+	/**
+	 * \brief Levels of the source file, measured on the first call if they are unknown
+	 */
+	const Levels& GetSourceLevels();
+
+	/**
+	 * \brief Append effect to the end of the chain
+	 * \throw invalid_argument unknown effect or wrong number of parameters
+	 */
+	void AddEffect(EffectStep step);
+
+	/**
+	 * \brief Replace effect (e.g. with new parameters)
+	 * \throw invalid_argument unknown effect or wrong number of parameters
+	 * \throw out_of_range idx out of range
+	 */
+	void SetEffect(size_t idx, EffectStep step);
+
+	/**
+	 * \brief Remove effect from the chain
+	 * \throw out_of_range idx out of range
+	 */
+	void RemoveEffect(size_t idx);
+
+	[[nodiscard]] EffectChain GetChain() const;
+	[[nodiscard]] size_t GetNumEffects() const;
+	[[nodiscard]] const EffectStep& GetEffect(size_t idx) const;
+
+	/**
+	 * \brief Revert last chain edit
+	 * \return true, if there was something to undo
+	 */
+	bool Undo();
+
+	/**
+	 * \brief Apply again the reverted chain edit
+	 * \return true, if there was something to redo
+	 */
+	bool Redo();
+
+	[[nodiscard]] bool CanUndo() const;
+	[[nodiscard]] bool CanRedo() const;
+
+	/**
+	 * \brief Render dirty parts of the chain
+	 * \return Output of the last effect, or source if chain is empty
+	 */
+	const WavFile<float>& Render();
+
+	/**
+	 * \brief Number of frames recomputed by the last Render(), summed over all effects
+	 */
+	[[nodiscard]] size_t GetLastRenderedFrames() const;
+
+	/**
+	 * \brief Memory of the samples of the source, node outputs and undo states, shared chunks are counted once, bytes
+	 */
+	[[nodiscard]] size_t GetMemoryUsage() const;
+
+private:
+	struct Node
+	{
+		EffectStep step;
+		ChunkedAudio output;
+		bool rendered = false;
+
+		// Layout of the input, that output was rendered from
+		size_t input_channels = 0;
+		size_t input_frames = 0;
+		uint32_t input_sample_rate = 0;
+
+		// Frames, where input changed since the last render
+		FrameRange input_dirty = FrameRange::Empty();
+		// Frames, where effect itself changed since the last render
+		FrameRange self_dirty = FrameRange::Empty();
+	};
+
+	void Insert(size_t idx, EffectStep step);
+	void Erase(size_t idx);
+	void Replace(size_t idx, EffectStep step);
+
+	/**
+	 * \brief Render single node
+	 * \param levels levels of the input, if they are known
+	 * \param dirty in: frames changed in input, out: frames changed in output
+	 */
+	void RenderNode(Node& node, const ChunkedAudio& input, const Levels* levels, FrameRange& dirty);
+
+	/**
+	 * \brief Wave file of the format and layout of the samples, its samples aren't copied
+	 */
+	const WavFile<float>& GetFormat(const ChunkedAudio& audio);
+
+	/**
+	 * \brief Frames, that differ between node's input and output
+	 */
+	[[nodiscard]] static FrameRange GetChangedRange(const EffectStep& step, const WavFile<float>& wav);
+
+	WavFile<float> source_;
+	ChunkedAudio source_chunks_;
+	std::optional<Levels> source_levels_;
+
+	std::vector<Node> nodes_;
+	UndoHistory<std::vector<Node>> history_;
+	AudioMirror mirror_;
+
+	size_t last_rendered_frames_ = 0;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/**
+ * \brief Lock-free single producer, single consumer ring buffer
+ *
+ * One thread writes, another one reads, neither blocks nor allocates.
+ * Indices grow without wrapping and are masked on access, so full and empty states differ.
+ * Producer and consumer indices are on separate cache lines.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+	/**
+	 * \param capacity minimal capacity, rounded up to a power of two
+	 */
+	explicit RingBuffer(size_t capacity = 0)
+	{
+		Reset(capacity);
+	}
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	/**
+	 * \brief Resize and clear, not thread-safe
+	 */
+	void Reset(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+
+		buffer_.assign(size, T());
+		mask_ = size - 1;
+		write_index_.store(0, std::memory_order_relaxed);
+		read_index_.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * \brief Write up to count items, producer only
+	 * \return number of written items
+	 */
+	size_t Write(const T* items, size_t count)
+	{
+		const size_t write_index = write_index_.load(std::memory_order_relaxed);
+		const size_t read_index = read_index_.load(std::memory_order_acquire);
+		count = std::min(count, buffer_.size() - (write_index - read_index));
+
+		for (size_t i = 0; i < count; i++)
+			buffer_[(write_index + i) & mask_] = items[i];
+
+		write_index_.store(write_index + count, std::memory_order_release);
+		return count;
+	}
+
+	/**
+	 * \brief Read up to count items, consumer only
+	 * \return number of read items
+	 */
+	size_t Read(T* items, size_t count)
+	{
+		const size_t read_index = read_index_.load(std::memory_order_relaxed);
+		const size_t write_index = write_index_.load(std::memory_order_acquire);
+		count = std::min(count, write_index - read_index);
+
+		for (size_t i = 0; i < count; i++)
+			items[i] = buffer_[(read_index + i) & mask_];
+
+		read_index_.store(read_index + count, std::memory_order_release);
+		return count;
+	}
+
+	/**
+	 * \brief Number of items, that can be read now
+	 */
+	[[nodiscard]] size_t GetReadAvailable() const
+	{
+		return write_index_.load(std::memory_order_acquire) - read_index_.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * \brief Number of items, that can be written now
+	 */
+	[[nodiscard]] size_t GetWriteAvailable() const
+	{
+		return buffer_.size() - GetReadAvailable();
+	}
+
+	[[nodiscard]] size_t GetCapacity() const
+	{
+		return buffer_.size();
+	}
+
+private:
+	static constexpr size_t kCacheLine = 64;
+
+	std::vector<T> buffer_;
+	size_t mask_ = 0;
+
+	alignas(kCacheLine) std::atomic<size_t> write_index_ = 0;
+	alignas(kCacheLine) std::atomic<size_t> read_index_ = 0;
+};
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdint>
+#include "ScratchArena.h"
+
+namespace
+{
+	size_t AlignUp(size_t value)
+	{
+		return (value + ScratchArena::kAlignment - 1) & ~(ScratchArena::kAlignment - 1);
+	}
+}
+
+ScratchArena::ScratchArena(size_t capacity)
+{
+	Reserve(capacity);
+}
+
+ScratchArena& ScratchArena::GetThreadArena()
+{
+	thread_local ScratchArena arena;
+	return arena;
+}
+
+void ScratchArena::Reserve(size_t capacity)
+{
+	capacity = AlignUp(capacity);
+	if (capacity <= capacity_)
+		return;
+
+	// Live buffers would move, so the arena grows only when it's empty
+	if (used_ != 0)
+		return;
+
+	memory_.reset(new unsigned char[capacity + kAlignment]);
+	const auto address = reinterpret_cast<uintptr_t>(memory_.get());
+	base_ = memory_.get() + (AlignUp(address) - address);
+	capacity_ = capacity;
+}
+
+size_t ScratchArena::GetMark() const
+{
+	return used_;
+}
+
+void ScratchArena::Release(size_t mark)
+{
+	used_ = std::min(used_, mark);
+	while (!chunks_.empty() && chunks_.back().position >= used_)
+		chunks_.pop_back();
+
+	if (used_ == 0 && grow_)
+	{
+		grow_ = false;
+		Reserve(high_water_);
+	}
+}
+
+void ScratchArena::Reset()
+{
+	Release(0);
+}
+
+size_t ScratchArena::GetCapacity() const
+{
+	return capacity_;
+}
+
+size_t ScratchArena::GetUsed() const
+{
+	return used_;
+}
+
+size_t ScratchArena::GetHighWater() const
+{
+	return high_water_;
+}
+
+void* ScratchArena::AllocateBytes(size_t bytes)
+{
+	bytes = AlignUp(std::max<size_t>(bytes, 1));
+
+	void* ptr;
+	if (chunks_.empty() && used_ + bytes <= capacity_)
+	{
+		ptr = base_ + used_;
+	}
+	else
+	{
+		// Heap allocation is aligned for any scalar type, not to the cache line
+		chunks_.push_back({ used_, std::unique_ptr<unsigned char[]>(new unsigned char[bytes]) });
+		ptr = chunks_.back().memory.get();
+		grow_ = true;
+	}
+
+	used_ += bytes;
+	high_water_ = std::max(high_water_, used_);
+	return ptr;
+}
+
+ScratchScope::ScratchScope(ScratchArena& arena) : arena_(arena), mark_(arena.GetMark())
+{
+}
+
+ScratchScope::~ScratchScope()
+{
+	arena_.Release(mark_);
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * \brief Bump allocator for temporary buffers of effects
+ *
+ * Every thread has its own arena, so allocating takes neither a lock nor the heap.
+ * Buffers are released all at once by moving back to a mark, usually by ScratchScope
+ * at the end of the block. When the arena runs out, extra chunks come from the heap,
+ * and once the arena is empty again it grows to the largest size used, so a steady
+ * processing loop stops allocating after the first block.
+ */
+class ScratchArena
+{
+public:
+	// Buffers start on separate cache lines
+	static constexpr size_t kAlignment = 64;
+
+	explicit ScratchArena(size_t capacity = 0);
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	/**
+	 * \brief Arena of the calling thread
+	 */
+	static ScratchArena& GetThreadArena();
+
+	/**
+	 * \brief Make sure, that capacity bytes are available without heap allocations.
+	 * Call before processing, e.g. in prepare, when nothing is allocated
+	 */
+	void Reserve(size_t capacity);
+
+	/**
+	 * \brief Uninitialized buffer of count items, valid until the arena is released below it
+	 */
+	template <typename T>
+	T* Allocate(size_t count)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Arena alignment is too small");
+		return static_cast<T*>(AllocateBytes(count * sizeof(T)));
+	}
+
+	/**
+	 * \brief Position to release to
+	 */
+	[[nodiscard]] size_t GetMark() const;
+
+	/**
+	 * \brief Release buffers allocated after the mark
+	 */
+	void Release(size_t mark);
+
+	/**
+	 * \brief Release all buffers
+	 */
+	void Reset();
+
+	[[nodiscard]] size_t GetCapacity() const;
+	[[nodiscard]] size_t GetUsed() const;
+
+	/**
+	 * \brief Most bytes used at once since the arena was created
+	 */
+	[[nodiscard]] size_t GetHighWater() const;
+
+private:
+	void* AllocateBytes(size_t bytes);
+
+	/**
+	 * \brief Heap buffer allocated when the arena was full
+	 */
+	struct Chunk
+	{
+		// Arena position, that the chunk takes
+		size_t position;
+		std::unique_ptr<unsigned char[]> memory;
+	};
+
+	std::unique_ptr<unsigned char[]> memory_;
+	// First aligned byte of memory_
+	unsigned char* base_ = nullptr;
+	size_t capacity_ = 0;
+	// Bytes in use, including chunks
+	size_t used_ = 0;
+	size_t high_water_ = 0;
+
+	std::vector<Chunk> chunks_;
+	// Arena is smaller than the high water, grow when it's empty
+	bool grow_ = false;
+};
+
+/**
+ * \brief Releases buffers allocated in the scope
+ */
+class ScratchScope
+{
+public:
+	explicit ScratchScope(ScratchArena& arena = ScratchArena::GetThreadArena());
+	~ScratchScope();
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	template <typename T>
+	T* Allocate(size_t count)
+	{
+		return arena_.Allocate<T>(count);
+	}
+
+private:
+	ScratchArena& arena_;
+	size_t mark_;
+};
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+#include "Silence.h"
+#include "SimdKernels.h"
+#include "utility.h"
+
+using namespace std;
+
+namespace
+{
+	bool IsSilentRange(const WavFile<float>& wav, const FrameRange& range, float threshold)
+	{
+		return std::all_of(wav.samples.begin(), wav.samples.end(), [&](const vector<float>& channel) {
+			return SilenceMap::IsSilent(channel.data() + range.begin, range.GetLength(), threshold);
+		});
+	}
+
+	bool IsLoudFrame(const WavFile<float>& wav, size_t frame, float threshold)
+	{
+		return std::any_of(wav.samples.begin(), wav.samples.end(), [&](const vector<float>& channel) {
+			return std::abs(channel[frame]) > threshold;
+		});
+	}
+}
+
+SilenceMap::SilenceMap(const WavFile<float>& wav, float threshold_db) : num_frames_(wav.GetNumSamplesPerChannel())
+{
+	const float threshold = db_to_lin(threshold_db);
+	for (size_t begin = 0; begin < num_frames_; begin += kBlockFrames)
+		silent_.push_back(IsSilentRange(wav, { begin, std::min(begin + kBlockFrames, num_frames_) }, threshold));
+}
+
+bool SilenceMap::IsSilent(size_t block) const
+{
+	return silent_[block];
+}
+
+size_t SilenceMap::GetNumBlocks() const
+{
+	return silent_.size();
+}
+
+size_t SilenceMap::GetNumSilentBlocks() const
+{
+	return static_cast<size_t>(std::count(silent_.begin(), silent_.end(), true));
+}
+
+std::vector<FrameRange> SilenceMap::GetSoundRanges(const FrameRange& range) const
+{
+	const auto frames = range.Clamp(num_frames_);
+	vector<FrameRange> ranges;
+	if (frames.IsEmpty())
+		return ranges;
+
+	for (size_t block = frames.begin / kBlockFrames; block * kBlockFrames < frames.end; block++)
+	{
+		if (silent_[block])
+			continue;
+
+		// Loud blocks next to each other make one range
+		const FrameRange frames_of_block{ block * kBlockFrames, (block + 1) * kBlockFrames };
+		if (!ranges.empty() && ranges.back().end == frames_of_block.begin)
+			ranges.back().end = frames_of_block.end;
+		else
+			ranges.push_back(frames_of_block);
+	}
+
+	for (auto& sound : ranges)
+		sound = sound.Intersect(frames);
+
+	return ranges;
+}
+
+bool SilenceMap::IsSilent(const float* samples, size_t count, float threshold)
+{
+	return SimdKernels::Get().is_silent(samples, count, threshold);
+}
+
+bool SilenceMap::IsSilent(const WavFile<float>& wav, const FrameRange& range, float threshold_db)
+{
+	return IsSilentRange(wav, range.Clamp(wav.GetNumSamplesPerChannel()), db_to_lin(threshold_db));
+}
+
+FrameRange SilenceMap::FindContent(const WavFile<float>& wav, float threshold_db)
+{
+	const float threshold = db_to_lin(threshold_db);
+	const size_t num_frames = wav.GetNumSamplesPerChannel();
+
+	// Silent blocks are skipped, the first loud block is searched frame by frame
+	size_t begin = num_frames;
+	for (size_t block = 0; block < num_frames && begin == num_frames; block += kBlockFrames)
+	{
+		const FrameRange frames{ block, std::min(block + kBlockFrames, num_frames) };
+		if (IsSilentRange(wav, frames, threshold))
+			continue;
+
+		begin = frames.begin;
+		while (!IsLoudFrame(wav, begin, threshold))
+			begin++;
+	}
+
+	if (begin == num_frames)
+		return FrameRange::Empty();
+
+	// The same from the end, down to the first loud frame
+	size_t end = begin + 1;
+	for (size_t block_end = num_frames; block_end > begin; block_end -= std::min(block_end - begin, kBlockFrames))
+	{
+		const FrameRange frames{ block_end - std::min(block_end - begin, kBlockFrames), block_end };
+		if (IsSilentRange(wav, frames, threshold))
+			continue;
+
+		end = frames.end;
+		while (!IsLoudFrame(wav, end - 1, threshold))
+			end--;
+		break;
+	}
+
+	return { begin, end };
+}
+
+std::vector<FrameRange> SilenceMap::FindGaps(const WavFile<float>& wav, float threshold_db, size_t min_frames)
+{
+	const float threshold = db_to_lin(threshold_db);
+	const size_t num_frames = wav.GetNumSamplesPerChannel();
+	min_frames = std::max<size_t>(min_frames, 1);
+
+	vector<FrameRange> gaps;
+	size_t gap_begin = 0;
+	for (size_t block = 0; block < num_frames; block += kBlockFrames)
+	{
+		const FrameRange frames{ block, std::min(block + kBlockFrames, num_frames) };
+		if (IsSilentRange(wav, frames, threshold))
+			continue;
+
+		for (size_t frame = frames.begin; frame < frames.end; frame++)
+		{
+			if (!IsLoudFrame(wav, frame, threshold))
+				continue;
+
+			if (frame - gap_begin >= min_frames)
+				gaps.push_back({ gap_begin, frame });
+			gap_begin = frame + 1;
+		}
+	}
+
+	if (num_frames - std::min(gap_begin, num_frames) >= min_frames)
+		gaps.push_back({ gap_begin, num_frames });
+
+	return gaps;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <limits>
+#include <vector>
+#include "FrameRange.h"
+#include "WavFile.h"
+
+/**
+ * \brief Threshold of digital silence: only zero samples are silent
+ */
+constexpr float kDigitalSilence = -std::numeric_limits<float>::infinity();
+
+/**
+ * \brief Silent flags of the blocks of the wave file
+ *
+ * Frame is silent, when absolute values of its samples in every channel are at or below
+ * the threshold. Scans compare 4 samples at once and stop at the first loud sample,
+ * so a loud block costs a few comparisons.
+ */
+class SilenceMap
+{
+public:
+	// Frames of the block, that has its own flag
+	static constexpr size_t kBlockFrames = 1024;
+
+	SilenceMap() = default;
+
+	/**
+	 * \brief Scan blocks of the file
+	 * \param threshold_db level in dBFS, at and below which samples are silent
+	 */
+	SilenceMap(const WavFile<float>& wav, float threshold_db);
+
+	[[nodiscard]] bool IsSilent(size_t block) const;
+	[[nodiscard]] size_t GetNumBlocks() const;
+	[[nodiscard]] size_t GetNumSilentBlocks() const;
+
+	/**
+	 * \brief Runs of blocks, that aren't silent, clamped to the range
+	 */
+	[[nodiscard]] std::vector<FrameRange> GetSoundRanges(const FrameRange& range = FrameRange()) const;
+
+	/**
+	 * \brief Whether absolute values of all samples are at or below the linear threshold
+	 */
+	[[nodiscard]] static bool IsSilent(const float* samples, size_t count, float threshold);
+
+	/**
+	 * \brief Whether all frames of the range are silent
+	 */
+	[[nodiscard]] static bool IsSilent(const WavFile<float>& wav, const FrameRange& range, float threshold_db);
+
+	/**
+	 * \brief Frames from the first to the last frame, that isn't silent. Empty range, if whole file is silent
+	 */
+	[[nodiscard]] static FrameRange FindContent(const WavFile<float>& wav, float threshold_db);
+
+	/**
+	 * \brief Silent runs of at least min_frames frames, leading and trailing silence included
+	 */
+	[[nodiscard]] static std::vector<FrameRange> FindGaps(const WavFile<float>& wav, float threshold_db, size_t min_frames);
+
+private:
+	size_t num_frames_ = 0;
+	std::vector<bool> silent_;
+};
@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "SimdKernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	// Environment variable, that forces the SIMD level
+	constexpr const char* kSimdVariable = "WAV_EFFECTS_SIMD";
+
+	namespace scalar
+	{
+		void Decode16(const uint8_t* in, size_t count, float* out)
+		{
+			for (size_t i = 0; i < count; i++, in += 2)
+				out[i] = static_cast<float>(static_cast<int16_t>(in[0] | (in[1] << 8))) / 32768.f;
+		}
+
+		void Decode16Stereo(const uint8_t* in, size_t count, float* left, float* right)
+		{
+			for (size_t i = 0; i < count; i++, in += 4)
+			{
+				left[i] = static_cast<float>(static_cast<int16_t>(in[0] | (in[1] << 8))) / 32768.f;
+				right[i] = static_cast<float>(static_cast<int16_t>(in[2] | (in[3] << 8))) / 32768.f;
+			}
+		}
+
+		void Encode16(const float* in, size_t count, uint8_t* out)
+		{
+			for (size_t i = 0; i < count; i++, out += 2)
+			{
+				const auto sample = static_cast<int32_t>(std::clamp(std::nearbyint(static_cast<double>(in[i]) * 32768.), -32768., 32767.));
+				out[0] = static_cast<uint8_t>(sample);
+				out[1] = static_cast<uint8_t>(sample >> 8);
+			}
+		}
+
+		void Decode24(const uint8_t* in, size_t count, size_t stride, float* out)
+		{
+			for (size_t i = 0; i < count; i++, in += stride)
+				out[i] = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[0] << 8 | in[1] << 16 | in[2] << 24)) >> 8) / 8388608.f;
+		}
+
+		void Quantize(const float* in, const double* dither, size_t count, double scale, double min, double max, int32_t* out)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				const double value = static_cast<double>(in[i]) * scale;
+				out[i] = static_cast<int32_t>(std::clamp(std::nearbyint(dither != nullptr ? value + dither[i] : value), min, max));
+			}
+		}
+
+		float Atan(float x)
+		{
+			const float magnitude = std::abs(x);
+			float reduced = magnitude, offset = 0.f;
+			if (magnitude > kAtanTan3Pi8)
+			{
+				reduced = -1.f / magnitude;
+				offset = kAtanPi2;
+			}
+			else if (magnitude > kAtanTanPi8)
+			{
+				reduced = (magnitude - 1.f) / (magnitude + 1.f);
+				offset = kAtanPi4;
+			}
+
+			const float z = reduced * reduced;
+			const float result = offset + ((((kAtanC0 * z - kAtanC1) * z + kAtanC2) * z - kAtanC3) * z * reduced + reduced);
+			return std::signbit(x) ? -result : result;
+		}
+
+		void Distort(float* samples, size_t count, float drive, float blend, float volume)
+		{
+			for (size_t i = 0; i < count; i++)
+				samples[i] = (kAtanToUnit * Atan(samples[i] * drive) * blend + samples[i] * (1.f - blend)) / 2.f * volume;
+		}
+
+		void DistortRamps(float* samples, const float* drive, const float* blend, size_t count, float volume)
+		{
+			for (size_t i = 0; i < count; i++)
+				samples[i] = (kAtanToUnit * Atan(samples[i] * drive[i]) * blend[i] + samples[i] * (1.f - blend[i])) / 2.f * volume;
+		}
+
+		void Scale(float* samples, size_t count, float gain)
+		{
+			for (size_t i = 0; i < count; i++)
+				samples[i] *= gain;
+		}
+
+		void Multiply(float* samples, const float* gains, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				samples[i] *= gains[i];
+		}
+
+		void MixAdd(float* out, const float* in, float gain, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				out[i] += in[i] * gain;
+		}
+
+		float Peak(const float* in, size_t count)
+		{
+			float peak = 0.f;
+			for (size_t i = 0; i < count; i++)
+				peak = std::max(peak, std::abs(in[i]));
+			return peak;
+		}
+
+		bool IsSilent(const float* in, size_t count, float threshold)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				if (std::abs(in[i]) > threshold)
+					return false;
+			}
+
+			return true;
+		}
+
+		void AccumulateLevels(const float* in, size_t count, float* peak, double* sum, double* sum_squares)
+		{
+			for (size_t i = 0; i + 4 <= count; i += 4)
+			{
+				for (size_t lane = 0; lane < 4; lane++)
+				{
+					const float value = in[i + lane];
+					peak[lane] = std::max(peak[lane], std::abs(value));
+					sum[lane] += value;
+					sum_squares[lane] += static_cast<double>(value) * value;
+				}
+			}
+		}
+
+		const SimdKernels kKernels = { kSimdScalar, Decode16, Decode16Stereo, Encode16, Decode24, Quantize, Distort, DistortRamps, Scale, Multiply, MixAdd, Peak, IsSilent, AccumulateLevels };
+	}
+
+#ifdef KERNELS_SSE2
+	namespace sse2
+	{
+		const __m128 kAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+		void Decode16(const uint8_t* in, size_t count, float* out)
+		{
+			const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				// Samples are sign extended by shifting them from the top half of 32 bits
+				const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+				const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+				const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+				_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+			}
+			scalar::Decode16(in + 2 * i, count - i, out + i);
+		}
+
+		void Decode16Stereo(const uint8_t* in, size_t count, float* left, float* right)
+		{
+			// Frame is a 32 bit word, left sample is in its low half
+			const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i frames = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * i));
+				const __m128i left4 = _mm_srai_epi32(_mm_slli_epi32(frames, 16), 16);
+				const __m128i right4 = _mm_srai_epi32(frames, 16);
+				_mm_storeu_ps(left + i, _mm_mul_ps(_mm_cvtepi32_ps(left4), scale));
+				_mm_storeu_ps(right + i, _mm_mul_ps(_mm_cvtepi32_ps(right4), scale));
+			}
+			scalar::Decode16Stereo(in + 4 * i, count - i, left + i, right + i);
+		}
+
+		void Encode16(const float* in, size_t count, uint8_t* out)
+		{
+			// Clamped before conversion, so it doesn't overflow, rounding is to nearest like nearbyint
+			const __m128 scale = _mm_set1_ps(32768.f);
+			const __m128 min = _mm_set1_ps(-32768.f);
+			const __m128 max = _mm_set1_ps(32767.f);
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m128 low = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), min), max);
+				const __m128 high = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), min), max);
+				const __m128i samples = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), samples);
+			}
+			scalar::Encode16(in + i, count - i, out + 2 * i);
+		}
+
+		void Quantize(const float* in, const double* dither, size_t count, double scale, double min, double max, int32_t* out)
+		{
+			// Clamped before conversion to the integer bounds, so it rounds to nearest even like nearbyint and doesn't overflow
+			const __m128d scale2 = _mm_set1_pd(scale);
+			const __m128d min2 = _mm_set1_pd(min);
+			const __m128d max2 = _mm_set1_pd(max);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 values = _mm_loadu_ps(in + i);
+				__m128d low = _mm_mul_pd(_mm_cvtps_pd(values), scale2);
+				__m128d high = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(values, values)), scale2);
+				if (dither != nullptr)
+				{
+					low = _mm_add_pd(low, _mm_loadu_pd(dither + i));
+					high = _mm_add_pd(high, _mm_loadu_pd(dither + i + 2));
+				}
+
+				low = _mm_min_pd(_mm_max_pd(low, min2), max2);
+				high = _mm_min_pd(_mm_max_pd(high, min2), max2);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi64(_mm_cvtpd_epi32(low), _mm_cvtpd_epi32(high)));
+			}
+			scalar::Quantize(in + i, dither != nullptr ? dither + i : nullptr, count - i, scale, min, max, out + i);
+		}
+
+		__m128 Atan(__m128 x)
+		{
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 sign = _mm_andnot_ps(kAbsMask, x);
+			const __m128 magnitude = _mm_and_ps(x, kAbsMask);
+			const __m128 large = _mm_cmpgt_ps(magnitude, _mm_set1_ps(kAtanTan3Pi8));
+			const __m128 medium = _mm_andnot_ps(large, _mm_cmpgt_ps(magnitude, _mm_set1_ps(kAtanTanPi8)));
+			const __m128 small = _mm_andnot_ps(_mm_or_ps(large, medium), magnitude);
+
+			const __m128 inverse = _mm_div_ps(_mm_set1_ps(-1.f), magnitude);
+			const __m128 shifted = _mm_div_ps(_mm_sub_ps(magnitude, one), _mm_add_ps(magnitude, one));
+			const __m128 reduced = _mm_or_ps(_mm_or_ps(_mm_and_ps(large, inverse), _mm_and_ps(medium, shifted)), small);
+			const __m128 offset = _mm_or_ps(_mm_and_ps(large, _mm_set1_ps(kAtanPi2)), _mm_and_ps(medium, _mm_set1_ps(kAtanPi4)));
+
+			const __m128 z = _mm_mul_ps(reduced, reduced);
+			__m128 polynomial = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(kAtanC0), z), _mm_set1_ps(kAtanC1));
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, z), _mm_set1_ps(kAtanC2));
+			polynomial = _mm_sub_ps(_mm_mul_ps(polynomial, z), _mm_set1_ps(kAtanC3));
+			polynomial = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(polynomial, z), reduced), reduced);
+			return _mm_xor_ps(_mm_add_ps(offset, polynomial), sign);
+		}
+
+		__m128 Distort(__m128 clean, __m128 drive, __m128 blend, __m128 volume)
+		{
+			const __m128 distorted = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(kAtanToUnit), Atan(_mm_mul_ps(clean, drive))), blend);
+			const __m128 mixed = _mm_add_ps(distorted, _mm_mul_ps(clean, _mm_sub_ps(_mm_set1_ps(1.f), blend)));
+			return _mm_mul_ps(_mm_mul_ps(mixed, _mm_set1_ps(0.5f)), volume);
+		}
+
+		void Distort(float* samples, size_t count, float drive, float blend, float volume)
+		{
+			const __m128 drive4 = _mm_set1_ps(drive);
+			const __m128 blend4 = _mm_set1_ps(blend);
+			const __m128 volume4 = _mm_set1_ps(volume);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(samples + i, Distort(_mm_loadu_ps(samples + i), drive4, blend4, volume4));
+			scalar::Distort(samples + i, count - i, drive, blend, volume);
+		}
+
+		void DistortRamps(float* samples, const float* drive, const float* blend, size_t count, float volume)
+		{
+			const __m128 volume4 = _mm_set1_ps(volume);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(samples + i, Distort(_mm_loadu_ps(samples + i), _mm_loadu_ps(drive + i), _mm_loadu_ps(blend + i), volume4));
+			scalar::DistortRamps(samples + i, drive + i, blend + i, count - i, volume);
+		}
+
+		void Scale(float* samples, size_t count, float gain)
+		{
+			const __m128 gain4 = _mm_set1_ps(gain);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain4));
+			scalar::Scale(samples + i, count - i, gain);
+		}
+
+		void Multiply(float* samples, const float* gains, size_t count)
+		{
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(gains + i)));
+			scalar::Multiply(samples + i, gains + i, count - i);
+		}
+
+		void MixAdd(float* out, const float* in, float gain, size_t count)
+		{
+			const __m128 gain4 = _mm_set1_ps(gain);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), gain4)));
+			scalar::MixAdd(out + i, in + i, gain, count - i);
+		}
+
+		float Peak(const float* in, size_t count)
+		{
+			__m128 peak4 = _mm_setzero_ps();
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				peak4 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(in + i), kAbsMask), peak4);
+
+			float lanes[4];
+			_mm_storeu_ps(lanes, peak4);
+			return std::max({ lanes[0], lanes[1], lanes[2], lanes[3], scalar::Peak(in + i, count - i) });
+		}
+
+		bool IsSilent(const float* in, size_t count, float threshold)
+		{
+			// 16 samples are compared between the checks
+			const __m128 threshold4 = _mm_set1_ps(threshold);
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m128 loud0 = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(in + i), kAbsMask), threshold4);
+				const __m128 loud1 = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(in + i + 4), kAbsMask), threshold4);
+				const __m128 loud2 = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(in + i + 8), kAbsMask), threshold4);
+				const __m128 loud3 = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(in + i + 12), kAbsMask), threshold4);
+				if (_mm_movemask_ps(_mm_or_ps(_mm_or_ps(loud0, loud1), _mm_or_ps(loud2, loud3))) != 0)
+					return false;
+			}
+			return scalar::IsSilent(in + i, count - i, threshold);
+		}
+
+		void AccumulateLevels(const float* in, size_t count, float* peak, double* sum, double* sum_squares)
+		{
+			// Lanes 0, 1 and 2, 3 are in separate double vectors
+			__m128 peak4 = _mm_loadu_ps(peak);
+			__m128d sum01 = _mm_loadu_pd(sum), sum23 = _mm_loadu_pd(sum + 2);
+			__m128d squares01 = _mm_loadu_pd(sum_squares), squares23 = _mm_loadu_pd(sum_squares + 2);
+			for (size_t i = 0; i + 4 <= count; i += 4)
+			{
+				const __m128 values = _mm_loadu_ps(in + i);
+				const __m128d values01 = _mm_cvtps_pd(values);
+				const __m128d values23 = _mm_cvtps_pd(_mm_movehl_ps(values, values));
+				peak4 = _mm_max_ps(_mm_and_ps(values, kAbsMask), peak4);
+				sum01 = _mm_add_pd(sum01, values01);
+				sum23 = _mm_add_pd(sum23, values23);
+				squares01 = _mm_add_pd(squares01, _mm_mul_pd(values01, values01));
+				squares23 = _mm_add_pd(squares23, _mm_mul_pd(values23, values23));
+			}
+
+			_mm_storeu_ps(peak, peak4);
+			_mm_storeu_pd(sum, sum01);
+			_mm_storeu_pd(sum + 2, sum23);
+			_mm_storeu_pd(sum_squares, squares01);
+			_mm_storeu_pd(sum_squares + 2, squares23);
+		}
+
+		const SimdKernels kKernels = { kSimdSse2, Decode16, Decode16Stereo, Encode16, scalar::Decode24, Quantize, Distort, DistortRamps, Scale, Multiply, MixAdd, Peak, IsSilent, AccumulateLevels };
+	}
+#endif
+
+	string GetEnvironment(const char* name)
+	{
+#ifdef _MSC_VER
+		char* value = nullptr;
+		size_t size = 0;
+		if (_dupenv_s(&value, &size, name) != 0 || value == nullptr)
+			return {};
+
+		string result = value;
+		free(value);
+		return result;
+#else
+		const char* value = std::getenv(name);
+		return value != nullptr ? value : "";
+#endif
+	}
+
+	const SimdKernels& Select()
+	{
+		auto level = CpuFeatures::Get().GetSimdLevel();
+
+		const auto forced = GetEnvironment(kSimdVariable);
+		if (!forced.empty())
+		{
+			bool known = false;
+			for (const auto name_level : { kSimdScalar, kSimdSse2, kSimdAvx2, kSimdAvx512 })
+			{
+				if (forced != GetSimdLevelName(name_level))
+					continue;
+
+				known = true;
+				if (name_level > level)
+					cerr << "Error: CPU doesn't support " << forced << " kernels, " << GetSimdLevelName(level) << " ones are used" << endl;
+				else
+					level = name_level;
+			}
+
+			if (!known)
+				cerr << "Error: unknown " << kSimdVariable << " value " << forced << ", it must be scalar, sse2, avx2 or avx512" << endl;
+		}
+
+		// Level may be missing in the build, e.g. SSE2 of 32 bit build without /arch:SSE2
+		for (; level > kSimdScalar; level = static_cast<SimdLevel>(level - 1))
+		{
+			if (const auto* kernels = SimdKernels::Find(level))
+				return *kernels;
+		}
+
+		return scalar::kKernels;
+	}
+}
+
+const SimdKernels& SimdKernels::Get()
+{
+	static const SimdKernels& kernels = Select();
+	return kernels;
+}
+
+const SimdKernels* SimdKernels::Find(SimdLevel level)
+{
+	if (!CpuFeatures::Get().Supports(level))
+		return nullptr;
+
+	switch (level)
+	{
+		case kSimdScalar:
+			return &scalar::kKernels;
+
+		case kSimdSse2:
+#ifdef KERNELS_SSE2
+			return &sse2::kKernels;
+#else
+			return nullptr;
+#endif
+
+		case kSimdAvx2:
+			return GetAvx2Kernels();
+
+		case kSimdAvx512:
+			return GetAvx512Kernels();
+
+		default:
+			return nullptr;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "CpuFeatures.h"
+
+/**
+ * \brief Table of the SIMD kernels of one instruction set
+ *
+ * Kernels are compiled for every level, AVX2 and AVX-512 ones in their own translation units
+ * built with that instruction set, and the best level of the CPU is selected on the first use.
+ * Environment variable WAV_EFFECTS_SIMD (scalar, sse2, avx2, avx512) forces a lower level
+ * for testing and benchmarking. Kernels multiply and add without FMA and keep the lanes
+ * of the scalar code, so every level gives bit-exact the same results. Max takes the running
+ * peak as the second operand, that is kept on NaN like by std::max. Distortion kernels use
+ * the polynomial arctangent of kAtan* constants at every level instead of std::atan,
+ * it differs from std::atan by less than 2e-7.
+ */
+struct SimdKernels
+{
+	SimdLevel level;
+
+	// out[i] = 16 bit little-endian in[i] / 32768
+	void (*decode16)(const uint8_t* in, size_t count, float* out);
+
+	// decode16 of count interleaved stereo frames
+	void (*decode16_stereo)(const uint8_t* in, size_t count, float* left, float* right);
+
+	// 16 bit little-endian rounded in[i] * 32768, clamped, without dither
+	void (*encode16)(const float* in, size_t count, uint8_t* out);
+
+	// out[i] = 24 bit little-endian in[i * stride] / 8388608
+	void (*decode24)(const uint8_t* in, size_t count, size_t stride, float* out);
+
+	// out[i] = in[i] * scale + dither[i] rounded to nearest even and clamped to [min, max], dither may be nullptr
+	void (*quantize)(const float* in, const double* dither, size_t count, double scale, double min, double max, int32_t* out);
+
+	// samples[i] = (2 / pi * atan(samples[i] * drive) * blend + samples[i] * (1 - blend)) / 2 * volume
+	void (*distort)(float* samples, size_t count, float drive, float blend, float volume);
+
+	// distort by drive[i] and blend[i] of every sample
+	void (*distort_ramps)(float* samples, const float* drive, const float* blend, size_t count, float volume);
+
+	// samples[i] *= gain
+	void (*scale)(float* samples, size_t count, float gain);
+
+	// samples[i] *= gains[i]
+	void (*multiply)(float* samples, const float* gains, size_t count);
+
+	// out[i] += in[i] * gain
+	void (*mix_add)(float* out, const float* in, float gain, size_t count);
+
+	// Highest |in[i]|
+	float (*peak)(const float* in, size_t count);
+
+	// Whether every |in[i]| <= threshold, stops at the first loud sample
+	bool (*is_silent)(const float* in, size_t count, float threshold);
+
+	// Peak, sum and sum of squares of every lane i % 4 of the first count / 4 * 4 samples,
+	// added to peak[4], sum[4] and sum_squares[4]
+	void (*accumulate_levels)(const float* in, size_t count, float* peak, double* sum, double* sum_squares);
+
+	/**
+	 * \brief Kernels of the level selected for this process
+	 */
+	[[nodiscard]] static const SimdKernels& Get();
+
+	/**
+	 * \brief Kernels of the level, nullptr if the build or the CPU lacks it
+	 */
+	[[nodiscard]] static const SimdKernels* Find(SimdLevel level);
+};
+
+// Arctangent of the distortion kernels (Cephes atanf): |x| above tan(3 pi / 8) is reduced to -1 / |x| + pi / 2,
+// above tan(pi / 8) to (|x| - 1) / (|x| + 1) + pi / 4, and atan of the reduced x' is
+// (((c0 * z - c1) * z + c2) * z - c3) * z * x' + x' with z = x' * x', evaluated in this order
+constexpr float kAtanTan3Pi8 = 2.414213562373095f;
+constexpr float kAtanTanPi8 = 0.4142135623730950f;
+constexpr float kAtanC0 = 8.05374449538e-2f;
+constexpr float kAtanC1 = 1.38776856032e-1f;
+constexpr float kAtanC2 = 1.99777106478e-1f;
+constexpr float kAtanC3 = 3.33329491539e-1f;
+constexpr float kAtanPi2 = 1.5707963267948966f;
+constexpr float kAtanPi4 = 0.7853981633974483f;
+
+// 2 / pi, that scales atan to [-1, 1]
+constexpr float kAtanToUnit = 1.f / kAtanPi2;
+
+// Tables of the translation units built with the instruction set, nullptr if the compiler lacks it
+const SimdKernels* GetAvx2Kernels();
+const SimdKernels* GetAvx512Kernels();
@@ -0,0 +1,302 @@
+// Built with AVX2 code generation (/arch:AVX2). Only intrinsics and plain loops are used here:
+// an inline function of a header, compiled in this file, could be picked by the linker for the whole program
+// Multiplies and adds must not be contracted into FMA, like by default with /fp:precise, or results differ from scalar ones
+#include "SimdKernels.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace
+{
+	const __m256 kAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+	void Decode16(const uint8_t* in, size_t count, float* out)
+	{
+		const __m256 scale = _mm256_set1_ps(1.f / 32768.f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)));
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+		}
+		for (; i < count; i++)
+			out[i] = static_cast<float>(static_cast<int16_t>(in[2 * i] | (in[2 * i + 1] << 8))) / 32768.f;
+	}
+
+	void Decode16Stereo(const uint8_t* in, size_t count, float* left, float* right)
+	{
+		// Frame is a 32 bit word, left sample is in its low half
+		const __m256 scale = _mm256_set1_ps(1.f / 32768.f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256i frames = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i));
+			const __m256i left8 = _mm256_srai_epi32(_mm256_slli_epi32(frames, 16), 16);
+			const __m256i right8 = _mm256_srai_epi32(frames, 16);
+			_mm256_storeu_ps(left + i, _mm256_mul_ps(_mm256_cvtepi32_ps(left8), scale));
+			_mm256_storeu_ps(right + i, _mm256_mul_ps(_mm256_cvtepi32_ps(right8), scale));
+		}
+		for (; i < count; i++)
+		{
+			left[i] = static_cast<float>(static_cast<int16_t>(in[4 * i] | (in[4 * i + 1] << 8))) / 32768.f;
+			right[i] = static_cast<float>(static_cast<int16_t>(in[4 * i + 2] | (in[4 * i + 3] << 8))) / 32768.f;
+		}
+	}
+
+	void Encode16(const float* in, size_t count, uint8_t* out)
+	{
+		// Clamped before conversion, so it doesn't overflow, rounding is to nearest like nearbyint
+		const __m256 scale = _mm256_set1_ps(32768.f);
+		const __m256 min = _mm256_set1_ps(-32768.f);
+		const __m256 max = _mm256_set1_ps(32767.f);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m256 low = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), min), max);
+			const __m256 high = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), min), max);
+			// Packing works within 128 bit halves, quarters are put back in order
+			const __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(low), _mm256_cvtps_epi32(high));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute4x64_epi64(packed, 0xD8));
+		}
+		for (; i < count; i++)
+		{
+			float value = in[i] * 32768.f;
+			value = value < -32768.f ? -32768.f : value > 32767.f ? 32767.f : value;
+			const int sample = _mm_cvtss_si32(_mm_set_ss(value));
+			out[2 * i] = static_cast<uint8_t>(sample);
+			out[2 * i + 1] = static_cast<uint8_t>(sample >> 8);
+		}
+	}
+
+	void Decode24(const uint8_t* in, size_t count, size_t stride, float* out)
+	{
+		// Sample is the low 3 bytes of a gathered 32 bit word, the last one is decoded by the plain loop not to read past the end
+		const __m256 scale = _mm256_set1_ps(1.f / 8388608.f);
+		const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+		size_t i = 0;
+		for (; i + 8 < count; i += 8, in += 8 * stride)
+		{
+			const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(in), offsets, 1);
+			const __m256i samples = _mm256_srai_epi32(_mm256_slli_epi32(words, 8), 8);
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+		}
+		for (; i < count; i++, in += stride)
+			out[i] = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[0] << 8 | in[1] << 16 | in[2] << 24)) >> 8) / 8388608.f;
+	}
+
+	void Quantize8(const float* in, const double* dither, double scale, double min, double max, int32_t* out)
+	{
+		// Clamped before conversion to the integer bounds, so it rounds to nearest even like nearbyint and doesn't overflow
+		const __m256d scale4 = _mm256_set1_pd(scale);
+		const __m256d min4 = _mm256_set1_pd(min);
+		const __m256d max4 = _mm256_set1_pd(max);
+		__m256d low = _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(in)), scale4);
+		__m256d high = _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(in + 4)), scale4);
+		if (dither != nullptr)
+		{
+			low = _mm256_add_pd(low, _mm256_loadu_pd(dither));
+			high = _mm256_add_pd(high, _mm256_loadu_pd(dither + 4));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_cvtpd_epi32(_mm256_min_pd(_mm256_max_pd(low, min4), max4)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm256_cvtpd_epi32(_mm256_min_pd(_mm256_max_pd(high, min4), max4)));
+	}
+
+	void Quantize(const float* in, const double* dither, size_t count, double scale, double min, double max, int32_t* out)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			Quantize8(in + i, dither != nullptr ? dither + i : nullptr, scale, min, max, out + i);
+		if (i == count)
+			return;
+
+		// Tail is padded to a full vector, so it's computed by the same instructions
+		float values[8] = {};
+		double noise[8] = {};
+		int32_t samples[8];
+		for (size_t j = 0; i + j < count; j++)
+		{
+			values[j] = in[i + j];
+			noise[j] = dither != nullptr ? dither[i + j] : 0.;
+		}
+		Quantize8(values, dither != nullptr ? noise : nullptr, scale, min, max, samples);
+		for (size_t j = 0; i + j < count; j++)
+			out[i + j] = samples[j];
+	}
+
+	__m256 Atan(__m256 x)
+	{
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 sign = _mm256_andnot_ps(kAbsMask, x);
+		const __m256 magnitude = _mm256_and_ps(x, kAbsMask);
+		const __m256 large = _mm256_cmp_ps(magnitude, _mm256_set1_ps(kAtanTan3Pi8), _CMP_GT_OQ);
+		const __m256 medium = _mm256_andnot_ps(large, _mm256_cmp_ps(magnitude, _mm256_set1_ps(kAtanTanPi8), _CMP_GT_OQ));
+
+		const __m256 inverse = _mm256_div_ps(_mm256_set1_ps(-1.f), magnitude);
+		const __m256 shifted = _mm256_div_ps(_mm256_sub_ps(magnitude, one), _mm256_add_ps(magnitude, one));
+		const __m256 reduced = _mm256_blendv_ps(_mm256_blendv_ps(magnitude, shifted, medium), inverse, large);
+		const __m256 offset = _mm256_or_ps(_mm256_and_ps(large, _mm256_set1_ps(kAtanPi2)), _mm256_and_ps(medium, _mm256_set1_ps(kAtanPi4)));
+
+		const __m256 z = _mm256_mul_ps(reduced, reduced);
+		__m256 polynomial = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(kAtanC0), z), _mm256_set1_ps(kAtanC1));
+		polynomial = _mm256_add_ps(_mm256_mul_ps(polynomial, z), _mm256_set1_ps(kAtanC2));
+		polynomial = _mm256_sub_ps(_mm256_mul_ps(polynomial, z), _mm256_set1_ps(kAtanC3));
+		polynomial = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(polynomial, z), reduced), reduced);
+		return _mm256_xor_ps(_mm256_add_ps(offset, polynomial), sign);
+	}
+
+	__m256 Distort(__m256 clean, __m256 drive, __m256 blend, __m256 volume)
+	{
+		const __m256 distorted = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(kAtanToUnit), Atan(_mm256_mul_ps(clean, drive))), blend);
+		const __m256 mixed = _mm256_add_ps(distorted, _mm256_mul_ps(clean, _mm256_sub_ps(_mm256_set1_ps(1.f), blend)));
+		return _mm256_mul_ps(_mm256_mul_ps(mixed, _mm256_set1_ps(0.5f)), volume);
+	}
+
+	void Distort(float* samples, size_t count, float drive, float blend, float volume)
+	{
+		const __m256 drive8 = _mm256_set1_ps(drive);
+		const __m256 blend8 = _mm256_set1_ps(blend);
+		const __m256 volume8 = _mm256_set1_ps(volume);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(samples + i, Distort(_mm256_loadu_ps(samples + i), drive8, blend8, volume8));
+		if (i == count)
+			return;
+
+		// Tail is padded to a full vector, so it's computed by the same instructions
+		float tail[8] = {};
+		for (size_t j = 0; i + j < count; j++)
+			tail[j] = samples[i + j];
+		_mm256_storeu_ps(tail, Distort(_mm256_loadu_ps(tail), drive8, blend8, volume8));
+		for (size_t j = 0; i + j < count; j++)
+			samples[i + j] = tail[j];
+	}
+
+	void DistortRamps(float* samples, const float* drive, const float* blend, size_t count, float volume)
+	{
+		const __m256 volume8 = _mm256_set1_ps(volume);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(samples + i, Distort(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(drive + i), _mm256_loadu_ps(blend + i), volume8));
+		if (i == count)
+			return;
+
+		float tail[8] = {}, tail_drive[8] = {}, tail_blend[8] = {};
+		for (size_t j = 0; i + j < count; j++)
+		{
+			tail[j] = samples[i + j];
+			tail_drive[j] = drive[i + j];
+			tail_blend[j] = blend[i + j];
+		}
+		_mm256_storeu_ps(tail, Distort(_mm256_loadu_ps(tail), _mm256_loadu_ps(tail_drive), _mm256_loadu_ps(tail_blend), volume8));
+		for (size_t j = 0; i + j < count; j++)
+			samples[i + j] = tail[j];
+	}
+
+	void Scale(float* samples, size_t count, float gain)
+	{
+		const __m256 gain8 = _mm256_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain8));
+		for (; i < count; i++)
+			samples[i] *= gain;
+	}
+
+	void Multiply(float* samples, const float* gains, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(gains + i)));
+		for (; i < count; i++)
+			samples[i] *= gains[i];
+	}
+
+	void MixAdd(float* out, const float* in, float gain, size_t count)
+	{
+		const __m256 gain8 = _mm256_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(in + i), gain8)));
+		for (; i < count; i++)
+			out[i] += in[i] * gain;
+	}
+
+	float Peak(const float* in, size_t count)
+	{
+		__m256 peak8 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			peak8 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(in + i), kAbsMask), peak8);
+
+		float lanes[8];
+		_mm256_storeu_ps(lanes, peak8);
+		float peak = 0.f;
+		for (const float lane : lanes)
+			peak = lane > peak ? lane : peak;
+		for (; i < count; i++)
+		{
+			const float value = in[i] < 0.f ? -in[i] : in[i];
+			peak = value > peak ? value : peak;
+		}
+
+		return peak;
+	}
+
+	bool IsSilent(const float* in, size_t count, float threshold)
+	{
+		// 32 samples are compared between the checks
+		const __m256 threshold8 = _mm256_set1_ps(threshold);
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256 loud0 = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(in + i), kAbsMask), threshold8, _CMP_GT_OQ);
+			const __m256 loud1 = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(in + i + 8), kAbsMask), threshold8, _CMP_GT_OQ);
+			const __m256 loud2 = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(in + i + 16), kAbsMask), threshold8, _CMP_GT_OQ);
+			const __m256 loud3 = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(in + i + 24), kAbsMask), threshold8, _CMP_GT_OQ);
+			if (_mm256_movemask_ps(_mm256_or_ps(_mm256_or_ps(loud0, loud1), _mm256_or_ps(loud2, loud3))) != 0)
+				return false;
+		}
+		for (; i < count; i++)
+		{
+			if (in[i] > threshold || -in[i] > threshold)
+				return false;
+		}
+
+		return true;
+	}
+
+	void AccumulateLevels(const float* in, size_t count, float* peak, double* sum, double* sum_squares)
+	{
+		// 4 double lanes, like the scalar code, so sums are added in the same order
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 peak4 = _mm_loadu_ps(peak);
+		__m256d sum4 = _mm256_loadu_pd(sum);
+		__m256d squares4 = _mm256_loadu_pd(sum_squares);
+		for (size_t i = 0; i + 4 <= count; i += 4)
+		{
+			const __m128 values = _mm_loadu_ps(in + i);
+			const __m256d wide = _mm256_cvtps_pd(values);
+			peak4 = _mm_max_ps(_mm_and_ps(values, abs_mask), peak4);
+			sum4 = _mm256_add_pd(sum4, wide);
+			squares4 = _mm256_add_pd(squares4, _mm256_mul_pd(wide, wide));
+		}
+
+		_mm_storeu_ps(peak, peak4);
+		_mm256_storeu_pd(sum, sum4);
+		_mm256_storeu_pd(sum_squares, squares4);
+	}
+
+	const SimdKernels kKernels = { kSimdAvx2, Decode16, Decode16Stereo, Encode16, Decode24, Quantize, Distort, DistortRamps, Scale, Multiply, MixAdd, Peak, IsSilent, AccumulateLevels };
+}
+
+const SimdKernels* GetAvx2Kernels()
+{
+	return &kKernels;
+}
+#else
+const SimdKernels* GetAvx2Kernels()
+{
+	return nullptr;
+}
+#endif
@@ -0,0 +1,267 @@
+// Built with AVX-512 code generation (/arch:AVX512). Only intrinsics and plain loops are used here:
+// an inline function of a header, compiled in this file, could be picked by the linker for the whole program
+// Multiplies and adds must not be contracted into FMA, like by default with /fp:precise, or results differ from scalar ones
+#include "SimdKernels.h"
+
+#ifdef __AVX512F__
+#include <immintrin.h>
+
+namespace
+{
+	__m512 Abs(__m512 values)
+	{
+		return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(values), _mm512_set1_epi32(0x7FFFFFFF)));
+	}
+
+	void Decode16(const uint8_t* in, size_t count, float* out)
+	{
+		const __m512 scale = _mm512_set1_ps(1.f / 32768.f);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m512i samples = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i)));
+			_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(samples), scale));
+		}
+		for (; i < count; i++)
+			out[i] = static_cast<float>(static_cast<int16_t>(in[2 * i] | (in[2 * i + 1] << 8))) / 32768.f;
+	}
+
+	void Decode16Stereo(const uint8_t* in, size_t count, float* left, float* right)
+	{
+		// Frame is a 32 bit word, left sample is in its low half
+		const __m512 scale = _mm512_set1_ps(1.f / 32768.f);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m512i frames = _mm512_loadu_si512(in + 4 * i);
+			const __m512i left16 = _mm512_srai_epi32(_mm512_slli_epi32(frames, 16), 16);
+			const __m512i right16 = _mm512_srai_epi32(frames, 16);
+			_mm512_storeu_ps(left + i, _mm512_mul_ps(_mm512_cvtepi32_ps(left16), scale));
+			_mm512_storeu_ps(right + i, _mm512_mul_ps(_mm512_cvtepi32_ps(right16), scale));
+		}
+		for (; i < count; i++)
+		{
+			left[i] = static_cast<float>(static_cast<int16_t>(in[4 * i] | (in[4 * i + 1] << 8))) / 32768.f;
+			right[i] = static_cast<float>(static_cast<int16_t>(in[4 * i + 2] | (in[4 * i + 3] << 8))) / 32768.f;
+		}
+	}
+
+	void Encode16(const float* in, size_t count, uint8_t* out)
+	{
+		// Clamped before conversion, so it doesn't overflow, rounding is to nearest like nearbyint
+		const __m512 scale = _mm512_set1_ps(32768.f);
+		const __m512 min = _mm512_set1_ps(-32768.f);
+		const __m512 max = _mm512_set1_ps(32767.f);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m512 values = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(in + i), scale), min), max);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(values)));
+		}
+		for (; i < count; i++)
+		{
+			float value = in[i] * 32768.f;
+			value = value < -32768.f ? -32768.f : value > 32767.f ? 32767.f : value;
+			const int sample = _mm_cvtss_si32(_mm_set_ss(value));
+			out[2 * i] = static_cast<uint8_t>(sample);
+			out[2 * i + 1] = static_cast<uint8_t>(sample >> 8);
+		}
+	}
+
+	void Decode24(const uint8_t* in, size_t count, size_t stride, float* out)
+	{
+		// Sample is the low 3 bytes of a gathered 32 bit word, the last one is decoded by the plain loop not to read past the end
+		const __m512 scale = _mm512_set1_ps(1.f / 8388608.f);
+		const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(static_cast<int>(stride)));
+		size_t i = 0;
+		for (; i + 16 < count; i += 16, in += 16 * stride)
+		{
+			const __m512i words = _mm512_i32gather_epi32(offsets, in, 1);
+			const __m512i samples = _mm512_srai_epi32(_mm512_slli_epi32(words, 8), 8);
+			_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(samples), scale));
+		}
+		for (; i < count; i++, in += stride)
+			out[i] = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[0] << 8 | in[1] << 16 | in[2] << 24)) >> 8) / 8388608.f;
+	}
+
+	void Quantize(const float* in, const double* dither, size_t count, double scale, double min, double max, int32_t* out)
+	{
+		// Clamped before conversion to the integer bounds, so it rounds to nearest even like nearbyint and doesn't overflow,
+		// tail is loaded and stored by masks
+		const __m512d scale8 = _mm512_set1_pd(scale);
+		const __m512d min8 = _mm512_set1_pd(min);
+		const __m512d max8 = _mm512_set1_pd(max);
+		for (size_t i = 0; i < count; i += 8)
+		{
+			const auto mask = static_cast<__mmask8>(count - i >= 8 ? 0xFF : (1u << (count - i)) - 1);
+			__m512d values = _mm512_mul_pd(_mm512_cvtps_pd(_mm256_maskz_loadu_ps(mask, in + i)), scale8);
+			if (dither != nullptr)
+				values = _mm512_add_pd(values, _mm512_maskz_loadu_pd(mask, dither + i));
+			_mm256_mask_storeu_epi32(out + i, mask, _mm512_cvtpd_epi32(_mm512_min_pd(_mm512_max_pd(values, min8), max8)));
+		}
+	}
+
+	__m512 Atan(__m512 x)
+	{
+		const __m512 one = _mm512_set1_ps(1.f);
+		const __m512i sign = _mm512_andnot_si512(_mm512_set1_epi32(0x7FFFFFFF), _mm512_castps_si512(x));
+		const __m512 magnitude = Abs(x);
+		const __mmask16 large = _mm512_cmp_ps_mask(magnitude, _mm512_set1_ps(kAtanTan3Pi8), _CMP_GT_OQ);
+		const __mmask16 medium = _mm512_mask_cmp_ps_mask(static_cast<__mmask16>(~large), magnitude, _mm512_set1_ps(kAtanTanPi8), _CMP_GT_OQ);
+
+		const __m512 inverse = _mm512_div_ps(_mm512_set1_ps(-1.f), magnitude);
+		const __m512 shifted = _mm512_div_ps(_mm512_sub_ps(magnitude, one), _mm512_add_ps(magnitude, one));
+		const __m512 reduced = _mm512_mask_blend_ps(large, _mm512_mask_blend_ps(medium, magnitude, shifted), inverse);
+		const __m512 offset = _mm512_mask_blend_ps(large, _mm512_maskz_mov_ps(medium, _mm512_set1_ps(kAtanPi4)), _mm512_set1_ps(kAtanPi2));
+
+		const __m512 z = _mm512_mul_ps(reduced, reduced);
+		__m512 polynomial = _mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(kAtanC0), z), _mm512_set1_ps(kAtanC1));
+		polynomial = _mm512_add_ps(_mm512_mul_ps(polynomial, z), _mm512_set1_ps(kAtanC2));
+		polynomial = _mm512_sub_ps(_mm512_mul_ps(polynomial, z), _mm512_set1_ps(kAtanC3));
+		polynomial = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(polynomial, z), reduced), reduced);
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_add_ps(offset, polynomial)), sign));
+	}
+
+	__m512 Distort(__m512 clean, __m512 drive, __m512 blend, __m512 volume)
+	{
+		const __m512 distorted = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(kAtanToUnit), Atan(_mm512_mul_ps(clean, drive))), blend);
+		const __m512 mixed = _mm512_add_ps(distorted, _mm512_mul_ps(clean, _mm512_sub_ps(_mm512_set1_ps(1.f), blend)));
+		return _mm512_mul_ps(_mm512_mul_ps(mixed, _mm512_set1_ps(0.5f)), volume);
+	}
+
+	__mmask16 TailMask(size_t remaining)
+	{
+		return static_cast<__mmask16>(remaining >= 16 ? 0xFFFF : (1u << remaining) - 1);
+	}
+
+	void Distort(float* samples, size_t count, float drive, float blend, float volume)
+	{
+		// Tail is loaded and stored by masks
+		const __m512 drive16 = _mm512_set1_ps(drive);
+		const __m512 blend16 = _mm512_set1_ps(blend);
+		const __m512 volume16 = _mm512_set1_ps(volume);
+		for (size_t i = 0; i < count; i += 16)
+		{
+			const __mmask16 mask = TailMask(count - i);
+			_mm512_mask_storeu_ps(samples + i, mask, Distort(_mm512_maskz_loadu_ps(mask, samples + i), drive16, blend16, volume16));
+		}
+	}
+
+	void DistortRamps(float* samples, const float* drive, const float* blend, size_t count, float volume)
+	{
+		const __m512 volume16 = _mm512_set1_ps(volume);
+		for (size_t i = 0; i < count; i += 16)
+		{
+			const __mmask16 mask = TailMask(count - i);
+			const __m512 clean = _mm512_maskz_loadu_ps(mask, samples + i);
+			_mm512_mask_storeu_ps(samples + i, mask, Distort(clean, _mm512_maskz_loadu_ps(mask, drive + i), _mm512_maskz_loadu_ps(mask, blend + i), volume16));
+		}
+	}
+
+	void Scale(float* samples, size_t count, float gain)
+	{
+		const __m512 gain16 = _mm512_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm512_storeu_ps(samples + i, _mm512_mul_ps(_mm512_loadu_ps(samples + i), gain16));
+		for (; i < count; i++)
+			samples[i] *= gain;
+	}
+
+	void Multiply(float* samples, const float* gains, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm512_storeu_ps(samples + i, _mm512_mul_ps(_mm512_loadu_ps(samples + i), _mm512_loadu_ps(gains + i)));
+		for (; i < count; i++)
+			samples[i] *= gains[i];
+	}
+
+	void MixAdd(float* out, const float* in, float gain, size_t count)
+	{
+		const __m512 gain16 = _mm512_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), _mm512_mul_ps(_mm512_loadu_ps(in + i), gain16)));
+		for (; i < count; i++)
+			out[i] += in[i] * gain;
+	}
+
+	float Peak(const float* in, size_t count)
+	{
+		__m512 peak16 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			peak16 = _mm512_max_ps(Abs(_mm512_loadu_ps(in + i)), peak16);
+
+		float lanes[16];
+		_mm512_storeu_ps(lanes, peak16);
+		float peak = 0.f;
+		for (const float lane : lanes)
+			peak = lane > peak ? lane : peak;
+		for (; i < count; i++)
+		{
+			const float value = in[i] < 0.f ? -in[i] : in[i];
+			peak = value > peak ? value : peak;
+		}
+
+		return peak;
+	}
+
+	bool IsSilent(const float* in, size_t count, float threshold)
+	{
+		// 64 samples are compared between the checks
+		const __m512 threshold16 = _mm512_set1_ps(threshold);
+		size_t i = 0;
+		for (; i + 64 <= count; i += 64)
+		{
+			const __mmask16 loud0 = _mm512_cmp_ps_mask(Abs(_mm512_loadu_ps(in + i)), threshold16, _CMP_GT_OQ);
+			const __mmask16 loud1 = _mm512_cmp_ps_mask(Abs(_mm512_loadu_ps(in + i + 16)), threshold16, _CMP_GT_OQ);
+			const __mmask16 loud2 = _mm512_cmp_ps_mask(Abs(_mm512_loadu_ps(in + i + 32)), threshold16, _CMP_GT_OQ);
+			const __mmask16 loud3 = _mm512_cmp_ps_mask(Abs(_mm512_loadu_ps(in + i + 48)), threshold16, _CMP_GT_OQ);
+			if ((loud0 | loud1 | loud2 | loud3) != 0)
+				return false;
+		}
+		for (; i < count; i++)
+		{
+			if (in[i] > threshold || -in[i] > threshold)
+				return false;
+		}
+
+		return true;
+	}
+
+	void AccumulateLevels(const float* in, size_t count, float* peak, double* sum, double* sum_squares)
+	{
+		// 4 double lanes, like the scalar code, so sums are added in the same order
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 peak4 = _mm_loadu_ps(peak);
+		__m256d sum4 = _mm256_loadu_pd(sum);
+		__m256d squares4 = _mm256_loadu_pd(sum_squares);
+		for (size_t i = 0; i + 4 <= count; i += 4)
+		{
+			const __m128 values = _mm_loadu_ps(in + i);
+			const __m256d wide = _mm256_cvtps_pd(values);
+			peak4 = _mm_max_ps(_mm_and_ps(values, abs_mask), peak4);
+			sum4 = _mm256_add_pd(sum4, wide);
+			squares4 = _mm256_add_pd(squares4, _mm256_mul_pd(wide, wide));
+		}
+
+		_mm_storeu_ps(peak, peak4);
+		_mm256_storeu_pd(sum, sum4);
+		_mm256_storeu_pd(sum_squares, squares4);
+	}
+
+	const SimdKernels kKernels = { kSimdAvx512, Decode16, Decode16Stereo, Encode16, Decode24, Quantize, Distort, DistortRamps, Scale, Multiply, MixAdd, Peak, IsSilent, AccumulateLevels };
+}
+
+const SimdKernels* GetAvx512Kernels()
+{
+	return &kKernels;
+}
+#else
+const SimdKernels* GetAvx512Kernels()
+{
+	return nullptr;
+}
+#endif
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include "Stats.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <malloc.h>
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+namespace
+{
+	thread_local size_t thread_allocated_bytes = 0;
+}
+
+// Count every allocation of the program, counter is per thread, so it costs one addition
+void* operator new(std::size_t size)
+{
+	thread_allocated_bytes += size;
+	if (void* ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+// Over-aligned types don't go through the plain overloads, so they are counted the same way
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	thread_allocated_bytes += size;
+	const auto align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+	if (void* ptr = _aligned_malloc(size != 0 ? size : 1, align))
+		return ptr;
+#else
+	// Size of aligned_alloc must be a multiple of the alignment
+	if (void* ptr = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align))
+		return ptr;
+#endif
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept
+{
+	operator delete(ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(ptr, alignment);
+}
+
+void Stats::Record(const std::string& name, double wall_seconds, double cpu_seconds, size_t samples, size_t bytes, size_t bytes_allocated)
+{
+	const auto peak_rss = GetPeakRss();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::find_if(stages_.begin(), stages_.end(), [&](const auto& stage) {
+		return stage.name == name;
+	});
+
+	if (it == stages_.end())
+	{
+		stages_.push_back({ name });
+		it = stages_.end() - 1;
+	}
+
+	it->calls++;
+	it->wall_seconds += wall_seconds;
+	it->cpu_seconds += cpu_seconds;
+	it->samples += samples;
+	it->bytes += bytes;
+	it->bytes_allocated += bytes_allocated;
+	it->peak_rss = std::max(it->peak_rss, peak_rss);
+}
+
+void Stats::Reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	stages_.clear();
+}
+
+std::vector<StageStats> Stats::GetStages() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stages_;
+}
+
+void Stats::Print(std::ostream& out) const
+{
+	const auto stages = GetStages();
+
+	out << std::left << std::setw(24) << "Stage" << std::right
+		<< std::setw(7) << "Calls"
+		<< std::setw(11) << "Wall, ms"
+		<< std::setw(11) << "CPU, ms"
+		<< std::setw(14) << "Samples"
+		<< std::setw(12) << "Msmp/s"
+		<< std::setw(10) << "MB/s"
+		<< std::setw(12) << "Alloc, MB"
+		<< std::setw(12) << "Peak, MB" << std::endl;
+
+	for (const auto& stage : stages)
+	{
+		out << std::left << std::setw(24) << stage.name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(7) << stage.calls
+			<< std::setw(11) << stage.wall_seconds * 1000
+			<< std::setw(11) << stage.cpu_seconds * 1000
+			<< std::setw(14) << stage.samples
+			<< std::setw(12) << stage.GetSamplesPerSecond() / 1e6
+			<< std::setw(10) << stage.GetBytesPerSecond() / double(1 << 20)
+			<< std::setw(12) << stage.bytes_allocated / double(1 << 20)
+			<< std::setw(12) << stage.peak_rss / double(1 << 20) << std::endl;
+	}
+
+	out << "Peak RSS: " << GetPeakRss() / double(1 << 20) << " MB" << std::endl;
+}
+
+void Stats::PrintJson(std::ostream& out) const
+{
+	const auto stages = GetStages();
+
+	out << "{\"peak_rss\": " << GetPeakRss() << ", \"stages\": [";
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		const auto& stage = stages[i];
+		out << (i == 0 ? "" : ", ") << "{"
+			<< "\"name\": \"" << stage.name << "\", "
+			<< "\"calls\": " << stage.calls << ", "
+			<< "\"wall_seconds\": " << stage.wall_seconds << ", "
+			<< "\"cpu_seconds\": " << stage.cpu_seconds << ", "
+			<< "\"samples\": " << stage.samples << ", "
+			<< "\"samples_per_sec\": " << stage.GetSamplesPerSecond() << ", "
+			<< "\"bytes\": " << stage.bytes << ", "
+			<< "\"bytes_per_sec\": " << stage.GetBytesPerSecond() << ", "
+			<< "\"bytes_allocated\": " << stage.bytes_allocated << ", "
+			<< "\"peak_rss\": " << stage.peak_rss
+			<< "}";
+	}
+	out << "]}" << std::endl;
+}
+
+size_t Stats::GetPeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+double Stats::GetThreadCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0;
+
+	const auto to_seconds = [](const FILETIME& time) {
+		return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+	};
+	return to_seconds(kernel) + to_seconds(user);
+#else
+	timespec time{};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1e-9;
+#endif
+}
+
+size_t Stats::GetThreadAllocatedBytes()
+{
+	return thread_allocated_bytes;
+}
+
+StageTimer::StageTimer(std::string name, size_t samples)
+	: name_(std::move(name)), samples_(samples),
+	  start_wall_(std::chrono::steady_clock::now()),
+	  start_cpu_(Stats::GetThreadCpuTime()),
+	  start_allocated_(Stats::GetThreadAllocatedBytes())
+{
+}
+
+StageTimer::~StageTimer()
+{
+	Stop();
+}
+
+void StageTimer::SetSamples(size_t samples)
+{
+	samples_ = samples;
+}
+
+void StageTimer::SetBytes(size_t bytes)
+{
+	bytes_ = bytes;
+}
+
+void StageTimer::Stop()
+{
+	if (stopped_)
+		return;
+	stopped_ = true;
+
+	const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_wall_).count();
+	const double cpu = Stats::GetThreadCpuTime() - start_cpu_;
+	const size_t allocated = Stats::GetThreadAllocatedBytes() - start_allocated_;
+
+	Stats::get().Record(name_, wall, cpu, samples_, bytes_, allocated);
+}
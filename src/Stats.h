@@ -0,0 +1,129 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Accumulated measurements of one processing stage
+ */
+struct StageStats
+{
+	std::string name;
+	size_t calls = 0;
+	double wall_seconds = 0;
+	double cpu_seconds = 0;
+	size_t samples = 0;
+	// Bytes read or written by I/O stages
+	size_t bytes = 0;
+	size_t bytes_allocated = 0;
+
+	// Process peak resident memory, observed at the end of the stage
+	size_t peak_rss = 0;
+
+	[[nodiscard]] double GetSamplesPerSecond() const
+	{
+		return wall_seconds > 0 ? static_cast<double>(samples) / wall_seconds : 0;
+	}
+
+	[[nodiscard]] double GetBytesPerSecond() const
+	{
+		return wall_seconds > 0 ? static_cast<double>(bytes) / wall_seconds : 0;
+	}
+};
+
+/**
+ * \brief Process-wide per-stage statistics
+ *
+ * Stages are recorded by StageTimer, e.g. file read, header parse, decode, every effect, encode and write.
+ */
+class Stats
+{
+public:
+	static Stats& get() noexcept
+	{
+		static Stats m_instance;
+		return m_instance;
+	}
+
+	Stats(const Stats&) = delete;
+	Stats& operator=(const Stats&) = delete;
+
+	void Record(const std::string& name, double wall_seconds, double cpu_seconds, size_t samples, size_t bytes, size_t bytes_allocated);
+	void Reset();
+
+	[[nodiscard]] std::vector<StageStats> GetStages() const;
+
+	/**
+	 * \brief Print stats table
+	 */
+	void Print(std::ostream& out) const;
+
+	/**
+	 * \brief Print stats as JSON object
+	 */
+	void PrintJson(std::ostream& out) const;
+
+	/**
+	 * \brief Peak resident memory of the process, in bytes
+	 */
+	[[nodiscard]] static size_t GetPeakRss();
+
+	/**
+	 * \brief CPU time of the calling thread, in seconds
+	 */
+	[[nodiscard]] static double GetThreadCpuTime();
+
+	/**
+	 * \brief Bytes allocated by operator new in the calling thread since its start
+	 */
+	[[nodiscard]] static size_t GetThreadAllocatedBytes();
+
+private:
+	Stats() = default;
+
+	mutable std::mutex mutex_;
+	std::vector<StageStats> stages_;
+};
+
+/**
+ * \brief Measures scope as processing stage and records it into Stats
+ */
+class StageTimer
+{
+public:
+	/**
+	 * \param name stage name
+	 * \param samples number of samples processed by the stage
+	 */
+	explicit StageTimer(std::string name, size_t samples = 0);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+	/**
+	 * \brief Set number of samples, if it's known only at the end of the stage
+	 */
+	void SetSamples(size_t samples);
+
+	/**
+	 * \brief Set number of bytes read or written by the stage
+	 */
+	void SetBytes(size_t bytes);
+
+	/**
+	 * \brief Finish the stage before the end of the scope
+	 */
+	void Stop();
+
+private:
+	std::string name_;
+	size_t samples_;
+	size_t bytes_ = 0;
+	bool stopped_ = false;
+	std::chrono::steady_clock::time_point start_wall_;
+	double start_cpu_;
+	size_t start_allocated_;
+};
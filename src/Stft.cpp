@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include "Stft.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+	constexpr float kTwoPi = 6.28318530717958647692f;
+
+	/**
+	 * \brief Wrap phase to [-pi, pi]
+	 */
+	float WrapPhase(float phase)
+	{
+		return phase - kTwoPi * std::round(phase / kTwoPi);
+	}
+
+	/**
+	 * \brief Periodic window, so shifted copies sum to a constant
+	 */
+	std::vector<float> MakeWindow(WindowType type, size_t size)
+	{
+		std::vector<float> window(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			const double x = 2. * kPi * static_cast<double>(i) / static_cast<double>(size);
+			switch (type)
+			{
+				case kHannWindow:
+					window[i] = static_cast<float>(0.5 - 0.5 * std::cos(x));
+					break;
+
+				case kHammingWindow:
+					window[i] = static_cast<float>(0.54 - 0.46 * std::cos(x));
+					break;
+
+				case kBlackmanWindow:
+					window[i] = static_cast<float>(0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2. * x));
+					break;
+
+				default:
+					throw std::invalid_argument("Unknown window type");
+			}
+		}
+		return window;
+	}
+}
+
+Stft::Stft(const StftOptions& options) : options_(options)
+{
+	if (options.hop == 0 || options.hop > options.frame_size)
+		throw std::invalid_argument("STFT hop must be between 1 and frame size");
+
+	plan_ = FftPlan::Get(options.frame_size);
+	window_ = MakeWindow(options.window, options.frame_size);
+}
+
+std::vector<float> Stft::Process(const float* input, size_t count, const FrameCallback& callback, double stretch) const
+{
+	if (!(stretch > 0))
+		throw std::invalid_argument("Stretch must be greater than 0");
+
+	const size_t size = options_.frame_size;
+	const size_t half = size / 2;
+	const size_t hop = options_.hop;
+	const auto out_count = static_cast<size_t>(std::llround(static_cast<double>(count) * stretch));
+
+	std::vector<float> output(out_count, 0.f);
+	std::vector<float> norm(out_count, 0.f);
+	std::vector<float> frame(size);
+	std::vector<std::complex<float>> spectrum(plan_->GetNumBins());
+
+	// Frame j is centered at j * hop in the output and at j * hop / stretch in the input
+	size_t prev_center = 0;
+	for (size_t j = 0; j * hop < out_count + half; j++)
+	{
+		const size_t out_center = j * hop;
+		const auto in_center = static_cast<size_t>(std::llround(static_cast<double>(out_center) / stretch));
+
+		for (size_t i = 0; i < size; i++)
+		{
+			const auto idx = static_cast<ptrdiff_t>(in_center + i) - static_cast<ptrdiff_t>(half);
+			frame[i] = idx >= 0 && idx < static_cast<ptrdiff_t>(count) ? input[idx] * window_[i] : 0.f;
+		}
+
+		plan_->Forward(frame.data(), spectrum.data());
+		if (callback)
+		{
+			// Hop before the first frame is the nominal one, so phase advance is defined for it too
+			const size_t analysis_hop = j == 0 ? static_cast<size_t>(std::llround(hop / stretch)) : in_center - prev_center;
+			callback(spectrum, analysis_hop, hop);
+		}
+		plan_->Inverse(spectrum.data(), frame.data());
+		prev_center = in_center;
+
+		const size_t begin = out_center > half ? 0 : half - out_center;
+		const size_t end = std::min(size, out_count + half - out_center);
+		for (size_t i = begin; i < end; i++)
+		{
+			const size_t idx = out_center + i - half;
+			output[idx] += frame[i] * window_[i];
+			norm[idx] += window_[i] * window_[i];
+		}
+	}
+
+	for (size_t i = 0; i < out_count; i++)
+		output[i] = norm[i] > 1e-6f ? output[i] / norm[i] : 0.f;
+
+	return output;
+}
+
+void Stft::Process(WavFile<float>& wav, const CallbackFactory& make_callback, double stretch) const
+{
+	const size_t num_channels = wav.GetNumChannels();
+	StageTimer timer("stft", wav.GetNumSamplesPerChannel() * num_channels);
+
+	std::vector<std::exception_ptr> errors(num_channels);
+	const auto process_channel = [&](size_t channel) {
+		try
+		{
+			auto& samples = wav.samples[channel];
+			samples = Process(samples.data(), samples.size(), make_callback ? make_callback(channel) : FrameCallback(), stretch);
+		}
+		catch (...)
+		{
+			errors[channel] = std::current_exception();
+		}
+	};
+
+	if (num_channels > 1)
+	{
+		ThreadPool pool(std::min<size_t>(num_channels, std::max(1u, std::thread::hardware_concurrency())));
+		for (size_t channel = 0; channel < num_channels; channel++)
+			pool.Submit([&process_channel, channel] { process_channel(channel); });
+		pool.Wait();
+	}
+	else if (num_channels == 1)
+		process_channel(0);
+
+	for (const auto& error : errors)
+		if (error)
+			std::rethrow_exception(error);
+}
+
+const StftOptions& Stft::GetOptions() const
+{
+	return options_;
+}
+
+void PhaseVocoder::operator()(std::vector<std::complex<float>>& spectrum, size_t analysis_hop, size_t synthesis_hop)
+{
+	const size_t num_bins = spectrum.size();
+	const bool first = analysis_phase_.empty();
+	if (first)
+	{
+		analysis_phase_.resize(num_bins);
+		synthesis_phase_.resize(num_bins);
+		magnitude_.resize(num_bins);
+		phase_.resize(num_bins);
+		peaks_.reserve(num_bins);
+	}
+
+	for (size_t k = 0; k < num_bins; k++)
+	{
+		magnitude_[k] = std::abs(spectrum[k]);
+		phase_[k] = std::arg(spectrum[k]);
+	}
+
+	// Local maxima over two neighbours on each side
+	peaks_.clear();
+	for (size_t k = 0; k < num_bins; k++)
+	{
+		const float m = magnitude_[k];
+		if (m > 0 && (k < 1 || m > magnitude_[k - 1]) && (k < 2 || m > magnitude_[k - 2]) &&
+			(k + 1 >= num_bins || m >= magnitude_[k + 1]) && (k + 2 >= num_bins || m >= magnitude_[k + 2]))
+			peaks_.push_back(k);
+	}
+
+	// Bin frequency in radians per sample
+	const float bin_omega = kTwoPi / static_cast<float>(2 * (num_bins - 1));
+	const auto ha = static_cast<float>(analysis_hop);
+	const auto hs = static_cast<float>(synthesis_hop);
+
+	for (size_t p = 0; p < peaks_.size(); p++)
+	{
+		const size_t peak = peaks_[p];
+		float& synthesis = synthesis_phase_[peak];
+		if (first || analysis_hop == 0)
+			synthesis = first ? phase_[peak] : synthesis + bin_omega * static_cast<float>(peak) * hs;
+		else
+		{
+			const float omega = bin_omega * static_cast<float>(peak);
+			const float deviation = WrapPhase(phase_[peak] - analysis_phase_[peak] - omega * ha);
+			synthesis = WrapPhase(synthesis + (omega + deviation / ha) * hs);
+		}
+
+		// Region of influence of the peak is up to the middle between it and the neighbour peaks
+		const size_t begin = p == 0 ? 0 : (peaks_[p - 1] + peak) / 2 + 1;
+		const size_t end = p + 1 == peaks_.size() ? num_bins : (peak + peaks_[p + 1]) / 2 + 1;
+		const float rotation = synthesis - phase_[peak];
+		for (size_t k = begin; k < end; k++)
+		{
+			if (k != peak)
+				synthesis_phase_[k] = phase_[k] + rotation;
+			spectrum[k] = std::polar(magnitude_[k], synthesis_phase_[k]);
+		}
+	}
+
+	std::copy(phase_.begin(), phase_.end(), analysis_phase_.begin());
+}
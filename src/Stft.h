@@ -0,0 +1,104 @@
+#pragma once
+#include <complex>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Fft.h"
+#include "WavFile.h"
+
+enum WindowType
+{
+	kHannWindow = 1,
+	kHammingWindow,
+	kBlackmanWindow
+};
+
+struct StftOptions
+{
+	// Frame size, power of two
+	size_t frame_size = 2048;
+	// Synthesis hop, frames overlap by frame_size - hop
+	size_t hop = 512;
+	WindowType window = kHannWindow;
+};
+
+/**
+ * \brief Short-time Fourier transform with weighted overlap-add resynthesis
+ *
+ * Frames are windowed before analysis and after synthesis, output is divided by the overlapped
+ * squared window, so unmodified spectra reconstruct the input exactly. Frames are centered on
+ * their positions, so the first and last samples are covered by full frames.
+ *
+ * Analysis frames can be taken with a different hop, than the synthesis one,
+ * then the output is stretched in time (e.g. by phase vocoder).
+ */
+class Stft
+{
+public:
+	/**
+	 * \brief Called for every frame, modifies spectrum in place
+	 * \param spectrum frame_size / 2 + 1 bins
+	 * \param analysis_hop distance from the previous analysis frame, samples
+	 * \param synthesis_hop distance from the previous synthesis frame, samples
+	 */
+	typedef std::function<void(std::vector<std::complex<float>>& spectrum, size_t analysis_hop, size_t synthesis_hop)> FrameCallback;
+
+	/**
+	 * \brief Creates callback for the channel, so the callback can keep per channel state
+	 */
+	typedef std::function<FrameCallback(size_t channel)> CallbackFactory;
+
+	/**
+	 * \throw invalid_argument frame size is not a power of two, hop is 0 or greater than frame size,
+	 * or unknown window type
+	 */
+	explicit Stft(const StftOptions& options = StftOptions());
+
+	/**
+	 * \brief Transform block, process its frames and resynthesize
+	 * \param input input samples
+	 * \param count number of input samples
+	 * \param callback frame processing
+	 * \param stretch ratio of output length to input length
+	 * \return round(count * stretch) samples
+	 * \throw invalid_argument stretch <= 0
+	 */
+	[[nodiscard]] std::vector<float> Process(const float* input, size_t count, const FrameCallback& callback, double stretch = 1.) const;
+
+	/**
+	 * \brief Process every channel of the wave file, channels are processed in parallel
+	 * \param wav wave file
+	 * \param make_callback creates frame processing for every channel, called from worker threads
+	 * \param stretch ratio of output length to input length
+	 * \throw invalid_argument stretch <= 0
+	 */
+	void Process(WavFile<float>& wav, const CallbackFactory& make_callback, double stretch = 1.) const;
+
+	[[nodiscard]] const StftOptions& GetOptions() const;
+
+private:
+	StftOptions options_;
+	std::shared_ptr<const FftPlan> plan_;
+	std::vector<float> window_;
+};
+
+/**
+ * \brief Phase vocoder frame processing, for time stretching by Stft
+ *
+ * Instantaneous frequency of every spectral peak is estimated from the phase advance between
+ * analysis frames, synthesis phase advances by it over the synthesis hop. Bins around a peak keep
+ * their phase relation to the peak (identity phase locking), which reduces phasiness.
+ * Keeps state, so every channel needs its own instance.
+ */
+class PhaseVocoder
+{
+public:
+	void operator()(std::vector<std::complex<float>>& spectrum, size_t analysis_hop, size_t synthesis_hop);
+
+private:
+	std::vector<float> analysis_phase_;
+	std::vector<float> synthesis_phase_;
+	std::vector<float> magnitude_;
+	std::vector<float> phase_;
+	std::vector<size_t> peaks_;
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+namespace
+{
+	// Pool and worker index of the current thread, used to push nested tasks into the local deque
+	thread_local const ThreadPool* current_pool = nullptr;
+	thread_local size_t current_worker_idx = 0;
+}
+
+ThreadPool::ThreadPool(size_t num_threads)
+{
+	if (num_threads == 0)
+		num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < num_threads; i++)
+		workers_.push_back(std::make_unique<Worker>());
+
+	for (size_t i = 0; i < num_threads; i++)
+		threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Wait();
+
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		stopping_ = true;
+	}
+	wake_cv_.notify_all();
+
+	for (auto& thread : threads_)
+		thread.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	const size_t worker_idx = current_pool == this
+		? current_worker_idx
+		: next_worker_++ % workers_.size();
+
+	{
+		// Count the task before it becomes visible, so a thief can't take it with a zero counter
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		++queued_tasks_;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(workers_[worker_idx]->mutex);
+		workers_[worker_idx]->tasks.push_back(std::move(task));
+	}
+	wake_cv_.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+	done_cv_.wait(lock, [this] {
+		return queued_tasks_ == 0 && active_tasks_ == 0;
+	});
+}
+
+size_t ThreadPool::GetNumThreads() const
+{
+	return threads_.size();
+}
+
+void ThreadPool::WorkerLoop(size_t worker_idx)
+{
+	current_pool = this;
+	current_worker_idx = worker_idx;
+
+	while (true)
+	{
+		Task task;
+		if (TryPop(worker_idx, task) || TrySteal(worker_idx, task))
+		{
+			task();
+
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			if (--active_tasks_ == 0 && queued_tasks_ == 0)
+				done_cv_.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wake_mutex_);
+		wake_cv_.wait(lock, [this] {
+			return stopping_ || queued_tasks_ > 0;
+		});
+
+		if (stopping_ && queued_tasks_ == 0)
+			return;
+	}
+}
+
+bool ThreadPool::TryPop(size_t worker_idx, Task& task)
+{
+	auto& worker = *workers_[worker_idx];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.tasks.empty())
+		return false;
+
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+
+	// Counters are updated under the worker lock so Wait() never sees a task in flight as finished
+	++active_tasks_;
+	--queued_tasks_;
+	return true;
+}
+
+bool ThreadPool::TrySteal(size_t worker_idx, Task& task)
+{
+	for (size_t i = 1; i < workers_.size(); i++)
+	{
+		auto& victim = *workers_[(worker_idx + i) % workers_.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty())
+			continue;
+
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+
+		++active_tasks_;
+		--queued_tasks_;
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Work-stealing thread pool
+ *
+ * Every worker owns a task deque. A worker pops its own tasks from the back (LIFO, cache friendly)
+ * and, when it runs dry, steals from the front of the other workers' deques.
+ * Tasks submitted from a worker thread go to that worker's deque, tasks submitted
+ * from outside are distributed round-robin.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	/**
+	 * \brief Create pool
+	 * \param num_threads Number of worker threads, 0 means hardware concurrency
+	 */
+	explicit ThreadPool(size_t num_threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * \brief Schedule task for execution
+	 * \param task Task to run. It must catch its exceptions, exception escaping a worker terminates the process
+	 */
+	void Submit(Task task);
+
+	/**
+	 * \brief Block until all submitted tasks are finished
+	 */
+	void Wait();
+
+	[[nodiscard]] size_t GetNumThreads() const;
+
+private:
+	struct Worker
+	{
+		std::deque<Task> tasks;
+		std::mutex mutex;
+	};
+
+	void WorkerLoop(size_t worker_idx);
+	bool TryPop(size_t worker_idx, Task& task);
+	bool TrySteal(size_t worker_idx, Task& task);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<std::thread> threads_;
+
+	std::mutex wake_mutex_;
+	std::condition_variable wake_cv_;
+	std::condition_variable done_cv_;
+
+	std::atomic<size_t> queued_tasks_ = 0;
+	std::atomic<size_t> active_tasks_ = 0;
+	std::atomic<size_t> next_worker_ = 0;
+	bool stopping_ = false;
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+/**
+ * \brief Multi-level undo/redo of states, that hold samples in ChunkedAudio
+ *
+ * History keeps copies of the states before the edits. Copies share the chunks of the samples
+ * with the current state, and the edit copies only the chunks it writes, so memory cost
+ * of the history is proportional to the edits and taking a snapshot doesn't read the samples.
+ */
+template<typename State>
+class UndoHistory
+{
+public:
+	/**
+	 * \param max_levels Maximum number of undo levels
+	 */
+	explicit UndoHistory(size_t max_levels = 32) : max_levels_(std::max<size_t>(1, max_levels))
+	{
+	}
+
+	/**
+	 * \brief Drop all history
+	 */
+	void Clear()
+	{
+		undo_.clear();
+		redo_.clear();
+	}
+
+	/**
+	 * \brief Record state before an edit, drops all redo states
+	 */
+	void Commit(State before)
+	{
+		redo_.clear();
+		undo_.push_back(std::move(before));
+
+		// Oldest state is dropped, its unique chunks are freed
+		if (undo_.size() > max_levels_)
+			undo_.erase(undo_.begin());
+	}
+
+	/**
+	 * \brief Revert state to the previous one
+	 * \param state in: current state, kept for redo, out: previous state
+	 * \return true, if there was something to undo
+	 */
+	bool Undo(State& state)
+	{
+		return Move(undo_, redo_, state);
+	}
+
+	/**
+	 * \brief Apply again the reverted edit
+	 * \param state in: current state, kept for undo, out: next state
+	 * \return true, if there was something to redo
+	 */
+	bool Redo(State& state)
+	{
+		return Move(redo_, undo_, state);
+	}
+
+	[[nodiscard]] bool CanUndo() const
+	{
+		return !undo_.empty();
+	}
+
+	[[nodiscard]] bool CanRedo() const
+	{
+		return !redo_.empty();
+	}
+
+	/**
+	 * \brief Call f for every kept state, except the current one
+	 */
+	template<typename F>
+	void ForEachState(F f) const
+	{
+		for (const auto& state : undo_)
+			f(state);
+		for (const auto& state : redo_)
+			f(state);
+	}
+
+private:
+	static bool Move(std::vector<State>& from, std::vector<State>& to, State& state)
+	{
+		if (from.empty())
+			return false;
+
+		to.push_back(std::move(state));
+		state = std::move(from.back());
+		from.pop_back();
+		return true;
+	}
+
+	size_t max_levels_;
+	std::vector<State> undo_;
+	std::vector<State> redo_;
+};
@@ -2,11 +2,56 @@
 #include <fstream>
 #include <iterator>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 #include <utility>
 #include "WavFile.h"
+#include "Flac.h"
+#include "Meter.h"
+#include "Quantizer.h"
+#include "SimdKernels.h"
+#include "Stats.h"
 
 using namespace std;
 
+namespace
+{
+	// Frames encoded at once, so every channel state stays in registers while interleaved output stays in cache
+	constexpr size_t kEncodeBlockSize = 4096;
+
+	/**
+	 * \brief Decode count 16 bit mono or stereo frames or 24 bit frames into samples from start, with the SIMD kernels
+	 * \return false, if there is no kernel for the sample type, the bit depth or the number of channels
+	 */
+	template <typename T>
+	bool DecodeWithKernels(int bit_depth, const uint8_t* in, size_t block_align, std::vector<std::vector<T>>& samples, size_t start, size_t count)
+	{
+		if constexpr (std::is_same_v<T, float>)
+		{
+			const auto& kernels = SimdKernels::Get();
+			if (bit_depth == 16 && samples.size() == 1)
+			{
+				kernels.decode16(in, count, &samples[0][start]);
+				return true;
+			}
+			if (bit_depth == 16 && samples.size() == 2)
+			{
+				kernels.decode16_stereo(in, count, &samples[0][start], &samples[1][start]);
+				return true;
+			}
+			if (bit_depth == 24)
+			{
+				for (size_t channel = 0; channel < samples.size(); channel++)
+					kernels.decode24(in + 3 * channel, count, block_align, &samples[channel][start]);
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
 template <typename T>
 WavFile<T>::WavFile()
 {
@@ -24,16 +69,35 @@ WavFile<T>::WavFile(uint32_t sample_rate, int bit_depth, AudioData samples)
 }
 
 template <typename T>
-WavFile<T>::WavFile(const WavFile&& other) noexcept
+bool WavFile<T>::Save(const std::string& filename, const DitherOptions& dither) const
 {
-	sampleRate = other.sampleRate;
-	bitDepth = other.bitDepth;
-	samples = other.samples;
-}
+	if (FlacCodec::HasFlacExtension(filename))
+	{
+		if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24)
+		{
+			cerr << "Error: FLAC files of " << bitDepth << " bits aren`t supported, only 8, 16 or 24 bits" << endl;
+			return false;
+		}
+
+		// Quantize by blocks into packed samples, FLAC encoder reads them as integers
+		PackedAudio audio(sampleRate, bitDepth, GetNumChannels(), GetNumSamplesPerChannel());
+		std::vector<float> block(kEncodeBlockSize);
+		for (size_t channel = 0; channel < GetNumChannels(); channel++)
+		{
+			Quantizer quantizer(bitDepth, dither, channel);
+			for (size_t block_start = 0; block_start < audio.GetNumFrames(); block_start += kEncodeBlockSize)
+			{
+				const size_t count = std::min(kEncodeBlockSize, audio.GetNumFrames() - block_start);
+				std::copy_n(&samples[channel][block_start], count, block.data());
+				audio.Write(channel, block_start, count, block.data(), quantizer);
+			}
+		}
+
+		return audio.Save(filename);
+	}
+
+	StageTimer encode_timer("encode", GetNumSamplesPerChannel() * GetNumChannels());
 
-template <typename T>
-bool WavFile<T>::Save(const std::string& filename)
-{
 	FileData data;
 	const int32_t data_chunk_size = GetNumSamplesPerChannel() * (GetNumChannels() * bitDepth / 8);
 
@@ -69,53 +133,33 @@ bool WavFile<T>::Save(const std::string& filename)
 	WriteStringToFileData(data, "data");
 	WriteInt32ToFileData(data, data_chunk_size);
 
-	for (size_t i = 0; i < GetNumSamplesPerChannel(); i++)
+	if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
 	{
-		for (size_t channel = 0; channel < GetNumChannels(); channel++)
-		{
-			if (bitDepth == 8)
-			{
-				uint8_t byte = SampleToSingleByte(samples[channel][i]);
-				data.push_back(byte);
-			}
-			else if (bitDepth == 16)
-			{
-				const int16_t sample_as_int = SampleToSixteenBitInt(samples[channel][i]);
-				WriteInt16ToFileData(data, sample_as_int);
-			}
-			else if (bitDepth == 24)
-			{
-				const auto sample_as_int_again = static_cast<int32_t>(samples[channel][i] * static_cast<T>(1 << 23));
+		cerr << "Error: Trying to write a file with unsupported bit depth" << endl;
+		return false;
+	}
 
-				uint8_t bytes[3];
-				bytes[2] = static_cast<uint8_t>(sample_as_int_again >> 16) & 0xFF;
-				bytes[1] = static_cast<uint8_t>(sample_as_int_again >> 8) & 0xFF;
-				bytes[0] = static_cast<uint8_t>(sample_as_int_again) & 0xFF;
+	const size_t num_channels = GetNumChannels();
+	const size_t num_samples = GetNumSamplesPerChannel();
+	const size_t bytes_per_sample = bitDepth / 8;
+	const size_t header_size = data.size();
+	data.resize(header_size + num_samples * num_channels * bytes_per_sample);
 
-				data.push_back(bytes[0]);
-				data.push_back(bytes[1]);
-				data.push_back(bytes[2]);
-			}
-			else if (bitDepth == 32)
-			{
-				const auto sample_as_int_again = static_cast<int32_t>(samples[channel][i] * std::numeric_limits<int32_t>::max());
-
-				uint8_t bytes[4];
-				bytes[3] = static_cast<uint8_t>(sample_as_int_again >> 24) & 0xFF;
-				bytes[2] = static_cast<uint8_t>(sample_as_int_again >> 16) & 0xFF;
-				bytes[1] = static_cast<uint8_t>(sample_as_int_again >> 8) & 0xFF;
-				bytes[0] = static_cast<uint8_t>(sample_as_int_again >> 0) & 0xFF;
-
-				data.push_back(bytes[0]);
-				data.push_back(bytes[1]);
-				data.push_back(bytes[2]);
-				data.push_back(bytes[3]);
-			}
-			else
-			{
-				cerr << "Error: Trying to write a file with unsupported bit depth" << endl;
-				return false;
-			}
+	std::vector<Quantizer> quantizers;
+	quantizers.reserve(num_channels);
+	for (size_t channel = 0; channel < num_channels; channel++)
+		quantizers.emplace_back(bitDepth, dither, channel);
+
+	// Quantize and interleave by blocks
+	for (size_t block_start = 0; block_start < num_samples; block_start += kEncodeBlockSize)
+	{
+		const size_t count = std::min(kEncodeBlockSize, num_samples - block_start);
+		for (size_t channel = 0; channel < num_channels; channel++)
+		{
+			const T* in = &samples[channel][block_start];
+			uint8_t* out = &data[header_size + (block_start * num_channels + channel) * bytes_per_sample];
+			const size_t stride = num_channels * bytes_per_sample;
+			quantizers[channel].Encode(bitDepth, in, count, out, stride);
 		}
 	}
 
@@ -127,13 +171,19 @@ bool WavFile<T>::Save(const std::string& filename)
 		return false;
 	}
 
+	encode_timer.Stop();
+
 	// try to write the file
+	StageTimer write_timer("file write");
+	write_timer.SetBytes(data.size());
 	return WriteDataToFile(data, filename);
 }
 
 template <typename T>
-bool WavFile<T>::Load(const std::string& filename)
+bool WavFile<T>::Load(const std::string& filename, Meter* meter)
 {
+	StageTimer read_timer("file read");
+
 	// Open file stream
 	std::ifstream file(filename, std::ios::binary);
 
@@ -150,6 +200,42 @@ bool WavFile<T>::Load(const std::string& filename)
 	FileData data(char_count);
 	file.read(reinterpret_cast<char*>(&data[0]), data.size());
 
+	read_timer.SetBytes(data.size());
+	read_timer.Stop();
+
+	if (FlacCodec::IsFlac(data.data(), data.size()))
+	{
+		PackedAudio audio;
+		if (!FlacCodec::Decode(data, audio))
+			return false;
+
+		sampleRate = audio.GetSampleRate();
+		bitDepth = audio.GetBitDepth();
+		ClearSamples();
+		samples.resize(audio.GetNumChannels());
+
+		if (meter != nullptr)
+			meter->Reset(sampleRate, GetNumChannels());
+
+		std::vector<float> block(kEncodeBlockSize);
+		for (size_t channel = 0; channel < GetNumChannels(); channel++)
+		{
+			samples[channel].resize(audio.GetNumFrames());
+			for (size_t block_start = 0; block_start < audio.GetNumFrames(); block_start += kEncodeBlockSize)
+			{
+				const size_t count = std::min(kEncodeBlockSize, audio.GetNumFrames() - block_start);
+				audio.Read(channel, block_start, count, block.data());
+				std::copy_n(block.data(), count, &samples[channel][block_start]);
+
+				if (meter != nullptr)
+					meter->Process(channel, &samples[channel][block_start], count);
+			}
+		}
+
+		return true;
+	}
+	StageTimer parse_timer("header parse");
+
 	////////////////////////////////////////////////////////////////////////////
 	// Read header chunk ///////////////////////////////////////////////////////
 	const string header_chunk_id(data.begin(), data.begin() + 4);
@@ -186,9 +272,9 @@ bool WavFile<T>::Load(const std::string& filename)
 	}
 
 	// Check number of channels
-	if(num_channels < 1 || num_channels > 2)
+	if(num_channels < 1)
 	{
-		cerr << "Error: Supported only mono or stereo files." << endl;
+		cerr << "Error: File has no channels." << endl;
 		return false;
 	}
 
@@ -215,48 +301,96 @@ bool WavFile<T>::Load(const std::string& filename)
 	const int num_samples = data_chunk_size / (num_channels * num_bytes_per_sample);
 	const int samples_start_index = data_chunk_index + 8;
 
+	parse_timer.Stop();
+	StageTimer decode_timer("decode", static_cast<size_t>(num_samples) * num_channels);
+
 	ClearSamples();
 	samples.resize(num_channels);
+	for (auto& channel : samples)
+		channel.resize(num_samples);
+
+	if (meter != nullptr)
+		meter->Reset(sampleRate, num_channels);
 
-	for (int i = 0; i < num_samples; i++)
+	// Decode by blocks, so the meter reads samples while they are still in cache
+	constexpr int block_size = 4096;
+	for (int block_start = 0; block_start < num_samples; block_start += block_size)
 	{
-		for (int channel = 0; channel < num_channels; channel++)
+		const int block_end = std::min(num_samples, block_start + block_size);
+		const uint8_t* block_data = data.data() + samples_start_index + static_cast<size_t>(block_align) * block_start;
+		const bool decoded = DecodeWithKernels(bitDepth, block_data, block_align, samples, block_start, block_end - block_start);
+		for (int i = block_start; i < block_end && !decoded; i++)
 		{
-			int sample_index = samples_start_index + (block_align * i) + channel * num_bytes_per_sample;
-
-			if (bitDepth == 8)
-			{
-				T sample = SingleByteToSample(data[sample_index]);
-				samples[channel].push_back(sample);
-			}
-			else if (bitDepth == 16)
+			for (int channel = 0; channel < num_channels; channel++)
 			{
-				int16_t sample_as_int = TwoBytesToInt(data, sample_index);
-				T sample = SixteenBitIntToSample(sample_as_int);
-				samples[channel].push_back(sample);
+				int sample_index = samples_start_index + (block_align * i) + channel * num_bytes_per_sample;
+
+				if (bitDepth == 8)
+				{
+					T sample = SingleByteToSample(data[sample_index]);
+					samples[channel][i] = sample;
+				}
+				else if (bitDepth == 16)
+				{
+					int16_t sample_as_int = TwoBytesToInt(data, sample_index);
+					T sample = SixteenBitIntToSample(sample_as_int);
+					samples[channel][i] = sample;
+				}
+				else if (bitDepth == 24)
+				{
+					int32_t sample_as_int = 0;
+					sample_as_int = (data[sample_index + 2] << 16) | (data[sample_index + 1] << 8) | data[sample_index];
+
+					if (sample_as_int & (1 << 23)) //  if the 24th bit is set, this is a negative number in 24-bit world
+						sample_as_int = sample_as_int | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
+
+					T sample = static_cast<T>(sample_as_int) / static_cast<T>(1 << 23);
+					samples[channel][i] = sample;
+				}
+				else if (bitDepth == 32)
+				{
+					int32_t sample_as_int = FourBytesToInt(data, sample_index);
+					T sample = static_cast<T>(sample_as_int) / static_cast<T>(std::numeric_limits<std::int32_t>::max());
+					samples[channel][i] = sample;
+				}
+				else
+				{
+					cerr << "Error: Unsupported bit depth: " << bitDepth << endl;
+					return false;
+				}
 			}
-			else if (bitDepth == 24)
-			{
-				int32_t sample_as_int = 0;
-				sample_as_int = (data[sample_index + 2] << 16) | (data[sample_index + 1] << 8) | data[sample_index];
+		}
 
-				if (sample_as_int & (1 << 23)) //  if the 24th bit is set, this is a negative number in 24-bit world
-					sample_as_int = sample_as_int | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
+		if (meter != nullptr)
+			for (int channel = 0; channel < num_channels; channel++)
+				meter->Process(channel, &samples[channel][block_start], block_end - block_start);
+	}
 
-				T sample = static_cast<T>(sample_as_int) / static_cast<T>(1 << 23);
-				samples[channel].push_back(sample);
-			}
-			else if (bitDepth == 32)
-			{
-				int32_t sample_as_int = FourBytesToInt(data, sample_index);
-				T sample = static_cast<T>(sample_as_int) / static_cast<T>(std::numeric_limits<std::int32_t>::max());
-				samples[channel].push_back(sample);
-			}
-			else
-			{
-				cerr << "Error: Unsupported bit depth: " << bitDepth << endl;
-				return false;
-			}
+	return true;
+}
+
+template <typename T>
+bool WavFile<T>::Load(const std::string& filename, const FrameRange& range, Meter* meter)
+{
+	PackedAudio audio;
+	if (!audio.Load(filename, range, meter))
+		return false;
+
+	StageTimer decode_timer("decode", audio.GetNumFrames() * audio.GetNumChannels());
+
+	sampleRate = audio.GetSampleRate();
+	bitDepth = audio.GetBitDepth();
+	ClearSamples();
+	samples.resize(audio.GetNumChannels());
+	std::vector<float> block(kEncodeBlockSize);
+	for (size_t channel = 0; channel < GetNumChannels(); channel++)
+	{
+		samples[channel].resize(audio.GetNumFrames());
+		for (size_t block_start = 0; block_start < audio.GetNumFrames(); block_start += kEncodeBlockSize)
+		{
+			const size_t count = std::min(kEncodeBlockSize, audio.GetNumFrames() - block_start);
+			audio.Read(channel, block_start, count, block.data());
+			std::copy_n(block.data(), count, &samples[channel][block_start]);
 		}
 	}
 
@@ -432,21 +566,6 @@ T WavFile<T>::SixteenBitIntToSample(int16_t sample)
 	return static_cast<T> (sample) / static_cast<T> (32768.);
 }
 
-template <class T>
-int16_t WavFile<T>::SampleToSixteenBitInt(T sample)
-{
-	sample = clamp<T>(sample, -1., 1.);
-	return static_cast<int16_t> (sample * 32767.);
-}
-
-template <class T>
-uint8_t WavFile<T>::SampleToSingleByte(T sample)
-{
-	sample = clamp<T>(sample, -1., 1.);
-	sample = (sample + 1.) / 2.;
-	return static_cast<uint8_t> (sample * 255.);
-}
-
 template <class T>
 T WavFile<T>::SingleByteToSample(uint8_t sample)
 {
@@ -1,6 +1,39 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
+#include "FrameRange.h"
+
+class Meter;
+
+enum DitherType
+{
+	kDitherNone = 1,
+	// Triangular PDF, 2 LSB peak to peak, removes distortion and noise modulation of quantization
+	kDitherTpdf
+};
+
+enum NoiseShaping
+{
+	kShapingNone = 1,
+	// Error feedback of the previous sample, noise rises by 6 dB per octave
+	kShapingFirstOrder,
+	// Lipshitz 5-tap E-weighted filter, designed for 44.1 kHz
+	kShapingLipshitz
+};
+
+/**
+ * \brief Word length reduction settings of integer formats
+ *
+ * Samples, that the format holds exactly (e.g. unprocessed ones), are saved without dither and shaping.
+ */
+struct DitherOptions
+{
+	DitherType type = kDitherTpdf;
+	NoiseShaping shaping = kShapingNone;
+	// Every channel has its own generators seeded from this, so output is reproducible
+	uint64_t seed = 1;
+};
 
 template<typename T>
 class WavFile
@@ -15,25 +48,37 @@ public:
 	WavFile();
 	WavFile(uint32_t sample_rate, int bit_depth, AudioData samples);
 	WavFile(const WavFile& other) = default;
-	WavFile(const WavFile&& other) noexcept;
+	WavFile(WavFile&& other) noexcept = default;
 	~WavFile() = default;
 
 	WavFile& operator=(const WavFile& other) = default;
 	WavFile& operator=(WavFile&& other) = default;
 	
 	/**
-	 * \brief Save wave file
+	 * \brief Save wave file, or FLAC file of 8, 16 or 24 bits, if the name has .flac extension
 	 * \param filename File to Save
+	 * \param dither dither and noise shaping of 8, 16 and 24 bit formats
 	 * \return  true, if saving was successful, otherwise false
 	 */
-	bool Save(const std::string& filename);
+	bool Save(const std::string& filename, const DitherOptions& dither = DitherOptions()) const;
+
+	/**
+	 * \brief Load wave or FLAC file
+	 * \param filename File to load
+	 * \param meter if not null, measures levels of the samples while they are decoded
+	 * \return true, if loading was successful, otherwise false
+	 */
+	bool Load(const std::string& filename, Meter* meter = nullptr);
 
 	/**
-	 * \brief Load wave file
+	 * \brief Load frames of the range of wave or FLAC file, wave file is read from
+	 * the offset of the first frame in its data chunk, so the rest of it isn't read
 	 * \param filename File to load
+	 * \param range frames to load, clamped to the file length
+	 * \param meter if not null, measures levels of the loaded samples
 	 * \return true, if loading was successful, otherwise false
 	 */
-	bool Load(const std::string& filename);
+	bool Load(const std::string& filename, const FrameRange& range, Meter* meter = nullptr);
 
 	[[nodiscard]] size_t GetNumChannels() const;
 	void SetNumChannels(size_t num_channels);
@@ -78,8 +123,5 @@ private:
 	static bool WriteDataToFile(FileData& data, const std::string& filename);
 
 	static T SixteenBitIntToSample(int16_t sample);
-	static int16_t SampleToSixteenBitInt(T sample);
-
-	static uint8_t SampleToSingleByte(T sample);
 	static T SingleByteToSample(uint8_t sample);
 };
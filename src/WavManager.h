@@ -1,6 +1,7 @@
 #pragma once
 #include <filesystem>
-#include "WavFile.h"
+#include "PeakCache.h"
+#include "RenderGraph.h"
 
 class WavManager
 {
@@ -19,7 +20,9 @@ public:
 	}
 
 	// ReSharper disable CppInconsistentNaming
-	WavFile<float> wav;
+	RenderGraph graph;
+	// Overview of the source file
+	PeakCache peaks;
 	std::filesystem::path filepath;
 	std::filesystem::path out_filepath;
 	bool isFileUnsaved = false;
@@ -1,30 +1,202 @@
+#include <algorithm>
+#include <stdexcept>
 #include "generator.h"
 #include "utility.h"
 
-std::vector<float> GenerateSilence(float length, float sample_rate)
+namespace
 {
-	length = floor(length * sample_rate);
-	std::vector<float> samples;
-	std::fill_n(samples.begin(), length, 0);
-	return samples;
+	double Fraction(double value)
+	{
+		return value - std::floor(value);
+	}
+
+	/**
+	 * \brief Residual of band-limited step, t is phase in periods, dt is phase increment per sample
+	 */
+	double PolyBlep(double t, double dt)
+	{
+		if (t < dt)
+		{
+			t /= dt;
+			return t + t - t * t - 1.;
+		}
+		if (t > 1. - dt)
+		{
+			t = (t - 1.) / dt;
+			return t * t + t + t + 1.;
+		}
+		return 0.;
+	}
+
+	/**
+	 * \brief Residual of band-limited ramp (integrated PolyBlep), for slope change of 2 per sample
+	 */
+	double PolyBlamp(double t, double dt)
+	{
+		if (t < dt)
+		{
+			t = t / dt - 1.;
+			return -t * t * t / 3.;
+		}
+		if (t > 1. - dt)
+		{
+			t = (t - 1.) / dt + 1.;
+			return t * t * t / 3.;
+		}
+		return 0.;
+	}
 }
 
-std::vector<float> GenerateWaveInput(float freq, float length, float sample_rate, float phase)
+Oscillator::Oscillator(WaveformType type, double freq, double sample_rate, double phase)
+	: type_(type), sample_rate_(sample_rate), phase_(Fraction(phase))
 {
-	length = ceil(length * sample_rate);
-	phase *= sample_rate;
-	const float factor = freq * (kPi * 2) / sample_rate;
+	SetFrequency(freq);
+}
 
-	std::vector<float> samples;
-	for (size_t i = 0; i < length; i++)
-		samples.push_back((i + phase) * factor);
-	return samples;
+void Oscillator::SetFrequency(double freq)
+{
+	step_ = freq / sample_rate_;
+}
+
+void Oscillator::Render(float* out, size_t count)
+{
+	// Phase of every sample is computed from the block start, so iterations are independent
+	const double phase = phase_;
+	const double step = step_;
+	const double dt = std::min(std::abs(step), 0.5);
+
+	switch (type_)
+	{
+		case kWaveSine:
+			for (size_t i = 0; i < count; i++)
+				out[i] = sin_of_phase(phase + static_cast<double>(i) * step);
+			break;
+
+		case kWaveSaw:
+			for (size_t i = 0; i < count; i++)
+			{
+				// Shifted by half of period to start from zero, as sine does
+				const double t = Fraction(phase + static_cast<double>(i) * step + 0.5);
+				out[i] = static_cast<float>(2. * t - 1. - PolyBlep(t, dt));
+			}
+			break;
+
+		case kWaveSquare:
+			for (size_t i = 0; i < count; i++)
+			{
+				const double t = Fraction(phase + static_cast<double>(i) * step);
+				const double value = t < 0.5 ? 1. : -1.;
+				out[i] = static_cast<float>(value + PolyBlep(t, dt) - PolyBlep(Fraction(t + 0.5), dt));
+			}
+			break;
+
+		case kWaveTriangle:
+			for (size_t i = 0; i < count; i++)
+			{
+				// Shifted by quarter of period to start from zero, corners are at t = 0 and t = 0.5,
+				// slope changes there by 8 per period
+				const double t = Fraction(phase + static_cast<double>(i) * step + 0.25);
+				const double value = 1. - 4. * std::abs(t - 0.5);
+				out[i] = static_cast<float>(value + 4. * dt * (PolyBlamp(t, dt) - PolyBlamp(Fraction(t + 0.5), dt)));
+			}
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown waveform type");
+	}
+
+	phase_ = Fraction(phase + static_cast<double>(count) * step);
+}
+
+double Oscillator::GetPhase() const
+{
+	return phase_;
+}
+
+NoiseGenerator::NoiseGenerator(NoiseType type, uint64_t seed)
+	: type_(type), state_(seed != 0 ? seed : 1)
+{
+}
+
+void NoiseGenerator::Render(float* out, size_t count)
+{
+	switch (type_)
+	{
+		case kWhiteNoise:
+			for (size_t i = 0; i < count; i++)
+				out[i] = NextWhite();
+			break;
+
+		case kPinkNoise:
+			// Paul Kellet's filter, -3 dB per octave within 0.05 dB above 9 Hz at 44.1 kHz
+			for (size_t i = 0; i < count; i++)
+			{
+				const float white = NextWhite();
+				pink_[0] = 0.99886f * pink_[0] + white * 0.0555179f;
+				pink_[1] = 0.99332f * pink_[1] + white * 0.0750759f;
+				pink_[2] = 0.96900f * pink_[2] + white * 0.1538520f;
+				pink_[3] = 0.86650f * pink_[3] + white * 0.3104856f;
+				pink_[4] = 0.55000f * pink_[4] + white * 0.5329522f;
+				pink_[5] = -0.7616f * pink_[5] - white * 0.0168980f;
+
+				const float pink = pink_[0] + pink_[1] + pink_[2] + pink_[3] + pink_[4] + pink_[5] + pink_[6] + white * 0.5362f;
+				pink_[6] = white * 0.115926f;
+				out[i] = pink * 0.11f;
+			}
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown noise type");
+	}
+}
+
+float NoiseGenerator::NextWhite()
+{
+	// xorshift64*
+	state_ ^= state_ >> 12;
+	state_ ^= state_ << 25;
+	state_ ^= state_ >> 27;
+	const uint64_t value = state_ * 2685821657736338717ULL;
+
+	// Upper 24 bits to [-1, 1)
+	return static_cast<float>(value >> 40) / static_cast<float>(1 << 23) - 1.f;
+}
+
+void GenerateSilence(float* out, size_t count)
+{
+	std::fill_n(out, count, 0.f);
+}
+
+void GenerateSweep(float* out, size_t count, double start_freq, double end_freq, double sample_rate, SweepType type)
+{
+	const double duration = static_cast<double>(count) / sample_rate;
+
+	if (type == kLogarithmicSweep && (start_freq <= 0 || end_freq <= 0))
+		throw std::invalid_argument("Frequencies of logarithmic sweep must be greater than 0");
+
+	// Phase in periods as a function of time
+	const double rate = type == kLogarithmicSweep ? std::log(end_freq / start_freq) : 0.;
+	for (size_t i = 0; i < count; i++)
+	{
+		const double t = static_cast<double>(i) / sample_rate;
+		const double phase = type == kLogarithmicSweep && rate != 0.
+			? start_freq * duration / rate * (std::exp(t / duration * rate) - 1.)
+			: start_freq * t + (end_freq - start_freq) * t * t / (2. * duration);
+
+		out[i] = sin_of_phase(phase);
+	}
+}
+
+std::vector<float> GenerateSilence(float length, float sample_rate)
+{
+	return std::vector<float>(static_cast<size_t>(std::floor(length * sample_rate)), 0.f);
 }
 
 std::vector<float> GenerateSineWave(float freq, float length, float sample_rate, float phase)
 {
-	auto wave = GenerateWaveInput(freq, length, sample_rate, phase);
-	for (auto& sample : wave)
-		sample = sin(sample);
-	return wave;
+	std::vector<float> samples(static_cast<size_t>(std::ceil(length * sample_rate)));
+
+	Oscillator oscillator(kWaveSine, freq, sample_rate, static_cast<double>(phase) * freq);
+	oscillator.Render(samples.data(), samples.size());
+	return samples;
 }
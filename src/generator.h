@@ -1,27 +1,116 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 
+enum WaveformType
+{
+	kWaveSine = 1,
+	kWaveSaw,
+	kWaveSquare,
+	kWaveTriangle
+};
+
+enum NoiseType
+{
+	kWhiteNoise = 1,
+	kPinkNoise
+};
+
+enum SweepType
+{
+	kLinearSweep = 1,
+	kLogarithmicSweep
+};
+
 /**
- * \brief Generrate silence of specified length
- * \param length length of silence
+ * \brief Band-limited oscillator
+ *
+ * Saw, square and triangle are anti-aliased by PolyBLEP/PolyBLAMP. Phase is kept in double
+ * precision, so hour long tones don't drift.
+ */
+class Oscillator
+{
+public:
+	/**
+	 * \param type waveform
+	 * \param freq frequency, Hz
+	 * \param sample_rate sample rate of wave
+	 * \param phase initial phase, in periods (0..1)
+	 */
+	Oscillator(WaveformType type, double freq, double sample_rate, double phase = 0);
+
+	void SetFrequency(double freq);
+
+	/**
+	 * \brief Write next count samples into out, amplitude is 1
+	 */
+	void Render(float* out, size_t count);
+
+	/**
+	 * \brief Current phase, in periods (0..1)
+	 */
+	[[nodiscard]] double GetPhase() const;
+
+private:
+	WaveformType type_;
+	double sample_rate_;
+	double phase_;
+	// Phase increment per sample
+	double step_ = 0;
+};
+
+/**
+ * \brief White or pink noise with reproducible sequence
+ */
+class NoiseGenerator
+{
+public:
+	explicit NoiseGenerator(NoiseType type, uint64_t seed = 1);
+
+	/**
+	 * \brief Write next count samples into out, peak amplitude is about 1
+	 */
+	void Render(float* out, size_t count);
+
+private:
+	[[nodiscard]] float NextWhite();
+
+	NoiseType type_;
+	uint64_t state_;
+
+	// Pink noise filter states
+	float pink_[7] = {};
+};
+
+/**
+ * \brief Write silence
+ */
+void GenerateSilence(float* out, size_t count);
+
+/**
+ * \brief Write sine sweep, phase is computed analytically in double precision
+ * \param out output buffer
+ * \param count number of samples
+ * \param start_freq frequency at the first sample, Hz
+ * \param end_freq frequency at the end, Hz
  * \param sample_rate sample rate of wave
+ * \param type frequency change law
+ * \throw invalid_argument frequencies <= 0 for logarithmic sweep
  */
-std::vector<float> GenerateSilence(float length, float sample_rate = 44100);
+void GenerateSweep(float* out, size_t count, double start_freq, double end_freq, double sample_rate, SweepType type = kLogarithmicSweep);
 
 /**
- * \brief Generate input for other wave generators
- * \param freq frequency
- * \param length of wave
+ * \brief Generate silence of specified length
+ * \param length length of silence
  * \param sample_rate sample rate of wave
- * \param phase phase shift
  */
-std::vector<float> GenerateWaveInput(float freq, float length, float sample_rate = 44100, float phase = 0);
+std::vector<float> GenerateSilence(float length, float sample_rate = 44100);
 
 /**
  * \brief Generate sine wave
  * \param freq frequency
  * \param length length of wave
  * \param sample_rate sample rate of wave
- * \param phase phase shift 
+ * \param phase phase shift, in seconds
  */
 std::vector<float> GenerateSineWave(float freq, float length, float sample_rate = 44100, float phase = 0);
@@ -2,20 +2,574 @@
 #include <string>
 #include <functional>
 #include <filesystem>
+#include <map>
+#include <tuple>
 #include "Menu/Menu.h"
 #include "WavManager.h"
+#include "BatchProcessor.h"
+#include "JobServer.h"
+#include "MediaIndex.h"
+#include "Mixer.h"
+#include "RealtimeEngine.h"
+#include "Stats.h"
+#include "generator.h"
+#include "utility.h"
 #include "MenuStates/MainMenu.h"
 
 using namespace std;
 namespace fs = std::filesystem;
 
+/**
+ * \brief Dither settings by name: none, tpdf, first_order or lipshitz (both shaped ones are TPDF dithered)
+ * \throw invalid_argument unknown name
+ */
+DitherOptions ParseDither(const string& name)
+{
+	DitherOptions dither;
+	if (name == "none")
+		dither.type = kDitherNone;
+	else if (name == "first_order")
+		dither.shaping = kShapingFirstOrder;
+	else if (name == "lipshitz")
+		dither.shaping = kShapingLipshitz;
+	else if (name != "tpdf")
+		throw invalid_argument("Unknown dither: " + name);
+
+	return dither;
+}
+
+/**
+ * \brief Run batch mode
+ *
+ * Usage: --batch <input dir|glob> <output dir> [--chain effects] [--jobs N] [--memory MB] [--stats[=json]]
+ *        [--cache dir [--cache-link]] [--dither none|tpdf|first_order|lipshitz] [--index file] [--silence dBFS]
+ * Steps without a tail skip blocks at or below the silence threshold, digital silence by default
+ */
+int RunBatch(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		cerr << "Batch mode requires input and output" << endl;
+		return 1;
+	}
+
+	BatchOptions options;
+	options.input = argv[2];
+	options.output_dir = argv[3];
+	string stats_format;
+	float silence_db = kDigitalSilence;
+
+	try
+	{
+		for (int i = 4; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (option == "--stats" || option == "--stats=text")
+				stats_format = "text";
+			else if (option == "--stats=json")
+				stats_format = "json";
+			else if (option == "--cache-link")
+				options.cache_link = true;
+			else if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--chain")
+				options.chain = EffectChain::Parse(argv[++i]);
+			else if (option == "--jobs")
+				options.num_threads = stoul(argv[++i]);
+			else if (option == "--memory")
+				options.memory_budget = stoull(argv[++i]) << 20;
+			else if (option == "--cache")
+				options.cache_dir = argv[++i];
+			else if (option == "--dither")
+				options.dither = ParseDither(argv[++i]);
+			else if (option == "--index")
+				options.index_path = argv[++i];
+			else if (option == "--silence")
+				silence_db = stof(argv[++i]);
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+
+		options.chain.SetSilenceThreshold(silence_db);
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	BatchProcessor processor(std::move(options));
+	const bool ok = processor.Run();
+
+	// Stats are printed last, so JSON is the last line of the output
+	if (stats_format == "json")
+		Stats::get().PrintJson(cout);
+	else if (stats_format == "text")
+		Stats::get().Print(cout);
+
+	return ok ? 0 : 1;
+}
+
+/**
+ * \brief Generate test signal into mono wave file
+ *
+ * Usage: --generate <out.wav> <signal> <seconds> [freq [end freq]] [--rate N] [--bits N] [--level dBFS] [--dither name]
+ * Signals: sine, saw, square, triangle, white, pink, sweep, log_sweep
+ */
+int RunGenerate(int argc, char** argv)
+{
+	if (argc < 5)
+	{
+		cerr << "Generate mode requires output, signal and length" << endl;
+		return 1;
+	}
+
+	const string output = argv[2];
+	const string signal = argv[3];
+	uint32_t sample_rate = 44100;
+	int bit_depth = 24;
+	float level = -6.f;
+	DitherOptions dither;
+	vector<double> freqs;
+
+	try
+	{
+		const double length = stod(argv[4]);
+		for (int i = 5; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (option.rfind("--", 0) != 0)
+				freqs.push_back(stod(option));
+			else if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--rate")
+				sample_rate = stoul(argv[++i]);
+			else if (option == "--bits")
+				bit_depth = stoi(argv[++i]);
+			else if (option == "--level")
+				level = stof(argv[++i]);
+			else if (option == "--dither")
+				dither = ParseDither(argv[++i]);
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+
+		const double freq = freqs.empty() ? 1000. : freqs[0];
+		const double end_freq = freqs.size() > 1 ? freqs[1] : 20000.;
+
+		WavFile<float>::AudioData samples(1, vector<float>(static_cast<size_t>(length * sample_rate)));
+		auto& channel = samples[0];
+
+		if (signal == "sine" || signal == "saw" || signal == "square" || signal == "triangle")
+		{
+			const auto type = signal == "sine" ? kWaveSine : signal == "saw" ? kWaveSaw : signal == "square" ? kWaveSquare : kWaveTriangle;
+			Oscillator(type, freq, sample_rate).Render(channel.data(), channel.size());
+		}
+		else if (signal == "white" || signal == "pink")
+			NoiseGenerator(signal == "white" ? kWhiteNoise : kPinkNoise).Render(channel.data(), channel.size());
+		else if (signal == "sweep" || signal == "log_sweep")
+		{
+			const double start_freq = freqs.empty() ? 20. : freq;
+			GenerateSweep(channel.data(), channel.size(), start_freq, end_freq, sample_rate,
+				signal == "sweep" ? kLinearSweep : kLogarithmicSweep);
+		}
+		else
+			throw invalid_argument("Unknown signal: " + signal);
+
+		const float gain = db_to_lin(level);
+		for (auto& sample : channel)
+			sample *= gain;
+
+		return WavFile<float>(sample_rate, bit_depth, std::move(samples)).Save(output, dither) ? 0 : 1;
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+}
+
+/**
+ * \brief Play file through the effect chain by the real-time engine into the null sink, or records it with --out
+ *
+ * Usage: --realtime <in.wav> [--chain effects] [--block N] [--buffer N] [--wall-clock] [--out out.wav]
+ */
+int RunRealtime(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cerr << "Real-time mode requires input" << endl;
+		return 1;
+	}
+
+	EffectChain chain;
+	RealtimeOptions options;
+	string output;
+
+	try
+	{
+		for (int i = 3; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (option == "--wall-clock")
+				options.wall_clock = true;
+			else if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--chain")
+				chain = EffectChain::Parse(argv[++i]);
+			else if (option == "--block")
+				options.block_size = stoul(argv[++i]);
+			else if (option == "--buffer")
+				options.buffer_size = stoul(argv[++i]);
+			else if (option == "--out")
+				output = argv[++i];
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+
+		WavFile<float> wav;
+		if (!wav.Load(argv[2]))
+			return 1;
+
+		RealtimeEngine engine(wav, std::move(chain), options);
+		engine.Prepare();
+
+		// Output is recorded from the sink, the engine keeps only the current block
+		NullSink null_sink;
+		RecordingSink recording_sink(wav.GetNumSamplesPerChannel(), wav.bitDepth);
+		engine.Run(output.empty() ? static_cast<AudioSink&>(null_sink) : recording_sink);
+		engine.PrintReport(cout);
+
+		return output.empty() || recording_sink.GetRecording().Save(output) ? 0 : 1;
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+}
+
+/**
+ * \brief Print headers of the file, or summary of the directory tree by its metadata index
+ *
+ * Usage: --probe <file|dir> [--index file] [--jobs N]
+ * Index of the directory is kept in `<dir>/.wav_effects_index`, unless other file is given
+ */
+int RunProbe(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cerr << "Probe mode requires input" << endl;
+		return 1;
+	}
+
+	const fs::path input = argv[2];
+	fs::path index_path = MediaIndex::GetDefaultPath(input);
+	size_t num_threads = 0;
+
+	try
+	{
+		for (int i = 3; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--index")
+				index_path = argv[++i];
+			else if (option == "--jobs")
+				num_threads = stoul(argv[++i]);
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	if (!fs::is_directory(input))
+	{
+		AudioInfo info;
+		if (!info.Probe(input))
+		{
+			cerr << "Error: " << input.string() << " isn`t a wave or FLAC file" << endl;
+			return 1;
+		}
+
+		info.PrintSummary();
+		return 0;
+	}
+
+	MediaIndex index(input);
+	index.Load(index_path);
+	const size_t num_probed = index.Update(num_threads);
+	if (!index.Save(index_path))
+		cerr << "Error: couldn't save index to " << index_path.string() << endl;
+
+	// Number of files and length by format, flac, rate, bits and channels
+	map<tuple<bool, uint32_t, int, size_t>, pair<size_t, double>> formats;
+	double total_seconds = 0;
+	size_t num_invalid = 0;
+	for (const auto& entry : index.GetEntries())
+	{
+		if (!entry.valid)
+		{
+			cout << " Unreadable: " << entry.path.string() << endl;
+			num_invalid++;
+			continue;
+		}
+
+		const auto& info = entry.info;
+		auto& format = formats[{ info.is_flac, info.sample_rate, info.bit_depth, info.num_channels }];
+		format.first++;
+		format.second += info.GetLengthInSeconds();
+		total_seconds += info.GetLengthInSeconds();
+	}
+
+	cout << " Files: " << index.GetEntries().size() << " (" << num_probed << " probed, "
+		<< index.GetEntries().size() - num_probed << " from index), " << num_invalid << " unreadable" << endl
+		<< " Total length: " << total_seconds / 3600. << " hours" << endl;
+
+	for (const auto& [key, value] : formats)
+	{
+		const auto& [is_flac, sample_rate, bit_depth, num_channels] = key;
+		cout << "   " << (is_flac ? "FLAC " : "WAVE ") << sample_rate << " Hz, " << bit_depth << " bit, " << num_channels << " ch: "
+			<< value.first << " files, " << value.second / 3600. << " hours" << endl;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Mix files into one, or join them one after another with crossfades
+ *
+ * Usage: --mix <out.wav> <in.wav[@gain dB[,pan[,offset[,fade in[,fade out]]]]]>... [format options]
+ *        --concat <out.wav> <in.wav>... [--crossfade seconds] [format options]
+ * Format options: [--rate N] [--channels N] [--bits N] [--curve linear|log|sine] [--dither name]
+ * Format is taken from the inputs, unless it's given: the highest rate and bit depth, the most channels
+ */
+int RunMix(int argc, char** argv)
+{
+	const bool concatenate = strcmp(argv[1], "--concat") == 0;
+	if (argc < 4)
+	{
+		cerr << (concatenate ? "Concatenate" : "Mix") << " mode requires output and inputs" << endl;
+		return 1;
+	}
+
+	const string output = argv[2];
+	vector<MixInput> inputs;
+	MixOptions options;
+	double crossfade = 0.;
+
+	try
+	{
+		for (int i = 3; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (option.rfind("--", 0) != 0)
+			{
+				// Parameters follow the last '@', so paths may contain it
+				MixInput input;
+				const size_t at = concatenate ? string::npos : option.rfind('@');
+				input.filename = option.substr(0, at);
+
+				vector<double> params;
+				for (size_t pos = at; pos != string::npos; )
+				{
+					const size_t next = option.find(',', pos + 1);
+					params.push_back(stod(option.substr(pos + 1, next - pos - 1)));
+					pos = next;
+				}
+
+				if (params.size() > 5)
+					throw invalid_argument("Too many parameters of input: " + option);
+
+				params.resize(5, 0.);
+				input.gain_db = static_cast<float>(params[0]);
+				input.pan = static_cast<float>(params[1]);
+				input.offset = params[2];
+				input.fade_in = params[3];
+				input.fade_out = params[4];
+				inputs.push_back(std::move(input));
+			}
+			else if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--crossfade" && concatenate)
+				crossfade = stod(argv[++i]);
+			else if (option == "--rate")
+				options.sample_rate = stoul(argv[++i]);
+			else if (option == "--channels")
+				options.num_channels = stoul(argv[++i]);
+			else if (option == "--bits")
+				options.bit_depth = stoi(argv[++i]);
+			else if (option == "--dither")
+				options.dither = ParseDither(argv[++i]);
+			else if (option == "--curve")
+			{
+				const string curve = argv[++i];
+				if (curve == "linear")
+					options.fade_curve = kLinear;
+				else if (curve == "log")
+					options.fade_curve = kLogarithmic;
+				else if (curve == "sine")
+					options.fade_curve = kSine;
+				else
+					throw invalid_argument("Unknown curve: " + curve);
+			}
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	if (!concatenate)
+		return Mixer::Mix(inputs, output, options) ? 0 : 1;
+
+	vector<string> filenames;
+	for (const auto& input : inputs)
+		filenames.push_back(input.filename);
+
+	return Mixer::Concatenate(filenames, output, crossfade, options) ? 0 : 1;
+}
+
+/**
+ * \brief Run job server, that takes jobs over a Unix domain socket until it's asked to stop
+ *
+ * Usage: --serve <socket> [--jobs N] [--cache dir [--cache-link]] [--dither name] [--silence dBFS] [--stats[=json]]
+ */
+int RunServe(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cerr << "Server mode requires socket path" << endl;
+		return 1;
+	}
+
+	JobServerOptions options;
+	options.socket_path = argv[2];
+	string stats_format;
+
+	try
+	{
+		for (int i = 3; i < argc; i++)
+		{
+			const string option = argv[i];
+			if (option == "--stats" || option == "--stats=text")
+				stats_format = "text";
+			else if (option == "--stats=json")
+				stats_format = "json";
+			else if (option == "--cache-link")
+				options.cache_link = true;
+			else if (i + 1 >= argc)
+				throw invalid_argument("Missing value of option: " + option);
+			else if (option == "--jobs")
+				options.num_threads = stoul(argv[++i]);
+			else if (option == "--cache")
+				options.cache_dir = argv[++i];
+			else if (option == "--dither")
+				options.dither = ParseDither(argv[++i]);
+			else if (option == "--silence")
+				options.silence_db = stof(argv[++i]);
+			else
+				throw invalid_argument("Unknown option: " + option);
+		}
+	}
+	catch (exception& ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	JobServer server(std::move(options));
+	const bool ok = server.Run();
+
+	// Stats of all jobs, since the server started
+	if (stats_format == "json")
+		Stats::get().PrintJson(cout);
+	else if (stats_format == "text")
+		Stats::get().Print(cout);
+
+	return ok ? 0 : 1;
+}
+
+/**
+ * \brief Submit a job to the job server and print its answer, or ask the server to stop
+ *
+ * Usage: --submit <socket> <input> <output> [--chain effects]
+ *        --submit <socket> --shutdown
+ */
+int RunSubmit(int argc, char** argv)
+{
+	const bool shutdown = argc == 4 && strcmp(argv[3], "--shutdown") == 0;
+	const bool has_chain = argc == 7 && strcmp(argv[5], "--chain") == 0;
+	if (!shutdown && argc != 5 && !has_chain)
+	{
+		cerr << "Submit mode requires socket path, input and output, or --shutdown" << endl;
+		return 1;
+	}
+
+	JobClient client;
+	if (!client.Connect(argv[2]))
+		return 1;
+
+	string response;
+	const bool sent = shutdown ? client.Shutdown(response) : client.Submit(argv[3], argv[4], has_chain ? argv[6] : "", response);
+	if (!sent)
+		return 1;
+
+	cout << response << endl;
+	return JobClient::IsSuccess(response) ? 0 : 1;
+}
+
 int main(int argc, char** argv)
 {
+	if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+		return RunBatch(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], "--generate") == 0)
+		return RunGenerate(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], "--realtime") == 0)
+		return RunRealtime(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], "--probe") == 0)
+		return RunProbe(argc, argv);
+
+	if (argc >= 2 && (strcmp(argv[1], "--mix") == 0 || strcmp(argv[1], "--concat") == 0))
+		return RunMix(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], "--serve") == 0)
+		return RunServe(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], "--submit") == 0)
+		return RunSubmit(argc, argv);
+
 	// If filepath not specified, or user type help - print usage
 	if (argc < 2 || argc > 3 || strstr(argv[1], "help") != nullptr)
 	{
 		const auto program_name = fs::path(argv[0]).stem().u8string();
-		cout << "Usage: " << program_name << " in.wav [out.wav]" << endl;
+		cout << "Usage: " << program_name << " in.wav [out.wav]" << endl
+			<< "       " << program_name << " --batch <input dir|glob> <output dir> [--chain effects] [--jobs N] [--memory MB] [--stats[=json]]" << endl
+			<< "           [--cache dir [--cache-link]] [--dither none|tpdf|first_order|lipshitz] [--index file]" << endl
+			<< "           [--silence dBFS]" << endl
+			<< "       " << program_name << " --generate <out.wav> <sine|saw|square|triangle|white|pink|sweep|log_sweep> <seconds>" << endl
+			<< "           [freq [end freq]] [--rate N] [--bits N] [--level dBFS] [--dither name]" << endl
+			<< "       " << program_name << " --realtime <in.wav> [--chain effects] [--block N] [--buffer N] [--wall-clock] [--out out.wav]" << endl
+			<< "       " << program_name << " --probe <file|dir> [--index file] [--jobs N]" << endl
+			<< "       " << program_name << " --mix <out.wav> <in.wav[@gain dB[,pan[,offset[,fade in[,fade out]]]]]>... [format]" << endl
+			<< "       " << program_name << " --concat <out.wav> <in.wav>... [--crossfade seconds] [format]" << endl
+			<< "           format: [--rate N] [--channels N] [--bits N] [--curve linear|log|sine] [--dither name]" << endl
+			<< "       " << program_name << " --serve <socket> [--jobs N] [--cache dir [--cache-link]] [--dither name] [--silence dBFS]" << endl
+			<< "           [--stats[=json]]" << endl
+			<< "       " << program_name << " --submit <socket> <input> <output> [--chain effects] | --submit <socket> --shutdown" << endl
+			<< "       Any .wav file may be a .flac file of 8, 16 or 24 bits" << endl;
+		EffectChain::PrintUsage();
 		return 0;
 	}
 
@@ -31,13 +585,22 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	// Overview of the sidecar is shown before the decode, it's built from the samples only if it's missing
+	if (wm.peaks.Load(wm.filepath))
+		wm.peaks.PrintOverview();
+
 	// Load file
 	cout << "File is loading..." << endl;
-	if (!wm.wav.Load(wm.filepath.string()))
+	WavFile<float> wav;
+	Meter meter;
+	if (!wav.Load(wm.filepath.string(), &meter))
 	{
 		cerr << "File loading failed!" << endl;
 		return 1;
 	}
+	if (wm.peaks.IsEmpty())
+		wm.peaks.Open(wm.filepath, &wav);
+	wm.graph.SetSource(std::move(wav), meter.GetLevels());
 
 	// Run menu
 	return RunMenu<MainMenu>();
@@ -30,3 +30,13 @@ inline float db_to_lin(float dB) noexcept
 	static const float db_2_log = log(10.f) / 20.f;
 	return exp(dB * db_2_log);
 }
+
+/**
+ * \brief Sine of the phase in periods. Phase is reduced in double, so float sine stays precise
+ * when the phase is counted in frames of a long file
+ */
+inline float sin_of_phase(double phase) noexcept
+{
+	constexpr double two_pi = 6.283185307179586476925;
+	return std::sin(static_cast<float>(two_pi * (phase - std::floor(phase))));
+}